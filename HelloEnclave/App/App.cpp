@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 # include <unistd.h>
 # include <pwd.h>
@@ -41,10 +42,16 @@
 #include "sgx_urts.h"
 #include "App.h"
 #include "Enclave_u.h"
+#include "memprof_app.h"
 
 /* Global EID shared by multiple threads */
 sgx_enclave_id_t global_eid = 0;
 
+/* Set by the startup profiler to see where load_enclave_ex spends its time */
+enclave_load_timing_t *load_timing = NULL;
+
+#define LOAD_STAMP(field) do { if (load_timing != NULL) load_timing->field = monotonic_ns(); } while (0)
+
 typedef struct _sgx_errlist_t {
     sgx_status_t err;
     const char *msg;
@@ -149,17 +156,37 @@ void print_error_message(sgx_status_t ret)
     	printf("Error code is 0x%X. Please refer to the \"Intel SGX SDK Developer Reference\" for more details.\n", ret);
 }
 
+unsigned long long monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 /* Initialize the enclave:
  *   Step 1: try to retrieve the launch token saved by last transaction
  *   Step 2: call sgx_create_enclave to initialize an enclave instance
  *   Step 3: save the launch token if it is updated
+ *
+ * load_enclave does this for any signed enclave and launch token file name,
+ * e.g. the differently configured signings the benchmarks load.
+ * load_enclave_ex also starts the switchless call workers when switchless
+ * is not NULL, see sgx_create_enclave_ex.
  */
-int initialize_enclave(void)
+int load_enclave(const char *enclave_filename, const char *token_filename, sgx_enclave_id_t *eid)
+{
+    return load_enclave_ex(enclave_filename, token_filename, NULL, eid);
+}
+
+int load_enclave_ex(const char *enclave_filename, const char *token_filename,
+        const sgx_uswitchless_config_t *switchless, sgx_enclave_id_t *eid)
 {
     char token_path[MAX_PATH] = {'\0'};
     sgx_launch_token_t token = {0};
     sgx_status_t ret = SGX_ERROR_UNEXPECTED;
     int updated = 0;
+
+    LOAD_STAMP(begin);
     
     /* Step 1: try to retrieve the launch token saved by last transaction 
      *         if there is no token, then create a new one.
@@ -168,14 +195,14 @@ int initialize_enclave(void)
     const char *home_dir = getpwuid(getuid())->pw_dir;
     
     if (home_dir != NULL && 
-        (strlen(home_dir)+strlen("/")+sizeof(TOKEN_FILENAME)+1) <= MAX_PATH) {
+        (strlen(home_dir)+strlen("/")+strlen(token_filename)+2) <= MAX_PATH) {
         /* compose the token path */
         strncpy(token_path, home_dir, strlen(home_dir));
         strncat(token_path, "/", strlen("/"));
-        strncat(token_path, TOKEN_FILENAME, sizeof(TOKEN_FILENAME)+1);
+        strncat(token_path, token_filename, strlen(token_filename)+1);
     } else {
         /* if token path is too long or $HOME is NULL */
-        strncpy(token_path, TOKEN_FILENAME, sizeof(TOKEN_FILENAME));
+        strncpy(token_path, token_filename, MAX_PATH-1);
     }
 
     FILE *fp = fopen(token_path, "rb");
@@ -194,7 +221,16 @@ int initialize_enclave(void)
     }
     /* Step 2: call sgx_create_enclave to initialize an enclave instance */
     /* Debug Support: set 2nd parameter to 1 */
-    ret = sgx_create_enclave(ENCLAVE_FILENAME, SGX_DEBUG_FLAG, &token, &updated, &global_eid, NULL);
+    LOAD_STAMP(create_begin);
+    if (switchless == NULL) {
+        ret = sgx_create_enclave(enclave_filename, SGX_DEBUG_FLAG, &token, &updated, eid, NULL);
+    } else {
+        const void *ex_features[32] = {0};
+        ex_features[SGX_CREATE_ENCLAVE_EX_SWITCHLESS_BIT_IDX] = switchless;
+        ret = sgx_create_enclave_ex(enclave_filename, SGX_DEBUG_FLAG, &token, &updated, eid, NULL,
+                SGX_CREATE_ENCLAVE_EX_SWITCHLESS, ex_features);
+    }
+    LOAD_STAMP(create_end);
     if (ret != SGX_SUCCESS) {
         print_error_message(ret);
         if (fp != NULL) fclose(fp);
@@ -205,35 +241,75 @@ int initialize_enclave(void)
     if (updated == FALSE || fp == NULL) {
         /* if the token is not updated, or file handler is invalid, do not perform saving */
         if (fp != NULL) fclose(fp);
+        LOAD_STAMP(end);
         return 0;
     }
 
     /* reopen the file with write capablity */
     fp = freopen(token_path, "wb", fp);
-    if (fp == NULL) return 0;
+    if (fp == NULL) {
+        LOAD_STAMP(end);
+        return 0;
+    }
     size_t write_num = fwrite(token, 1, sizeof(sgx_launch_token_t), fp);
     if (write_num != sizeof(sgx_launch_token_t))
         printf("Warning: Failed to save launch token to \"%s\".\n", token_path);
     fclose(fp);
+    LOAD_STAMP(end);
     return 0;
 }
 
+int initialize_enclave(void)
+{
+#ifdef SGX_SWITCHLESS
+    /* The print OCALLs are served by untrusted workers, see App.h */
+    sgx_uswitchless_config_t switchless = SGX_USWITCHLESS_CONFIG_INITIALIZER;
+    switchless.num_uworkers = SWITCHLESS_UWORKERS;
+    switchless.num_tworkers = 0;
+    return load_enclave_ex(ENCLAVE_FILENAME, TOKEN_FILENAME, &switchless, &global_eid);
+#else
+    return load_enclave(ENCLAVE_FILENAME, TOKEN_FILENAME, &global_eid);
+#endif
+}
+
+/* Where the enclave printf ends up; benchmarks point it at /dev/null */
+FILE *print_stream = stdout;
+/* OCALLs and bytes the enclave printf has cost so far */
+unsigned long long print_ocalls = 0;
+unsigned long long print_bytes = 0;
+
 /* OCall functions */
 void ocall_print_string(const char *str)
 {
     /* Proxy/Bridge will check the length and null-terminate 
      * the input string to prevent buffer overflow. 
      */
-    printf("%s", str);
+    size_t len = strlen(str);
+    fwrite(str, 1, len, print_stream);
+    print_ocalls++;
+    print_bytes += len;
+}
+
+void ocall_print_buffer(const char *buf, size_t len)
+{
+    fwrite(buf, 1, len, print_stream);
+    print_ocalls++;
+    print_bytes += len;
 }
 
 
 /* Application entry */
 int SGX_CDECL main(int argc, char *argv[])
 {
-    (void)(argc);
-    (void)(argv);
-
+    /* Benchmarks that load an enclave of their own */
+    if (argc > 1 && strcmp(argv[1], "bench_transitions") == 0)
+        return transition_bench_main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "bench_tcs") == 0)
+        return tcs_bench_main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "bench_switchless") == 0)
+        return switchless_bench_main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "profile_startup") == 0)
+        return startup_profile_main(argc - 1, argv + 1);
 
     /* Initialize the enclave */
     if(initialize_enclave() < 0){
@@ -241,12 +317,18 @@ int SGX_CDECL main(int argc, char *argv[])
         getchar();
         return -1; 
     }
+    MEMPROF_BEGIN(global_eid);
  
-    printf_helloworld(global_eid);
+    int ret = 0;
+    if (argc > 1 && strcmp(argv[1], "bench_printf") == 0)
+        ret = printf_bench_main(argc - 1, argv + 1);
+    else
+        printf_helloworld(global_eid);
 
     /* Destroy the enclave */
+    MEMPROF_REPORT();
     sgx_destroy_enclave(global_eid);
     
-    return 0;
+    return ret;
 }
 
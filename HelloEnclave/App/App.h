@@ -40,6 +40,7 @@
 
 #include "sgx_error.h"       /* sgx_status_t */
 #include "sgx_eid.h"     /* sgx_enclave_id_t */
+#include "sgx_uswitchless.h" /* sgx_uswitchless_config_t */
 
 #ifndef TRUE
 # define TRUE 1
@@ -52,12 +53,54 @@
 # define TOKEN_FILENAME   "enclave.token"
 # define ENCLAVE_FILENAME "enclave.signed.so"
 
+/* The same enclave signed with Enclave/Bench.config.xml, for the benchmarks */
+# define BENCH_TOKEN_FILENAME   "bench_enclave.token"
+# define BENCH_ENCLAVE_FILENAME "bench_enclave.signed.so"
+
+/* Untrusted workers serving the switchless OCALLs of an SGX_SWITCHLESS=1 build.
+ * The enclave makes one OCALL at a time, so one worker keeps up; more only
+ * burn CPU spinning.
+ */
+# define SWITCHLESS_UWORKERS 1
+
 extern sgx_enclave_id_t global_eid;    /* global enclave id */
 
+/* Where load_enclave_ex spent its time, in monotonic_ns() */
+typedef struct enclave_load_timing {
+    unsigned long long begin;           /* entered, the token is read next */
+    unsigned long long create_begin;    /* token read, sgx_create_enclave called */
+    unsigned long long create_end;      /* sgx_create_enclave returned */
+    unsigned long long end;             /* token saved, or left as it was */
+} enclave_load_timing_t;
+
+/* load_enclave_ex fills this in when it is not NULL, see App/StartupProfile.cpp */
+extern enclave_load_timing_t *load_timing;
+
+extern FILE *print_stream;                  /* where ocall_print_* write */
+extern unsigned long long print_ocalls;     /* ocall_print_* calls so far */
+extern unsigned long long print_bytes;      /* bytes they printed */
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
+void print_error_message(sgx_status_t ret);
+unsigned long long monotonic_ns(void);
+int load_enclave(const char *enclave_filename, const char *token_filename, sgx_enclave_id_t *eid);
+int load_enclave_ex(const char *enclave_filename, const char *token_filename,
+        const sgx_uswitchless_config_t *switchless, sgx_enclave_id_t *eid);
+
+/* ./app bench_printf [options], see App/PrintfBench.cpp */
+int printf_bench_main(int argc, char *argv[]);
+/* ./app bench_transitions [options], see App/TransitionBench.cpp */
+int transition_bench_main(int argc, char *argv[]);
+/* ./app bench_tcs [options], see App/TcsBench.cpp */
+int tcs_bench_main(int argc, char *argv[]);
+/* ./app bench_switchless [options], see App/SwitchlessBench.cpp */
+int switchless_bench_main(int argc, char *argv[]);
+/* ./app profile_startup [options], see App/StartupProfile.cpp */
+int startup_profile_main(int argc, char *argv[]);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -0,0 +1,109 @@
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+
+#include "App.h"
+#include "Enclave_u.h"
+#include "LogRing.h"
+
+LogRing::LogRing(FILE *out, uint32_t size)
+    : out_(out), size_(size), eid_(0), ring_(NULL), stopping_(false), drained_(0)
+{
+}
+
+LogRing::~LogRing()
+{
+    stop();
+}
+
+int LogRing::start(sgx_enclave_id_t eid)
+{
+    void *mem = NULL;
+    if (ring_ != NULL || posix_memalign(&mem, 64, sizeof(log_ring_t) + size_) != 0)
+        return -1;
+    ring_ = (log_ring_t *)mem;
+    memset(ring_, 0, sizeof(log_ring_t));
+    ring_->size = size_;
+    eid_ = eid;
+    stopping_ = false;
+    drained_ = 0;
+    thread_ = std::thread(&LogRing::drain_loop, this);
+
+    int retval = -1;
+    sgx_status_t ret = enclave_log_set_ring(eid_, &retval, ring_);
+    if (ret != SGX_SUCCESS || retval != 0) {
+        if (ret != SGX_SUCCESS) print_error_message(ret);
+        else printf("Error: The enclave refused a log ring of %u bytes.\n", size_);
+        stopping_ = true;
+        thread_.join();
+        free(ring_);
+        ring_ = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void LogRing::stop()
+{
+    if (ring_ == NULL)
+        return;
+    /* Once this returns no enclave thread is writing into the ring */
+    int retval;
+    enclave_log_set_ring(eid_, &retval, NULL);
+    stopping_ = true;
+    thread_.join();
+    free(ring_);
+    ring_ = NULL;
+}
+
+void LogRing::wait_drained() const
+{
+    while (ring_ != NULL && __atomic_load_n(&ring_->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&ring_->head, __ATOMIC_ACQUIRE))
+        std::this_thread::yield();
+}
+
+/* Writes out the bytes between tail and head and frees their space, returns how many */
+size_t LogRing::drain()
+{
+    uint64_t tail = ring_->tail;
+    uint64_t head = __atomic_load_n(&ring_->head, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return 0;
+
+    const uint8_t *data = LOG_RING_DATA(ring_);
+    size_t len = (size_t)(head - tail);
+    size_t offset = (size_t)(tail & (size_ - 1));
+    size_t first = len < size_ - offset ? len : size_ - offset;
+    fwrite(data + offset, 1, first, out_);
+    fwrite(data, 1, len - first, out_);
+    __atomic_store_n(&ring_->tail, head, __ATOMIC_RELEASE);
+    drained_ += len;
+    return len;
+}
+
+void LogRing::drain_loop()
+{
+    unsigned idle = 0;
+    for (;;) {
+        /* Read stopping_ first: after stop() the enclave has written its last byte */
+        bool last = stopping_.load();
+        if (drain() > 0) {
+            idle = 0;
+            continue;
+        }
+        if (last)
+            break;
+        /* Spin a little, then yield, then sleep up to a millisecond while the enclave is quiet */
+        if (idle < 1024)
+            idle++;
+        if (idle == 64)
+            fflush(out_);
+        if (idle < 64)
+            continue;
+        if (idle < 128)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(idle < 1024 ? 50 : 1000));
+    }
+    fflush(out_);
+}
@@ -0,0 +1,51 @@
+#ifndef _LOG_RING_H_
+#define _LOG_RING_H_
+
+#include <atomic>
+#include <stdio.h>
+#include <thread>
+
+#include "sgx_urts.h"
+#include "enclave_log.h"
+
+/*
+ * LogRing:
+ *   App side of LOG_MODE_RING. Owns a log_ring_t, registers it with the
+ *   enclave and runs the thread that writes what the enclave logs to out.
+ *   Logging then costs the enclave no OCALL; the drain thread polls, backing
+ *   off to short sleeps while the ring stays empty.
+ */
+class LogRing {
+public:
+    /* size: bytes of ring data, a power of two in [LOG_RING_MIN_SIZE, LOG_RING_MAX_SIZE] */
+    LogRing(FILE *out, uint32_t size);
+    ~LogRing();
+
+    /* Allocates and registers the ring and starts the drain thread, 0 or -1 */
+    int start(sgx_enclave_id_t eid);
+    /* Unregisters the ring, writes out what is left and stops the thread */
+    void stop();
+
+    /* Waits until everything logged so far has been written out */
+    void wait_drained() const;
+
+    unsigned long long drained_bytes() const { return drained_.load(); }
+    unsigned long long dropped() const { return ring_ != NULL ? ring_->dropped : 0; }
+
+private:
+    LogRing(const LogRing&);
+    LogRing& operator=(const LogRing&);
+
+    size_t drain();
+    void drain_loop();
+
+    FILE *out_;
+    uint32_t size_;
+    sgx_enclave_id_t eid_;
+    log_ring_t *ring_;
+    std::thread thread_;
+    std::atomic<bool> stopping_;
+    std::atomic<unsigned long long> drained_;
+};
+
+#endif /* !_LOG_RING_H_ */
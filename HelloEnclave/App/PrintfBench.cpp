@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "sgx_urts.h"
+#include "App.h"
+#include "Enclave_u.h"
+#include "enclave_log.h"
+#include "LogRing.h"
+
+#ifndef BENCH_SGX_MODE
+# define BENCH_SGX_MODE "SIM"
+#endif
+
+static const char *mode_names[] = { "direct", "buffered", "ring" };
+
+struct printf_bench_result {
+    int mode;
+    uint32_t line_len;
+    uint64_t lines;
+    double lines_per_sec;       /* median over the repeats */
+    double ns_per_line;
+    unsigned long long ocalls;  /* per run */
+    unsigned long long bytes;   /* per run */
+    unsigned long long dropped; /* per run, ring only */
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+/*
+ * Times one bench_printf ECALL, in seconds, or returns a negative value on error.
+ * With a ring only the enclave side is timed; the drain thread catches up after.
+ */
+static double run_once(uint64_t lines, uint32_t line_len, LogRing *ring, printf_bench_result *r)
+{
+    unsigned long long drained = ring != NULL ? ring->drained_bytes() : 0;
+    unsigned long long dropped = ring != NULL ? ring->dropped() : 0;
+    print_ocalls = 0;
+    print_bytes = 0;
+    bench_clock::time_point begin = bench_clock::now();
+    sgx_status_t ret = bench_printf(global_eid, lines, line_len);
+    bench_clock::time_point end = bench_clock::now();
+    if (ring != NULL) ring->wait_drained();
+    fflush(print_stream);
+    if (ret != SGX_SUCCESS) {
+        print_error_message(ret);
+        return -1;
+    }
+    r->ocalls = print_ocalls;
+    r->bytes = print_bytes;
+    r->dropped = 0;
+    if (ring != NULL) {
+        r->bytes += ring->drained_bytes() - drained;
+        r->dropped = ring->dropped() - dropped;
+    }
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+static bool run_mode(int mode, uint64_t lines, uint32_t line_len, unsigned repeats, uint32_t ring_size,
+        printf_bench_result *r)
+{
+    LogRing ring(print_stream, ring_size);
+    if (mode == LOG_MODE_RING) {
+        if (ring.start(global_eid) != 0) return false;
+    } else {
+        int old_mode = -1;
+        sgx_status_t ret = enclave_log_set_mode(global_eid, &old_mode, mode);
+        if (ret != SGX_SUCCESS || old_mode < 0) {
+            if (ret != SGX_SUCCESS) print_error_message(ret);
+            return false;
+        }
+    }
+
+    std::vector<double> seconds;
+    r->mode = mode;
+    r->line_len = line_len;
+    r->lines = lines;
+    for (unsigned i = 0; i < repeats; i++) {
+        double s = run_once(lines, line_len, mode == LOG_MODE_RING ? &ring : NULL, r);
+        if (s < 0) return false;
+        seconds.push_back(s);
+    }
+    std::sort(seconds.begin(), seconds.end());
+    double median = seconds[seconds.size() / 2];
+    r->lines_per_sec = lines / median;
+    r->ns_per_line = median * 1e9 / lines;
+    return true;
+}
+
+static void write_csv(const std::string &path, const std::vector<printf_bench_result> &results)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "sgx_mode,log_mode,line_len,lines,lines_per_sec,ns_per_line,ocalls,bytes,dropped\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const printf_bench_result &r = results[i];
+        fprintf(fp, "%s,%s,%u,%llu,%.1f,%.1f,%llu,%llu,%llu\n", BENCH_SGX_MODE, mode_names[r.mode],
+                r.line_len, (unsigned long long)r.lines, r.lines_per_sec, r.ns_per_line, r.ocalls, r.bytes, r.dropped);
+    }
+    fclose(fp);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: app %s [-n lines] [-l line_bytes] [-r repeats] [-R ring_bytes] [-p] [-o output.csv]\n", name);
+    printf("  Prints lines lines (default 200000) from the enclave with one OCALL per printf,\n");
+    printf("  with the buffered printf and into a log ring of ring_bytes (default 4194304),\n");
+    printf("  for lines of 32, 80 and 256 bytes or of line_bytes (12 to 1024).\n");
+    printf("  Each is run repeats times (default 5) and the median is reported.\n");
+    printf("  The lines go to /dev/null unless -p is given, so the numbers are of the OCALLs only.\n");
+}
+
+int printf_bench_main(int argc, char *argv[])
+{
+    uint64_t lines = 200000;
+    std::vector<uint32_t> line_lens;
+    unsigned repeats = 5;
+    uint32_t ring_size = 4U << 20;
+    bool to_stdout = false;
+    std::string output;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:r:R:po:h")) != -1) {
+        switch (opt) {
+        case 'n': lines = strtoull(optarg, NULL, 0); break;
+        case 'l': line_lens.push_back((uint32_t)strtoul(optarg, NULL, 0)); break;
+        case 'r': repeats = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'R': ring_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'p': to_stdout = true; break;
+        case 'o': output = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (line_lens.empty()) {
+        line_lens.push_back(32);
+        line_lens.push_back(80);
+        line_lens.push_back(256);
+    }
+    for (size_t i = 0; i < line_lens.size(); i++) {
+        if (line_lens[i] < 12 || line_lens[i] > 1024) lines = 0;
+    }
+    if (lines == 0 || repeats == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!to_stdout && (print_stream = fopen("/dev/null", "w")) == NULL) {
+        printf("Error: Failed to open /dev/null.\n");
+        print_stream = stdout;
+        return 1;
+    }
+
+    std::vector<printf_bench_result> results;
+    bool ok = true;
+    for (size_t i = 0; ok && i < line_lens.size(); i++) {
+        for (int mode = LOG_MODE_DIRECT; ok && mode <= LOG_MODE_RING; mode++) {
+            printf_bench_result r;
+            if ((ok = run_mode(mode, lines, line_lens[i], repeats, ring_size, &r)))
+                results.push_back(r);
+        }
+    }
+
+    if (print_stream != stdout) {
+        fclose(print_stream);
+        print_stream = stdout;
+    }
+    /* Leave the enclave the way it started */
+    int old_mode;
+    enclave_log_set_mode(global_eid, &old_mode, LOG_MODE_BUFFERED);
+    if (!ok) return 1;
+
+    printf("%-9s %8s %10s %14s %12s %10s %12s %8s %8s\n",
+            "log_mode", "line_len", "lines", "lines/s", "ns/line", "ocalls", "bytes", "dropped", "speedup");
+    for (size_t i = 0; i < results.size(); i++) {
+        const printf_bench_result &r = results[i];
+        /* Results come in direct, buffered, ring triples */
+        double speedup = r.lines_per_sec / results[i - i % 3].lines_per_sec;
+        printf("%-9s %8u %10llu %14.1f %12.1f %10llu %12llu %8llu %7.1fx\n", mode_names[r.mode], r.line_len,
+                (unsigned long long)r.lines, r.lines_per_sec, r.ns_per_line, r.ocalls, r.bytes, r.dropped, speedup);
+    }
+    if (!output.empty()) {
+        write_csv(output, results);
+        printf("Results written to %s\n", output.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sgx_urts.h"
+#include "App.h"
+#include "Enclave_u.h"
+
+#ifndef BENCH_SGX_MODE
+# define BENCH_SGX_MODE "SIM"
+#endif
+
+/* One timed span of the startup timeline, in monotonic_ns() */
+struct startup_span {
+    const char *name;
+    unsigned tid;               /* 0 for the main thread, 1.. for the TCS probe threads */
+    unsigned long long begin;
+    unsigned long long end;
+};
+
+struct startup_run {
+    std::string enclave;
+    unsigned run;
+    std::vector<startup_span> spans;
+};
+
+/*
+ * The probe threads enter the enclave together; each sits in
+ * ocall_startup_probe, holding its TCS, until all have arrived, so every
+ * thread is on a TCS of its own.
+ */
+static std::mutex probe_lock;
+static std::condition_variable probe_cv;
+static int probe_round = -1;        /* the round the threads may start */
+static unsigned probe_arrived = 0;  /* threads in ocall_startup_probe, or failed, this round */
+static unsigned probe_returned = 0; /* threads back from startup_probe this round */
+static bool probe_released = false;
+static thread_local unsigned long long probe_arrival = 0;
+
+/* OCall functions */
+void ocall_startup_probe(void)
+{
+    probe_arrival = monotonic_ns();
+    std::unique_lock<std::mutex> lock(probe_lock);
+    probe_arrived++;
+    probe_cv.notify_all();
+    probe_cv.wait(lock, [] { return probe_released; });
+}
+
+static double us(unsigned long long begin, unsigned long long end)
+{
+    return (end - begin) / 1e3;
+}
+
+static double median(std::vector<double> v)
+{
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+/* Microseconds spent in the named spans of r, the median if there are several */
+static double span_us(const startup_run &r, const char *name)
+{
+    std::vector<double> v;
+    for (size_t i = 0; i < r.spans.size(); i++) {
+        if (strcmp(r.spans[i].name, name) == 0) v.push_back(us(r.spans[i].begin, r.spans[i].end));
+    }
+    return median(v);
+}
+
+/* Runs two rounds of startup_probe on threads threads: the first entry on each TCS, then a warm one */
+static unsigned probe_tcs(sgx_enclave_id_t eid, unsigned threads, startup_run *r)
+{
+    std::vector<std::vector<startup_span> > spans(threads);
+    std::vector<unsigned> failures(threads, 0);
+    std::vector<std::thread> workers;
+    probe_round = -1;
+
+    for (unsigned t = 0; t < threads; t++) {
+        workers.push_back(std::thread([eid, t, &spans, &failures] {
+            for (int round = 0; round < 2; round++) {
+                {
+                    std::unique_lock<std::mutex> lock(probe_lock);
+                    probe_cv.wait(lock, [round] { return probe_round >= round; });
+                }
+                unsigned long long begin = monotonic_ns();
+                probe_arrival = 0;
+                sgx_status_t ret = startup_probe(eid);
+                unsigned long long end = monotonic_ns();
+
+                std::lock_guard<std::mutex> lock(probe_lock);
+                if (ret != SGX_SUCCESS || probe_arrival == 0) {
+                    /* e.g. SGX_ERROR_OUT_OF_TCS: count it as arrived so the round can end */
+                    failures[t]++;
+                    probe_arrived++;
+                } else {
+                    startup_span entry = { round == 0 ? "tcs_first_entry" : "tcs_warm_entry", t + 1, begin, probe_arrival };
+                    startup_span exit = { "tcs_held", t + 1, probe_arrival, end };
+                    spans[t].push_back(entry);
+                    spans[t].push_back(exit);
+                }
+                probe_returned++;
+                probe_cv.notify_all();
+            }
+        }));
+    }
+
+    for (int round = 0; round < 2; round++) {
+        std::unique_lock<std::mutex> lock(probe_lock);
+        probe_arrived = 0;
+        probe_returned = 0;
+        probe_released = false;
+        probe_round = round;
+        probe_cv.notify_all();
+        probe_cv.wait(lock, [threads] { return probe_arrived >= threads; });
+        probe_released = true;
+        probe_cv.notify_all();
+        probe_cv.wait(lock, [threads] { return probe_returned >= threads; });
+    }
+    for (unsigned t = 0; t < threads; t++) workers[t].join();
+
+    unsigned failed = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        r->spans.insert(r->spans.end(), spans[t].begin(), spans[t].end());
+        failed += failures[t];
+    }
+    return failed;
+}
+
+static std::string home_token_path(const std::string &token)
+{
+    struct passwd *pw = getpwuid(getuid());
+    return pw != NULL && pw->pw_dir != NULL ? std::string(pw->pw_dir) + "/" + token : token;
+}
+
+/* startup_<name without .signed.so>.token, so each enclave profiled keeps its own token */
+static std::string token_name(const std::string &enclave)
+{
+    std::string name = enclave.substr(enclave.find_last_of('/') + 1);
+    size_t suffix = name.find(".signed.so");
+    if (suffix != std::string::npos) name.erase(suffix);
+    return "startup_" + name + ".token";
+}
+
+/* Loads, warms up, probes and destroys enclave once */
+static bool profile_once(const std::string &enclave, unsigned run, unsigned threads, bool cold_token,
+        startup_run *r, unsigned *tcs_failures)
+{
+    std::string token = token_name(enclave);
+    if (cold_token) unlink(home_token_path(token).c_str());
+
+    r->enclave = enclave;
+    r->run = run;
+    enclave_load_timing_t timing;
+    memset(&timing, 0, sizeof(timing));
+    sgx_enclave_id_t eid = 0;
+    load_timing = &timing;
+    int loaded = load_enclave(enclave.c_str(), token.c_str(), &eid);
+    load_timing = NULL;
+    if (loaded < 0) return false;
+
+    startup_span token_read = { "token_read", 0, timing.begin, timing.create_begin };
+    startup_span create = { "sgx_create_enclave", 0, timing.create_begin, timing.create_end };
+    startup_span token_write = { "token_write", 0, timing.create_end, timing.end };
+    r->spans.push_back(token_read);
+    r->spans.push_back(create);
+    r->spans.push_back(token_write);
+
+    /* The first ECALL runs the enclave's one-time initialization */
+    unsigned long long t0 = monotonic_ns();
+    sgx_status_t ret = bench_empty(eid);
+    unsigned long long t1 = monotonic_ns();
+    if (ret == SGX_SUCCESS) ret = bench_empty(eid);
+    unsigned long long t2 = monotonic_ns();
+    if (ret != SGX_SUCCESS) {
+        print_error_message(ret);
+        sgx_destroy_enclave(eid);
+        return false;
+    }
+    startup_span first_ecall = { "first_ecall", 0, t0, t1 };
+    startup_span ecall = { "warm_ecall", 0, t1, t2 };
+    r->spans.push_back(first_ecall);
+    r->spans.push_back(ecall);
+
+    *tcs_failures += probe_tcs(eid, threads, r);
+
+    unsigned long long d0 = monotonic_ns();
+    sgx_destroy_enclave(eid);
+    startup_span destroy = { "sgx_destroy_enclave", 0, d0, monotonic_ns() };
+    r->spans.push_back(destroy);
+    return true;
+}
+
+/* Chrome trace event format, one process per run, open in chrome://tracing or Perfetto */
+static void write_trace(const std::string &path, const std::vector<startup_run> &runs, unsigned long long origin)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"otherData\": {\"sgx_mode\": \"%s\"}, \"traceEvents\": [\n", BENCH_SGX_MODE);
+    const char *sep = "";
+    for (size_t i = 0; i < runs.size(); i++) {
+        const startup_run &r = runs[i];
+        fprintf(fp, "%s{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %zu, \"args\": {\"name\": \"%s run %u\"}}",
+                sep, i + 1, r.enclave.c_str(), r.run);
+        sep = ",\n";
+        for (size_t j = 0; j < r.spans.size(); j++) {
+            const startup_span &s = r.spans[j];
+            fprintf(fp, "%s{\"name\": \"%s\", \"cat\": \"startup\", \"ph\": \"X\", \"pid\": %zu, \"tid\": %u, "
+                    "\"ts\": %.3f, \"dur\": %.3f}", sep, s.name, i + 1, s.tid, us(origin, s.begin), us(s.begin, s.end));
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+}
+
+static const char *phase_names[] = {
+    "token_read", "sgx_create_enclave", "token_write", "first_ecall", "warm_ecall",
+    "tcs_first_entry", "tcs_warm_entry", "sgx_destroy_enclave"
+};
+#define PHASES (sizeof(phase_names) / sizeof(phase_names[0]))
+
+static void write_csv(const std::string &path, const std::vector<startup_run> &runs)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "sgx_mode,enclave,enclave_bytes,run");
+    for (size_t p = 0; p < PHASES; p++) fprintf(fp, ",%s_us", phase_names[p]);
+    fprintf(fp, "\n");
+    for (size_t i = 0; i < runs.size(); i++) {
+        const startup_run &r = runs[i];
+        struct stat st;
+        long long size = stat(r.enclave.c_str(), &st) == 0 ? (long long)st.st_size : -1;
+        fprintf(fp, "%s,%s,%lld,%u", BENCH_SGX_MODE, r.enclave.c_str(), size, r.run);
+        for (size_t p = 0; p < PHASES; p++) fprintf(fp, ",%.1f", span_us(r, phase_names[p]));
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: app %s [-e enclave.signed.so]... [-n runs] [-t threads] [-T] [-o trace.json] [-c output.csv]\n", name);
+    printf("  Loads each enclave (default %s) runs times (default 5) and times the phases of its startup:\n", ENCLAVE_FILENAME);
+    printf("    token_read, sgx_create_enclave, token_write   load_enclave, with the token in $HOME\n");
+    printf("    first_ecall, warm_ecall                        the first ECALL and the one after it\n");
+    printf("    tcs_first_entry, tcs_warm_entry                threads (default 4) threads entering on a TCS\n");
+    printf("                                                   each for the first time, then again\n");
+    printf("    sgx_destroy_enclave\n");
+    printf("  -T removes the launch token before each load. Medians are printed per enclave; -o writes\n");
+    printf("  every run as a Chrome trace (chrome://tracing, ui.perfetto.dev), -c as CSV.\n");
+}
+
+int startup_profile_main(int argc, char *argv[])
+{
+    std::vector<std::string> enclaves;
+    unsigned runs = 5;
+    unsigned threads = 4;
+    bool cold_token = false;
+    std::string trace;
+    std::string output;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:n:t:To:c:h")) != -1) {
+        switch (opt) {
+        case 'e': enclaves.push_back(optarg); break;
+        case 'n': runs = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 't': threads = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'T': cold_token = true; break;
+        case 'o': trace = optarg; break;
+        case 'c': output = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (enclaves.empty()) enclaves.push_back(ENCLAVE_FILENAME);
+    if (runs == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    unsigned long long origin = monotonic_ns();
+    std::vector<startup_run> results;
+    unsigned tcs_failures = 0;
+    for (size_t e = 0; e < enclaves.size(); e++) {
+        for (unsigned run = 1; run <= runs; run++) {
+            startup_run r;
+            if (!profile_once(enclaves[e], run, threads, cold_token, &r, &tcs_failures)) {
+                printf("Error: Failed to profile %s.\n", enclaves[e].c_str());
+                return 1;
+            }
+            results.push_back(r);
+        }
+    }
+
+    printf("%-36s %10s", "enclave (median us)", "bytes");
+    for (size_t p = 0; p < PHASES; p++) printf(" %*s", (int)std::max<size_t>(10, strlen(phase_names[p])), phase_names[p]);
+    printf(" %10s\n", "tcs_init");
+    for (size_t e = 0; e < enclaves.size(); e++) {
+        struct stat st;
+        long long size = stat(enclaves[e].c_str(), &st) == 0 ? (long long)st.st_size : -1;
+        printf("%-36s %10lld", enclaves[e].c_str(), size);
+        std::vector<double> phase[PHASES];
+        for (size_t i = 0; i < results.size(); i++) {
+            if (results[i].enclave != enclaves[e]) continue;
+            for (size_t p = 0; p < PHASES; p++) phase[p].push_back(span_us(results[i], phase_names[p]));
+        }
+        double medians[PHASES];
+        for (size_t p = 0; p < PHASES; p++) {
+            medians[p] = median(phase[p]);
+            printf(" %*.1f", (int)std::max<size_t>(10, strlen(phase_names[p])), medians[p]);
+        }
+        /* What entering a TCS costs the first time over any later time */
+        printf(" %10.1f\n", medians[5] - medians[6]);
+    }
+    if (tcs_failures > 0) {
+        printf("Warning: %u probe ECALLs failed, e.g. for want of a TCS; use fewer threads than TCSNum.\n",
+                tcs_failures);
+    }
+
+    if (!trace.empty()) {
+        write_trace(trace, results, origin);
+        printf("Trace written to %s\n", trace.c_str());
+    }
+    if (!output.empty()) {
+        write_csv(output, results);
+        printf("Results written to %s\n", output.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "sgx_urts.h"
+#include "sgx_uswitchless.h"
+#include "App.h"
+#include "Enclave_u.h"
+#include "enclave_log.h"
+
+#ifndef BENCH_SGX_MODE
+# define BENCH_SGX_MODE "SIM"
+#endif
+
+enum switchless_workload {
+    WORKLOAD_PRINT,             /* bench_printf in LOG_MODE_DIRECT, one ocall_print_string per line */
+    WORKLOAD_PRINT_BUFFERED,    /* bench_printf in LOG_MODE_BUFFERED, one ocall_print_buffer per 8 KB */
+    WORKLOAD_WRITE              /* bench_write, one ocall_bench_write per block */
+};
+
+static const char *workload_names[] = { "print", "print_buffered", "write" };
+
+struct switchless_bench_options {
+    uint64_t lines;
+    uint32_t line_len;
+    uint64_t blocks;
+    uint32_t block_size;
+    unsigned repeats;
+    uint32_t uworkers;
+    uint32_t retries_before_fallback;
+    uint32_t retries_before_sleep;
+};
+
+struct switchless_result {
+    switchless_workload workload;
+    bool switchless;
+    uint64_t ops;               /* lines or blocks per run */
+    double ops_per_sec;         /* median over the repeats */
+    double ns_per_op;
+    unsigned long long ocalls;  /* per run */
+    unsigned long long served;  /* OCALLs the workers served, all runs */
+    unsigned long long missed;  /* OCALLs that fell back to a regular OCALL, all runs */
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* The file bench_write writes to, unlinked */
+static int write_fd = -1;
+static unsigned long long write_ocalls = 0;
+
+/* Worker statistics of the enclave last destroyed */
+static std::mutex worker_stats_lock;
+static sgx_uswitchless_worker_stats_t worker_stats;
+
+/* OCall functions */
+int64_t ocall_bench_write(int fd, const uint8_t *buf, size_t len)
+{
+    write_ocalls++;
+    return write(fd, buf, len);
+}
+
+/*
+ * The statistics are shared by the workers of an enclave, so the last
+ * worker to exit leaves the totals.
+ */
+static void on_worker_exit(sgx_uswitchless_worker_type_t type, sgx_uswitchless_worker_event_t event,
+        const sgx_uswitchless_worker_stats_t *stats)
+{
+    (void)event;
+    if (type != SGX_USWITCHLESS_WORKER_TYPE_UNTRUSTED) return;
+    std::lock_guard<std::mutex> lock(worker_stats_lock);
+    worker_stats = *stats;
+}
+
+static bool load(bool switchless, const switchless_bench_options &options, sgx_enclave_id_t *eid)
+{
+    if (!switchless)
+        return load_enclave(BENCH_ENCLAVE_FILENAME, BENCH_TOKEN_FILENAME, eid) == 0;
+
+    sgx_uswitchless_config_t config = SGX_USWITCHLESS_CONFIG_INITIALIZER;
+    config.num_uworkers = options.uworkers;
+    config.num_tworkers = 0;
+    config.retries_before_fallback = options.retries_before_fallback;
+    config.retries_before_sleep = options.retries_before_sleep;
+    config.callback_func[SGX_USWITCHLESS_WORKER_EVENT_EXIT] = on_worker_exit;
+    memset(&worker_stats, 0, sizeof(worker_stats));
+    return load_enclave_ex(BENCH_ENCLAVE_FILENAME, BENCH_TOKEN_FILENAME, &config, eid) == 0;
+}
+
+/* Times one run of the workload, in seconds, or returns a negative value on error */
+static double run_once(sgx_enclave_id_t eid, switchless_workload workload, const switchless_bench_options &options,
+        switchless_result *r)
+{
+    sgx_status_t ret;
+    uint64_t written = 0;
+    print_ocalls = 0;
+    write_ocalls = 0;
+    if (workload == WORKLOAD_WRITE && (lseek(write_fd, 0, SEEK_SET) != 0 || ftruncate(write_fd, 0) != 0)) {
+        perror("bench_switchless");
+        return -1;
+    }
+
+    bench_clock::time_point begin = bench_clock::now();
+    if (workload == WORKLOAD_WRITE)
+        ret = bench_write(eid, &written, write_fd, options.blocks, options.block_size);
+    else
+        ret = bench_printf(eid, options.lines, options.line_len);
+    bench_clock::time_point end = bench_clock::now();
+    fflush(print_stream);
+
+    if (ret != SGX_SUCCESS) {
+        print_error_message(ret);
+        return -1;
+    }
+    if (workload == WORKLOAD_WRITE && written != options.blocks * options.block_size) {
+        printf("Error: bench_write wrote %llu of %llu bytes.\n", (unsigned long long)written,
+                (unsigned long long)(options.blocks * options.block_size));
+        return -1;
+    }
+    r->ocalls = workload == WORKLOAD_WRITE ? write_ocalls : print_ocalls;
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+/* Runs the workload repeats times on a freshly loaded enclave, so the worker statistics are its own */
+static bool run_workload(switchless_workload workload, bool switchless, const switchless_bench_options &options,
+        switchless_result *r)
+{
+    sgx_enclave_id_t eid = 0;
+    if (!load(switchless, options, &eid)) return false;
+
+    bool ok = true;
+    if (workload != WORKLOAD_WRITE) {
+        int old_mode = -1;
+        sgx_status_t ret = enclave_log_set_mode(eid, &old_mode,
+                workload == WORKLOAD_PRINT ? LOG_MODE_DIRECT : LOG_MODE_BUFFERED);
+        if (ret != SGX_SUCCESS || old_mode < 0) {
+            if (ret != SGX_SUCCESS) print_error_message(ret);
+            ok = false;
+        }
+    }
+
+    std::vector<double> seconds;
+    for (unsigned i = 0; ok && i < options.repeats; i++) {
+        double s = run_once(eid, workload, options, r);
+        if (s < 0) ok = false;
+        else seconds.push_back(s);
+    }
+    /* The workers report their totals as they exit */
+    sgx_destroy_enclave(eid);
+    if (!ok) return false;
+
+    std::sort(seconds.begin(), seconds.end());
+    double median = seconds[seconds.size() / 2];
+    r->workload = workload;
+    r->switchless = switchless;
+    r->ops = workload == WORKLOAD_WRITE ? options.blocks : options.lines;
+    r->ops_per_sec = r->ops / median;
+    r->ns_per_op = median * 1e9 / r->ops;
+    std::lock_guard<std::mutex> lock(worker_stats_lock);
+    r->served = switchless ? worker_stats.processed : 0;
+    r->missed = switchless ? worker_stats.missed : 0;
+    return true;
+}
+
+static void write_csv(const std::string &path, const switchless_bench_options &options,
+        const std::vector<switchless_result> &results)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "sgx_mode,workload,mode,uworkers,op_bytes,ops,ops_per_sec,ns_per_op,ocalls,served,missed\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const switchless_result &r = results[i];
+        fprintf(fp, "%s,%s,%s,%u,%u,%llu,%.1f,%.1f,%llu,%llu,%llu\n", BENCH_SGX_MODE,
+                workload_names[r.workload], r.switchless ? "switchless" : "regular",
+                r.switchless ? options.uworkers : 0,
+                r.workload == WORKLOAD_WRITE ? options.block_size : options.line_len,
+                (unsigned long long)r.ops, r.ops_per_sec, r.ns_per_op, r.ocalls, r.served, r.missed);
+    }
+    fclose(fp);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: app %s [-n lines] [-l line_bytes] [-b blocks] [-s block_bytes] [-r repeats]\n", name);
+    printf("       [-w workers] [-F retries_before_fallback] [-S retries_before_sleep] [-p] [-o output.csv]\n");
+    printf("  Runs each workload on %s with regular OCALLs, then with its OCALLs\n", BENCH_ENCLAVE_FILENAME);
+    printf("  served by workers (default 1) untrusted switchless workers:\n");
+    printf("    print           lines (default 200000) lines of line_bytes (default 80), one OCALL each\n");
+    printf("    print_buffered  the same lines through the buffered printf\n");
+    printf("    write           blocks (default 20000) writes of block_bytes (default 4096) to a temporary file\n");
+    printf("  Each is run repeats times (default 5) and the median is reported. A switchless OCALL\n");
+    printf("  falls back to a regular one when no worker picks it up within retries_before_fallback\n");
+    printf("  spins; idle workers sleep after retries_before_sleep. Both default to the SDK's 20000.\n");
+    printf("  The lines go to /dev/null unless -p is given.\n");
+}
+
+int switchless_bench_main(int argc, char *argv[])
+{
+    switchless_bench_options options;
+    options.lines = 200000;
+    options.line_len = 80;
+    options.blocks = 20000;
+    options.block_size = 4096;
+    options.repeats = 5;
+    options.uworkers = 1;
+    options.retries_before_fallback = 20000;
+    options.retries_before_sleep = 20000;
+    bool to_stdout = false;
+    std::string output;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:b:s:r:w:F:S:po:h")) != -1) {
+        switch (opt) {
+        case 'n': options.lines = strtoull(optarg, NULL, 0); break;
+        case 'l': options.line_len = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'b': options.blocks = strtoull(optarg, NULL, 0); break;
+        case 's': options.block_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'r': options.repeats = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'w': options.uworkers = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'F': options.retries_before_fallback = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'S': options.retries_before_sleep = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'p': to_stdout = true; break;
+        case 'o': output = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    /* bench_write caps blocks at 64 KB */
+    if (options.lines == 0 || options.line_len < 12 || options.line_len > 1024 || options.blocks == 0 ||
+            options.block_size == 0 || options.block_size > 65536 || options.repeats == 0 || options.uworkers == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char write_path[] = "/tmp/bench_switchless_XXXXXX";
+    if ((write_fd = mkstemp(write_path)) < 0) {
+        perror("bench_switchless");
+        return 1;
+    }
+    unlink(write_path);
+    if (!to_stdout && (print_stream = fopen("/dev/null", "w")) == NULL) {
+        printf("Error: Failed to open /dev/null.\n");
+        print_stream = stdout;
+        close(write_fd);
+        return 1;
+    }
+
+    std::vector<switchless_result> results;
+    bool ok = true;
+    for (int workload = WORKLOAD_PRINT; ok && workload <= WORKLOAD_WRITE; workload++) {
+        for (int switchless = 0; ok && switchless <= 1; switchless++) {
+            switchless_result r;
+            if ((ok = run_workload((switchless_workload)workload, switchless != 0, options, &r)))
+                results.push_back(r);
+        }
+    }
+
+    if (print_stream != stdout) {
+        fclose(print_stream);
+        print_stream = stdout;
+    }
+    close(write_fd);
+    if (!ok) return 1;
+
+    printf("%-15s %-10s %10s %14s %10s %10s %10s %10s %8s\n",
+            "workload", "mode", "ops", "ops/s", "ns/op", "ocalls", "served", "missed", "speedup");
+    for (size_t i = 0; i < results.size(); i++) {
+        const switchless_result &r = results[i];
+        /* Results come in regular, switchless pairs */
+        double speedup = r.ops_per_sec / results[i - i % 2].ops_per_sec;
+        printf("%-15s %-10s %10llu %14.1f %10.1f %10llu %10llu %10llu %7.2fx\n", workload_names[r.workload],
+                r.switchless ? "switchless" : "regular", (unsigned long long)r.ops, r.ops_per_sec, r.ns_per_op,
+                r.ocalls, r.served, r.missed, speedup);
+    }
+    printf("served/missed: switchless OCALLs the %u worker(s) ran and those that fell back, over all %u runs\n",
+            options.uworkers, options.repeats);
+    if (!output.empty()) {
+        write_csv(output, options, results);
+        printf("Results written to %s\n", output.c_str());
+    }
+    return 0;
+}
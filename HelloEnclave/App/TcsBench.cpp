@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "sgx_urts.h"
+#include "App.h"
+#include "Enclave_u.h"
+
+#ifndef BENCH_SGX_MODE
+# define BENCH_SGX_MODE "SIM"
+#endif
+
+/* Throughput within this fraction of the best counts as good enough when sizing TCSNum */
+#define GOOD_ENOUGH 0.95
+
+/* TCSPolicy values, see the Enclave.config.xml reference */
+static const char *policy_names[] = { "bind", "unbind" };
+
+struct tcs_bench_config {
+    std::vector<unsigned> tcs_counts;
+    unsigned max_threads;
+    unsigned duration_ms;
+    uint64_t work;
+    std::string output;
+};
+
+struct tcs_thread_state {
+    std::vector<double> samples_ns;
+    unsigned long long out_of_tcs;
+    sgx_status_t error;
+};
+
+struct tcs_bench_result {
+    unsigned tcs;
+    int policy;
+    unsigned threads;
+    size_t ops;
+    unsigned long long out_of_tcs;
+    double ops_per_sec;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ns_between(bench_clock::time_point begin, bench_clock::time_point end)
+{
+    return std::chrono::duration<double, std::nano>(end - begin).count();
+}
+
+/* Signed by "make bench_tcs" for each TCS_BENCH_COUNTS and both policies */
+static std::string tcs_enclave_name(unsigned tcs, int policy, const char *suffix)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "tcs_enclave_%u_%d%s", tcs, policy, suffix);
+    return name;
+}
+
+/* Issues bench_spin until stop is set; SGX_ERROR_OUT_OF_TCS is counted and retried */
+static void run_thread(sgx_enclave_id_t eid, uint64_t work, tcs_thread_state *state,
+        const std::atomic<bool> *start, const std::atomic<bool> *stop)
+{
+    while (!start->load()) {
+        std::this_thread::yield();
+    }
+    while (!stop->load()) {
+        uint64_t retval;
+        bench_clock::time_point begin = bench_clock::now();
+        sgx_status_t ret = bench_spin(eid, &retval, work);
+        bench_clock::time_point end = bench_clock::now();
+        if (ret == SGX_SUCCESS) {
+            state->samples_ns.push_back(ns_between(begin, end));
+        } else if (ret == SGX_ERROR_OUT_OF_TCS) {
+            state->out_of_tcs++;
+            std::this_thread::yield();
+        } else {
+            state->error = ret;
+            return;
+        }
+    }
+}
+
+static bool run_threads(sgx_enclave_id_t eid, unsigned thread_count, const tcs_bench_config &config,
+        tcs_bench_result *r)
+{
+    std::vector<tcs_thread_state> states(thread_count);
+    std::vector<std::thread> threads;
+    std::atomic<bool> start(false);
+    std::atomic<bool> stop(false);
+    for (unsigned t = 0; t < thread_count; t++) {
+        states[t].out_of_tcs = 0;
+        states[t].error = SGX_SUCCESS;
+        threads.push_back(std::thread(run_thread, eid, config.work, &states[t], &start, &stop));
+    }
+
+    bench_clock::time_point begin = bench_clock::now();
+    start.store(true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.duration_ms));
+    stop.store(true);
+    for (unsigned t = 0; t < thread_count; t++) {
+        threads[t].join();
+    }
+    double wall_ns = ns_between(begin, bench_clock::now());
+
+    std::vector<double> samples;
+    r->threads = thread_count;
+    r->out_of_tcs = 0;
+    for (unsigned t = 0; t < thread_count; t++) {
+        if (states[t].error != SGX_SUCCESS) {
+            printf("bench_spin failed:\n");
+            print_error_message(states[t].error);
+            return false;
+        }
+        samples.insert(samples.end(), states[t].samples_ns.begin(), states[t].samples_ns.end());
+        r->out_of_tcs += states[t].out_of_tcs;
+    }
+    std::sort(samples.begin(), samples.end());
+    r->ops = samples.size();
+    r->ops_per_sec = r->ops / (wall_ns / 1e9);
+    r->p50_ns = r->p99_ns = r->p999_ns = r->max_ns = 0;
+    if (!samples.empty()) {
+        r->p50_ns = samples[samples.size() / 2];
+        r->p99_ns = samples[std::min(samples.size() - 1, (size_t)(samples.size() * 0.99))];
+        r->p999_ns = samples[std::min(samples.size() - 1, (size_t)(samples.size() * 0.999))];
+        r->max_ns = samples.back();
+    }
+    return true;
+}
+
+static bool run_bench(const tcs_bench_config &config, std::vector<tcs_bench_result> *results)
+{
+    for (size_t c = 0; c < config.tcs_counts.size(); c++) {
+        for (int policy = 0; policy <= 1; policy++) {
+            unsigned tcs = config.tcs_counts[c];
+            sgx_enclave_id_t eid = 0;
+            std::string enclave = tcs_enclave_name(tcs, policy, ".signed.so");
+            if (load_enclave(enclave.c_str(), tcs_enclave_name(tcs, policy, ".token").c_str(), &eid) < 0) {
+                printf("Fail to initialize enclave %s.\n", enclave.c_str());
+                return false;
+            }
+            bool ok = true;
+            for (unsigned threads = 1; ok && threads <= config.max_threads; threads *= 2) {
+                tcs_bench_result r;
+                r.tcs = tcs;
+                r.policy = policy;
+                if ((ok = run_threads(eid, threads, config, &r)))
+                    results->push_back(r);
+            }
+            sgx_destroy_enclave(eid);
+            if (!ok) return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Per policy and thread count, the smallest TCSNum without SGX_ERROR_OUT_OF_TCS
+ * and within GOOD_ENOUGH of the best throughput measured for that thread count.
+ */
+static void print_sizing(const std::vector<tcs_bench_result> &results)
+{
+    printf("Suggested TCSNum:\n");
+    for (int policy = 0; policy <= 1; policy++) {
+        for (unsigned threads = 1; ; threads *= 2) {
+            double best = 0;
+            bool seen = false;
+            for (size_t i = 0; i < results.size(); i++) {
+                if (results[i].policy == policy && results[i].threads == threads) {
+                    best = std::max(best, results[i].ops_per_sec);
+                    seen = true;
+                }
+            }
+            if (!seen) break;
+            unsigned pick = 0;
+            for (size_t i = 0; i < results.size(); i++) {
+                const tcs_bench_result &r = results[i];
+                if (r.policy == policy && r.threads == threads && r.out_of_tcs == 0 &&
+                        r.ops_per_sec >= best * GOOD_ENOUGH && (pick == 0 || r.tcs < pick))
+                    pick = r.tcs;
+            }
+            if (pick > 0)
+                printf("  %-6s %3u threads: %u\n", policy_names[policy], threads, pick);
+            else
+                printf("  %-6s %3u threads: more than measured\n", policy_names[policy], threads);
+        }
+    }
+}
+
+static void write_csv(const std::string &path, const std::vector<tcs_bench_result> &results)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "mode,tcs_num,tcs_policy,threads,ops,ops_per_sec,out_of_tcs,p50_ns,p99_ns,p999_ns,max_ns\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const tcs_bench_result &r = results[i];
+        fprintf(fp, "%s,%u,%s,%u,%zu,%.1f,%llu,%.1f,%.1f,%.1f,%.1f\n", BENCH_SGX_MODE, r.tcs,
+                policy_names[r.policy], r.threads, r.ops, r.ops_per_sec, r.out_of_tcs,
+                r.p50_ns, r.p99_ns, r.p999_ns, r.max_ns);
+    }
+    fclose(fp);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: app %s -c tcs_num [-c tcs_num ...] [-t max_threads] [-d ms] [-w work] [-o output.csv]\n", name);
+    printf("  For each tcs_num and both TCS policies loads tcs_enclave_<tcs_num>_<policy>.signed.so\n");
+    printf("  (make bench_tcs signs them) and has 1 to max_threads threads (default 16, in steps of 2x)\n");
+    printf("  call an ECALL doing work rounds of xorshift (default 1000) for ms milliseconds each (default 1000).\n");
+    printf("  Reports throughput, SGX_ERROR_OUT_OF_TCS returns and latency percentiles of the calls that got in.\n");
+}
+
+int tcs_bench_main(int argc, char *argv[])
+{
+    tcs_bench_config config;
+    config.max_threads = 16;
+    config.duration_ms = 1000;
+    config.work = 1000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:d:w:o:h")) != -1) {
+        switch (opt) {
+        case 'c': config.tcs_counts.push_back((unsigned)strtoul(optarg, NULL, 0)); break;
+        case 't': config.max_threads = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'd': config.duration_ms = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'w': config.work = strtoull(optarg, NULL, 0); break;
+        case 'o': config.output = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (config.tcs_counts.empty() || config.max_threads == 0 || config.duration_ms == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::sort(config.tcs_counts.begin(), config.tcs_counts.end());
+
+    std::vector<tcs_bench_result> results;
+    if (!run_bench(config, &results)) return 1;
+
+    printf("%7s %7s %7s %10s %12s %10s %10s %10s %10s %12s\n", "tcs_num", "policy", "threads",
+            "ops", "ops/s", "out_of_tcs", "p50_ns", "p99_ns", "p999_ns", "max_ns");
+    for (size_t i = 0; i < results.size(); i++) {
+        const tcs_bench_result &r = results[i];
+        printf("%7u %7s %7u %10zu %12.1f %10llu %10.1f %10.1f %10.1f %12.1f\n", r.tcs, policy_names[r.policy],
+                r.threads, r.ops, r.ops_per_sec, r.out_of_tcs, r.p50_ns, r.p99_ns, r.p999_ns, r.max_ns);
+    }
+    print_sizing(results);
+    if (!config.output.empty()) {
+        write_csv(config.output, results);
+        printf("Results written to %s\n", config.output.c_str());
+    }
+    return 0;
+}
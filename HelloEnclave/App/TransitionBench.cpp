@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "sgx_urts.h"
+#include "App.h"
+#include "Enclave_u.h"
+
+#ifndef BENCH_SGX_MODE
+# define BENCH_SGX_MODE "SIM"
+#endif
+
+/* Bytes each buffer case may move in total, so the 1 MB cases finish in reasonable time */
+#define BYTES_PER_CASE (1ULL << 30)
+/* Fewest timed calls of any case */
+#define MIN_ITERATIONS 100
+/* Largest buffer: half the 4 MB HeapMaxSize of Enclave/Bench.config.xml, which the [in] and [out] copies come from */
+#define MAX_BUFFER_BYTES (2U << 20)
+
+enum transition_op {
+    OP_EMPTY,           /* ECALL with no arguments */
+    OP_IN,              /* ECALL with an [in] buffer */
+    OP_OUT,             /* ECALL with an [out] buffer */
+    OP_USER_CHECK,      /* ECALL with a [user_check] buffer */
+    OP_OCALL,           /* OCALL with no arguments, from a loop in the enclave */
+    OP_NESTED           /* ECALL -> OCALL -> ECALL */
+};
+
+static const char *op_names[] = { "empty", "in", "out", "user_check", "ocall", "nested" };
+
+struct transition_result {
+    transition_op op;
+    size_t bytes;
+    size_t ops;
+    double mean_ns;
+    double p50_ns;
+    double p90_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static sgx_enclave_id_t bench_eid = 0;
+
+/* When each ocall_bench_empty ran; a round trip is the time between two */
+static std::vector<bench_clock::time_point> ocall_stamps;
+
+static double ns_between(bench_clock::time_point begin, bench_clock::time_point end)
+{
+    return std::chrono::duration<double, std::nano>(end - begin).count();
+}
+
+/* OCall functions */
+void ocall_bench_empty(void)
+{
+    if (ocall_stamps.size() < ocall_stamps.capacity())
+        ocall_stamps.push_back(bench_clock::now());
+}
+
+void ocall_bench_nested(void)
+{
+    bench_empty(bench_eid);
+}
+
+static double percentile(const std::vector<double> &sorted, double q)
+{
+    return sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * q))];
+}
+
+static transition_result summarize(transition_op op, size_t bytes, std::vector<double> &samples)
+{
+    std::sort(samples.begin(), samples.end());
+    transition_result r;
+    r.op = op;
+    r.bytes = bytes;
+    r.ops = samples.size();
+    r.mean_ns = 0;
+    for (size_t i = 0; i < samples.size(); i++) r.mean_ns += samples[i];
+    r.mean_ns /= samples.size();
+    r.p50_ns = percentile(samples, 0.5);
+    r.p90_ns = percentile(samples, 0.9);
+    r.p99_ns = percentile(samples, 0.99);
+    r.p999_ns = percentile(samples, 0.999);
+    r.max_ns = samples.back();
+    return r;
+}
+
+static sgx_status_t call_op(transition_op op, uint8_t *buf, size_t bytes)
+{
+    switch (op) {
+    case OP_EMPTY:      return bench_empty(bench_eid);
+    case OP_IN:         return bench_in(bench_eid, buf, bytes);
+    case OP_OUT:        return bench_out(bench_eid, buf, bytes);
+    case OP_USER_CHECK: return bench_user_check(bench_eid, buf, bytes);
+    case OP_NESTED:     return bench_nested(bench_eid);
+    default:            return SGX_ERROR_INVALID_PARAMETER;
+    }
+}
+
+/* Times iterations calls of op after warmup untimed ones */
+static bool run_ecall_case(transition_op op, uint8_t *buf, size_t bytes, size_t warmup, size_t iterations,
+        std::vector<transition_result> *results)
+{
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    for (size_t i = 0; i < warmup + iterations; i++) {
+        bench_clock::time_point begin = bench_clock::now();
+        sgx_status_t ret = call_op(op, buf, bytes);
+        bench_clock::time_point end = bench_clock::now();
+        if (ret != SGX_SUCCESS) {
+            printf("%s of %zu bytes failed:\n", op_names[op], bytes);
+            print_error_message(ret);
+            return false;
+        }
+        if (i >= warmup) samples.push_back(ns_between(begin, end));
+    }
+    results->push_back(summarize(op, bytes, samples));
+    return true;
+}
+
+/* One ECALL making warmup + iterations + 1 OCALLs, timed between consecutive OCALLs */
+static bool run_ocall_case(size_t warmup, size_t iterations, std::vector<transition_result> *results)
+{
+    ocall_stamps.clear();
+    ocall_stamps.reserve(warmup + iterations + 1);
+    sgx_status_t ret = bench_ocall(bench_eid, warmup + iterations + 1);
+    if (ret != SGX_SUCCESS) {
+        printf("ocall failed:\n");
+        print_error_message(ret);
+        return false;
+    }
+    std::vector<double> samples;
+    for (size_t i = warmup + 1; i < ocall_stamps.size(); i++)
+        samples.push_back(ns_between(ocall_stamps[i - 1], ocall_stamps[i]));
+    results->push_back(summarize(OP_OCALL, 0, samples));
+    return true;
+}
+
+/* Median cost of reading the clock, which every sample includes once */
+static double timer_overhead_ns()
+{
+    std::vector<double> samples;
+    for (int i = 0; i < 10000; i++) {
+        bench_clock::time_point begin = bench_clock::now();
+        samples.push_back(ns_between(begin, bench_clock::now()));
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+static bool run_bench(size_t iterations, size_t max_bytes, std::vector<transition_result> *results)
+{
+    std::vector<uint8_t> buf(max_bytes > 0 ? max_bytes : 1, 0xA5);
+    size_t warmup = std::max(iterations / 10, (size_t)1);
+
+    if (!run_ecall_case(OP_EMPTY, buf.data(), 0, warmup, iterations, results)) return false;
+
+    const transition_op buffer_ops[] = { OP_IN, OP_OUT, OP_USER_CHECK };
+    for (size_t o = 0; o < sizeof(buffer_ops) / sizeof(buffer_ops[0]); o++) {
+        /* 0 B, 64 B, then powers of four from 1 KB */
+        for (size_t bytes = 0; bytes <= max_bytes; bytes = bytes == 0 ? 64 : bytes == 64 ? 1024 : bytes * 4) {
+            size_t n = std::min((size_t)iterations, std::max((size_t)MIN_ITERATIONS,
+                    bytes > 0 ? (size_t)(BYTES_PER_CASE / bytes) : (size_t)iterations));
+            if (!run_ecall_case(buffer_ops[o], buf.data(), bytes, std::max(n / 10, (size_t)1), n, results))
+                return false;
+        }
+    }
+
+    if (!run_ocall_case(warmup, iterations, results)) return false;
+    return run_ecall_case(OP_NESTED, buf.data(), 0, warmup, iterations, results);
+}
+
+static void write_csv(const std::string &path, const std::vector<transition_result> &results)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "mode,op,bytes,ops,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const transition_result &r = results[i];
+        fprintf(fp, "%s,%s,%zu,%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", BENCH_SGX_MODE, op_names[r.op], r.bytes, r.ops,
+                r.mean_ns, r.p50_ns, r.p90_ns, r.p99_ns, r.p999_ns, r.max_ns);
+    }
+    fclose(fp);
+}
+
+static void write_json(const std::string &path, double timer_ns, const std::vector<transition_result> &results)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "{\n  \"mode\": \"%s\",\n  \"timer_ns\": %.1f,\n  \"results\": [\n", BENCH_SGX_MODE, timer_ns);
+    for (size_t i = 0; i < results.size(); i++) {
+        const transition_result &r = results[i];
+        fprintf(fp, "    {\"op\": \"%s\", \"bytes\": %zu, \"ops\": %zu, \"mean_ns\": %.1f, \"p50_ns\": %.1f, "
+                "\"p90_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"max_ns\": %.1f}%s\n",
+                op_names[r.op], r.bytes, r.ops, r.mean_ns, r.p50_ns, r.p90_ns, r.p99_ns, r.p999_ns, r.max_ns,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: app %s [-n iterations] [-s max_bytes] [-o output_prefix]\n", name);
+    printf("  Times an empty ECALL, ECALLs with [in], [out] and [user_check] buffers of 0 B to max_bytes\n");
+    printf("  (default 1048576), an OCALL round trip and an ECALL -> OCALL -> ECALL, iterations times\n");
+    printf("  each (default 100000, fewer for large buffers) in %s, after a tenth as many warmup calls.\n",
+            BENCH_ENCLAVE_FILENAME);
+    printf("  max_bytes is at most %u, what the bench enclave heap holds.\n", MAX_BUFFER_BYTES);
+    printf("  Results are written to <output_prefix>.csv and <output_prefix>.json (default bench_transitions).\n");
+}
+
+int transition_bench_main(int argc, char *argv[])
+{
+    size_t iterations = 100000;
+    size_t max_bytes = 1 << 20;
+    std::string output_prefix = "bench_transitions";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:o:h")) != -1) {
+        switch (opt) {
+        case 'n': iterations = strtoul(optarg, NULL, 0); break;
+        case 's': max_bytes = strtoul(optarg, NULL, 0); break;
+        case 'o': output_prefix = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (iterations < MIN_ITERATIONS || max_bytes > MAX_BUFFER_BYTES) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (load_enclave(BENCH_ENCLAVE_FILENAME, BENCH_TOKEN_FILENAME, &bench_eid) < 0) {
+        printf("Fail to initialize enclave.\n");
+        return 1;
+    }
+    std::vector<transition_result> results;
+    bool ok = run_bench(iterations, max_bytes, &results);
+    sgx_destroy_enclave(bench_eid);
+    if (!ok) return 1;
+
+    double timer_ns = timer_overhead_ns();
+    printf("%-10s %9s %8s %10s %10s %10s %10s %10s %12s\n",
+            "op", "bytes", "ops", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "p999_ns", "max_ns");
+    for (size_t i = 0; i < results.size(); i++) {
+        const transition_result &r = results[i];
+        printf("%-10s %9zu %8zu %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n", op_names[r.op], r.bytes, r.ops,
+                r.mean_ns, r.p50_ns, r.p90_ns, r.p99_ns, r.p999_ns, r.max_ns);
+    }
+    printf("Mode %s; every sample includes one clock read of %.1f ns.\n", BENCH_SGX_MODE, timer_ns);
+
+    write_csv(output_prefix + ".csv", results);
+    write_json(output_prefix + ".json", timer_ns, results);
+    printf("Results written to %s.csv and %s.json\n", output_prefix.c_str(), output_prefix.c_str());
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <string.h>
+
+#include "Enclave.h"
+#include "Enclave_t.h"
+#include "Log.h"
+
+/* Longest line bench_printf writes, newline included */
+#define BENCH_MAX_LINE 1024
+/* Largest block bench_write hands to one OCALL */
+#define BENCH_MAX_BLOCK 65536
+
+/*
+ * bench_printf:
+ *   Prints lines numbered lines of line_len bytes each, newline included,
+ *   for the App to time under the current log mode.
+ */
+void bench_printf(uint64_t lines, uint32_t line_len)
+{
+    log_scope scope;
+    char fill[BENCH_MAX_LINE];
+
+    /* "%010llu " and the newline take 12 bytes, the rest is padding */
+    if (line_len > BENCH_MAX_LINE)
+        line_len = BENCH_MAX_LINE;
+    int pad = line_len > 12 ? (int)line_len - 12 : 0;
+    memset(fill, 'x', sizeof(fill));
+
+    for (uint64_t i = 0; i < lines; i++)
+        printf("%010llu %.*s\n", (unsigned long long)i, pad, fill);
+}
+
+void bench_empty(void)
+{
+}
+
+void bench_in(uint8_t *buf, size_t len)
+{
+    (void)buf;
+    (void)len;
+}
+
+void bench_out(uint8_t *buf, size_t len)
+{
+    (void)buf;
+    (void)len;
+}
+
+void bench_user_check(uint8_t *buf, size_t len)
+{
+    (void)buf;
+    (void)len;
+}
+
+void bench_ocall(uint64_t count)
+{
+    for (uint64_t i = 0; i < count; i++)
+        ocall_bench_empty();
+}
+
+void bench_nested(void)
+{
+    ocall_bench_nested();
+}
+
+uint64_t bench_spin(uint64_t iterations)
+{
+    uint64_t x = iterations | 1;
+    for (uint64_t i = 0; i < iterations; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    return x;
+}
+
+/*
+ * bench_write:
+ *   Writes blocks blocks of block_size bytes to the App's fd, one OCALL
+ *   each, as an I/O-bound enclave would. Stops at the first failed write.
+ */
+uint64_t bench_write(int fd, uint64_t blocks, uint32_t block_size)
+{
+    static uint8_t block[BENCH_MAX_BLOCK];
+    uint64_t written = 0;
+
+    if (block_size > BENCH_MAX_BLOCK)
+        block_size = BENCH_MAX_BLOCK;
+    memset(block, 'x', block_size);
+
+    for (uint64_t i = 0; i < blocks; i++) {
+        int64_t ret = -1;
+        if (ocall_bench_write(&ret, fd, block, block_size) != SGX_SUCCESS || ret < 0)
+            break;
+        written += (uint64_t)ret;
+    }
+    return written;
+}
+
+void startup_probe(void)
+{
+    ocall_startup_probe();
+}
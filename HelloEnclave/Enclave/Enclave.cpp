@@ -31,27 +31,27 @@
 
 
 #include <stdarg.h>
-#include <stdio.h>      /* vsnprintf */
 
 #include "Enclave.h"
 #include "Enclave_t.h"  /* print_string */
+#include "Log.h"
 
 /* 
  * printf: 
- *   Invokes OCALL to display the enclave buffer to the terminal.
+ *   Formats into the thread's log buffer, which reaches the terminal in one
+ *   OCALL at ECALL exit, when the buffer fills up or on printf_flush().
  */
 void printf(const char *fmt, ...)
 {
-    char buf[BUFSIZ] = {'\0'};
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(buf, BUFSIZ, fmt, ap);
+    log_vprintf(fmt, ap);
     va_end(ap);
-    ocall_print_string(buf);
 }
 
 void printf_helloworld()
 {
+    log_scope scope;
     printf("Hello World\n");
 }
 
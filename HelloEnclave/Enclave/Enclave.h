@@ -41,6 +41,7 @@ extern "C" {
 #endif
 
 void printf(const char *fmt, ...);
+void printf_flush(void);
 void printf_helloworld();
 
 #if defined(__cplusplus)
@@ -0,0 +1,188 @@
+#include <stdio.h>      /* vsnprintf */
+#include <string.h>
+
+#include "sgx_trts.h"
+#include "sgx_spinlock.h"
+
+#include "Enclave.h"
+#include "Enclave_t.h"  /* ocall_print_string, ocall_print_buffer */
+#include "Log.h"
+#include "enclave_log.h"
+
+static int g_log_mode = LOG_MODE_BUFFERED;
+
+/* Pause loops a printf waits for the App to drain a full ring before dropping its output */
+#define LOG_RING_SPINS 100000
+
+/*
+ * The registered ring, guarded by g_ring_lock, which also makes the enclave
+ * threads a single producer. Its size and write position live here and are
+ * never read back from App memory, so the App cannot make the enclave write
+ * outside the ring.
+ */
+static sgx_spinlock_t g_ring_lock = SGX_SPINLOCK_INITIALIZER;
+static log_ring_t *g_ring = NULL;
+static uint32_t g_ring_size = 0;
+static uint64_t g_ring_head = 0;
+static uint64_t g_ring_dropped = 0;
+
+/*
+ * Each thread fills its own buffer, so there is no lock on the printf path
+ * and lines of different threads never interleave within a flush.
+ */
+static __thread char t_log_buf[LOG_BUFFER_SIZE];
+static __thread size_t t_log_len = 0;
+static __thread unsigned t_log_depth = 0;   /* log_scopes open on this thread */
+
+log_scope::log_scope()
+{
+    t_log_depth++;
+}
+
+log_scope::~log_scope()
+{
+    if (--t_log_depth == 0)
+        log_flush();
+}
+
+void log_flush(void)
+{
+    if (t_log_len == 0)
+        return;
+    ocall_print_buffer(t_log_buf, t_log_len);
+    t_log_len = 0;
+}
+
+/* One printf, truncated to BUFSIZ like the enclave printf always was */
+static void log_direct(const char *fmt, va_list ap)
+{
+    char buf[BUFSIZ] = {'\0'};
+    vsnprintf(buf, BUFSIZ, fmt, ap);
+    ocall_print_string(buf);
+}
+
+/* Appends len bytes to the ring, or drops them if the App does not make room in time */
+static void log_ring_write(const char *buf, size_t len)
+{
+    sgx_spin_lock(&g_ring_lock);
+    if (g_ring == NULL) {
+        /* Unregistered since the mode was read */
+        sgx_spin_unlock(&g_ring_lock);
+        ocall_print_buffer(buf, len);
+        return;
+    }
+
+    for (unsigned spins = 0; ; spins++) {
+        /* A tail the App moved past head counts as a full ring */
+        uint64_t used = g_ring_head - __atomic_load_n(&g_ring->tail, __ATOMIC_ACQUIRE);
+        if (used <= g_ring_size && g_ring_size - used >= len)
+            break;
+        if (spins == LOG_RING_SPINS) {
+            __atomic_store_n(&g_ring->dropped, ++g_ring_dropped, __ATOMIC_RELAXED);
+            sgx_spin_unlock(&g_ring_lock);
+            return;
+        }
+        __builtin_ia32_pause();
+    }
+
+    uint8_t *data = LOG_RING_DATA(g_ring);
+    size_t offset = (size_t)(g_ring_head & (g_ring_size - 1));
+    size_t first = len < g_ring_size - offset ? len : g_ring_size - offset;
+    memcpy(data + offset, buf, first);
+    memcpy(data, buf + first, len - first);
+    g_ring_head += len;
+    __atomic_store_n(&g_ring->head, g_ring_head, __ATOMIC_RELEASE);
+    sgx_spin_unlock(&g_ring_lock);
+}
+
+static void log_ring(const char *fmt, va_list ap)
+{
+    char buf[LOG_BUFFER_SIZE];
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    if (n <= 0)
+        return;
+    log_ring_write(buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+void log_vprintf(const char *fmt, va_list ap)
+{
+    int mode = __atomic_load_n(&g_log_mode, __ATOMIC_RELAXED);
+    if (mode == LOG_MODE_DIRECT) {
+        log_direct(fmt, ap);
+        return;
+    }
+    if (mode == LOG_MODE_RING) {
+        log_ring(fmt, ap);
+        return;
+    }
+
+    /* Format in place; on overflow flush what was there and format again at the start */
+    size_t room = LOG_BUFFER_SIZE - t_log_len;
+    va_list aq;
+    va_copy(aq, ap);
+    int n = vsnprintf(t_log_buf + t_log_len, room, fmt, aq);
+    va_end(aq);
+    if (n < 0)
+        return;
+
+    if ((size_t)n >= room && t_log_len > 0) {
+        log_flush();
+        room = LOG_BUFFER_SIZE;
+        n = vsnprintf(t_log_buf, room, fmt, ap);
+        if (n < 0)
+            return;
+    }
+    /* A single message longer than the whole buffer is truncated */
+    t_log_len += (size_t)n < room ? (size_t)n : room - 1;
+
+    if (t_log_depth == 0 || t_log_len == LOG_BUFFER_SIZE - 1)
+        log_flush();
+}
+
+void printf_flush(void)
+{
+    log_flush();
+}
+
+int enclave_log_set_mode(int mode)
+{
+    /* LOG_MODE_RING is entered by registering a ring */
+    if (mode != LOG_MODE_DIRECT && mode != LOG_MODE_BUFFERED)
+        return -1;
+    /* This thread's buffer is flushed at ECALL exit; other threads' buffers on their next one */
+    return __atomic_exchange_n(&g_log_mode, mode, __ATOMIC_RELAXED);
+}
+
+int enclave_log_set_ring(void *ring)
+{
+    log_ring_t *r = (log_ring_t *)ring;
+    uint32_t size = 0;
+
+    if (r != NULL) {
+        if (!sgx_is_outside_enclave(r, sizeof(log_ring_t)))
+            return -1;
+        /* Read once: the App could change it under us */
+        size = *(volatile uint32_t *)&r->size;
+        if (size < LOG_RING_MIN_SIZE || size > LOG_RING_MAX_SIZE || (size & (size - 1)) != 0 ||
+                !sgx_is_outside_enclave(r, sizeof(log_ring_t) + size))
+            return -1;
+    }
+
+    sgx_spin_lock(&g_ring_lock);
+    g_ring = r;
+    g_ring_size = size;
+    g_ring_dropped = 0;
+    if (r != NULL) {
+        /* Carry on from where the App has drained to, so a ring can be registered again */
+        g_ring_head = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        r->dropped = 0;
+        __atomic_store_n(&r->head, g_ring_head, __ATOMIC_RELEASE);
+        __atomic_store_n(&g_log_mode, LOG_MODE_RING, __ATOMIC_RELAXED);
+    } else {
+        int ring_mode = LOG_MODE_RING;
+        __atomic_compare_exchange_n(&g_log_mode, &ring_mode, LOG_MODE_BUFFERED, false,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    sgx_spin_unlock(&g_ring_lock);
+    return 0;
+}
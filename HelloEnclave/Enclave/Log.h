@@ -0,0 +1,29 @@
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stdarg.h>
+
+/* Formats into the calling thread's log buffer, straight out in LOG_MODE_DIRECT or into the ring in LOG_MODE_RING */
+void log_vprintf(const char *fmt, va_list ap);
+
+/* Hands whatever the calling thread has buffered to the App in one OCALL */
+void log_flush(void);
+
+/*
+ * log_scope:
+ *   Put one at the top of every ECALL. Output is buffered while a scope is
+ *   open and flushed when the outermost one closes, i.e. at ECALL exit.
+ *   A printf outside any scope is flushed right away, so nothing is lost
+ *   by an ECALL that forgets it.
+ */
+class log_scope {
+public:
+    log_scope();
+    ~log_scope();
+
+private:
+    log_scope(const log_scope&);
+    log_scope& operator=(const log_scope&);
+};
+
+#endif /* !_LOG_H_ */
@@ -0,0 +1,41 @@
+#ifndef _ENCLAVE_LOG_H_
+#define _ENCLAVE_LOG_H_
+
+#include <stdint.h>
+
+/* How the enclave printf reaches the App, see Enclave/Log.cpp */
+#define LOG_MODE_DIRECT     0   /* one ocall_print_string per printf */
+#define LOG_MODE_BUFFERED   1   /* per-thread buffer, flushed by ocall_print_buffer */
+#define LOG_MODE_RING       2   /* written to a log_ring_t the App drains, no OCALL at all */
+
+/* Size of each thread's log buffer, and so of the largest ocall_print_buffer */
+#define LOG_BUFFER_SIZE     8192
+
+/* Bounds of log_ring_t.size, which must be a power of two */
+#define LOG_RING_MIN_SIZE   (2 * LOG_BUFFER_SIZE)
+#define LOG_RING_MAX_SIZE   (1U << 30)
+
+/*
+ * log_ring_t:
+ *   Single-producer single-consumer byte ring in App memory, registered with
+ *   enclave_log_set_ring. The enclave appends whole printf outputs and then
+ *   publishes head; the App writes out the bytes from tail to head and then
+ *   publishes tail. Both are free-running byte counts, the offset into the
+ *   data is count & (size - 1). The size bytes of data follow the header.
+ *
+ *   head and tail sit on cache lines of their own, so producer and consumer
+ *   do not invalidate each other's line on every update.
+ */
+typedef struct log_ring {
+    volatile uint64_t head;         /* written by the enclave only */
+    uint8_t pad0[56];
+    volatile uint64_t tail;         /* written by the App only */
+    uint8_t pad1[56];
+    volatile uint64_t dropped;      /* printf outputs the enclave dropped because the ring was full */
+    uint32_t size;                  /* bytes of data, set by the App before registering */
+    uint8_t pad2[52];
+} log_ring_t;
+
+#define LOG_RING_DATA(ring) ((uint8_t *)(ring) + sizeof(log_ring_t))
+
+#endif /* !_ENCLAVE_LOG_H_ */
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include "sgx_urts.h"
+#include "memprof.h"
+#include "memprof_app.h"
+
+/*
+ * The ECALLs come from MemProf/Enclave/MemProf.edl, imported into each
+ * sample's EDL, so their proxies live in the sample's own Enclave_u.c.
+ */
+extern "C" sgx_status_t memprof_start(sgx_enclave_id_t eid);
+extern "C" sgx_status_t memprof_get(sgx_enclave_id_t eid, memprof_stats_t* stats);
+
+void memprof_begin(sgx_enclave_id_t eid) {
+    sgx_status_t status = memprof_start(eid);
+    if (status != SGX_SUCCESS) {
+        fprintf(stderr, "memprof: memprof_start failed: %#x\n", status);
+    }
+}
+
+void memprof_report(sgx_enclave_id_t eid) {
+    memprof_stats_t stats;
+    sgx_status_t status = memprof_get(eid, &stats);
+    if (status != SGX_SUCCESS) {
+        fprintf(stderr, "memprof: memprof_get failed: %#x\n", status);
+        return;
+    }
+    fprintf(stderr, "memprof: heap_peak=%llu heap_live=%llu heap_committed_peak=%llu allocations=%llu "
+            "largest_allocation=%llu stack_peak=%llu stack_size=%llu stacks=%u\n",
+            (unsigned long long)stats.heap_peak, (unsigned long long)stats.heap_live,
+            (unsigned long long)stats.heap_committed_peak, (unsigned long long)stats.allocations,
+            (unsigned long long)stats.largest_allocation, (unsigned long long)stats.stack_peak,
+            (unsigned long long)stats.stack_size, stats.stacks);
+}
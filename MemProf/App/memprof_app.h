@@ -0,0 +1,52 @@
+#ifndef MEMPROF_APP_H_
+#define MEMPROF_APP_H_
+
+#include "sgx_eid.h"
+
+/*
+ * App side of the heap/stack high-water instrumentation, see MemProf/README.md.
+ *
+ * With SGX_MEMPROF=1 the samples call MEMPROF_BEGIN(eid) right after creating
+ * their enclave, which starts the measurement on the calling thread's TCS,
+ * and the report is printed to stderr by MEMPROF_REPORT() or, failing that,
+ * when the scope MEMPROF_BEGIN was used in ends. Otherwise both do nothing.
+ */
+#ifdef SGX_MEMPROF
+
+/* Paints the stack of the TCS the calling thread gets and starts heap_peak over */
+void memprof_begin(sgx_enclave_id_t eid);
+/* Prints one "memprof: key=value ..." line to stderr, which memprof_tune.sh parses */
+void memprof_report(sgx_enclave_id_t eid);
+
+class MemProfScope {
+public:
+    explicit MemProfScope(sgx_enclave_id_t eid) : eid_(eid), reported_(false) { memprof_begin(eid_); }
+    ~MemProfScope() { report(); }
+
+    /* Reports once; call it before the enclave is destroyed */
+    void report() {
+        if (!reported_) {
+            reported_ = true;
+            memprof_report(eid_);
+        }
+    }
+
+private:
+    MemProfScope(const MemProfScope&);
+    MemProfScope& operator=(const MemProfScope&);
+
+    sgx_enclave_id_t eid_;
+    bool reported_;
+};
+
+#define MEMPROF_BEGIN(eid)  MemProfScope memprof_scope_(eid)
+#define MEMPROF_REPORT()    memprof_scope_.report()
+
+#else
+
+#define MEMPROF_BEGIN(eid)
+#define MEMPROF_REPORT()
+
+#endif // SGX_MEMPROF
+
+#endif // MEMPROF_APP_H_
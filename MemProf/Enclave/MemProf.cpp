@@ -0,0 +1,232 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "sgx_trts.h"
+#include "sgx_spinlock.h"
+#include "memprof.h"
+
+/*
+ * Heap and stack high-water marks for sizing HeapMaxSize and StackMaxSize.
+ *
+ * Heap: the enclave is linked with --wrap for malloc, calloc, realloc,
+ * memalign and free (MemProf/memprof.mk), so every allocation, including
+ * those of the SDK's libraries and of the edger8r bridges, passes through
+ * here. Each block gets a header recording its size. The trts also keeps
+ * the furthest the heap grew, g_peak_heap_used, which includes malloc's
+ * own overhead and fragmentation and so is what HeapMaxSize has to cover.
+ *
+ * Stack: memprof_start fills the unused part of the calling TCS's stack
+ * with a pattern, and memprof_get finds the lowest word that is no longer
+ * the pattern.
+ */
+
+#define MEMPROF_BLOCK_MAGIC ((uintptr_t)0x6D656D70726F6621ULL)
+#define MEMPROF_STACK_FILL  ((uintptr_t)0xA5A5A5A5A5A5A5A5ULL)
+
+/* Bytes below the painting frame left alone, past the red zone and the spin lock calls */
+#define MEMPROF_STACK_MARGIN 4096
+
+/* TCSs whose stacks can be painted */
+#define MEMPROF_MAX_STACKS 64
+
+extern "C" {
+/* Furthest the heap has grown, kept by the trts for the sgx_emmt tool */
+extern size_t g_peak_heap_used;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void* __real_memalign(size_t alignment, size_t size);
+void __real_free(void* ptr);
+}
+
+/*
+ * Sits right before each block handed out. check tells these blocks from
+ * ones allocated past the wrappers, e.g. inside the allocator itself,
+ * which are passed to the real free untouched.
+ */
+typedef struct memprof_block {
+    void* base;         /* what the real allocator returned */
+    size_t size;        /* what the caller asked for */
+    uintptr_t check;    /* MEMPROF_BLOCK_MAGIC ^ address of the header */
+    uintptr_t pad;      /* keeps the block 16-byte aligned */
+} memprof_block_t;
+
+static uint64_t g_heap_live = 0;
+static uint64_t g_heap_peak = 0;
+static uint64_t g_allocations = 0;
+static uint64_t g_largest = 0;
+
+typedef struct memprof_stack {
+    uintptr_t base;     /* highest address + 1 */
+    uintptr_t limit;    /* lowest address */
+} memprof_stack_t;
+
+static sgx_spinlock_t g_stacks_lock = SGX_SPINLOCK_INITIALIZER;
+static memprof_stack_t g_stacks[MEMPROF_MAX_STACKS];
+static uint32_t g_stack_count = 0;
+
+static void raise_to(uint64_t* mark, uint64_t value) {
+    uint64_t seen = __atomic_load_n(mark, __ATOMIC_RELAXED);
+    while (value > seen &&
+            !__atomic_compare_exchange_n(mark, &seen, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void* track(void* base, void* ptr, size_t size) {
+    memprof_block_t* block = (memprof_block_t*)ptr - 1;
+    block->base = base;
+    block->size = size;
+    block->check = MEMPROF_BLOCK_MAGIC ^ (uintptr_t)block;
+
+    uint64_t live = __atomic_add_fetch(&g_heap_live, size, __ATOMIC_RELAXED);
+    raise_to(&g_heap_peak, live);
+    raise_to(&g_largest, size);
+    __atomic_add_fetch(&g_allocations, 1, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+/* The header of ptr, or NULL if ptr did not come from the wrappers */
+static memprof_block_t* block_of(void* ptr) {
+    memprof_block_t* block = (memprof_block_t*)ptr - 1;
+    return block->check == (MEMPROF_BLOCK_MAGIC ^ (uintptr_t)block) ? block : NULL;
+}
+
+extern "C" void* __wrap_malloc(size_t size) {
+    if (size > SIZE_MAX - sizeof(memprof_block_t)) {
+        return NULL;
+    }
+    uint8_t* base = (uint8_t*)__real_malloc(sizeof(memprof_block_t) + size);
+    return base != NULL ? track(base, base + sizeof(memprof_block_t), size) : NULL;
+}
+
+extern "C" void* __wrap_memalign(size_t alignment, size_t size) {
+    /* The header must fit in front of the block without breaking its alignment */
+    if (alignment < sizeof(memprof_block_t)) {
+        alignment = sizeof(memprof_block_t);
+    }
+    if (size > SIZE_MAX - alignment) {
+        return NULL;
+    }
+    uint8_t* base = (uint8_t*)__real_memalign(alignment, alignment + size);
+    return base != NULL ? track(base, base + alignment, size) : NULL;
+}
+
+extern "C" void* __wrap_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void* ptr = __wrap_malloc(count * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+extern "C" void __wrap_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    memprof_block_t* block = block_of(ptr);
+    if (block == NULL) {
+        __real_free(ptr);
+        return;
+    }
+    __atomic_sub_fetch(&g_heap_live, block->size, __ATOMIC_RELAXED);
+    block->check = 0;
+    __real_free(block->base);
+}
+
+extern "C" void* __wrap_realloc(void* ptr, size_t size) {
+    if (ptr == NULL) {
+        return __wrap_malloc(size);
+    }
+    memprof_block_t* block = block_of(ptr);
+    if (block == NULL) {
+        return __real_realloc(ptr, size);
+    }
+    if (size == 0) {
+        __wrap_free(ptr);
+        return NULL;
+    }
+    void* moved = __wrap_malloc(size);
+    if (moved != NULL) {
+        memcpy(moved, ptr, block->size < size ? block->size : size);
+        __wrap_free(ptr);
+    }
+    return moved;
+}
+
+/*
+ * The trts keeps each TCS's thread_data_t at the TLS base. Its layout is
+ * fixed, as -fstack-protector reads stack_guard, the sixth word, at
+ * %fs:0x28 (%gs:0x14 on x86); stack_base_addr and stack_limit_addr are the
+ * third and fourth words.
+ */
+static bool stack_bounds(uintptr_t* base, uintptr_t* limit) {
+#if defined(__x86_64__)
+    __asm__ volatile("mov %%fs:0x10, %0" : "=r"(*base));
+    __asm__ volatile("mov %%fs:0x18, %0" : "=r"(*limit));
+#elif defined(__i386__)
+    __asm__ volatile("mov %%gs:0x8, %0" : "=r"(*base));
+    __asm__ volatile("mov %%gs:0xc, %0" : "=r"(*limit));
+#else
+    return false;
+#endif
+    return *limit < *base && sgx_is_within_enclave((void*)*limit, *base - *limit);
+}
+
+extern "C" void memprof_start(void) {
+    __atomic_store_n(&g_heap_peak, __atomic_load_n(&g_heap_live, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+
+    uintptr_t base, limit;
+    volatile uintptr_t here = 0;
+    if (!stack_bounds(&base, &limit) || (uintptr_t)&here <= limit + MEMPROF_STACK_MARGIN ||
+            (uintptr_t)&here >= base) {
+        return;
+    }
+
+    /* No calls while painting: they would run on the words being painted */
+    uintptr_t top = ((uintptr_t)&here - MEMPROF_STACK_MARGIN) & ~(uintptr_t)(sizeof(uintptr_t) - 1);
+    for (volatile uintptr_t* word = (volatile uintptr_t*)limit; (uintptr_t)word < top; word++) {
+        *word = MEMPROF_STACK_FILL;
+    }
+
+    sgx_spin_lock(&g_stacks_lock);
+    uint32_t i = 0;
+    while (i < g_stack_count && g_stacks[i].base != base) {
+        i++;
+    }
+    if (i < MEMPROF_MAX_STACKS) {
+        g_stacks[i].base = base;
+        g_stacks[i].limit = limit;
+        if (i == g_stack_count) {
+            g_stack_count++;
+        }
+    }
+    sgx_spin_unlock(&g_stacks_lock);
+}
+
+extern "C" void memprof_get(memprof_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->heap_peak = __atomic_load_n(&g_heap_peak, __ATOMIC_RELAXED);
+    stats->heap_live = __atomic_load_n(&g_heap_live, __ATOMIC_RELAXED);
+    stats->heap_committed_peak = g_peak_heap_used;
+    stats->allocations = __atomic_load_n(&g_allocations, __ATOMIC_RELAXED);
+    stats->largest_allocation = __atomic_load_n(&g_largest, __ATOMIC_RELAXED);
+
+    sgx_spin_lock(&g_stacks_lock);
+    for (uint32_t i = 0; i < g_stack_count; i++) {
+        const uintptr_t* word = (const uintptr_t*)g_stacks[i].limit;
+        while ((uintptr_t)word < g_stacks[i].base && *word == MEMPROF_STACK_FILL) {
+            word++;
+        }
+        uint64_t used = g_stacks[i].base - (uintptr_t)word;
+        if (used > stats->stack_peak) {
+            stats->stack_peak = used;
+        }
+        stats->stack_size = g_stacks[i].base - g_stacks[i].limit;
+    }
+    stats->stacks = g_stack_count;
+    sgx_spin_unlock(&g_stacks_lock);
+}
@@ -0,0 +1,18 @@
+#ifndef MEMPROF_H_
+#define MEMPROF_H_
+
+#include <stdint.h>
+
+/* High-water marks of an enclave built with SGX_MEMPROF=1, see MemProf/README.md */
+typedef struct memprof_stats {
+    uint64_t heap_peak;             /* most bytes malloc'ed at once since memprof_start */
+    uint64_t heap_live;             /* bytes malloc'ed now */
+    uint64_t heap_committed_peak;   /* furthest the heap itself grew since enclave load, malloc overhead included */
+    uint64_t allocations;           /* malloc, calloc, realloc and memalign calls since load */
+    uint64_t largest_allocation;    /* biggest single request since load */
+    uint64_t stack_peak;            /* deepest use of any painted stack, in bytes from its base */
+    uint64_t stack_size;            /* size of the stacks, StackMaxSize */
+    uint32_t stacks;                /* stacks painted, one per TCS memprof_start ran on */
+} memprof_stats_t;
+
+#endif // MEMPROF_H_
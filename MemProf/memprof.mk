@@ -0,0 +1,51 @@
+# Heap/stack high-water instrumentation, see MemProf/README.md.
+#
+# Included by the samples' Makefiles once App_Name, Enclave_Name and the
+# App/Enclave flags are set, with MemProf_Dir pointing at this directory.
+# Build with SGX_MEMPROF=1 to link MemProf into the enclave; run
+# "make clean" when switching, as the objects do not track the setting.
+
+SGX_MEMPROF ?= 0
+
+App_C_Flags += -I$(MemProf_Dir)/App -I$(MemProf_Dir)/Include
+App_Cpp_Flags += -I$(MemProf_Dir)/App -I$(MemProf_Dir)/Include
+
+ifeq ($(SGX_MEMPROF), 1)
+
+App_C_Flags += -DSGX_MEMPROF
+App_Cpp_Flags += -DSGX_MEMPROF
+Enclave_C_Flags += -I$(MemProf_Dir)/Include
+Enclave_Cpp_Flags += -I$(MemProf_Dir)/Include
+
+# Search path the samples hand edger8r, so their EDL's MemProf.edl import resolves
+MemProf_Edl_Path := $(MemProf_Dir)/Enclave
+
+$(App_Name): .memprof/memprof_app.o
+$(Enclave_Name): .memprof/MemProf.o
+
+# Only the sample's own enclave goes through the malloc wrappers
+$(Enclave_Name): Enclave_Link_Flags += -Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc,--wrap=memalign
+
+.memprof/memprof_app.o: $(MemProf_Dir)/App/memprof_app.cpp
+	@mkdir -p .memprof
+	@$(CXX) $(App_Cpp_Flags) -c $< -o $@
+	@echo "CXX  <=  $<"
+
+.memprof/MemProf.o: $(MemProf_Dir)/Enclave/MemProf.cpp
+	@mkdir -p .memprof
+	@$(CXX) $(Enclave_Cpp_Flags) -c $< -o $@
+	@echo "CXX  <=  $<"
+
+else
+
+# An empty MemProf.edl, so the import adds nothing
+MemProf_Edl_Path := $(MemProf_Dir)/Enclave/disabled
+
+endif
+
+.PHONY: memprof_clean
+
+clean: memprof_clean
+
+memprof_clean:
+	@rm -rf .memprof
@@ -0,0 +1,143 @@
+#!/bin/sh
+#
+# Builds HelloEnclave, Sealing and PasswordWallet with SGX_MEMPROF=1 in
+# simulation mode, runs a workload for each, and recommends HeapMaxSize and
+# StackMaxSize for their enclave configs from the measured high-water marks.
+#
+#   memprof_tune.sh [-m margin_percent] [-a] [sample ...]
+#
+#   -m   headroom added on top of the peaks, 25 by default
+#   -a   write the recommendations into the configs
+#
+# The samples are built from copies in a scratch directory and their
+# workloads run there too, so their own builds and sealed files are left
+# alone. See MemProf/README.md.
+
+set -e
+
+margin=25
+apply=0
+while getopts "m:ah" opt; do
+    case $opt in
+        m) margin=$OPTARG ;;
+        a) apply=1 ;;
+        h) sed -n '3,14p' "$0" | sed 's/^# \{0,1\}//'; exit 0 ;;
+        *) echo "usage: $0 [-m margin_percent] [-a] [sample ...]" >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -gt 0 ] || set -- HelloEnclave Sealing PasswordWallet
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+# The samples find MemProf at ../MemProf, so it is copied next to them
+src="$scratch/src"
+mkdir -p "$src"
+cp -R "$root/MemProf" "$src/"
+
+# The stack can never be smaller than the SDK's minimum
+min_stack=8192
+
+config_of() {
+    case $1 in
+        HelloEnclave) echo "$root/HelloEnclave/Enclave/Enclave.config.xml" ;;
+        Sealing) echo "$root/Sealing/Enclave/Enclave.config.xml" ;;
+        PasswordWallet) echo "$root/PasswordWallet/enclave/enclave.config.xml" ;;
+    esac
+}
+
+app_of() {
+    case $1 in
+        PasswordWallet) echo sgx-wallet ;;
+        *) echo app ;;
+    esac
+}
+
+# Runs the sample's workload in the current directory, memprof lines go to stderr
+workload() {
+    case $1 in
+        HelloEnclave)
+            ./app > /dev/null
+            ./app bench_printf -n 20000 -l 1024 -r 1 > /dev/null
+            ;;
+        Sealing)
+            ./app > /dev/null
+            ;;
+        PasswordWallet)
+            ./sgx-wallet -n master > /dev/null
+            ./sgx-wallet -p master -a -x title -y user -z password > /dev/null
+            ./sgx-wallet -p master -s > /dev/null
+            ./sgx-wallet -p master -c changed > /dev/null
+            ./sgx-wallet -p changed -r 0 > /dev/null
+            ;;
+    esac
+}
+
+# Prints the value of <tag> in the config
+config_value() {
+    sed -n "s|.*<$2>\(.*\)</$2>.*|\1|p" "$1"
+}
+
+for sample in "$@"; do
+    config=$(config_of "$sample")
+    if [ -z "$config" ]; then
+        echo "$sample: not a sample MemProf knows how to run" >&2
+        exit 1
+    fi
+
+    echo "== $sample"
+    # The copy may carry objects of the sample's own build, which do not track SGX_MEMPROF
+    cp -R "$root/$sample" "$src/"
+    (cd "$src/$sample" && make clean > /dev/null && make SGX_MODE=SIM SGX_MEMPROF=1 > /dev/null)
+
+    run="$scratch/$sample"
+    mkdir -p "$run"
+    cp "$src/$sample/$(app_of "$sample")" "$src/$sample/enclave.signed.so" "$run/"
+    (cd "$run" && workload "$sample") 2> "$run/stderr" || {
+        cat "$run/stderr" >&2
+        echo "$sample: workload failed" >&2
+        exit 1
+    }
+
+    current_heap=$(config_value "$config" HeapMaxSize)
+    current_stack=$(config_value "$config" StackMaxSize)
+
+    recommendation=$(awk -v margin="$margin" -v min_stack="$min_stack" \
+        -v current_heap="$current_heap" -v current_stack="$current_stack" '
+        function page(bytes) { return int((bytes + 4095) / 4096) * 4096 }
+        /^memprof: / {
+            runs++
+            for (i = 2; i <= NF; i++) {
+                split($i, kv, "=")
+                if (kv[2] + 0 > max[kv[1]]) max[kv[1]] = kv[2] + 0
+            }
+        }
+        END {
+            if (runs == 0) exit 1
+            heap = max["heap_committed_peak"] > max["heap_peak"] ? max["heap_committed_peak"] : max["heap_peak"]
+            heap = page(heap * (100 + margin) / 100)
+            stack = page(max["stack_peak"] * (100 + margin) / 100)
+            if (stack < min_stack) stack = min_stack
+            printf "  runs                  %d\n", runs
+            printf "  heap peak (malloc)    %d bytes\n", max["heap_peak"]
+            printf "  heap peak (committed) %d bytes\n", max["heap_committed_peak"]
+            printf "  largest allocation    %d bytes in %d allocations\n", max["largest_allocation"], max["allocations"]
+            printf "  stack peak            %d bytes of %d\n", max["stack_peak"], max["stack_size"]
+            printf "  HeapMaxSize           %s -> 0x%x\n", current_heap, heap
+            printf "  StackMaxSize          %s -> 0x%x\n", current_stack, stack
+            printf "HEAP=0x%x STACK=0x%x\n", heap, stack
+        }' "$run/stderr") || {
+        echo "$sample: no memprof output, was it built with SGX_MEMPROF=1?" >&2
+        exit 1
+    }
+    echo "$recommendation" | grep -v '^HEAP='
+
+    if [ $apply -eq 1 ]; then
+        eval "$(echo "$recommendation" | grep '^HEAP=')"
+        sed -i -e "s|<HeapMaxSize>.*</HeapMaxSize>|<HeapMaxSize>$HEAP</HeapMaxSize>|" \
+            -e "s|<StackMaxSize>.*</StackMaxSize>|<StackMaxSize>$STACK</StackMaxSize>|" "$config"
+        echo "  written to ${config#$root/}"
+    fi
+done
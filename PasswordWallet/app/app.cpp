@@ -9,6 +9,7 @@
 #include "utils.h"
 #include "wallet.h"
 #include "enclave.h"
+#include "memprof_app.h"
 
 using namespace std;
 
@@ -50,6 +51,7 @@ int main(int argc, char** argv) {
         return -1;
     }
     info_print("Enclave successfully initilised.");
+    MEMPROF_BEGIN(eid);
 
     const char* options = "hvn:p:c:sax:y:z:r:";
     opterr=0; // prevent 'getopt' from printing err messages
@@ -213,6 +215,7 @@ int main(int argc, char** argv) {
     }
     
     // destroy enclave
+    MEMPROF_REPORT();
     enclave_status = sgx_destroy_enclave(eid);
     if(enclave_status != SGX_SUCCESS) {
         error_print("Fail to destroy enclave."); 
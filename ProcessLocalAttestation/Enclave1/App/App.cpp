@@ -32,6 +32,7 @@
 
 // App.cpp : Defines the entry point for the console application.
 #include <stdio.h>
+#include <string.h>
 #include <map>
 #include "../Enclave1/Enclave1_u.h"
 #include "../Enclave2/Enclave2_u.h"
@@ -44,6 +45,7 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <unistd.h>
+#include <time.h>
 
 #define UNUSED(val) (void)(val)
 #define TCHAR   char
@@ -52,8 +54,24 @@
 #define scanf_s scanf
 #define _tmain  main
 
+//Sessions established one after the other, the first with the full DH exchange and the rest resumed from the session cache
+#define SESSION_ROUNDS 2
+
+//Secret message exchanges timed over the session channel
+#define MESSAGE_EXCHANGE_ROUNDS 10000
+
+//Requests in flight of the windowed message exchanges; past the slots of a session channel ring (CHANNEL_RING_SLOTS)
+//the channel holds send_request back
+static const uint32_t pipeline_windows[] = { 1, 2, 4, 8, 16 };
+
+//Requests per batched message exchange, as many as fit a session channel slot (CHANNEL_SLOT_SIZE) at 50 bytes of response each
+static const uint32_t exchange_batches[] = { 1, 4, 16, 64 };
+
 extern std::map<sgx_enclave_id_t, uint32_t>g_enclave_id_map;
 
+//./app bench_sessions [options], see App/SessionBench.cpp
+int session_bench_main(sgx_enclave_id_t initiator_id, int argc, char *argv[]);
+
 
 sgx_enclave_id_t e1_enclave_id = 0;
 sgx_enclave_id_t e2_enclave_id = 0;
@@ -90,19 +108,35 @@ uint32_t load_enclaves()
     return SGX_SUCCESS;
 }
 
+static double elapsed_us(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 + (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
 int _tmain(int argc, _TCHAR* argv[])
 {
     uint32_t ret_status;
     sgx_status_t status;
-
-    UNUSED(argc);
-    UNUSED(argv);
+    struct timespec start;
+    int exchange;
+    size_t window;
+    size_t batch;
+    int session_round = 0;
 
     if(load_enclaves() != SGX_SUCCESS)
     {
         printf("\nLoad Enclave Failure");
     }
 
+    if(argc > 1 && strcmp(argv[1], "bench_sessions") == 0)
+    {
+        int bench_status = session_bench_main(e1_enclave_id, argc - 1, argv + 1);
+        sgx_destroy_enclave(e1_enclave_id);
+        return bench_status;
+    }
+
     //printf("\nAvailable Enclaves");
     //printf("\nEnclave1 - EnclaveID %" PRIx64 "\n", e1_enclave_id);
 
@@ -116,7 +150,8 @@ int _tmain(int argc, _TCHAR* argv[])
 
     do
     {
-        printf("[START] Testing create session between Enclave1 (Initiator) and Enclave2 (Responder)\n");
+        printf("[START] Testing create session %d of %d between Enclave1 (Initiator) and Enclave2 (Responder)\n", session_round + 1, SESSION_ROUNDS);
+        clock_gettime(CLOCK_MONOTONIC, &start);
         status = Enclave1_test_create_session(e1_enclave_id, &ret_status, e1_enclave_id, 0);
         status = SGX_SUCCESS;
         if (status!=SGX_SUCCESS)
@@ -128,7 +163,7 @@ int _tmain(int argc, _TCHAR* argv[])
         {
             if(ret_status==0)
             {
-                printf("[END] Secure Channel Establishment between Initiator (E1) and Responder (E2) Enclaves successful !!!\n");
+                printf("[END] Secure Channel Establishment between Initiator (E1) and Responder (E2) Enclaves successful in %.1f us !!!\n", elapsed_us(&start));
             }
             else
             {
@@ -137,9 +172,94 @@ int _tmain(int argc, _TCHAR* argv[])
             }
         }
 
+        //Test message exchange with Enclave2 in the other process through the session channel
+        printf("[START] Testing %d message exchanges between Initiator (E1) and Responder (E2)\n", MESSAGE_EXCHANGE_ROUNDS);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (exchange = 0; exchange < MESSAGE_EXCHANGE_ROUNDS; exchange++)
+        {
+            status = Enclave1_test_message_exchange(e1_enclave_id, &ret_status, e1_enclave_id, 0);
+            if (status != SGX_SUCCESS || ret_status != 0)
+                break;
+        }
+        if (status!=SGX_SUCCESS)
+        {
+            printf("[END] test_message_exchange Ecall failed: Error code is %x\n", status);
+            break;
+        }
+        else if (ret_status != 0)
+        {
+            printf("[END] Message Exchange failure between Initiator (E1) and Responder (E2): Error code is %x\n", ret_status);
+            break;
+        }
+        printf("[END] Message Exchange between Initiator (E1) and Responder (E2) Enclaves successful, %.2f us per exchange !!!\n",
+               elapsed_us(&start) / MESSAGE_EXCHANGE_ROUNDS);
+
+        //Test windowed message exchange, with more and more requests in flight
+        for (window = 0; window < sizeof(pipeline_windows) / sizeof(pipeline_windows[0]); window++)
+        {
+            printf("[START] Testing %d message exchanges between Initiator (E1) and Responder (E2) with up to %u requests in flight\n",
+                   MESSAGE_EXCHANGE_ROUNDS, pipeline_windows[window]);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            status = Enclave1_test_pipelined_message_exchange(e1_enclave_id, &ret_status, e1_enclave_id, 0,
+                                                              MESSAGE_EXCHANGE_ROUNDS, pipeline_windows[window]);
+            if (status != SGX_SUCCESS || ret_status != 0)
+                break;
+            printf("[END] Windowed Message Exchange successful, %.1f requests/s with up to %u requests in flight !!!\n",
+                   MESSAGE_EXCHANGE_ROUNDS / (elapsed_us(&start) / 1e6), pipeline_windows[window]);
+        }
+        if (status!=SGX_SUCCESS)
+        {
+            printf("[END] test_pipelined_message_exchange Ecall failed: Error code is %x\n", status);
+            break;
+        }
+        else if (ret_status != 0)
+        {
+            printf("[END] Windowed Message Exchange failure between Initiator (E1) and Responder (E2): Error code is %x\n", ret_status);
+            break;
+        }
+
+        //Test batched message exchange, with more and more requests to a message
+        for (batch = 0; batch < sizeof(exchange_batches) / sizeof(exchange_batches[0]); batch++)
+        {
+            printf("[START] Testing %d message exchanges between Initiator (E1) and Responder (E2) in batches of %u\n",
+                   MESSAGE_EXCHANGE_ROUNDS, exchange_batches[batch]);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            status = Enclave1_test_batched_message_exchange(e1_enclave_id, &ret_status, e1_enclave_id, 0,
+                                                            MESSAGE_EXCHANGE_ROUNDS, exchange_batches[batch]);
+            if (status != SGX_SUCCESS || ret_status != 0)
+                break;
+            printf("[END] Batched Message Exchange successful, %.1f requests/s in batches of %u !!!\n",
+                   MESSAGE_EXCHANGE_ROUNDS / (elapsed_us(&start) / 1e6), exchange_batches[batch]);
+        }
+        if (status!=SGX_SUCCESS)
+        {
+            printf("[END] test_batched_message_exchange Ecall failed: Error code is %x\n", status);
+            break;
+        }
+        else if (ret_status != 0)
+        {
+            printf("[END] Batched Message Exchange failure between Initiator (E1) and Responder (E2): Error code is %x\n", ret_status);
+            break;
+        }
+
+        //Test closing the session, which also ends the responder's loop
+        printf("[START] Testing close session between Initiator (E1) and Responder (E2)\n");
+        status = Enclave1_test_close_session(e1_enclave_id, &ret_status, e1_enclave_id, 0);
+        if (status!=SGX_SUCCESS)
+        {
+            printf("[END] test_close_session Ecall failed: Error code is %x\n", status);
+            break;
+        }
+        else if (ret_status != 0)
+        {
+            printf("[END] Session Close failure between Initiator (E1) and Responder (E2): Error code is %x\n", ret_status);
+            break;
+        }
+        printf("[END] Close Session between Initiator (E1) and Responder (E2) Enclaves successful !!!\n");
+
 #pragma warning (push)
 #pragma warning (disable : 4127)
-    }while(0);
+    }while(++session_round < SESSION_ROUNDS);
 #pragma warning (pop)
 
     sgx_destroy_enclave(e1_enclave_id);
@@ -0,0 +1,212 @@
+// SessionBench.cpp : "app bench_sessions", request throughput of Enclave1 over many sessions from many threads
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "../Enclave1/Enclave1_u.h"
+#include "sgx_eid.h"
+#include "sgx_urts.h"
+
+//The responders are instances of Enclave2 loaded into this process, so the exchanges skip the session channel
+#define SESSION_BENCH_RESPONDER_PATH "libenclave2.so"
+#define SESSION_BENCH_RESPONDER_NO   2
+
+extern std::map<sgx_enclave_id_t, uint32_t>g_enclave_id_map;
+
+struct session_bench_config {
+    unsigned max_threads;
+    unsigned duration_ms;
+    std::string output;
+};
+
+//How the threads share the sessions
+struct session_bench_mode {
+    const char *name;
+    bool shared;
+};
+
+static const session_bench_mode modes[] = {
+    { "independent", false },   //each thread drives its own session, with its own responder
+    { "shared", true },         //all threads drive the first session, one at a time under its lock
+};
+
+struct session_bench_result {
+    const char *mode;
+    unsigned threads;
+    unsigned long long exchanges;
+    double exchanges_per_sec;
+    double us_per_exchange;     //per thread
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ns_between(bench_clock::time_point begin, bench_clock::time_point end)
+{
+    return std::chrono::duration<double, std::nano>(end - begin).count();
+}
+
+static void run_thread(sgx_enclave_id_t initiator_id, sgx_enclave_id_t responder_id, unsigned long long *exchanges,
+        uint32_t *error, const std::atomic<bool> *start, const std::atomic<bool> *stop)
+{
+    while (!start->load()) {
+        std::this_thread::yield();
+    }
+    while (!stop->load()) {
+        uint32_t retval;
+        sgx_status_t ret = Enclave1_test_message_exchange(initiator_id, &retval, initiator_id, responder_id);
+        if (ret != SGX_SUCCESS || retval != 0) {
+            *error = ret != SGX_SUCCESS ? ret : retval;
+            return;
+        }
+        (*exchanges)++;
+    }
+}
+
+static bool run_threads(sgx_enclave_id_t initiator_id, const std::vector<sgx_enclave_id_t> &responder_ids,
+        const session_bench_mode *mode, unsigned thread_count, const session_bench_config &config, session_bench_result *r)
+{
+    std::vector<unsigned long long> exchanges(thread_count, 0);
+    std::vector<uint32_t> errors(thread_count, 0);
+    std::vector<std::thread> threads;
+    std::atomic<bool> start(false);
+    std::atomic<bool> stop(false);
+    for (unsigned t = 0; t < thread_count; t++) {
+        sgx_enclave_id_t responder_id = responder_ids[mode->shared ? 0 : t];
+        threads.push_back(std::thread(run_thread, initiator_id, responder_id, &exchanges[t], &errors[t], &start, &stop));
+    }
+
+    bench_clock::time_point begin = bench_clock::now();
+    start.store(true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.duration_ms));
+    stop.store(true);
+    for (unsigned t = 0; t < thread_count; t++) {
+        threads[t].join();
+    }
+    double wall_ns = ns_between(begin, bench_clock::now());
+
+    r->mode = mode->name;
+    r->threads = thread_count;
+    r->exchanges = 0;
+    for (unsigned t = 0; t < thread_count; t++) {
+        if (errors[t] != 0) {
+            printf("test_message_exchange failed: Error code is %x\n", errors[t]);
+            return false;
+        }
+        r->exchanges += exchanges[t];
+    }
+    r->exchanges_per_sec = r->exchanges / (wall_ns / 1e9);
+    r->us_per_exchange = r->exchanges ? wall_ns * thread_count / r->exchanges / 1e3 : 0;
+    return true;
+}
+
+//Loads the responders and opens a session with each
+static bool open_sessions(sgx_enclave_id_t initiator_id, unsigned count, std::vector<sgx_enclave_id_t> *responder_ids)
+{
+    for (unsigned i = 0; i < count; i++) {
+        sgx_enclave_id_t responder_id;
+        sgx_launch_token_t launch_token = {0};
+        int launch_token_updated = 0;
+        sgx_status_t ret = sgx_create_enclave(SESSION_BENCH_RESPONDER_PATH, SGX_DEBUG_FLAG, &launch_token, &launch_token_updated, &responder_id, NULL);
+        if (ret != SGX_SUCCESS) {
+            printf("Failed to load %s: Error code is %x\n", SESSION_BENCH_RESPONDER_PATH, ret);
+            return false;
+        }
+        g_enclave_id_map.insert(std::pair<sgx_enclave_id_t, uint32_t>(responder_id, SESSION_BENCH_RESPONDER_NO));
+        responder_ids->push_back(responder_id);
+
+        uint32_t retval;
+        ret = Enclave1_test_create_session(initiator_id, &retval, initiator_id, responder_id);
+        if (ret != SGX_SUCCESS || retval != 0) {
+            printf("test_create_session failed: Error code is %x\n", ret != SGX_SUCCESS ? ret : retval);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void close_sessions(sgx_enclave_id_t initiator_id, const std::vector<sgx_enclave_id_t> &responder_ids)
+{
+    for (size_t i = 0; i < responder_ids.size(); i++) {
+        uint32_t retval;
+        Enclave1_test_close_session(initiator_id, &retval, initiator_id, responder_ids[i]);
+        g_enclave_id_map.erase(responder_ids[i]);
+        sgx_destroy_enclave(responder_ids[i]);
+    }
+}
+
+static void write_csv(const std::string &path, const std::vector<session_bench_result> &results)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "mode,threads,exchanges,exchanges_per_sec,us_per_exchange\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const session_bench_result &r = results[i];
+        fprintf(fp, "%s,%u,%llu,%.1f,%.2f\n", r.mode, r.threads, r.exchanges, r.exchanges_per_sec, r.us_per_exchange);
+    }
+    fclose(fp);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: app %s [-t max_threads] [-d ms] [-o output.csv]\n", name);
+    printf("  Loads max_threads (default 8, at most Enclave1's TCSNum) instances of Enclave2, opens a session\n");
+    printf("  with each, then has 1 to max_threads threads (in steps of 2x) exchange secret messages for ms\n");
+    printf("  milliseconds each (default 1000), each thread over its own session and all over the same one.\n");
+}
+
+int session_bench_main(sgx_enclave_id_t initiator_id, int argc, char *argv[])
+{
+    session_bench_config config;
+    config.max_threads = 8;
+    config.duration_ms = 1000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:d:o:h")) != -1) {
+        switch (opt) {
+        case 't': config.max_threads = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'd': config.duration_ms = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'o': config.output = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (config.max_threads == 0 || config.duration_ms == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<sgx_enclave_id_t> responder_ids;
+    bool ok = open_sessions(initiator_id, config.max_threads, &responder_ids);
+
+    std::vector<session_bench_result> results;
+    for (size_t m = 0; ok && m < sizeof(modes) / sizeof(modes[0]); m++) {
+        for (unsigned threads = 1; ok && threads <= config.max_threads; threads *= 2) {
+            session_bench_result r;
+            if ((ok = run_threads(initiator_id, responder_ids, &modes[m], threads, config, &r)))
+                results.push_back(r);
+        }
+    }
+    close_sessions(initiator_id, responder_ids);
+    if (!ok) return 1;
+
+    printf("%12s %7s %12s %14s %12s\n", "mode", "threads", "exchanges", "exchanges/s", "us/exchange");
+    for (size_t i = 0; i < results.size(); i++) {
+        const session_bench_result &r = results[i];
+        printf("%12s %7u %12llu %14.1f %12.2f\n", r.mode, r.threads, r.exchanges, r.exchanges_per_sec, r.us_per_exchange);
+    }
+    if (!config.output.empty()) {
+        write_csv(config.output, results);
+        printf("Results written to %s\n", config.output.c_str());
+    }
+    return 0;
+}
@@ -34,17 +34,81 @@
 #include "sgx_eid.h"
 #include "Enclave1_t.h"
 #include "EnclaveMessageExchange.h"
+#include "MessageBatch.h"
+#include "MessageSerializer.h"
 #include "error_codes.h"
 #include "Utility_E1.h"
 #include "sgx_thread.h"
 #include "sgx_dh.h"
+#include "sgx_spinlock.h"
 #include <map>
+#include <stddef.h>
+#include <string.h>
 
 #define UNUSED(val) (void)(val)
 
-std::map<sgx_enclave_id_t, dh_session_t>g_src_session_info_map;
+//A session with a destination enclave, used by one thread at a time under its lock
+typedef struct _src_session_t
+{
+    sgx_thread_mutex_t lock;
+    dh_session_t session;
+} src_session_t;
+
+//Entries stay once created, closed sessions are marked CLOSED, so that a thread may wait for the lock of one
+//without holding g_src_session_info_lock; threads using different sessions then never wait for each other
+std::map<sgx_enclave_id_t, src_session_t>g_src_session_info_map;
+static sgx_spinlock_t g_src_session_info_lock = SGX_SPINLOCK_INITIALIZER;
 
-static uint32_t e1_foo1_wrapper(ms_in_msg_exchange_t *ms, size_t param_lenth, char** resp_buffer, size_t* resp_length);
+//Locks and returns the session with dest_enclave_id, adding a CLOSED one if there is none and create is set
+static src_session_t* acquire_src_session(sgx_enclave_id_t dest_enclave_id, bool create)
+{
+    src_session_t* entry = NULL;
+
+    sgx_spin_lock(&g_src_session_info_lock);
+    std::map<sgx_enclave_id_t, src_session_t>::iterator it = g_src_session_info_map.find(dest_enclave_id);
+    if(it != g_src_session_info_map.end())
+    {
+        entry = &it->second;
+    }
+    else if(create)
+    {
+        src_session_t new_entry;
+        memset(&new_entry, 0, sizeof(src_session_t));
+        entry = &g_src_session_info_map.insert(std::pair<sgx_enclave_id_t, src_session_t>(dest_enclave_id, new_entry)).first->second;
+        sgx_thread_mutex_init(&entry->lock, NULL);
+    }
+    sgx_spin_unlock(&g_src_session_info_lock);
+
+    if(entry)
+    {
+        sgx_thread_mutex_lock(&entry->lock);
+    }
+    return entry;
+}
+
+//Locks and returns the active session with dest_enclave_id, or returns NULL
+static dh_session_t* acquire_active_src_session(sgx_enclave_id_t dest_enclave_id)
+{
+    src_session_t* entry = acquire_src_session(dest_enclave_id, false);
+    if(!entry)
+    {
+        return NULL;
+    }
+    if(entry->session.status != ACTIVE)
+    {
+        sgx_thread_mutex_unlock(&entry->lock);
+        return NULL;
+    }
+    return &entry->session;
+}
+
+static void release_src_session(dh_session_t* session)
+{
+    src_session_t* entry = (src_session_t*)((uint8_t*)session - offsetof(src_session_t, session));
+    sgx_thread_mutex_unlock(&entry->lock);
+}
+
+static uint32_t e1_foo1_wrapper(ms_in_msg_exchange_t *ms, size_t param_lenth, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length);
 
 //Function pointer table containing the list of functions that the enclave exposes
 const struct {
@@ -64,9 +128,23 @@ uint32_t test_create_session(sgx_enclave_id_t src_enclave_id,
     ATTESTATION_STATUS ke_status = SUCCESS;
     dh_session_t dest_session_info;
 
+    //Find or add the map entry of the destination enclave, which also keeps other threads off the session while it is created
+    src_session_t* entry = acquire_src_session(dest_enclave_id, true);
+    if(entry->session.status == ACTIVE)
+    {
+        sgx_thread_mutex_unlock(&entry->lock);
+        return DUPLICATE_SESSION;
+    }
+
     //Core reference code function for creating a session
     ke_status = create_session(src_enclave_id, dest_enclave_id, &dest_session_info);
-
+    if(ke_status == SUCCESS)
+    {
+        //Store the session information in the map entry of the destination enclave
+        memcpy(&entry->session, &dest_session_info, sizeof(dh_session_t));
+    }
+    sgx_thread_mutex_unlock(&entry->lock);
+    memset(&dest_session_info, 0, sizeof(dh_session_t));
     return ke_status;
 }
 
@@ -83,7 +161,7 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
     size_t out_buff_len;
     dh_session_t *dest_session_info;
     size_t max_out_buff_size;
-    char* retval;
+    uint32_t retval;
 
     var1 = 0x4;
     var2 = 0x5;
@@ -98,13 +176,9 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
         return ke_status;
     }
 
-    //Search the map for the session information associated with the destination enclave id of Enclave2 passed in
-    std::map<sgx_enclave_id_t, dh_session_t>::iterator it = g_src_session_info_map.find(dest_enclave_id);
-    if(it != g_src_session_info_map.end())
-    {
-          dest_session_info = &it->second;
-    }
-    else
+    //Search the map for the session information associated with the destination enclave id of Enclave2 passed in, and lock it
+    dest_session_info = acquire_active_src_session(dest_enclave_id);
+    if(!dest_session_info)
     {
         SAFE_FREE(marshalled_inp_buff);
         return INVALID_SESSION;
@@ -113,6 +187,7 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
     //Core Reference Code function
     ke_status = send_request_receive_response(src_enclave_id, dest_enclave_id, dest_session_info, marshalled_inp_buff,
                                             marshalled_inp_buff_len, max_out_buff_size, &out_buff, &out_buff_len);
+    release_src_session(dest_session_info);
 
 
     if(ke_status != SUCCESS)
@@ -133,7 +208,6 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
 
     SAFE_FREE(marshalled_inp_buff);
     SAFE_FREE(out_buff);
-    SAFE_FREE(retval);
     return SUCCESS;
 }
 
@@ -143,61 +217,254 @@ uint32_t test_message_exchange(sgx_enclave_id_t src_enclave_id,
 {
     ATTESTATION_STATUS ke_status = SUCCESS;
     uint32_t target_fn_id, msg_type;
-    char* marshalled_inp_buff;
+    char marshalled_inp_buff[message_request_size<uint32_t>::value];
     size_t marshalled_inp_buff_len;
-    char* out_buff;
+    char out_buff[message_response_size<uint32_t>::value];
     size_t out_buff_len;
     dh_session_t *dest_session_info;
-    size_t max_out_buff_size;
-    char* secret_response;
+    uint32_t secret_response;
     uint32_t secret_data;
 
     target_fn_id = 0;
     msg_type = MESSAGE_EXCHANGE;
-    max_out_buff_size = 50;
     secret_data = 0x12345678; //Secret Data here is shown only for purpose of demonstration.
 
     //Marshals the secret data into a buffer
-    ke_status = marshal_message_exchange_request(target_fn_id, msg_type, secret_data, &marshalled_inp_buff, &marshalled_inp_buff_len);
+    ke_status = marshal_request_in_place(marshalled_inp_buff, sizeof(marshalled_inp_buff), target_fn_id, msg_type,
+                                         &marshalled_inp_buff_len, secret_data);
     if(ke_status != SUCCESS)
     {
         return ke_status;
     }
-    //Search the map for the session information associated with the destination enclave id passed in
-    std::map<sgx_enclave_id_t, dh_session_t>::iterator it = g_src_session_info_map.find(dest_enclave_id);
-    if(it != g_src_session_info_map.end())
+    //Search the map for the session information associated with the destination enclave id passed in, and lock it
+    dest_session_info = acquire_active_src_session(dest_enclave_id);
+    if(!dest_session_info)
     {
-         dest_session_info = &it->second;
+        return INVALID_SESSION;
     }
-    else
+
+    //Core Reference Code function, decrypting the response into out_buff
+    ke_status = send_request_receive_response_in_place(src_enclave_id, dest_enclave_id, dest_session_info, marshalled_inp_buff,
+                                                marshalled_inp_buff_len, out_buff, sizeof(out_buff), &out_buff_len);
+    release_src_session(dest_session_info);
+    if(ke_status != SUCCESS)
     {
-        SAFE_FREE(marshalled_inp_buff);
-        return INVALID_SESSION;
+        return ke_status;
     }
 
-    //Core Reference Code function
-    ke_status = send_request_receive_response(src_enclave_id, dest_enclave_id, dest_session_info, marshalled_inp_buff,
-                                                marshalled_inp_buff_len, max_out_buff_size, &out_buff, &out_buff_len);
+    //Un-marshal the secret response data, read where it lies in out_buff
+    message_view<uint32_t> results = view_response<uint32_t>((ms_out_msg_exchange_t *)out_buff);
+    if(out_buff_len != sizeof(out_buff) || !results.valid())
+    {
+        return ATTESTATION_ERROR;
+    }
+    secret_response = results.get<0>();
+    UNUSED(secret_response);
+
+    return SUCCESS;
+}
+
+
+//Makes use of the sample code functions of windowed mode to exchange requests secret messages with the destination enclave,
+//keeping up to window requests in flight
+uint32_t test_pipelined_message_exchange(sgx_enclave_id_t src_enclave_id,
+                                         sgx_enclave_id_t dest_enclave_id,
+                                         uint32_t requests,
+                                         uint32_t window)
+{
+    ATTESTATION_STATUS ke_status = SUCCESS;
+    uint32_t target_fn_id, msg_type;
+    char* marshalled_inp_buff;
+    size_t marshalled_inp_buff_len;
+    char out_buff[message_response_size<uint32_t>::value];
+    size_t out_buff_len;
+    dh_session_t *dest_session_info;
+    size_t max_out_buff_size;
+    uint32_t secret_response;
+    uint32_t secret_data;
+    uint32_t sent, received, sequence;
+
+    if(window == 0 || window > SESSION_WINDOW_SIZE)
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
+
+    target_fn_id = 0;
+    msg_type = MESSAGE_EXCHANGE;
+    max_out_buff_size = sizeof(out_buff);
+    secret_data = 0x12345678; //Secret Data here is shown only for purpose of demonstration.
+
+    //Marshals the secret data into a buffer, once for all the requests
+    ke_status = marshal_message_exchange_request(target_fn_id, msg_type, secret_data, &marshalled_inp_buff, &marshalled_inp_buff_len);
     if(ke_status != SUCCESS)
     {
-        SAFE_FREE(marshalled_inp_buff);
-        SAFE_FREE(out_buff);
         return ke_status;
     }
+    //Search the map for the session information associated with the destination enclave id passed in, and lock it
+    dest_session_info = acquire_active_src_session(dest_enclave_id);
+    if(!dest_session_info)
+    {
+        SAFE_FREE(marshalled_inp_buff);
+        return INVALID_SESSION;
+    }
+
+    sent = 0;
+    received = 0;
+    while(ke_status == SUCCESS && received < requests)
+    {
+        //Fill the window, then take a response to make room for the next request
+        if(sent < requests && sent - received < window)
+        {
+            ke_status = send_request(src_enclave_id, dest_enclave_id, dest_session_info, marshalled_inp_buff,
+                                     marshalled_inp_buff_len, max_out_buff_size, &sequence);
+            if(ke_status == SUCCESS)
+            {
+                sent++;
+                continue;
+            }
+            //The window, or the channel to a peer in another process, is full until a response comes
+            if(ke_status != WINDOW_FULL_ERROR || sent == received)
+            {
+                break;
+            }
+            ke_status = SUCCESS;
+        }
+
+        //Decrypt the response into out_buff
+        ke_status = receive_response_in_place(src_enclave_id, dest_enclave_id, dest_session_info, out_buff,
+                                              sizeof(out_buff), &out_buff_len, &sequence);
+        if(ke_status != SUCCESS)
+        {
+            break;
+        }
+        received++;
+
+        //Un-marshal the secret response data
+        ke_status = umarshal_message_exchange_response(out_buff, &secret_response);
+    }
+    //Take the responses still in flight after a failure, so that the session is left to lock-step requests
+    while(ke_status != SUCCESS && dest_session_info->active.window != 0)
+    {
+        if(receive_response_in_place(src_enclave_id, dest_enclave_id, dest_session_info, out_buff,
+                                     sizeof(out_buff), &out_buff_len, &sequence) != SUCCESS)
+        {
+            break;
+        }
+    }
+    release_src_session(dest_session_info);
+
+    SAFE_FREE(marshalled_inp_buff);
+    return ke_status;
+}
+
+
+//Makes use of the sample code function to exchange requests secret messages with the destination enclave,
+//batch of them to a message
+uint32_t test_batched_message_exchange(sgx_enclave_id_t src_enclave_id,
+                                       sgx_enclave_id_t dest_enclave_id,
+                                       uint32_t requests,
+                                       uint32_t batch)
+{
+    ATTESTATION_STATUS ke_status = SUCCESS;
+    uint32_t target_fn_id, msg_type;
+    char* marshalled_inp_buff;
+    size_t marshalled_inp_buff_len;
+    char* batch_inp_buff;
+    size_t batch_inp_buff_len;
+    char** calls;
+    size_t* call_lens;
+    char** results;
+    char* out_buff;
+    size_t out_buff_len;
+    dh_session_t *dest_session_info;
+    size_t max_out_buff_size;
+    uint32_t secret_response;
+    uint32_t secret_data;
+    uint32_t count, done, i;
+
+    if(batch == 0)
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
 
-    //Un-marshal the secret response data
-    ke_status = umarshal_message_exchange_response(out_buff, &secret_response);
+    target_fn_id = 0;
+    msg_type = MESSAGE_EXCHANGE;
+    max_out_buff_size = sizeof(ms_out_msg_exchange_t) + (size_t)batch * 50;
+    secret_data = 0x12345678; //Secret Data here is shown only for purpose of demonstration.
+    batch_inp_buff = NULL;
+    out_buff = NULL;
+
+    //Marshals the secret data into a buffer, once for all the requests
+    ke_status = marshal_message_exchange_request(target_fn_id, msg_type, secret_data, &marshalled_inp_buff, &marshalled_inp_buff_len);
     if(ke_status != SUCCESS)
     {
+        return ke_status;
+    }
+    calls = (char**)malloc(batch * sizeof(char*));
+    call_lens = (size_t*)malloc(batch * sizeof(size_t));
+    results = (char**)malloc(batch * sizeof(char*));
+    if(!calls || !call_lens || !results)
+    {
+        SAFE_FREE(calls);
+        SAFE_FREE(call_lens);
+        SAFE_FREE(results);
         SAFE_FREE(marshalled_inp_buff);
+        return MALLOC_ERROR;
+    }
+    for(i = 0; i < batch; i++)
+    {
+        calls[i] = marshalled_inp_buff;
+        call_lens[i] = marshalled_inp_buff_len;
+    }
+
+    //Search the map for the session information associated with the destination enclave id passed in, and lock it
+    dest_session_info = acquire_active_src_session(dest_enclave_id);
+    if(!dest_session_info)
+    {
+        ke_status = INVALID_SESSION;
+    }
+
+    for(done = 0; ke_status == SUCCESS && done < requests; done += count)
+    {
+        //Packs the next batch, the last one with the requests left over
+        count = (requests - done < batch) ? requests - done : batch;
+        if(!batch_inp_buff || count != batch)
+        {
+            SAFE_FREE(batch_inp_buff);
+            ke_status = marshal_batch_request(calls, call_lens, count, &batch_inp_buff, &batch_inp_buff_len);
+            if(ke_status != SUCCESS)
+            {
+                break;
+            }
+        }
+
+        //Core Reference Code function
+        ke_status = send_request_receive_response(src_enclave_id, dest_enclave_id, dest_session_info, batch_inp_buff,
+                                                  batch_inp_buff_len, max_out_buff_size, &out_buff, &out_buff_len);
+        if(ke_status != SUCCESS)
+        {
+            break;
+        }
+
+        //Un-marshal the secret response data of each request in the batch
+        ke_status = unmarshal_batch_response(out_buff, out_buff_len, count, results);
+        for(i = 0; ke_status == SUCCESS && i < count; i++)
+        {
+            ke_status = umarshal_message_exchange_response(results[i], &secret_response);
+        }
         SAFE_FREE(out_buff);
-        return ke_status;
+    }
+    if(dest_session_info)
+    {
+        release_src_session(dest_session_info);
     }
 
+    SAFE_FREE(batch_inp_buff);
+    SAFE_FREE(calls);
+    SAFE_FREE(call_lens);
+    SAFE_FREE(results);
     SAFE_FREE(marshalled_inp_buff);
-    SAFE_FREE(out_buff);
-    SAFE_FREE(secret_response);
-    return SUCCESS;
+    return ke_status;
 }
 
 
@@ -205,15 +472,11 @@ uint32_t test_message_exchange(sgx_enclave_id_t src_enclave_id,
 uint32_t test_close_session(sgx_enclave_id_t src_enclave_id,
                                 sgx_enclave_id_t dest_enclave_id)
 {
-    dh_session_t dest_session_info;
+    dh_session_t* dest_session_info;
     ATTESTATION_STATUS ke_status = SUCCESS;
-    //Search the map for the session information associated with the destination enclave id passed in
-    std::map<sgx_enclave_id_t, dh_session_t>::iterator it = g_src_session_info_map.find(dest_enclave_id);
-    if(it != g_src_session_info_map.end())
-    {
-        dest_session_info = it->second;
-    }
-    else
+    //Search the map for the session information associated with the destination enclave id passed in, and lock it
+    dest_session_info = acquire_active_src_session(dest_enclave_id);
+    if(!dest_session_info)
     {
         return NULL;
     }
@@ -221,8 +484,10 @@ uint32_t test_close_session(sgx_enclave_id_t src_enclave_id,
     //Core reference code function for closing a session
     ke_status = close_session(src_enclave_id, dest_enclave_id);
 
-    //Erase the session information associated with the destination enclave id
-    g_src_session_info_map.erase(dest_enclave_id);
+    //Erase the session information associated with the destination enclave id, leaving the entry CLOSED
+    release_session_buffers(dest_session_info);
+    memset(dest_session_info, 0, sizeof(dh_session_t));
+    release_src_session(dest_session_info);
     return ke_status;
 }
 
@@ -250,12 +515,13 @@ extern "C" uint32_t verify_peer_enclave_trust(sgx_dh_session_enclave_identity_t*
 //Each enclave can have its own way of dispatching the calls from other enclave
 extern "C" uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data,
                                                        size_t decrypted_data_length,
-                                                       char** resp_buffer,
+                                                       char* resp_buffer,
+                                                       size_t resp_buffer_size,
                                                        size_t* resp_length)
 {
     ms_in_msg_exchange_t *ms;
-    uint32_t (*fn1)(ms_in_msg_exchange_t *ms, size_t, char**, size_t*);
-    if(!decrypted_data || !resp_length)
+    uint32_t (*fn1)(ms_in_msg_exchange_t *ms, size_t, char*, size_t, size_t*);
+    if(!decrypted_data || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
@@ -264,8 +530,8 @@ extern "C" uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data,
     {
         return INVALID_PARAMETER_ERROR;
     }
-    fn1 = (uint32_t (*)(ms_in_msg_exchange_t*, size_t, char**, size_t*))func_table.table[ms->target_fn_id];
-    return fn1(ms, decrypted_data_length, resp_buffer, resp_length);
+    fn1 = (uint32_t (*)(ms_in_msg_exchange_t*, size_t, char*, size_t, size_t*))func_table.table[ms->target_fn_id];
+    return fn1(ms, decrypted_data_length, resp_buffer, resp_buffer_size, resp_length);
 }
 
 //Operates on the input secret and generates the output secret
@@ -282,13 +548,14 @@ uint32_t get_message_exchange_response(uint32_t inp_secret_data)
 
 //Generates the response from the request message
 extern "C" uint32_t message_exchange_response_generator(char* decrypted_data,
-                                              char** resp_buffer,
+                                              char* resp_buffer,
+                                              size_t resp_buffer_size,
                                               size_t* resp_length)
 {
     ms_in_msg_exchange_t *ms;
     uint32_t inp_secret_data;
     uint32_t out_secret_data;
-    if(!decrypted_data || !resp_length)
+    if(!decrypted_data || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
@@ -299,8 +566,8 @@ extern "C" uint32_t message_exchange_response_generator(char* decrypted_data,
 
     out_secret_data = get_message_exchange_response(inp_secret_data);
 
-    if(marshal_message_exchange_response(resp_buffer, resp_length, out_secret_data) != SUCCESS)
-        return MALLOC_ERROR;
+    if(marshal_message_exchange_response(resp_buffer, resp_buffer_size, resp_length, out_secret_data) != SUCCESS)
+        return OUT_BUFFER_LENGTH_ERROR;
 
     return SUCCESS;
 
@@ -324,44 +591,38 @@ static uint32_t e1_foo1(external_param_struct_t *p_struct_var)
 //Function which is executed on request from the source enclave
 static uint32_t e1_foo1_wrapper(ms_in_msg_exchange_t *ms,
                     size_t param_lenth,
-                    char** resp_buffer,
+                    char* resp_buffer,
+                    size_t resp_buffer_size,
                     size_t* resp_length)
 {
     UNUSED(param_lenth);
 
     uint32_t ret;
     size_t len_data, len_ptr_data;
-    external_param_struct_t *p_struct_var;
+    external_param_struct_t struct_var;
     internal_param_struct_t internal_struct_var;
 
-    if(!ms || !resp_length)
+    if(!ms || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
 
-    p_struct_var = (external_param_struct_t*)malloc(sizeof(external_param_struct_t));
-    if(!p_struct_var)
-        return MALLOC_ERROR;
+    struct_var.p_internal_struct = &internal_struct_var;
 
-    p_struct_var->p_internal_struct = &internal_struct_var;
-
-    if(unmarshal_input_parameters_e1_foo1(p_struct_var, ms) != SUCCESS)//can use the stack
+    if(unmarshal_input_parameters_e1_foo1(&struct_var, ms) != SUCCESS)
     {
-        SAFE_FREE(p_struct_var);
         return ATTESTATION_ERROR;
     }
 
-    ret = e1_foo1(p_struct_var);
+    ret = e1_foo1(&struct_var);
 
-    len_data = sizeof(external_param_struct_t) - sizeof(p_struct_var->p_internal_struct);
+    len_data = sizeof(external_param_struct_t) - sizeof(struct_var.p_internal_struct);
     len_ptr_data = sizeof(internal_struct_var);
 
-    if(marshal_retval_and_output_parameters_e1_foo1(resp_buffer, resp_length, ret, p_struct_var, len_data, len_ptr_data) != SUCCESS)
+    if(marshal_retval_and_output_parameters_e1_foo1(resp_buffer, resp_buffer_size, resp_length, ret, &struct_var, len_data, len_ptr_data) != SUCCESS)
     {
-        SAFE_FREE(p_struct_var);
-        return MALLOC_ERROR;
+        return OUT_BUFFER_LENGTH_ERROR;
     }
-    SAFE_FREE(p_struct_var);
     return SUCCESS;
 }
 
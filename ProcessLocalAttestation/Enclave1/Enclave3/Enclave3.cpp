@@ -44,7 +44,7 @@
 
 std::map<sgx_enclave_id_t, dh_session_t>g_src_session_info_map;
 
-static uint32_t e3_foo1_wrapper(ms_in_msg_exchange_t *ms, size_t param_lenth, char** resp_buffer, size_t* resp_length);
+static uint32_t e3_foo1_wrapper(ms_in_msg_exchange_t *ms, size_t param_lenth, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length);
 
 //Function pointer table containing the list of functions that the enclave exposes
 const struct {
@@ -88,7 +88,7 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
     size_t out_buff_len;
     dh_session_t *dest_session_info;
     size_t max_out_buff_size;
-    char* retval;
+    uint32_t retval;
 
     max_out_buff_size = 50;
     msg_type = ENCLAVE_TO_ENCLAVE_CALL;
@@ -146,7 +146,6 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
 
     SAFE_FREE(marshalled_inp_buff);
     SAFE_FREE(out_buff);
-    SAFE_FREE(retval);
     return SUCCESS;
 }
 
@@ -162,7 +161,7 @@ uint32_t test_message_exchange(sgx_enclave_id_t src_enclave_id,
     size_t out_buff_len;
     dh_session_t *dest_session_info;
     size_t max_out_buff_size;
-    char* secret_response;
+    uint32_t secret_response;
     uint32_t secret_data;
 
     target_fn_id = 0;
@@ -209,7 +208,6 @@ uint32_t test_message_exchange(sgx_enclave_id_t src_enclave_id,
 
     SAFE_FREE(marshalled_inp_buff);
     SAFE_FREE(out_buff);
-    SAFE_FREE(secret_response);
     return SUCCESS;
 }
 
@@ -234,6 +232,7 @@ uint32_t test_close_session(sgx_enclave_id_t src_enclave_id,
     ke_status = close_session(src_enclave_id, dest_enclave_id);
 
     //Erase the session information associated with the destination enclave id
+    release_session_buffers(&it->second);
     g_src_session_info_map.erase(dest_enclave_id);
     return ke_status;
 }
@@ -262,12 +261,13 @@ extern "C" uint32_t verify_peer_enclave_trust(sgx_dh_session_enclave_identity_t*
 //Each enclave can have its own way of dispatching the calls from other enclave
 extern "C" uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data,
                                                        size_t decrypted_data_length,
-                                                       char** resp_buffer,
+                                                       char* resp_buffer,
+                                                       size_t resp_buffer_size,
                                                        size_t* resp_length)
 {
     ms_in_msg_exchange_t *ms;
-    uint32_t (*fn1)(ms_in_msg_exchange_t *ms, size_t, char**, size_t*);
-    if(!decrypted_data || !resp_length)
+    uint32_t (*fn1)(ms_in_msg_exchange_t *ms, size_t, char*, size_t, size_t*);
+    if(!decrypted_data || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
@@ -276,8 +276,8 @@ extern "C" uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data,
     {
         return INVALID_PARAMETER_ERROR;
     }
-    fn1 = (uint32_t (*)(ms_in_msg_exchange_t*, size_t, char**, size_t*))func_table.table[ms->target_fn_id];
-    return fn1(ms, decrypted_data_length, resp_buffer, resp_length);
+    fn1 = (uint32_t (*)(ms_in_msg_exchange_t*, size_t, char*, size_t, size_t*))func_table.table[ms->target_fn_id];
+    return fn1(ms, decrypted_data_length, resp_buffer, resp_buffer_size, resp_length);
 }
 
 //Operates on the input secret and generates the output secret
@@ -293,13 +293,14 @@ uint32_t get_message_exchange_response(uint32_t inp_secret_data)
 }
 //Generates the response from the request message
 extern "C" uint32_t message_exchange_response_generator(char* decrypted_data,
-                                              char** resp_buffer,
+                                              char* resp_buffer,
+                                              size_t resp_buffer_size,
                                               size_t* resp_length)
 {
     ms_in_msg_exchange_t *ms;
     uint32_t inp_secret_data;
     uint32_t out_secret_data;
-    if(!decrypted_data || !resp_length)
+    if(!decrypted_data || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
@@ -310,8 +311,8 @@ extern "C" uint32_t message_exchange_response_generator(char* decrypted_data,
 
     out_secret_data = get_message_exchange_response(inp_secret_data);
 
-    if(marshal_message_exchange_response(resp_buffer, resp_length, out_secret_data) != SUCCESS)
-        return MALLOC_ERROR;
+    if(marshal_message_exchange_response(resp_buffer, resp_buffer_size, resp_length, out_secret_data) != SUCCESS)
+        return OUT_BUFFER_LENGTH_ERROR;
 
     return SUCCESS;
 
@@ -333,34 +334,29 @@ static uint32_t e3_foo1(param_struct_t *p_struct_var)
 //Function which is executed on request from the source enclave
 static uint32_t e3_foo1_wrapper(ms_in_msg_exchange_t *ms,
                     size_t param_lenth,
-                    char** resp_buffer,
+                    char* resp_buffer,
+                    size_t resp_buffer_size,
                     size_t* resp_length)
 {
     UNUSED(param_lenth);
     
     uint32_t ret;
-    param_struct_t *p_struct_var;
-    if(!ms || !resp_length)
+    param_struct_t struct_var;
+    if(!ms || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
-    p_struct_var = (param_struct_t*)malloc(sizeof(param_struct_t));
-    if(!p_struct_var)
-        return MALLOC_ERROR;
 
-    if(unmarshal_input_parameters_e3_foo1(p_struct_var, ms) != SUCCESS)
+    if(unmarshal_input_parameters_e3_foo1(&struct_var, ms) != SUCCESS)
     {
-        SAFE_FREE(p_struct_var);
         return ATTESTATION_ERROR;
     }
 
-    ret = e3_foo1(p_struct_var);
+    ret = e3_foo1(&struct_var);
 
-    if(marshal_retval_and_output_parameters_e3_foo1(resp_buffer, resp_length, ret, p_struct_var) != SUCCESS)
+    if(marshal_retval_and_output_parameters_e3_foo1(resp_buffer, resp_buffer_size, resp_length, ret, &struct_var) != SUCCESS)
     {
-        SAFE_FREE(p_struct_var);
-        return MALLOC_ERROR;
+        return OUT_BUFFER_LENGTH_ERROR;
     }
-    SAFE_FREE(p_struct_var);
     return SUCCESS;
 }
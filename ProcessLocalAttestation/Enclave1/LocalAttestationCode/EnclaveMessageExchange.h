@@ -44,8 +44,22 @@ extern "C" {
 #endif
 
 uint32_t SGXAPI create_session(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, dh_session_t *p_session_info);
+//The caller must hold p_session_info for the whole exchange, such as under a lock of its own: the exchange
+//reads the session key and may re-establish the session, and the destination expects the nonces in order
 uint32_t SGXAPI send_request_receive_response(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, dh_session_t *p_session_info, char *inp_buff, size_t inp_buff_len, size_t max_out_buff_size, char **out_buff, size_t* out_buff_len);
+//Same exchange through the buffer kept with the session, decrypting the response straight into out_buff, of out_buff_size
+//bytes, so that it allocates nothing once the session's buffer has grown to the size of its messages
+uint32_t SGXAPI send_request_receive_response_in_place(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, dh_session_t *p_session_info, const char *inp_buff, size_t inp_buff_len, char *out_buff, size_t out_buff_size, size_t* out_buff_len);
+//Windowed mode: up to SESSION_WINDOW_SIZE requests in flight, sent by send_request and answered in any order, each
+//response coming with the sequence number send_request gave its request; the caller holds p_session_info for each call.
+//send_request returns WINDOW_FULL_ERROR once the window, or the channel to a peer in another process, holds no more
+uint32_t SGXAPI send_request(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, dh_session_t *p_session_info, char *inp_buff, size_t inp_buff_len, size_t max_out_buff_size, uint32_t *sequence);
+uint32_t SGXAPI receive_response(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, dh_session_t *p_session_info, size_t max_out_buff_size, char **out_buff, size_t* out_buff_len, uint32_t *sequence);
+//Same receive, decrypting the response straight into out_buff, of out_buff_size bytes, so that it allocates nothing
+uint32_t SGXAPI receive_response_in_place(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, dh_session_t *p_session_info, char *out_buff, size_t out_buff_size, size_t* out_buff_len, uint32_t *sequence);
 uint32_t SGXAPI close_session(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id);
+//Frees the buffers kept with a session, before it is discarded or established anew
+void SGXAPI release_session_buffers(dh_session_t *p_session_info);
 
 #ifdef __cplusplus
 }
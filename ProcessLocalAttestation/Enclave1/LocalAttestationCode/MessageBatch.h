@@ -0,0 +1,37 @@
+#include "datatypes.h"
+#include "error_codes.h"
+#include <stddef.h>
+
+#ifndef MESSAGE_BATCH_H_
+#define MESSAGE_BATCH_H_
+
+/*
+ * A batch carries many calls in one secure message, so that the calls share
+ * one encryption, one ocall and one generate_response ecall each way. It is
+ * an ms_in_msg_exchange_t of msg_type MESSAGE_BATCH whose target_fn_id holds
+ * the number of calls and whose inparam_buff holds the calls, each a whole
+ * ms_in_msg_exchange_t of type MESSAGE_EXCHANGE or ENCLAVE_TO_ENCLAVE_CALL,
+ * one after another. The response is an ms_out_msg_exchange_t whose
+ * retval_len holds the number of results and whose ret_outparam_buff holds
+ * the calls' ms_out_msg_exchange_t in the order of the calls. A call that
+ * fails fails the whole batch.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Initiator: packs count marshalled calls into a batch to send in their place
+uint32_t marshal_batch_request(char* const* calls, const size_t* call_lens, uint32_t count, char** marshalled_buff, size_t* marshalled_buff_len);
+
+//Initiator: points results at the count results in the response to a batch, where they lie in out_buff
+uint32_t unmarshal_batch_response(char* out_buff, size_t out_buff_len, uint32_t count, char** results);
+
+//Responder: serves the calls of a batch and packs their results into resp_buffer, of resp_buffer_size bytes
+uint32_t batch_response_generator(char* decrypted_data, size_t decrypted_data_length, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+#include "datatypes.h"
+#include "error_codes.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#ifndef MESSAGE_SERIALIZER_H_
+#define MESSAGE_SERIALIZER_H_
+
+/*
+ * Marshalling of the parameters of enclave to enclave calls, for any list of
+ * trivially copyable arguments. The arguments of a call are packed one after
+ * another in the order they are passed, so the types of the list fix the
+ * layout at compile time: message_layout gives its size and message_arg the
+ * type and offset of each argument. A request holds the input parameters in
+ * the inparam_buff of an ms_in_msg_exchange_t; a response holds the return
+ * value and then the output parameters in the ret_outparam_buff of an
+ * ms_out_msg_exchange_t. The marshal functions write each argument once,
+ * straight into the message, and a message_view reads them where they lie.
+ * The _in_place variants write into a buffer the caller keeps, so that a
+ * call needs no allocation on either side.
+ * A remote function is thus marshalled by naming its argument types:
+ *
+ *     marshal_request(&buff, &buff_len, target_fn_id, ENCLAVE_TO_ENCLAVE_CALL, var1, var2);
+ *     message_view<uint32_t, uint32_t> params = view_request<uint32_t, uint32_t>(ms);
+ *     if(params.valid()) ret = foo(params.get<0>(), params.get<1>());
+ */
+
+//Size of the arguments Args packed one after another
+template<typename... Args> struct message_layout;
+
+template<> struct message_layout<>
+{
+    static const size_t size = 0;
+};
+
+template<typename T, typename... Rest> struct message_layout<T, Rest...>
+{
+    static_assert(std::is_trivially_copyable<T>::value, "message arguments must be trivially copyable");
+    static_assert(!std::is_pointer<T>::value, "message arguments must not be pointers, what they point to stays behind");
+    static const size_t size = sizeof(T) + message_layout<Rest...>::size;
+};
+
+//Type and offset of argument I of Args
+template<size_t I, typename T, typename... Rest> struct message_arg
+{
+    typedef typename message_arg<I - 1, Rest...>::type type;
+    static const size_t offset = sizeof(T) + message_arg<I - 1, Rest...>::offset;
+};
+
+template<typename T, typename... Rest> struct message_arg<0, T, Rest...>
+{
+    typedef T type;
+    static const size_t offset = 0;
+};
+
+//Sizes of the messages of a request with input parameters Args and of a response with return value Ret and output parameters Outs
+template<typename... Args> struct message_request_size
+{
+    static const size_t value = sizeof(ms_in_msg_exchange_t) + message_layout<Args...>::size;
+};
+
+template<typename Ret, typename... Outs> struct message_response_size
+{
+    static const size_t value = sizeof(ms_out_msg_exchange_t) + message_layout<Ret, Outs...>::size;
+};
+
+inline void write_message_args(char*)
+{
+}
+
+template<typename T, typename... Rest>
+inline void write_message_args(char* buff, const T& arg, const Rest&... rest)
+{
+    memcpy(buff, &arg, sizeof(T));
+    write_message_args(buff + sizeof(T), rest...);
+}
+
+//Initiator: marshals a call of target_fn_id with args into buff, of buff_size bytes, which message_request_size<Args...> fills
+template<typename... Args>
+uint32_t marshal_request_in_place(char* buff, size_t buff_size, uint32_t target_fn_id, uint32_t msg_type, size_t* marshalled_buff_len, const Args&... args)
+{
+    ms_in_msg_exchange_t *ms;
+
+    if(!buff || !marshalled_buff_len)
+        return INVALID_PARAMETER_ERROR;
+    if(buff_size < message_request_size<Args...>::value)
+        return OUT_BUFFER_LENGTH_ERROR;
+
+    ms = (ms_in_msg_exchange_t *)buff;
+    ms->msg_type = msg_type;
+    ms->target_fn_id = target_fn_id;
+    ms->inparam_buff_len = (uint32_t)message_layout<Args...>::size;
+    write_message_args(ms->inparam_buff, args...);
+    *marshalled_buff_len = message_request_size<Args...>::value;
+    return SUCCESS;
+}
+
+//Initiator: same, into a buffer allocated for the message, which the caller frees
+template<typename... Args>
+uint32_t marshal_request(char** marshalled_buff, size_t* marshalled_buff_len, uint32_t target_fn_id, uint32_t msg_type, const Args&... args)
+{
+    char *buff;
+    uint32_t ret;
+
+    if(!marshalled_buff || !marshalled_buff_len)
+        return INVALID_PARAMETER_ERROR;
+    buff = (char*)malloc(message_request_size<Args...>::value);
+    if(!buff)
+        return MALLOC_ERROR;
+
+    ret = marshal_request_in_place(buff, message_request_size<Args...>::value, target_fn_id, msg_type, marshalled_buff_len, args...);
+    if(ret != SUCCESS)
+    {
+        SAFE_FREE(buff);
+        return ret;
+    }
+    *marshalled_buff = buff;
+    return SUCCESS;
+}
+
+//Responder: marshals the return value and the output parameters of a call into buff, of buff_size bytes, which
+//message_response_size<Ret, Outs...> fills
+template<typename Ret, typename... Outs>
+uint32_t marshal_response_in_place(char* buff, size_t buff_size, size_t* resp_length, const Ret& retval, const Outs&... outs)
+{
+    ms_out_msg_exchange_t *ms;
+
+    if(!buff || !resp_length)
+        return INVALID_PARAMETER_ERROR;
+    if(buff_size < message_response_size<Ret, Outs...>::value)
+        return OUT_BUFFER_LENGTH_ERROR;
+
+    ms = (ms_out_msg_exchange_t *)buff;
+    ms->retval_len = (uint32_t)sizeof(Ret);
+    ms->ret_outparam_buff_len = (uint32_t)message_layout<Ret, Outs...>::size;
+    write_message_args(ms->ret_outparam_buff, retval, outs...);
+    *resp_length = message_response_size<Ret, Outs...>::value;
+    return SUCCESS;
+}
+
+//Responder: same, into a buffer allocated for the response, which the caller frees
+template<typename Ret, typename... Outs>
+uint32_t marshal_response(char** resp_buffer, size_t* resp_length, const Ret& retval, const Outs&... outs)
+{
+    char *buff;
+    uint32_t ret;
+
+    if(!resp_buffer || !resp_length)
+        return INVALID_PARAMETER_ERROR;
+    buff = (char*)malloc(message_response_size<Ret, Outs...>::value);
+    if(!buff)
+        return MALLOC_ERROR;
+
+    ret = marshal_response_in_place(buff, message_response_size<Ret, Outs...>::value, resp_length, retval, outs...);
+    if(ret != SUCCESS)
+    {
+        SAFE_FREE(buff);
+        return ret;
+    }
+    *resp_buffer = buff;
+    return SUCCESS;
+}
+
+//The arguments Args of a message, read where they lie in it; not valid if the message does not hold exactly Args
+template<typename... Args>
+struct message_view
+{
+    const char* buff;
+
+    bool valid() const
+    {
+        return buff != NULL;
+    }
+
+    //Argument I, copied out since the message does not keep it aligned
+    template<size_t I> typename message_arg<I, Args...>::type get() const
+    {
+        typename message_arg<I, Args...>::type value;
+        memcpy(&value, buff + message_arg<I, Args...>::offset, sizeof(value));
+        return value;
+    }
+};
+
+//Responder: the input parameters Args of a request
+template<typename... Args>
+message_view<Args...> view_request(const ms_in_msg_exchange_t* ms)
+{
+    message_view<Args...> view;
+    view.buff = (ms && ms->inparam_buff_len == message_layout<Args...>::size) ? ms->inparam_buff : NULL;
+    return view;
+}
+
+//Initiator: the return value Ret, argument 0, and the output parameters Outs of a response
+template<typename Ret, typename... Outs>
+message_view<Ret, Outs...> view_response(const ms_out_msg_exchange_t* ms)
+{
+    message_view<Ret, Outs...> view;
+    view.buff = (ms && ms->retval_len == sizeof(Ret) && ms->ret_outparam_buff_len == message_layout<Ret, Outs...>::size) ?
+                ms->ret_outparam_buff : NULL;
+    return view;
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include "sgx_trts.h"
+#include "sgx_tcrypto.h"
+#include "sgx_spinlock.h"
+#include "SessionCache.h"
+#include "LocalAttestationCode_t.h"
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t verify_peer_enclave_trust(sgx_dh_session_enclave_identity_t* peer_enclave_identity);
+
+#ifdef __cplusplus
+}
+#endif
+
+typedef struct _session_cache_entry_t
+{
+    uint32_t in_use;
+    sgx_enclave_id_t peer_enclave_id;
+    sgx_dh_session_enclave_identity_t peer_identity;
+    uint8_t ticket[SESSION_TICKET_SIZE];
+    sgx_key_128bit_t secret; //Resumption secret, never used as a session key itself
+    uint64_t expiry; //Untrusted clock, seconds
+    uint32_t resumes_left;
+} session_cache_entry_t;
+
+//Input of the key derivations
+typedef struct _session_kdf_input_t
+{
+    char label[16];
+    uint8_t initiator_nonce[NONCE_SIZE];
+    uint8_t responder_nonce[NONCE_SIZE];
+    uint32_t session_id;
+} session_kdf_input_t;
+
+static session_cache_entry_t g_session_cache[SESSION_CACHE_SIZE];
+static sgx_spinlock_t g_session_cache_lock = SGX_SPINLOCK_INITIALIZER;
+
+static uint64_t session_clock()
+{
+    uint64_t now = 0;
+    if(session_clock_ocall(&now) != SGX_SUCCESS)
+    {
+        return (uint64_t)-1;    //Treat every entry as expired
+    }
+    return now;
+}
+
+//CMAC of label, the nonces and the session id under key
+static sgx_status_t derive(const sgx_key_128bit_t* key, const char* label, const uint8_t* initiator_nonce,
+                           const uint8_t* responder_nonce, uint32_t session_id, uint8_t* out)
+{
+    session_kdf_input_t input;
+    memset(&input, 0, sizeof(input));
+    strncpy(input.label, label, sizeof(input.label));
+    if(initiator_nonce)
+        memcpy(input.initiator_nonce, initiator_nonce, NONCE_SIZE);
+    if(responder_nonce)
+        memcpy(input.responder_nonce, responder_nonce, NONCE_SIZE);
+    input.session_id = session_id;
+    return sgx_rijndael128_cmac_msg((const sgx_cmac_128bit_key_t*)key, (const uint8_t*)&input, sizeof(input),
+                                    (sgx_cmac_128bit_tag_t*)out);
+}
+
+static bool equal(const uint8_t* a, const uint8_t* b, size_t length)
+{
+    uint8_t diff = 0;
+    for(size_t i = 0; i < length; i++)
+    {
+        diff |= (uint8_t)(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+static void drop(session_cache_entry_t* entry)
+{
+    memset(entry, 0, sizeof(session_cache_entry_t));
+}
+
+//The live entry for peer_enclave_id, matching ticket unless it is NULL; the lock must be held
+static session_cache_entry_t* find(sgx_enclave_id_t peer_enclave_id, const uint8_t* ticket, uint64_t now)
+{
+    for(int i = 0; i < SESSION_CACHE_SIZE; i++)
+    {
+        session_cache_entry_t* entry = &g_session_cache[i];
+        if(!entry->in_use || entry->peer_enclave_id != peer_enclave_id)
+            continue;
+        if(ticket && !equal(entry->ticket, ticket, SESSION_TICKET_SIZE))
+            continue;
+        if(now >= entry->expiry || entry->resumes_left == 0)
+        {
+            drop(entry);
+            continue;
+        }
+        return entry;
+    }
+    return NULL;
+}
+
+void session_cache_store(sgx_enclave_id_t peer_enclave_id, const sgx_dh_session_enclave_identity_t* peer_identity, const sgx_key_128bit_t* aek)
+{
+    session_cache_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.in_use = 1;
+    entry.peer_enclave_id = peer_enclave_id;
+    memcpy(&entry.peer_identity, peer_identity, sizeof(sgx_dh_session_enclave_identity_t));
+    if(derive(aek, "LA resume secret", NULL, NULL, 0, entry.secret) != SGX_SUCCESS ||
+       derive(aek, "LA resume ticket", NULL, NULL, 0, entry.ticket) != SGX_SUCCESS)
+    {
+        drop(&entry);
+        return;
+    }
+    uint64_t now = session_clock();
+    entry.expiry = now + SESSION_CACHE_LIFETIME_SEC;
+    entry.resumes_left = SESSION_CACHE_MAX_RESUMES;
+
+    //Drop the peer's previous entries, whatever identity they were for, so that only this one is offered, and take a
+    //free entry, else the one expiring first
+    sgx_spin_lock(&g_session_cache_lock);
+    session_cache_entry_t* slot = NULL;
+    for(int i = 0; i < SESSION_CACHE_SIZE; i++)
+    {
+        session_cache_entry_t* candidate = &g_session_cache[i];
+        if(candidate->in_use && candidate->peer_enclave_id == peer_enclave_id)
+            drop(candidate);
+        if(!slot || (slot->in_use && (!candidate->in_use || candidate->expiry < slot->expiry)))
+            slot = candidate;
+    }
+    memcpy(slot, &entry, sizeof(entry));
+    sgx_spin_unlock(&g_session_cache_lock);
+    drop(&entry);
+}
+
+void session_cache_hello(sgx_enclave_id_t peer_enclave_id, session_hello_t* hello)
+{
+    memset(hello, 0, sizeof(session_hello_t));
+    if(sgx_read_rand(hello->nonce, NONCE_SIZE) != SGX_SUCCESS)
+        return;
+
+    uint64_t now = session_clock();
+    sgx_spin_lock(&g_session_cache_lock);
+    session_cache_entry_t* entry = find(peer_enclave_id, NULL, now);
+    if(entry)
+    {
+        hello->resume = 1;
+        memcpy(hello->ticket, entry->ticket, SESSION_TICKET_SIZE);
+    }
+    sgx_spin_unlock(&g_session_cache_lock);
+}
+
+ATTESTATION_STATUS session_cache_accept(sgx_enclave_id_t peer_enclave_id, const session_hello_t* hello, uint32_t session_id, session_resume_t* resume, sgx_key_128bit_t* aek)
+{
+    session_cache_entry_t entry;
+    ATTESTATION_STATUS status = INVALID_SESSION;
+
+    memset(resume, 0, sizeof(session_resume_t));
+    if(!hello->resume)
+        return INVALID_SESSION;
+
+    uint64_t now = session_clock();
+    sgx_spin_lock(&g_session_cache_lock);
+    session_cache_entry_t* found = find(peer_enclave_id, hello->ticket, now);
+    if(found)
+    {
+        found->resumes_left--;
+        memcpy(&entry, found, sizeof(entry));
+    }
+    sgx_spin_unlock(&g_session_cache_lock);
+    if(!found)
+        return INVALID_SESSION;
+
+    //The trust policy may have changed since the peer was verified
+    if(verify_peer_enclave_trust(&entry.peer_identity) == SUCCESS &&
+       sgx_read_rand(resume->nonce, NONCE_SIZE) == SGX_SUCCESS &&
+       derive(&entry.secret, "LA resume key", hello->nonce, resume->nonce, session_id, *aek) == SGX_SUCCESS &&
+       derive(&entry.secret, "LA resume accept", hello->nonce, resume->nonce, session_id, resume->mac) == SGX_SUCCESS)
+    {
+        resume->accepted = 1;
+        resume->session_id = session_id;
+        status = SUCCESS;
+    }
+    else
+    {
+        memset(resume, 0, sizeof(session_resume_t));
+        memset(aek, 0, sizeof(sgx_key_128bit_t));
+    }
+    drop(&entry);
+    return status;
+}
+
+ATTESTATION_STATUS session_cache_resume(sgx_enclave_id_t peer_enclave_id, const session_hello_t* hello, const session_resume_t* resume, sgx_key_128bit_t* aek)
+{
+    session_cache_entry_t entry;
+    uint8_t mac[MAC_SIZE];
+    ATTESTATION_STATUS status = INVALID_SESSION;
+
+    if(!hello->resume || !resume->accepted)
+        return INVALID_SESSION;
+
+    uint64_t now = session_clock();
+    sgx_spin_lock(&g_session_cache_lock);
+    session_cache_entry_t* found = find(peer_enclave_id, hello->ticket, now);
+    if(found)
+    {
+        found->resumes_left--;
+        memcpy(&entry, found, sizeof(entry));
+    }
+    sgx_spin_unlock(&g_session_cache_lock);
+    if(!found)
+        return INVALID_SESSION;
+
+    if(verify_peer_enclave_trust(&entry.peer_identity) == SUCCESS &&
+       derive(&entry.secret, "LA resume accept", hello->nonce, resume->nonce, resume->session_id, mac) == SGX_SUCCESS &&
+       equal(mac, resume->mac, MAC_SIZE) &&
+       derive(&entry.secret, "LA resume key", hello->nonce, resume->nonce, resume->session_id, *aek) == SGX_SUCCESS)
+    {
+        status = SUCCESS;
+    }
+    else
+    {
+        memset(aek, 0, sizeof(sgx_key_128bit_t));
+    }
+    drop(&entry);
+    return status;
+}
@@ -0,0 +1,46 @@
+#include "datatypes.h"
+#include "error_codes.h"
+#include "sgx_eid.h"
+#include "sgx_dh.h"
+
+#ifndef SESSION_CACHE_H_
+#define SESSION_CACHE_H_
+
+/*
+ * Sessions established with the full sgx_dh exchange leave a resumption
+ * secret and a ticket naming it, both derived from the session key, in a
+ * cache keyed by the peer's identity (MRENCLAVE, MRSIGNER) and enclave id.
+ * A later session with the same peer starts with a session_hello_t carrying
+ * the ticket; if the responder still holds it, both sides derive a fresh
+ * session key from the secret and their nonces and skip the DH exchange.
+ *
+ * Entries expire SESSION_CACHE_LIFETIME_SEC after the full exchange, as
+ * read from the untrusted clock, and after SESSION_CACHE_MAX_RESUMES
+ * resumptions, which bounds their life when the clock is not honest.
+ */
+
+#define SESSION_CACHE_SIZE          16
+#define SESSION_CACHE_LIFETIME_SEC  600
+#define SESSION_CACHE_MAX_RESUMES   64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Caches the session just established with peer_enclave_id through the full DH exchange
+void session_cache_store(sgx_enclave_id_t peer_enclave_id, const sgx_dh_session_enclave_identity_t* peer_identity, const sgx_key_128bit_t* aek);
+
+//Initiator: fills the hello, asking to resume the session cached for peer_enclave_id if there is one
+void session_cache_hello(sgx_enclave_id_t peer_enclave_id, session_hello_t* hello);
+
+//Responder: accepts the hello if it names a live cached session, filling the answer and the key of session_id
+ATTESTATION_STATUS session_cache_accept(sgx_enclave_id_t peer_enclave_id, const session_hello_t* hello, uint32_t session_id, session_resume_t* resume, sgx_key_128bit_t* aek);
+
+//Initiator: checks the responder's acceptance of the hello and derives the key of the resumed session
+ATTESTATION_STATUS session_cache_resume(sgx_enclave_id_t peer_enclave_id, const session_hello_t* hello, const session_resume_t* resume, sgx_key_128bit_t* aek);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+#include "datatypes.h"
+#include "error_codes.h"
+#include "sgx_eid.h"
+#include "dh_session_protocol.h"
+
+#ifndef SESSION_TABLE_H_
+#define SESSION_TABLE_H_
+
+/*
+ * The sessions a responder holds, one per peer enclave, in a fixed table of
+ * SESSION_TABLE_CAPACITY slots. A session id is the index of its slot plus
+ * SESSION_TABLE_CAPACITY times a generation counter bumped every time the
+ * slot is recycled, so finding a session by id reads a single slot and the
+ * id of an ended session never reaches the slot's next session. Sessions are
+ * found by peer enclave id through an open-addressing index with linear
+ * probing, twice the capacity in size and split into SESSION_TABLE_STRIPES
+ * ranges of buckets with a lock each.
+ *
+ * Each slot has its own lock. session_table_acquire and
+ * session_table_acquire_peer return the session locked and it stays locked
+ * until session_table_release, so threads serving different sessions never
+ * wait for each other. Creating and removing sessions are serialized by a
+ * table-wide lock on top, which they take before any slot lock; a session
+ * must not be held while creating or removing one.
+ */
+
+#ifndef SESSION_TABLE_CAPACITY
+#define SESSION_TABLE_CAPACITY  4096    //Power of two
+#endif
+#define SESSION_TABLE_STRIPES   64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Reserves a slot for a new IN_PROGRESS session with peer_enclave_id, which must not have one already
+ATTESTATION_STATUS session_table_create(sgx_enclave_id_t peer_enclave_id, uint32_t* session_id);
+
+//Locks and returns session_id if it is live and belongs to peer_enclave_id, else returns NULL
+dh_session_t* session_table_acquire(uint32_t session_id, sgx_enclave_id_t peer_enclave_id);
+
+//Locks and returns the session with peer_enclave_id, or returns NULL
+dh_session_t* session_table_acquire_peer(sgx_enclave_id_t peer_enclave_id);
+
+//Unlocks a session returned by session_table_acquire*
+void session_table_release(dh_session_t* session);
+
+//Ends session_id, erasing its keys and recycling its slot
+ATTESTATION_STATUS session_table_remove(uint32_t session_id);
+
+//Ends the session with peer_enclave_id
+ATTESTATION_STATUS session_table_remove_peer(sgx_enclave_id_t peer_enclave_id);
+
+//Number of live sessions
+uint32_t session_table_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
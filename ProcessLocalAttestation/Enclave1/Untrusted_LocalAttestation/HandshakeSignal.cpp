@@ -0,0 +1,75 @@
+#include "HandshakeSignal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <time.h>
+
+static sem_t* g_handshake_sem[HANDSHAKE_EVENT_COUNT];
+
+static const char* g_handshake_event_name[HANDSHAKE_EVENT_COUNT] = {
+    "message1", "message2", "message3", "the session hello", "the answer to the session hello"
+};
+
+//Opens, creating it if the peer has not yet, the semaphore behind event
+static sem_t* handshake_sem(handshake_event_t event)
+{
+    if (event < 0 || event >= HANDSHAKE_EVENT_COUNT)
+        return NULL;
+
+    if (g_handshake_sem[event] == NULL)
+    {
+        char name[64];
+        key_t key = ftok("../..", 6);
+        snprintf(name, sizeof(name), "/sgx_la_handshake_%08x_%d", (unsigned int)key, (int)event + 1);
+
+        sem_t* sem = sem_open(name, O_CREAT, 0666, 0);
+        if (sem == SEM_FAILED)
+        {
+            printf("[OCALL IPC] Failed to open %s: %s\n", name, strerror(errno));
+            return NULL;
+        }
+        g_handshake_sem[event] = sem;
+    }
+    return g_handshake_sem[event];
+}
+
+int handshake_signal(handshake_event_t event)
+{
+    sem_t* sem = handshake_sem(event);
+    if (sem == NULL || sem_post(sem) != 0)
+        return -1;
+    return 0;
+}
+
+int handshake_wait(handshake_event_t event, unsigned int timeout_sec)
+{
+    sem_t* sem = handshake_sem(event);
+    if (sem == NULL)
+        return -1;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_sec;
+
+    while (sem_timedwait(sem, &deadline) != 0)
+    {
+        if (errno == EINTR)
+            continue;
+        if (errno == ETIMEDOUT)
+            printf("[OCALL IPC] Timed out after %u seconds waiting for %s\n", timeout_sec, g_handshake_event_name[event]);
+        return -1;
+    }
+    return 0;
+}
+
+void handshake_reset(handshake_event_t event)
+{
+    sem_t* sem = handshake_sem(event);
+    if (sem == NULL)
+        return;
+    while (sem_trywait(sem) == 0)
+        ;
+}
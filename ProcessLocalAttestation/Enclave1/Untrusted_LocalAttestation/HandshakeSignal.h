@@ -0,0 +1,36 @@
+#ifndef HANDSHAKE_SIGNAL_H_
+#define HANDSHAKE_SIGNAL_H_
+
+/*
+ * Cross-process signaling for the DH handshake between the Enclave1
+ * (initiator) and Enclave2 (responder) processes. Each message is still
+ * passed in its System V shared memory segment; the writer posts the
+ * matching event once the message is in place and the reader blocks on it
+ * instead of sleeping for a fixed time.
+ *
+ * The events are named POSIX semaphores derived from ftok("../..", 6), so
+ * both processes find them the same way they find the segments.
+ */
+
+/* How long either side waits for its peer before giving up on the session */
+#define HANDSHAKE_TIMEOUT_SEC 30
+
+typedef enum handshake_event {
+    HANDSHAKE_MSG1_READY = 0,   /* session id and message1 written by the responder */
+    HANDSHAKE_MSG2_READY,       /* message2 written by the initiator */
+    HANDSHAKE_MSG3_READY,       /* message3 written by the responder */
+    HANDSHAKE_HELLO_READY,      /* session hello written by the initiator */
+    HANDSHAKE_RESUME_READY,     /* answer to the hello written by the responder */
+    HANDSHAKE_EVENT_COUNT
+} handshake_event_t;
+
+/* Wakes the peer waiting on event. Returns 0 on success, -1 on failure. */
+int handshake_signal(handshake_event_t event);
+
+/* Blocks until event is signaled or timeout_sec elapse. Returns 0 on success, -1 on timeout or failure. */
+int handshake_wait(handshake_event_t event, unsigned int timeout_sec);
+
+/* Drops signals left over from an earlier, interrupted handshake */
+void handshake_reset(handshake_event_t event);
+
+#endif
@@ -0,0 +1,178 @@
+#include "SessionChannel.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static inline void cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+//The segment is shared between processes, so no FUTEX_PRIVATE_FLAG
+static void doorbell_sleep(uint32_t* doorbell, uint32_t seen, uint64_t timeout_ns)
+{
+    struct timespec timeout;
+    timeout.tv_sec = (time_t)(timeout_ns / 1000000000ULL);
+    timeout.tv_nsec = (long)(timeout_ns % 1000000000ULL);
+    syscall(SYS_futex, doorbell, FUTEX_WAIT, seen, &timeout, NULL, 0);
+}
+
+static void doorbell_ring(channel_ring_t* ring)
+{
+    __atomic_add_fetch(&ring->doorbell, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->sleepers, __ATOMIC_SEQ_CST) != 0)
+        syscall(SYS_futex, &ring->doorbell, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+static int ring_has_data(channel_ring_t* ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+}
+
+static int ring_has_space(channel_ring_t* ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_RELAXED) - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) < CHANNEL_RING_SLOTS;
+}
+
+/*
+ * Polls ready, then sleeps on the doorbell until it holds. A sleeper counts
+ * itself in sleepers before its last check, and the peer bumps doorbell
+ * before reading sleepers, so a wake-up cannot be lost between the two.
+ */
+static int ring_wait(channel_ring_t* ring, int (*ready)(channel_ring_t*), unsigned int timeout_sec)
+{
+    //Polling only helps if the peer can run meanwhile
+    static const int spin_count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? CHANNEL_SPIN_COUNT : 0;
+
+    for (int spin = 0; spin < spin_count; spin++)
+    {
+        if (ready(ring))
+            return 0;
+        cpu_relax();
+    }
+
+    uint64_t deadline = monotonic_ns() + (uint64_t)timeout_sec * 1000000000ULL;
+    for (;;)
+    {
+        uint32_t seen = __atomic_load_n(&ring->doorbell, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+        int is_ready = ready(ring);
+        uint64_t now = monotonic_ns();
+        if (!is_ready && now < deadline)
+            doorbell_sleep(&ring->doorbell, seen, deadline - now);
+        __atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+
+        if (is_ready || ready(ring))
+            return 0;
+        if (monotonic_ns() >= deadline)
+            return -1;
+    }
+}
+
+channel_slot_t* channel_ring_reserve(channel_ring_t* ring, unsigned int timeout_sec)
+{
+    if (ring_wait(ring, ring_has_space, timeout_sec) != 0)
+        return NULL;
+    return &ring->slots[ring->head & (CHANNEL_RING_SLOTS - 1)];
+}
+
+void channel_ring_publish(channel_ring_t* ring)
+{
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_SEQ_CST);
+    doorbell_ring(ring);
+}
+
+channel_slot_t* channel_ring_peek(channel_ring_t* ring, unsigned int timeout_sec)
+{
+    if (ring_wait(ring, ring_has_data, timeout_sec) != 0)
+        return NULL;
+    return &ring->slots[ring->tail & (CHANNEL_RING_SLOTS - 1)];
+}
+
+void channel_ring_release(channel_ring_t* ring)
+{
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_SEQ_CST);
+    doorbell_ring(ring);
+}
+
+static void session_channel_name(uint32_t session_id, char* name, size_t name_size)
+{
+    snprintf(name, name_size, "%s%u", CHANNEL_SHM_PREFIX, session_id);
+}
+
+session_channel_t* session_channel_open(uint32_t session_id, int create)
+{
+    char name[64];
+    struct stat info;
+
+    session_channel_name(session_id, name, sizeof(name));
+    int fd = shm_open(name, create ? O_RDWR|O_CREAT : O_RDWR, 0666);
+    if (fd == -1)
+    {
+        printf("[OCALL IPC] Failed to open the shared memory of session %u: %s\n", session_id, strerror(errno));
+        return NULL;
+    }
+    //The creator sizes it, replacing whatever size an older build left; the peer finds it sized
+    if ((create && ftruncate(fd, sizeof(channel_region_t)) != 0) ||
+        fstat(fd, &info) != 0 || (size_t)info.st_size != sizeof(channel_region_t))
+    {
+        printf("[OCALL IPC] Shared memory of session %u has the wrong size\n", session_id);
+        close(fd);
+        return NULL;
+    }
+
+    void* region = mmap(NULL, sizeof(channel_region_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED)
+    {
+        printf("[OCALL IPC] Failed to map the shared memory of session %u: %s\n", session_id, strerror(errno));
+        return NULL;
+    }
+
+    session_channel_t* channel = (session_channel_t*)malloc(sizeof(session_channel_t));
+    if (!channel)
+    {
+        munmap(region, sizeof(channel_region_t));
+        return NULL;
+    }
+    if (create)
+        memset(region, 0, sizeof(channel_region_t));
+
+    channel->region = (channel_region_t*)region;
+    channel->session_id = session_id;
+    channel->next_sequence = 0;
+    channel->fetched = 0;
+    return channel;
+}
+
+void session_channel_close(session_channel_t* channel, int remove)
+{
+    char name[64];
+
+    if (!channel)
+        return;
+    munmap(channel->region, sizeof(channel_region_t));
+    if (remove)
+    {
+        session_channel_name(channel->session_id, name, sizeof(name));
+        shm_unlink(name);
+    }
+    free(channel);
+}
@@ -0,0 +1,91 @@
+#ifndef SESSION_CHANNEL_H_
+#define SESSION_CHANNEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Transport for the secure_message_t requests and responses of a session
+ * whose enclaves live in different processes. Once the handshake is done
+ * both processes map one POSIX shared memory object for the session, named
+ * CHANNEL_SHM_PREFIX followed by the full session id so that no two live
+ * sessions share it, holding a single-producer single-consumer ring per
+ * direction. Messages go through as they are, encrypted with the session key.
+ *
+ * Each side polls the ring indexes before sleeping on the ring's doorbell,
+ * a futex word in the segment, and rings the doorbell only when the peer is
+ * asleep, so a steady stream of calls makes no system calls.
+ */
+
+#define CHANNEL_SHM_PREFIX   "/sgx101_session_"
+#define CHANNEL_RING_SLOTS   16         /* power of two */
+#define CHANNEL_SLOT_SIZE    4096       /* largest secure_message_t, header included */
+#define CHANNEL_SPIN_COUNT   (1 << 14)  /* polls before sleeping on the doorbell, on SMP */
+#define CHANNEL_TIMEOUT_SEC  30         /* longest wait for the peer */
+
+#define CHANNEL_CACHE_LINE   64
+
+typedef enum channel_msg_type {
+    CHANNEL_REQUEST = 1,    /* secure_message_t for the peer's generate_response */
+    CHANNEL_END_SESSION,    /* no message, ends the session at the peer */
+    CHANNEL_RESPONSE        /* status and, for a request, the secure_message_t response */
+} channel_msg_type_t;
+
+typedef struct channel_slot {
+    uint32_t type;              /* channel_msg_type_t */
+    uint32_t status;            /* ATTESTATION_STATUS of a response */
+    uint64_t sequence;          /* copied from the request into its response */
+    uint64_t max_payload_size;  /* of a request's response */
+    uint64_t length;            /* bytes of message used */
+    uint8_t message[CHANNEL_SLOT_SIZE];
+} channel_slot_t;
+
+typedef struct channel_ring {
+    uint32_t head;              /* slots published, written by the producer only */
+    uint8_t pad0[CHANNEL_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t tail;              /* slots released, written by the consumer only */
+    uint8_t pad1[CHANNEL_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t doorbell;          /* futex word, bumped on every publish and release */
+    uint32_t sleepers;          /* sides asleep on doorbell */
+    uint8_t pad2[CHANNEL_CACHE_LINE - 2 * sizeof(uint32_t)];
+    channel_slot_t slots[CHANNEL_RING_SLOTS];
+} channel_ring_t;
+
+/* The shared memory segment of a session */
+typedef struct channel_region {
+    channel_ring_t request;     /* initiator to responder */
+    channel_ring_t response;    /* responder to initiator */
+} channel_region_t;
+
+typedef struct session_channel {
+    channel_region_t* region;
+    uint32_t session_id;
+    uint64_t next_sequence;     /* of the next request posted */
+    uint64_t fetched;           /* responses taken, so next_sequence - fetched requests are in flight */
+} session_channel_t;
+
+/*
+ * Maps the shared memory of session_id. The responder creates it, clearing
+ * whatever an earlier run left, before it sends message3; the initiator maps
+ * the existing one once it has message3. Returns NULL on failure.
+ */
+session_channel_t* session_channel_open(uint32_t session_id, int create);
+
+/* Unmaps the shared memory and, if remove is set, deletes it */
+void session_channel_close(session_channel_t* channel, int remove);
+
+/*
+ * Producer side: waits up to timeout_sec for a free slot and returns it to
+ * be filled in place, then channel_ring_publish hands it to the consumer.
+ */
+channel_slot_t* channel_ring_reserve(channel_ring_t* ring, unsigned int timeout_sec);
+void channel_ring_publish(channel_ring_t* ring);
+
+/*
+ * Consumer side: waits up to timeout_sec for the oldest published slot and
+ * returns it, then channel_ring_release gives it back to the producer.
+ */
+channel_slot_t* channel_ring_peek(channel_ring_t* ring, unsigned int timeout_sec);
+void channel_ring_release(channel_ring_t* ring);
+
+#endif
@@ -36,26 +36,167 @@
 #include "sgx_urts.h"
 #include "UntrustedEnclaveMessageExchange.h"
 #include "sgx_dh.h"
+#include "HandshakeSignal.h"
+#include "SessionChannel.h"
+#include <deque>
 #include <map>
+#include <mutex>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <vector>
 
 std::map<sgx_enclave_id_t, uint32_t>g_enclave_id_map;
 
+//Shared memory channels of the sessions with enclaves hosted by another process, by peer enclave id
+std::map<sgx_enclave_id_t, session_channel_t*>g_session_channel_map;
+
+//Detaches the channel of the session with dest_enclave_id, if any
+static void close_session_channel(sgx_enclave_id_t dest_enclave_id, int remove)
+{
+    std::map<sgx_enclave_id_t, session_channel_t*>::iterator it = g_session_channel_map.find(dest_enclave_id);
+    if(it != g_session_channel_map.end())
+    {
+        session_channel_close(it->second, remove);
+        g_session_channel_map.erase(it);
+    }
+}
+
+//Attaches the channel of a session being established with an enclave hosted by another process
+static void open_session_channel(sgx_enclave_id_t dest_enclave_id, uint32_t session_id, int create)
+{
+    close_session_channel(dest_enclave_id, create);
+    session_channel_t* channel = session_channel_open(session_id, create);
+    if (channel)
+    {
+        g_session_channel_map.insert(std::pair<sgx_enclave_id_t, session_channel_t*>(dest_enclave_id, channel));
+    }
+}
+
+//The channel of the session with dest_enclave_id, if it is hosted by another process
+static session_channel_t* find_session_channel(sgx_enclave_id_t dest_enclave_id)
+{
+    std::map<sgx_enclave_id_t, session_channel_t*>::iterator it = g_session_channel_map.find(dest_enclave_id);
+    if(it == g_session_channel_map.end())
+    {
+        return NULL;
+    }
+    return it->second;
+}
+
+//Puts a request for the enclave hosted by another process in the session channel, sequence receives its place in the channel
+static ATTESTATION_STATUS post_to_session_channel(session_channel_t* channel, channel_msg_type_t type, secure_message_t* req_message, size_t req_message_size, size_t max_payload_size, uint64_t* sequence)
+{
+    if (req_message_size > CHANNEL_SLOT_SIZE)
+    {
+        return OUT_BUFFER_LENGTH_ERROR;
+    }
+
+    channel_slot_t* slot = channel_ring_reserve(&channel->region->request, CHANNEL_TIMEOUT_SEC);
+    if (!slot)
+    {
+        return INVALID_SESSION;
+    }
+    *sequence = channel->next_sequence++;
+    slot->type = type;
+    slot->status = SUCCESS;
+    slot->sequence = *sequence;
+    slot->max_payload_size = max_payload_size;
+    slot->length = req_message_size;
+    if (req_message_size)
+    {
+        memcpy(slot->message, req_message, req_message_size);
+    }
+    channel_ring_publish(&channel->region->request);
+    return SUCCESS;
+}
+
+//Takes the next response out of the session channel, which must answer the request at sequence unless it is NULL
+static ATTESTATION_STATUS fetch_from_session_channel(session_channel_t* channel, const uint64_t* sequence, secure_message_t* resp_message, size_t resp_message_size)
+{
+    channel_slot_t* slot = channel_ring_peek(&channel->region->response, CHANNEL_TIMEOUT_SEC);
+    if (!slot)
+    {
+        return INVALID_SESSION;
+    }
+
+    ATTESTATION_STATUS status = slot->status;
+    if (slot->type != CHANNEL_RESPONSE || (sequence && slot->sequence != *sequence))
+    {
+        status = INVALID_SESSION;
+    }
+    else if (status == SUCCESS && resp_message)
+    {
+        if (slot->length > resp_message_size)
+            status = OUT_BUFFER_LENGTH_ERROR;
+        else
+            memcpy(resp_message, slot->message, slot->length);
+    }
+    channel_ring_release(&channel->region->response);
+    channel->fetched++;
+    return status;
+}
+
+//Passes a request to an enclave hosted by another process through the session channel and waits for its response
+static ATTESTATION_STATUS forward_to_session_channel(sgx_enclave_id_t dest_enclave_id, channel_msg_type_t type, secure_message_t* req_message, size_t req_message_size, size_t max_payload_size, secure_message_t* resp_message, size_t resp_message_size)
+{
+    session_channel_t* channel = find_session_channel(dest_enclave_id);
+    if (!channel)
+    {
+        return INVALID_SESSION;
+    }
+
+    uint64_t sequence;
+    ATTESTATION_STATUS status = post_to_session_channel(channel, type, req_message, req_message_size, max_payload_size, &sequence);
+    if (status != SUCCESS)
+    {
+        return status;
+    }
+    return fetch_from_session_channel(channel, &sequence, resp_message, resp_message_size);
+}
+
 //Makes an sgx_ecall to the destination enclave to get session id and message1
 ATTESTATION_STATUS session_request_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, sgx_dh_msg1_t* dh_msg1, uint32_t* session_id)
 {
 	uint32_t status = 0;
 	sgx_status_t ret = SGX_SUCCESS;
+	uint32_t temp_enclave_no;
+
+	std::map<sgx_enclave_id_t, uint32_t>::iterator it = g_enclave_id_map.find(dest_enclave_id);
+    if(it != g_enclave_id_map.end())
+	{
+		//The destination enclave is hosted by this process
+		temp_enclave_no = it->second;
+		switch(temp_enclave_no)
+		{
+			case 1:
+				ret = Enclave1_session_request(dest_enclave_id, &status, src_enclave_id, dh_msg1, session_id);
+				break;
+			case 2:
+				ret = Enclave2_session_request(dest_enclave_id, &status, src_enclave_id, dh_msg1, session_id);
+				break;
+			case 3:
+				ret = Enclave3_session_request(dest_enclave_id, &status, src_enclave_id, dh_msg1, session_id);
+				break;
+		}
+		if (ret == SGX_SUCCESS)
+			return (ATTESTATION_STATUS)status;
+		else
+		    return INVALID_SESSION;
+	}
+
+    // Enclave2 only sends msg3 after this session's msg2, so any pending one is stale
+    handshake_reset(HANDSHAKE_MSG3_READY);
 
     // wait for Enclave2 to fill msg1
     printf("[OCALL IPC] Waiting for Enclave2 to generate SessionID and message1...\n");
-    sleep(5);
+    if (handshake_wait(HANDSHAKE_MSG1_READY, HANDSHAKE_TIMEOUT_SEC) != 0)
+        return INVALID_SESSION;
 
-    printf("[OCALL IPC] SessionID and message1 should be ready\n");
+    printf("[OCALL IPC] SessionID and message1 are ready\n");
 
     // for session id
     printf("[OCALL IPC] Retriving SessionID from shared memory\n");
@@ -86,6 +227,30 @@ ATTESTATION_STATUS exchange_report_ocall(sgx_enclave_id_t src_enclave_id, sgx_en
 {
 	uint32_t status = 0;
 	sgx_status_t ret = SGX_SUCCESS;
+	uint32_t temp_enclave_no;
+
+	std::map<sgx_enclave_id_t, uint32_t>::iterator it = g_enclave_id_map.find(dest_enclave_id);
+    if(it != g_enclave_id_map.end())
+	{
+		//The destination enclave is hosted by this process
+		temp_enclave_no = it->second;
+		switch(temp_enclave_no)
+		{
+			case 1:
+				ret = Enclave1_exchange_report(dest_enclave_id, &status, src_enclave_id, dh_msg2, dh_msg3, session_id);
+				break;
+			case 2:
+				ret = Enclave2_exchange_report(dest_enclave_id, &status, src_enclave_id, dh_msg2, dh_msg3, session_id);
+				break;
+			case 3:
+				ret = Enclave3_exchange_report(dest_enclave_id, &status, src_enclave_id, dh_msg2, dh_msg3, session_id);
+				break;
+		}
+		if (ret == SGX_SUCCESS)
+			return (ATTESTATION_STATUS)status;
+		else
+		    return INVALID_SESSION;
+	}
 
     // for msg2 (filled by Enclave1)
     printf("[OCALL IPC] Passing message2 to shared memory for Enclave2\n");
@@ -94,13 +259,16 @@ ATTESTATION_STATUS exchange_report_ocall(sgx_enclave_id_t src_enclave_id, sgx_en
     sgx_dh_msg2_t *tmp_msg2 = (sgx_dh_msg2_t*)shmat(shmid_msg2, (void*)0, 0);
     memcpy(tmp_msg2, dh_msg2, sizeof(sgx_dh_msg2_t));
     shmdt(tmp_msg2);
+    if (handshake_signal(HANDSHAKE_MSG2_READY) != 0)
+        return INVALID_SESSION;
 
     // wait for Enclave2 to process msg2
     printf("[OCALL IPC] Waiting for Enclave2 to process message2 and generate message3...\n");
-    sleep(5);
+    if (handshake_wait(HANDSHAKE_MSG3_READY, HANDSHAKE_TIMEOUT_SEC) != 0)
+        return INVALID_SESSION;
 
     // retrieve msg3 (filled by Enclave2)
-    printf("[OCALL IPC] Message3 should be ready\n");
+    printf("[OCALL IPC] Message3 is ready\n");
     printf("[OCALL IPC] Retrieving message3 from shared memory\n");
     key_t key_msg3 = ftok("../..", 5);
     int shmid_msg3 = shmget(key_msg3, sizeof(sgx_dh_msg3_t), 0666|IPC_CREAT);
@@ -108,6 +276,9 @@ ATTESTATION_STATUS exchange_report_ocall(sgx_enclave_id_t src_enclave_id, sgx_en
     memcpy(dh_msg3, tmp_msg3, sizeof(sgx_dh_msg3_t));
     shmdt(tmp_msg3);
 
+    // Enclave2 set up the channel for the session's requests before sending msg3
+    open_session_channel(dest_enclave_id, session_id, 0);
+
     ret = SGX_SUCCESS;
 	if (ret == SGX_SUCCESS)
 		return SUCCESS;
@@ -116,6 +287,64 @@ ATTESTATION_STATUS exchange_report_ocall(sgx_enclave_id_t src_enclave_id, sgx_en
 
 }
 
+//Passes the session hello to Enclave2, which may resume a cached session instead of the DH exchange
+ATTESTATION_STATUS session_hello_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, session_hello_t* hello)
+{
+    // Enclaves hosted by this process keep no session cache for their peers, sessions with them take the DH exchange
+    if (g_enclave_id_map.find(dest_enclave_id) != g_enclave_id_map.end())
+        return SUCCESS;
+
+    // Enclave2 only answers after this hello and sends msg1 and msg3 later still, so any pending ones are stale
+    handshake_reset(HANDSHAKE_RESUME_READY);
+    handshake_reset(HANDSHAKE_MSG1_READY);
+    handshake_reset(HANDSHAKE_MSG3_READY);
+
+    printf("[OCALL IPC] Passing the session hello to shared memory for Enclave2\n");
+    key_t key_hello = ftok("../..", 7);
+    int shmid_hello = shmget(key_hello, sizeof(session_hello_t), 0666|IPC_CREAT);
+    session_hello_t *tmp_hello = (session_hello_t*)shmat(shmid_hello, (void*)0, 0);
+    memcpy(tmp_hello, hello, sizeof(session_hello_t));
+    shmdt(tmp_hello);
+
+    if (handshake_signal(HANDSHAKE_HELLO_READY) != 0)
+        return INVALID_SESSION;
+    return SUCCESS;
+}
+
+//Gets the answer of Enclave2 to the session hello
+ATTESTATION_STATUS session_resume_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, session_resume_t* resume)
+{
+    if (g_enclave_id_map.find(dest_enclave_id) != g_enclave_id_map.end())
+    {
+        memset(resume, 0, sizeof(session_resume_t));
+        return SUCCESS;
+    }
+
+    printf("[OCALL IPC] Waiting for Enclave2 to answer the session hello...\n");
+    if (handshake_wait(HANDSHAKE_RESUME_READY, HANDSHAKE_TIMEOUT_SEC) != 0)
+        return INVALID_SESSION;
+
+    printf("[OCALL IPC] Retrieving the answer to the session hello from shared memory\n");
+    key_t key_resume = ftok("../..", 8);
+    int shmid_resume = shmget(key_resume, sizeof(session_resume_t), 0666|IPC_CREAT);
+    session_resume_t *tmp_resume = (session_resume_t*)shmat(shmid_resume, (void*)0, 0);
+    memcpy(resume, tmp_resume, sizeof(session_resume_t));
+    shmdt(tmp_resume);
+
+    // a resumed session is established already, Enclave2 set up its channel before answering
+    if (resume->accepted)
+        open_session_channel(dest_enclave_id, resume->session_id, 0);
+    return SUCCESS;
+}
+
+//Seconds on the monotonic clock, for the expiry of cached sessions
+uint64_t session_clock_ocall(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec;
+}
+
 //Make an sgx_ecall to the destination enclave function that generates the actual response
 ATTESTATION_STATUS send_request_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id,secure_message_t* req_message, size_t req_message_size, size_t max_payload_size, secure_message_t* resp_message, size_t resp_message_size)
 {
@@ -130,7 +359,8 @@ ATTESTATION_STATUS send_request_ocall(sgx_enclave_id_t src_enclave_id, sgx_encla
 	}
     else
 	{
-		return INVALID_SESSION;
+		//The destination enclave is hosted by another process
+		return forward_to_session_channel(dest_enclave_id, CHANNEL_REQUEST, req_message, req_message_size, max_payload_size, resp_message, resp_message_size);
 	}
 
 	switch(temp_enclave_no)
@@ -152,6 +382,81 @@ ATTESTATION_STATUS send_request_ocall(sgx_enclave_id_t src_enclave_id, sgx_encla
 
 }
 
+//Responses of enclaves hosted by this process to requests of windowed mode, waiting for fetch_response_ocall
+struct local_response_t
+{
+    ATTESTATION_STATUS status;
+    std::vector<uint8_t> message;
+};
+static std::map<std::pair<sgx_enclave_id_t, sgx_enclave_id_t>, std::deque<local_response_t> > g_local_response_map;
+static std::mutex g_local_response_lock;
+
+//Passes a request of windowed mode to the destination enclave, its response is left for fetch_response_ocall
+ATTESTATION_STATUS post_request_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, secure_message_t* req_message, size_t req_message_size, size_t max_payload_size)
+{
+    if(g_enclave_id_map.find(dest_enclave_id) == g_enclave_id_map.end())
+    {
+        //The destination enclave is hosted by another process, which answers in the session channel
+        session_channel_t* channel = find_session_channel(dest_enclave_id);
+        if (!channel)
+        {
+            return INVALID_SESSION;
+        }
+        //The responder holds a response for each request in flight until it is fetched, so no more may be in flight
+        //than the response ring has slots: past that both sides would wait on a full ring
+        if (channel->next_sequence - channel->fetched >= CHANNEL_RING_SLOTS)
+        {
+            return WINDOW_FULL_ERROR;
+        }
+        uint64_t sequence;
+        return post_to_session_channel(channel, CHANNEL_REQUEST, req_message, req_message_size, max_payload_size, &sequence);
+    }
+
+    //The destination enclave is hosted by this process, so its response is generated right away and queued
+    local_response_t response;
+    response.message.resize(sizeof(secure_message_t) + max_payload_size);
+    secure_message_t* resp_message = (secure_message_t*)&response.message[0];
+    response.status = send_request_ocall(src_enclave_id, dest_enclave_id, req_message, req_message_size, max_payload_size, resp_message, response.message.size());
+    if (response.status == SUCCESS)
+        response.message.resize(sizeof(secure_message_t) + resp_message->message_aes_gcm_data.payload_size);
+
+    std::lock_guard<std::mutex> lock(g_local_response_lock);
+    g_local_response_map[std::make_pair(src_enclave_id, dest_enclave_id)].push_back(response);
+    return SUCCESS;
+}
+
+//Gets the next response of the destination enclave to a request passed by post_request_ocall
+ATTESTATION_STATUS fetch_response_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, secure_message_t* resp_message, size_t resp_message_size)
+{
+    if(g_enclave_id_map.find(dest_enclave_id) == g_enclave_id_map.end())
+    {
+        session_channel_t* channel = find_session_channel(dest_enclave_id);
+        if (!channel)
+        {
+            return INVALID_SESSION;
+        }
+        return fetch_from_session_channel(channel, NULL, resp_message, resp_message_size);
+    }
+
+    local_response_t response;
+    {
+        std::lock_guard<std::mutex> lock(g_local_response_lock);
+        std::deque<local_response_t>& queue = g_local_response_map[std::make_pair(src_enclave_id, dest_enclave_id)];
+        if (queue.empty())
+        {
+            return INVALID_PARAMETER_ERROR;
+        }
+        response = queue.front();
+        queue.pop_front();
+    }
+    if (response.status != SUCCESS)
+        return response.status;
+    if (response.message.size() > resp_message_size)
+        return OUT_BUFFER_LENGTH_ERROR;
+    memcpy(resp_message, &response.message[0], response.message.size());
+    return SUCCESS;
+}
+
 //Make an sgx_ecall to the destination enclave to close the session
 ATTESTATION_STATUS end_session_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id)
 {
@@ -166,7 +471,10 @@ ATTESTATION_STATUS end_session_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclav
 	}
     else
 	{
-		return INVALID_SESSION;
+		//The destination enclave is hosted by another process
+		status = forward_to_session_channel(dest_enclave_id, CHANNEL_END_SESSION, NULL, 0, 0, NULL, 0);
+		close_session_channel(dest_enclave_id, 0);
+		return status;
 	}
 
 	switch(temp_enclave_no)
@@ -188,6 +496,75 @@ ATTESTATION_STATUS end_session_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclav
 
 }
 
+//Serves the requests of the enclave hosted by another process that last established a session with enclave_id, until it ends the session
+ATTESTATION_STATUS serve_session_requests(sgx_enclave_id_t enclave_id, sgx_enclave_id_t peer_enclave_id)
+{
+    ATTESTATION_STATUS status = SUCCESS;
+
+    std::map<sgx_enclave_id_t, session_channel_t*>::iterator it = g_session_channel_map.find(peer_enclave_id);
+    if(it == g_session_channel_map.end())
+    {
+        return INVALID_SESSION;
+    }
+    channel_region_t* region = it->second->region;
+
+    for (;;)
+    {
+        channel_slot_t* req = channel_ring_peek(&region->request, CHANNEL_TIMEOUT_SEC);
+        if (!req)
+        {
+            printf("[OCALL IPC] No request from the peer enclave for %u seconds, closing the session channel\n", CHANNEL_TIMEOUT_SEC);
+            status = INVALID_SESSION;
+            break;
+        }
+        channel_slot_t* resp = channel_ring_reserve(&region->response, CHANNEL_TIMEOUT_SEC);
+        if (!resp)
+        {
+            status = INVALID_SESSION;
+            break;
+        }
+
+        uint32_t type = req->type;
+        resp->type = CHANNEL_RESPONSE;
+        resp->sequence = req->sequence;
+        resp->length = 0;
+        if (type == CHANNEL_REQUEST)
+        {
+            //The messages are passed to the enclave where they lie in the rings
+            secure_message_t* resp_message = (secure_message_t*)resp->message;
+            size_t resp_message_size = sizeof(secure_message_t) + req->max_payload_size;
+            if (req->length < sizeof(secure_message_t) || req->length > CHANNEL_SLOT_SIZE || resp_message_size > CHANNEL_SLOT_SIZE)
+            {
+                resp->status = OUT_BUFFER_LENGTH_ERROR;
+            }
+            else
+            {
+                resp->status = send_request_ocall(peer_enclave_id, enclave_id, (secure_message_t*)req->message, req->length,
+                                                  req->max_payload_size, resp_message, resp_message_size);
+                if (resp->status == SUCCESS)
+                    resp->length = sizeof(secure_message_t) + resp_message->message_aes_gcm_data.payload_size;
+            }
+        }
+        else if (type == CHANNEL_END_SESSION)
+        {
+            resp->status = end_session_ocall(peer_enclave_id, enclave_id);
+        }
+        else
+        {
+            resp->status = INVALID_REQUEST_TYPE_ERROR;
+        }
+
+        channel_ring_release(&region->request);
+        channel_ring_publish(&region->response);
+
+        if (type == CHANNEL_END_SESSION)
+            break;
+    }
+
+    close_session_channel(peer_enclave_id, 1);
+    return status;
+}
+
 void ocall_print_string(const char *str)
 {
     printf("%s", str);
@@ -63,10 +63,17 @@ sgx_status_t Enclave3_end_session(sgx_enclave_id_t eid, uint32_t* retval, sgx_en
 
 uint32_t session_request_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, sgx_dh_msg1_t* dh_msg1, uint32_t* session_id);
 uint32_t exchange_report_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, sgx_dh_msg2_t* dh_msg2, sgx_dh_msg3_t* dh_msg3, uint32_t session_id);
+uint32_t session_hello_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, session_hello_t* hello);
+uint32_t session_resume_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, session_resume_t* resume);
+uint64_t session_clock_ocall(void);
 uint32_t send_request_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, secure_message_t* req_message, size_t req_message_size, size_t max_payload_size, secure_message_t* resp_message, size_t resp_message_size);
+uint32_t post_request_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, secure_message_t* req_message, size_t req_message_size, size_t max_payload_size);
+uint32_t fetch_response_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id, secure_message_t* resp_message, size_t resp_message_size);
 uint32_t end_session_ocall(sgx_enclave_id_t src_enclave_id, sgx_enclave_id_t dest_enclave_id);
 void ocall_print_string(const char *str);
 
+uint32_t serve_session_requests(sgx_enclave_id_t enclave_id, sgx_enclave_id_t peer_enclave_id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,6 +32,7 @@
 
 // App.cpp : Defines the entry point for the console application.
 #include <stdio.h>
+#include <string.h>
 #include <map>
 #include "../Enclave1/Enclave1_u.h"
 #include "../Enclave2/Enclave2_u.h"
@@ -52,7 +53,14 @@
 #define scanf_s scanf
 #define _tmain  main
 
+//Sessions established one after the other, the first with the full DH exchange and the rest resumed from the session cache
+#define SESSION_ROUNDS 2
+
 extern std::map<sgx_enclave_id_t, uint32_t>g_enclave_id_map;
+extern "C" uint32_t serve_session_requests(sgx_enclave_id_t enclave_id, sgx_enclave_id_t peer_enclave_id);
+
+//./app bench_session_table [options], see App/SessionTableBench.cpp
+int session_table_bench_main(sgx_enclave_id_t eid, int argc, char *argv[]);
 
 
 sgx_enclave_id_t e1_enclave_id = 0;
@@ -94,15 +102,20 @@ int _tmain(int argc, _TCHAR* argv[])
 {
     uint32_t ret_status;
     sgx_status_t status;
-
-    UNUSED(argc);
-    UNUSED(argv);
+    int session_round = 0;
 
     if(load_enclaves() != SGX_SUCCESS)
     {
         printf("\nLoad Enclave Failure");
     }
 
+    if(argc > 1 && strcmp(argv[1], "bench_session_table") == 0)
+    {
+        int bench_status = session_table_bench_main(e1_enclave_id, argc - 1, argv + 1);
+        sgx_destroy_enclave(e1_enclave_id);
+        return bench_status;
+    }
+
     //printf("\nAvailable Enclaves");
     //printf("\nEnclave1 - EnclaveID %" PRIx64 "\n", e1_enclave_id);
 
@@ -118,7 +131,7 @@ int _tmain(int argc, _TCHAR* argv[])
 
     do
     {
-        printf("[START] Testing create session between Enclave1 (Initiator) and Enclave2 (Responder)\n");
+        printf("[START] Testing create session %d of %d between Enclave1 (Initiator) and Enclave2 (Responder)\n", session_round + 1, SESSION_ROUNDS);
         status = Enclave1_test_create_session(e1_enclave_id, &ret_status, e1_enclave_id, 0);
         if (status!=SGX_SUCCESS)
         {
@@ -138,9 +151,22 @@ int _tmain(int argc, _TCHAR* argv[])
             }
         }
 
+        //Serve the requests of Enclave1 in the other process until it closes the session
+        printf("[START] Serving requests from Initiator (E1) through the session channel\n");
+        ret_status = serve_session_requests(e1_enclave_id, 0);
+        if (ret_status == 0)
+        {
+            printf("[END] Initiator (E1) closed the session\n");
+        }
+        else
+        {
+            printf("[END] Serving requests from Initiator (E1) failed: Error code is %x\n", ret_status);
+            break;
+        }
+
 #pragma warning (push)
 #pragma warning (disable : 4127)
-    }while(0);
+    }while(++session_round < SESSION_ROUNDS);
 #pragma warning (pop)
 
     sgx_destroy_enclave(e1_enclave_id);
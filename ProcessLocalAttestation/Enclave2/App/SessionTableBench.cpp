@@ -0,0 +1,207 @@
+// SessionTableBench.cpp : "app bench_session_table", lookup cost and scaling of the responder's session table
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "../Enclave1/Enclave1_u.h"
+#include "sgx_eid.h"
+#include "sgx_urts.h"
+
+//Lookups per ECALL, enough for the ECALL's own cost to fade
+#define LOOKUPS_PER_ECALL 10000
+
+struct session_table_bench_config {
+    uint32_t sessions;
+    unsigned max_threads;
+    unsigned duration_ms;
+    std::string output;
+};
+
+//A way of keeping and finding sessions
+struct session_store {
+    const char *name;
+    uint32_t use_map;
+    uint32_t by_peer;
+};
+
+static const session_store stores[] = {
+    { "map", 1, 1 },            //std::map by peer id behind one lock, as the sessions were kept before
+    { "table_by_id", 0, 0 },    //session table by session id, as generate_response finds sessions
+    { "table_by_peer", 0, 1 },  //session table by peer id, as exchange_report and end_session do
+};
+
+struct session_table_bench_result {
+    const char *store;
+    unsigned threads;
+    unsigned long long lookups;
+    double lookups_per_sec;
+    double ns_per_lookup;       //per thread
+    double fill_ns;             //per session created
+    double clear_ns;            //per session ended
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ns_between(bench_clock::time_point begin, bench_clock::time_point end)
+{
+    return std::chrono::duration<double, std::nano>(end - begin).count();
+}
+
+static void run_thread(sgx_enclave_id_t eid, const session_store *store, uint32_t seed, unsigned long long *lookups,
+        uint32_t *error, const std::atomic<bool> *start, const std::atomic<bool> *stop)
+{
+    while (!start->load()) {
+        std::this_thread::yield();
+    }
+    while (!stop->load()) {
+        uint32_t retval;
+        sgx_status_t ret = Enclave1_test_session_table_lookup(eid, &retval, LOOKUPS_PER_ECALL, seed++, store->by_peer, store->use_map);
+        if (ret != SGX_SUCCESS || retval != 0) {
+            *error = ret != SGX_SUCCESS ? ret : retval;
+            return;
+        }
+        *lookups += LOOKUPS_PER_ECALL;
+    }
+}
+
+static bool run_threads(sgx_enclave_id_t eid, const session_store *store, unsigned thread_count,
+        const session_table_bench_config &config, session_table_bench_result *r)
+{
+    std::vector<unsigned long long> lookups(thread_count, 0);
+    std::vector<uint32_t> errors(thread_count, 0);
+    std::vector<std::thread> threads;
+    std::atomic<bool> start(false);
+    std::atomic<bool> stop(false);
+    for (unsigned t = 0; t < thread_count; t++) {
+        threads.push_back(std::thread(run_thread, eid, store, (t + 1) * 0x9E3779B9u, &lookups[t], &errors[t], &start, &stop));
+    }
+
+    bench_clock::time_point begin = bench_clock::now();
+    start.store(true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.duration_ms));
+    stop.store(true);
+    for (unsigned t = 0; t < thread_count; t++) {
+        threads[t].join();
+    }
+    double wall_ns = ns_between(begin, bench_clock::now());
+
+    r->store = store->name;
+    r->threads = thread_count;
+    r->lookups = 0;
+    for (unsigned t = 0; t < thread_count; t++) {
+        if (errors[t] != 0) {
+            printf("test_session_table_lookup failed: Error code is %x\n", errors[t]);
+            return false;
+        }
+        r->lookups += lookups[t];
+    }
+    r->lookups_per_sec = r->lookups / (wall_ns / 1e9);
+    r->ns_per_lookup = r->lookups ? wall_ns * thread_count / r->lookups : 0;
+    return true;
+}
+
+static bool run_bench(sgx_enclave_id_t eid, const session_table_bench_config &config,
+        std::vector<session_table_bench_result> *results)
+{
+    for (size_t s = 0; s < sizeof(stores) / sizeof(stores[0]); s++) {
+        const session_store *store = &stores[s];
+        uint32_t retval;
+
+        bench_clock::time_point begin = bench_clock::now();
+        sgx_status_t ret = Enclave1_test_session_table_fill(eid, &retval, config.sessions, store->use_map);
+        double fill_ns = ns_between(begin, bench_clock::now()) / config.sessions;
+        if (ret != SGX_SUCCESS || retval != 0) {
+            printf("test_session_table_fill failed: Error code is %x\n", ret != SGX_SUCCESS ? ret : retval);
+            Enclave1_test_session_table_clear(eid, &retval, store->use_map);
+            return false;
+        }
+
+        bool ok = true;
+        size_t first = results->size();
+        for (unsigned threads = 1; ok && threads <= config.max_threads; threads *= 2) {
+            session_table_bench_result r;
+            if ((ok = run_threads(eid, store, threads, config, &r)))
+                results->push_back(r);
+        }
+
+        begin = bench_clock::now();
+        Enclave1_test_session_table_clear(eid, &retval, store->use_map);
+        double clear_ns = ns_between(begin, bench_clock::now()) / config.sessions;
+        for (size_t i = first; i < results->size(); i++) {
+            (*results)[i].fill_ns = fill_ns;
+            (*results)[i].clear_ns = clear_ns;
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static void write_csv(const std::string &path, uint32_t sessions, const std::vector<session_table_bench_result> &results)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "store,sessions,threads,lookups,lookups_per_sec,ns_per_lookup,fill_ns,clear_ns\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const session_table_bench_result &r = results[i];
+        fprintf(fp, "%s,%u,%u,%llu,%.1f,%.1f,%.1f,%.1f\n", r.store, sessions, r.threads, r.lookups,
+                r.lookups_per_sec, r.ns_per_lookup, r.fill_ns, r.clear_ns);
+    }
+    fclose(fp);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: app %s [-s sessions] [-t max_threads] [-d ms] [-o output.csv]\n", name);
+    printf("  Creates sessions sessions (default 1024) in the enclave, then has 1 to max_threads threads\n");
+    printf("  (default 8, in steps of 2x, at most TCSNum) look sessions up at random for ms milliseconds\n");
+    printf("  each (default 1000), in the old std::map and in the session table by session id and by peer.\n");
+}
+
+int session_table_bench_main(sgx_enclave_id_t eid, int argc, char *argv[])
+{
+    session_table_bench_config config;
+    config.sessions = 1024;
+    config.max_threads = 8;
+    config.duration_ms = 1000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:d:o:h")) != -1) {
+        switch (opt) {
+        case 's': config.sessions = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 't': config.max_threads = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'd': config.duration_ms = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'o': config.output = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (config.sessions == 0 || config.max_threads == 0 || config.duration_ms == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<session_table_bench_result> results;
+    if (!run_bench(eid, config, &results)) return 1;
+
+    printf("%14s %8s %7s %12s %14s %10s %10s %10s\n", "store", "sessions", "threads", "lookups",
+            "lookups/s", "ns/lookup", "fill_ns", "clear_ns");
+    for (size_t i = 0; i < results.size(); i++) {
+        const session_table_bench_result &r = results[i];
+        printf("%14s %8u %7u %12llu %14.1f %10.1f %10.1f %10.1f\n", r.store, config.sessions, r.threads,
+                r.lookups, r.lookups_per_sec, r.ns_per_lookup, r.fill_ns, r.clear_ns);
+    }
+    if (!config.output.empty()) {
+        write_csv(config.output, config.sessions, results);
+        printf("Results written to %s\n", config.output.c_str());
+    }
+    return 0;
+}
@@ -44,7 +44,7 @@
 
 std::map<sgx_enclave_id_t, dh_session_t>g_src_session_info_map;
 
-static uint32_t e1_foo1_wrapper(ms_in_msg_exchange_t *ms, size_t param_lenth, char** resp_buffer, size_t* resp_length);
+static uint32_t e1_foo1_wrapper(ms_in_msg_exchange_t *ms, size_t param_lenth, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length);
 
 //Function pointer table containing the list of functions that the enclave exposes
 const struct {
@@ -83,7 +83,7 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
     size_t out_buff_len;
     dh_session_t *dest_session_info;
     size_t max_out_buff_size;
-    char* retval;
+    uint32_t retval;
 
     var1 = 0x4;
     var2 = 0x5;
@@ -133,7 +133,6 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
 
     SAFE_FREE(marshalled_inp_buff);
     SAFE_FREE(out_buff);
-    SAFE_FREE(retval);
     return SUCCESS;
 }
 
@@ -149,7 +148,7 @@ uint32_t test_message_exchange(sgx_enclave_id_t src_enclave_id,
     size_t out_buff_len;
     dh_session_t *dest_session_info;
     size_t max_out_buff_size;
-    char* secret_response;
+    uint32_t secret_response;
     uint32_t secret_data;
 
     target_fn_id = 0;
@@ -196,7 +195,6 @@ uint32_t test_message_exchange(sgx_enclave_id_t src_enclave_id,
 
     SAFE_FREE(marshalled_inp_buff);
     SAFE_FREE(out_buff);
-    SAFE_FREE(secret_response);
     return SUCCESS;
 }
 
@@ -222,6 +220,7 @@ uint32_t test_close_session(sgx_enclave_id_t src_enclave_id,
     ke_status = close_session(src_enclave_id, dest_enclave_id);
 
     //Erase the session information associated with the destination enclave id
+    release_session_buffers(&it->second);
     g_src_session_info_map.erase(dest_enclave_id);
     return ke_status;
 }
@@ -250,12 +249,13 @@ extern "C" uint32_t verify_peer_enclave_trust(sgx_dh_session_enclave_identity_t*
 //Each enclave can have its own way of dispatching the calls from other enclave
 extern "C" uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data,
                                                        size_t decrypted_data_length,
-                                                       char** resp_buffer,
+                                                       char* resp_buffer,
+                                                       size_t resp_buffer_size,
                                                        size_t* resp_length)
 {
     ms_in_msg_exchange_t *ms;
-    uint32_t (*fn1)(ms_in_msg_exchange_t *ms, size_t, char**, size_t*);
-    if(!decrypted_data || !resp_length)
+    uint32_t (*fn1)(ms_in_msg_exchange_t *ms, size_t, char*, size_t, size_t*);
+    if(!decrypted_data || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
@@ -264,8 +264,8 @@ extern "C" uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data,
     {
         return INVALID_PARAMETER_ERROR;
     }
-    fn1 = (uint32_t (*)(ms_in_msg_exchange_t*, size_t, char**, size_t*))func_table.table[ms->target_fn_id];
-    return fn1(ms, decrypted_data_length, resp_buffer, resp_length);
+    fn1 = (uint32_t (*)(ms_in_msg_exchange_t*, size_t, char*, size_t, size_t*))func_table.table[ms->target_fn_id];
+    return fn1(ms, decrypted_data_length, resp_buffer, resp_buffer_size, resp_length);
 }
 
 //Operates on the input secret and generates the output secret
@@ -282,13 +282,14 @@ uint32_t get_message_exchange_response(uint32_t inp_secret_data)
 
 //Generates the response from the request message
 extern "C" uint32_t message_exchange_response_generator(char* decrypted_data,
-                                              char** resp_buffer,
+                                              char* resp_buffer,
+                                              size_t resp_buffer_size,
                                               size_t* resp_length)
 {
     ms_in_msg_exchange_t *ms;
     uint32_t inp_secret_data;
     uint32_t out_secret_data;
-    if(!decrypted_data || !resp_length)
+    if(!decrypted_data || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
@@ -299,8 +300,8 @@ extern "C" uint32_t message_exchange_response_generator(char* decrypted_data,
 
     out_secret_data = get_message_exchange_response(inp_secret_data);
 
-    if(marshal_message_exchange_response(resp_buffer, resp_length, out_secret_data) != SUCCESS)
-        return MALLOC_ERROR;
+    if(marshal_message_exchange_response(resp_buffer, resp_buffer_size, resp_length, out_secret_data) != SUCCESS)
+        return OUT_BUFFER_LENGTH_ERROR;
 
     return SUCCESS;
 
@@ -324,44 +325,38 @@ static uint32_t e1_foo1(external_param_struct_t *p_struct_var)
 //Function which is executed on request from the source enclave
 static uint32_t e1_foo1_wrapper(ms_in_msg_exchange_t *ms,
                     size_t param_lenth,
-                    char** resp_buffer,
+                    char* resp_buffer,
+                    size_t resp_buffer_size,
                     size_t* resp_length)
 {
     UNUSED(param_lenth);
 
     uint32_t ret;
     size_t len_data, len_ptr_data;
-    external_param_struct_t *p_struct_var;
+    external_param_struct_t struct_var;
     internal_param_struct_t internal_struct_var;
 
-    if(!ms || !resp_length)
+    if(!ms || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
 
-    p_struct_var = (external_param_struct_t*)malloc(sizeof(external_param_struct_t));
-    if(!p_struct_var)
-        return MALLOC_ERROR;
-
-    p_struct_var->p_internal_struct = &internal_struct_var;
+    struct_var.p_internal_struct = &internal_struct_var;
 
-    if(unmarshal_input_parameters_e1_foo1(p_struct_var, ms) != SUCCESS)//can use the stack
+    if(unmarshal_input_parameters_e1_foo1(&struct_var, ms) != SUCCESS)
     {
-        SAFE_FREE(p_struct_var);
         return ATTESTATION_ERROR;
     }
 
-    ret = e1_foo1(p_struct_var);
+    ret = e1_foo1(&struct_var);
 
-    len_data = sizeof(external_param_struct_t) - sizeof(p_struct_var->p_internal_struct);
+    len_data = sizeof(external_param_struct_t) - sizeof(struct_var.p_internal_struct);
     len_ptr_data = sizeof(internal_struct_var);
 
-    if(marshal_retval_and_output_parameters_e1_foo1(resp_buffer, resp_length, ret, p_struct_var, len_data, len_ptr_data) != SUCCESS)
+    if(marshal_retval_and_output_parameters_e1_foo1(resp_buffer, resp_buffer_size, resp_length, ret, &struct_var, len_data, len_ptr_data) != SUCCESS)
     {
-        SAFE_FREE(p_struct_var);
-        return MALLOC_ERROR;
+        return OUT_BUFFER_LENGTH_ERROR;
     }
-    SAFE_FREE(p_struct_var);
     return SUCCESS;
 }
 
@@ -0,0 +1,130 @@
+// SessionTableBench.cpp : ECALLs of "app bench_session_table", see App/SessionTableBench.cpp
+#include "sgx_eid.h"
+#include "sgx_spinlock.h"
+#include "Enclave1_t.h"
+#include "EnclaveMessageExchange.h"
+#include "SessionTable.h"
+#include "error_codes.h"
+#include <map>
+#include <string.h>
+
+/*
+ * The benchmark's sessions are created for peer ids from
+ * SESSION_BENCH_PEER_BASE up, away from the ids of real enclaves, either in
+ * the session table or, for comparison, in the std::map the sessions used
+ * to be kept in. The map is not thread-safe, so it is used behind a single
+ * lock, which is the least a multi-threaded responder would need.
+ */
+
+#define SESSION_BENCH_PEER_BASE ((sgx_enclave_id_t)1 << 48)
+
+static std::map<sgx_enclave_id_t, dh_session_t> g_bench_session_map;
+static sgx_spinlock_t g_bench_session_map_lock = SGX_SPINLOCK_INITIALIZER;
+
+//Session ids of the sessions created in the table
+static uint32_t g_bench_session_ids[SESSION_TABLE_CAPACITY];
+static uint32_t g_bench_session_count = 0;
+
+//Creates the ACTIVE sessions the lookups pick from
+uint32_t test_session_table_fill(uint32_t sessions, uint32_t use_map)
+{
+    ATTESTATION_STATUS status;
+    dh_session_t session_info;
+
+    if(sessions == 0 || sessions > SESSION_TABLE_CAPACITY || g_bench_session_count != 0)
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
+
+    for(uint32_t i = 0; i < sessions; i++)
+    {
+        sgx_enclave_id_t peer_enclave_id = SESSION_BENCH_PEER_BASE + i;
+        if(use_map)
+        {
+            memset(&session_info, 0, sizeof(dh_session_t));
+            session_info.session_id = i;
+            session_info.status = ACTIVE;
+            sgx_spin_lock(&g_bench_session_map_lock);
+            g_bench_session_map.insert(std::pair<sgx_enclave_id_t, dh_session_t>(peer_enclave_id, session_info));
+            sgx_spin_unlock(&g_bench_session_map_lock);
+        }
+        else
+        {
+            if((status = session_table_create(peer_enclave_id, &g_bench_session_ids[i])) != SUCCESS)
+            {
+                return status;
+            }
+            dh_session_t *session = session_table_acquire(g_bench_session_ids[i], peer_enclave_id);
+            session->status = ACTIVE;
+            session_table_release(session);
+        }
+        g_bench_session_count = i + 1;
+    }
+    return SUCCESS;
+}
+
+//Looks up lookups sessions picked at random from seed, by session id or by peer, and bumps their nonces as generate_response does
+uint32_t test_session_table_lookup(uint32_t lookups, uint32_t seed, uint32_t by_peer, uint32_t use_map)
+{
+    uint32_t x = seed | 1;
+    uint32_t count = g_bench_session_count;
+
+    if(count == 0)
+    {
+        return INVALID_SESSION;
+    }
+
+    for(uint32_t n = 0; n < lookups; n++)
+    {
+        //xorshift32
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        uint32_t i = x % count;
+        sgx_enclave_id_t peer_enclave_id = SESSION_BENCH_PEER_BASE + i;
+
+        if(use_map)
+        {
+            sgx_spin_lock(&g_bench_session_map_lock);
+            std::map<sgx_enclave_id_t, dh_session_t>::iterator it = g_bench_session_map.find(peer_enclave_id);
+            if(it == g_bench_session_map.end())
+            {
+                sgx_spin_unlock(&g_bench_session_map_lock);
+                return INVALID_SESSION;
+            }
+            it->second.active.counter++;
+            sgx_spin_unlock(&g_bench_session_map_lock);
+            continue;
+        }
+
+        dh_session_t *session = by_peer ? session_table_acquire_peer(peer_enclave_id)
+                                        : session_table_acquire(g_bench_session_ids[i], peer_enclave_id);
+        if(!session)
+        {
+            return INVALID_SESSION;
+        }
+        session->active.counter++;
+        session_table_release(session);
+    }
+    return SUCCESS;
+}
+
+//Ends the sessions test_session_table_fill created
+uint32_t test_session_table_clear(uint32_t use_map)
+{
+    for(uint32_t i = 0; i < g_bench_session_count; i++)
+    {
+        if(use_map)
+        {
+            sgx_spin_lock(&g_bench_session_map_lock);
+            g_bench_session_map.erase(SESSION_BENCH_PEER_BASE + i);
+            sgx_spin_unlock(&g_bench_session_map_lock);
+        }
+        else
+        {
+            session_table_remove(g_bench_session_ids[i]);
+        }
+    }
+    g_bench_session_count = 0;
+    return SUCCESS;
+}
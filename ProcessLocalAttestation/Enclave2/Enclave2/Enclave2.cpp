@@ -44,7 +44,7 @@
 
 std::map<sgx_enclave_id_t, dh_session_t>g_src_session_info_map;
 
-static uint32_t e2_foo1_wrapper(ms_in_msg_exchange_t *ms, size_t param_lenth, char** resp_buffer, size_t* resp_length);
+static uint32_t e2_foo1_wrapper(ms_in_msg_exchange_t *ms, size_t param_lenth, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length);
 
 //Function pointer table containing the list of functions that the enclave exposes
 const struct {
@@ -87,7 +87,7 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
     size_t out_buff_len;
     dh_session_t *dest_session_info;
     size_t max_out_buff_size;
-    char* retval;
+    uint32_t retval;
 
     max_out_buff_size = 50;
     target_fn_id = 0;
@@ -138,7 +138,6 @@ uint32_t test_enclave_to_enclave_call(sgx_enclave_id_t src_enclave_id,
 
     SAFE_FREE(marshalled_inp_buff);
     SAFE_FREE(out_buff);
-    SAFE_FREE(retval);
     return SUCCESS;
 }
 
@@ -154,7 +153,7 @@ uint32_t test_message_exchange(sgx_enclave_id_t src_enclave_id,
     size_t out_buff_len;
     dh_session_t *dest_session_info;
     size_t max_out_buff_size;
-    char* secret_response;
+    uint32_t secret_response;
     uint32_t secret_data;
 
     target_fn_id = 0;
@@ -201,7 +200,6 @@ uint32_t test_message_exchange(sgx_enclave_id_t src_enclave_id,
 
     SAFE_FREE(marshalled_inp_buff);
     SAFE_FREE(out_buff);
-    SAFE_FREE(secret_response);
     return SUCCESS;
 }
 
@@ -226,6 +224,7 @@ uint32_t test_close_session(sgx_enclave_id_t src_enclave_id,
     ke_status = close_session(src_enclave_id, dest_enclave_id);
 
     //Erase the session information associated with the destination enclave id
+    release_session_buffers(&it->second);
     g_src_session_info_map.erase(dest_enclave_id);
     return ke_status;
 }
@@ -253,12 +252,13 @@ extern "C" uint32_t verify_peer_enclave_trust(sgx_dh_session_enclave_identity_t*
 //Each enclave can have its own way of dispatching the calls from other enclave
 extern "C" uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data,
                                                        size_t decrypted_data_length,
-                                                       char** resp_buffer,
+                                                       char* resp_buffer,
+                                                       size_t resp_buffer_size,
                                                        size_t* resp_length)
 {
     ms_in_msg_exchange_t *ms;
-    uint32_t (*fn1)(ms_in_msg_exchange_t *ms, size_t, char**, size_t*);
-    if(!decrypted_data || !resp_length)
+    uint32_t (*fn1)(ms_in_msg_exchange_t *ms, size_t, char*, size_t, size_t*);
+    if(!decrypted_data || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
@@ -267,8 +267,8 @@ extern "C" uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data,
     {
         return INVALID_PARAMETER_ERROR;
     }
-    fn1 = (uint32_t (*)(ms_in_msg_exchange_t*, size_t, char**, size_t*))func_table.table[ms->target_fn_id];
-    return fn1(ms, decrypted_data_length, resp_buffer, resp_length);
+    fn1 = (uint32_t (*)(ms_in_msg_exchange_t*, size_t, char*, size_t, size_t*))func_table.table[ms->target_fn_id];
+    return fn1(ms, decrypted_data_length, resp_buffer, resp_buffer_size, resp_length);
 }
 
 //Operates on the input secret and generates the output secret
@@ -285,13 +285,14 @@ uint32_t get_message_exchange_response(uint32_t inp_secret_data)
 
 //Generates the response from the request message
 extern "C" uint32_t message_exchange_response_generator(char* decrypted_data,
-                                              char** resp_buffer,
+                                              char* resp_buffer,
+                                               size_t resp_buffer_size,
                                                size_t* resp_length)
 {
     ms_in_msg_exchange_t *ms;
     uint32_t inp_secret_data;
     uint32_t out_secret_data;
-    if(!decrypted_data || !resp_length)
+    if(!decrypted_data || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
@@ -302,8 +303,8 @@ extern "C" uint32_t message_exchange_response_generator(char* decrypted_data,
 
     out_secret_data = get_message_exchange_response(inp_secret_data);
 
-    if(marshal_message_exchange_response(resp_buffer, resp_length, out_secret_data) != SUCCESS)
-        return MALLOC_ERROR;
+    if(marshal_message_exchange_response(resp_buffer, resp_buffer_size, resp_length, out_secret_data) != SUCCESS)
+        return OUT_BUFFER_LENGTH_ERROR;
 
     return SUCCESS;
 
@@ -317,13 +318,14 @@ static uint32_t e2_foo1(uint32_t var1, uint32_t var2)
 //Function which is executed on request from the source enclave
 static uint32_t e2_foo1_wrapper(ms_in_msg_exchange_t *ms,
                     size_t param_lenth,
-                    char** resp_buffer,
+                    char* resp_buffer,
+                    size_t resp_buffer_size,
                     size_t* resp_length)
 {
     UNUSED(param_lenth);
 
     uint32_t var1,var2,ret;
-    if(!ms || !resp_length)
+    if(!ms || !resp_buffer || !resp_length)
     {
         return INVALID_PARAMETER_ERROR;
     }
@@ -332,8 +334,8 @@ static uint32_t e2_foo1_wrapper(ms_in_msg_exchange_t *ms,
 
     ret = e2_foo1(var1, var2);
 
-    if(marshal_retval_and_output_parameters_e2_foo1(resp_buffer, resp_length, ret) != SUCCESS )
-        return MALLOC_ERROR; //can set resp buffer to null here
+    if(marshal_retval_and_output_parameters_e2_foo1(resp_buffer, resp_buffer_size, resp_length, ret) != SUCCESS )
+        return OUT_BUFFER_LENGTH_ERROR;
 
     return SUCCESS;
 }
@@ -32,192 +32,88 @@
 #include "sgx_eid.h"
 #include "EnclaveMessageExchange.h"
 #include "error_codes.h"
+#include "MessageSerializer.h"
 #include "Utility_E3.h"
 #include "stdlib.h"
 #include "string.h"
 
 uint32_t marshal_input_parameters_e1_foo1(uint32_t target_fn_id, uint32_t msg_type, external_param_struct_t *p_struct_var, size_t len_data, size_t len_ptr_data, char** marshalled_buff, size_t* marshalled_buff_len)
 {
-    ms_in_msg_exchange_t *ms;
-    size_t param_len, ms_len;
-    char *temp_buff;
-    int* addr;
-    char* struct_data;
-    if(!p_struct_var || !marshalled_buff_len)
-        return INVALID_PARAMETER_ERROR;    
-    struct_data = (char*)p_struct_var;
-    temp_buff = (char*)malloc(len_data + len_ptr_data);
-    if(!temp_buff)
-        return MALLOC_ERROR;
-    memcpy(temp_buff, struct_data, len_data);
-    addr = *(int **)(struct_data + len_data);
-    memcpy(temp_buff + len_data, addr, len_ptr_data); //can be optimized
-    param_len = len_data + len_ptr_data;
-    ms_len =  sizeof(ms_in_msg_exchange_t) + param_len;
-    ms = (ms_in_msg_exchange_t *)malloc(ms_len);
-    if(!ms)
-    {
-        SAFE_FREE(temp_buff);
-        return MALLOC_ERROR;
-    }
-    ms->msg_type = msg_type;
-    ms->target_fn_id = target_fn_id;
-    ms->inparam_buff_len = (uint32_t)param_len;
-    memcpy(&ms->inparam_buff, temp_buff, param_len);
-    *marshalled_buff = (char*)ms;
-    *marshalled_buff_len = ms_len;
-        
-    SAFE_FREE(temp_buff);
-    return SUCCESS;
+    if(!p_struct_var || !p_struct_var->p_internal_struct || !marshalled_buff_len)
+        return INVALID_PARAMETER_ERROR;
+    //The struct goes as its two values followed by the internal struct it points to
+    if(len_data != sizeof(p_struct_var->var1) + sizeof(p_struct_var->var2) || len_ptr_data != sizeof(internal_param_struct_t))
+        return INVALID_PARAMETER_ERROR;
+
+    return marshal_request(marshalled_buff, marshalled_buff_len, target_fn_id, msg_type,
+                           p_struct_var->var1, p_struct_var->var2, *p_struct_var->p_internal_struct);
 }
 
-uint32_t marshal_retval_and_output_parameters_e3_foo1(char** resp_buffer, size_t* resp_length, uint32_t retval, param_struct_t *p_struct_var)
+uint32_t marshal_retval_and_output_parameters_e3_foo1(char* resp_buffer, size_t resp_buffer_size, size_t* resp_length, uint32_t retval, param_struct_t *p_struct_var)
 {
-    ms_out_msg_exchange_t *ms;
-    size_t ret_param_len, ms_len;
-    char *temp_buff;
-    size_t retval_len;
     if(!resp_length || !p_struct_var)
-        return INVALID_PARAMETER_ERROR;    
-    retval_len = sizeof(retval);
-    ret_param_len = sizeof(retval) + sizeof(param_struct_t);
-    temp_buff = (char*)malloc(ret_param_len);
-    if(!temp_buff)
-        return MALLOC_ERROR;
-    memcpy(temp_buff, &retval, sizeof(retval)); 
-    memcpy(temp_buff + sizeof(retval), p_struct_var, sizeof(param_struct_t));
-    ms_len = sizeof(ms_out_msg_exchange_t) + ret_param_len;
-    ms = (ms_out_msg_exchange_t *)malloc(ms_len);
-    if(!ms)
-    {
-        SAFE_FREE(temp_buff);
-        return MALLOC_ERROR;
-    }
-    ms->retval_len = (uint32_t)retval_len;
-    ms->ret_outparam_buff_len = (uint32_t)ret_param_len;
-    memcpy(&ms->ret_outparam_buff, temp_buff, ret_param_len);
-    *resp_buffer = (char*)ms;
-    *resp_length = ms_len;
-    SAFE_FREE(temp_buff);
-    return SUCCESS;
+        return INVALID_PARAMETER_ERROR;
+    return marshal_response_in_place(resp_buffer, resp_buffer_size, resp_length, retval, *p_struct_var);
 }
 
 uint32_t unmarshal_input_parameters_e3_foo1(param_struct_t *pstruct, ms_in_msg_exchange_t* ms)
 {
-    char* buff;
-    size_t len;
     if(!pstruct || !ms)
-        return INVALID_PARAMETER_ERROR;    
-    buff = ms->inparam_buff;
-    len = ms->inparam_buff_len;
-
-    if(len != (sizeof(pstruct->var1) + sizeof(pstruct->var2)))
+        return INVALID_PARAMETER_ERROR;
+    message_view<param_struct_t> params = view_request<param_struct_t>(ms);
+    if(!params.valid())
         return ATTESTATION_ERROR;
 
-    memcpy(&pstruct->var1, buff, sizeof(pstruct->var1));
-    memcpy(&pstruct->var2, buff + sizeof(pstruct->var1), sizeof(pstruct->var2)); 
-
+    *pstruct = params.get<0>();
     return SUCCESS;
 }
 
-
-uint32_t unmarshal_retval_and_output_parameters_e1_foo1(char* out_buff, external_param_struct_t *p_struct_var, char** retval)
+uint32_t unmarshal_retval_and_output_parameters_e1_foo1(char* out_buff, external_param_struct_t *p_struct_var, uint32_t* retval)
 {
-    size_t retval_len;
-    ms_out_msg_exchange_t *ms;
-    if(!out_buff || !p_struct_var)
-        return INVALID_PARAMETER_ERROR;    
-    ms = (ms_out_msg_exchange_t *)out_buff;
-    retval_len = ms->retval_len;
-    *retval = (char*)malloc(retval_len);
-    if(!*retval)
-    {
-        return MALLOC_ERROR;
-    }
-    memcpy(*retval, ms->ret_outparam_buff, retval_len);
-    memcpy(&p_struct_var->var1, (ms->ret_outparam_buff) + retval_len, sizeof(p_struct_var->var1));
-    memcpy(&p_struct_var->var2, (ms->ret_outparam_buff) + retval_len + sizeof(p_struct_var->var1), sizeof(p_struct_var->var2));
-    memcpy(&p_struct_var->p_internal_struct->ivar1, (ms->ret_outparam_buff) + retval_len + sizeof(p_struct_var->var1)+ sizeof(p_struct_var->var2), sizeof(p_struct_var->p_internal_struct->ivar1));
-    memcpy(&p_struct_var->p_internal_struct->ivar2, (ms->ret_outparam_buff) + retval_len + sizeof(p_struct_var->var1)+ sizeof(p_struct_var->var2) + sizeof(p_struct_var->p_internal_struct->ivar1), sizeof(p_struct_var->p_internal_struct->ivar2));
+    if(!out_buff || !p_struct_var || !p_struct_var->p_internal_struct || !retval)
+        return INVALID_PARAMETER_ERROR;
+    message_view<uint32_t, uint32_t, uint32_t, internal_param_struct_t> results =
+        view_response<uint32_t, uint32_t, uint32_t, internal_param_struct_t>((ms_out_msg_exchange_t *)out_buff);
+    if(!results.valid())
+        return ATTESTATION_ERROR;
+
+    *retval = results.get<0>();
+    p_struct_var->var1 = results.get<1>();
+    p_struct_var->var2 = results.get<2>();
+    *p_struct_var->p_internal_struct = results.get<3>();
     return SUCCESS;
 }
 
-
 uint32_t marshal_message_exchange_request(uint32_t target_fn_id, uint32_t msg_type, uint32_t secret_data, char** marshalled_buff, size_t* marshalled_buff_len)
 {
-    ms_in_msg_exchange_t *ms;
-    size_t secret_data_len, ms_len;
-    if(!marshalled_buff_len)
-        return INVALID_PARAMETER_ERROR;            
-    secret_data_len = sizeof(secret_data);
-    ms_len = sizeof(ms_in_msg_exchange_t) + secret_data_len;
-    ms = (ms_in_msg_exchange_t *)malloc(ms_len);
-    if(!ms)
-        return MALLOC_ERROR;
-
-    ms->msg_type = msg_type;
-    ms->target_fn_id = target_fn_id;
-    ms->inparam_buff_len = (uint32_t)secret_data_len;
-    memcpy(&ms->inparam_buff, &secret_data, secret_data_len);
-
-    *marshalled_buff = (char*)ms;
-    *marshalled_buff_len = ms_len;
-    return SUCCESS;
+    return marshal_request(marshalled_buff, marshalled_buff_len, target_fn_id, msg_type, secret_data);
 }
 
 uint32_t umarshal_message_exchange_request(uint32_t* inp_secret_data, ms_in_msg_exchange_t* ms)
 {
-    char* buff;
-    size_t len;
     if(!inp_secret_data || !ms)
-        return INVALID_PARAMETER_ERROR;    
-    buff = ms->inparam_buff;
-    len = ms->inparam_buff_len;
-
-    if(len != sizeof(uint32_t))
+        return INVALID_PARAMETER_ERROR;
+    message_view<uint32_t> params = view_request<uint32_t>(ms);
+    if(!params.valid())
         return ATTESTATION_ERROR;
 
-    memcpy(inp_secret_data, buff, sizeof(uint32_t));
-
+    *inp_secret_data = params.get<0>();
     return SUCCESS;
 }
 
-uint32_t marshal_message_exchange_response(char** resp_buffer, size_t* resp_length, uint32_t secret_response)
+uint32_t marshal_message_exchange_response(char* resp_buffer, size_t resp_buffer_size, size_t* resp_length, uint32_t secret_response)
 {
-    ms_out_msg_exchange_t *ms;
-    size_t secret_response_len, ms_len;
-    size_t retval_len, ret_param_len;
-    if(!resp_length)
-        return INVALID_PARAMETER_ERROR;    
-    secret_response_len = sizeof(secret_response);
-    retval_len = secret_response_len;
-    ret_param_len = secret_response_len;
-    ms_len = sizeof(ms_out_msg_exchange_t) + ret_param_len;
-    ms = (ms_out_msg_exchange_t *)malloc(ms_len);
-    if(!ms)
-        return MALLOC_ERROR;
-    ms->retval_len = (uint32_t)retval_len;
-    ms->ret_outparam_buff_len = (uint32_t)ret_param_len;
-    memcpy(&ms->ret_outparam_buff, &secret_response, secret_response_len);
-    *resp_buffer = (char*)ms;
-    *resp_length = ms_len;
-     return SUCCESS;
+    return marshal_response_in_place(resp_buffer, resp_buffer_size, resp_length, secret_response);
 }
 
-uint32_t umarshal_message_exchange_response(char* out_buff, char** secret_response)
+uint32_t umarshal_message_exchange_response(char* out_buff, uint32_t* secret_response)
 {
-    size_t retval_len;
-    ms_out_msg_exchange_t *ms;
-    if(!out_buff)
-        return INVALID_PARAMETER_ERROR;    
-    ms = (ms_out_msg_exchange_t *)out_buff;
-    retval_len = ms->retval_len;
-    *secret_response = (char*)malloc(retval_len);
-    if(!*secret_response)
-    {
-        return MALLOC_ERROR;
-    }
-    memcpy(*secret_response, ms->ret_outparam_buff, retval_len);
+    if(!out_buff || !secret_response)
+        return INVALID_PARAMETER_ERROR;
+    message_view<uint32_t> results = view_response<uint32_t>((ms_out_msg_exchange_t *)out_buff);
+    if(!results.valid())
+        return ATTESTATION_ERROR;
+
+    *secret_response = results.get<0>();
     return SUCCESS;
 }
-
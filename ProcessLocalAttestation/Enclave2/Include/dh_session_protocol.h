@@ -49,6 +49,8 @@ typedef struct _la_dh_session_t
 {
     uint32_t  session_id; //Identifies the current session
     uint32_t  status; //Indicates session is in progress, active or closed
+    uint8_t*  message_buffer; //Kept for the session's messages, grown to the largest so far; freed by release_session_buffers
+    uint32_t  message_buffer_size;
     union
     {
         struct
@@ -60,6 +62,8 @@ typedef struct _la_dh_session_t
         {
             sgx_key_128bit_t AEK; //Session Key
             uint32_t counter; //Used to store Message Sequence Number
+            uint32_t window_edge; //Windowed mode: the initiator's oldest request in flight, the responder's newest request received
+            uint64_t window; //Windowed mode: bit i marks request window_edge + i in flight, or request window_edge - i received
         }active;
     };
 } dh_session_t;
@@ -37,37 +37,125 @@
 #include "error_codes.h"
 #include "sgx_ecp_types.h"
 #include "sgx_thread.h"
-#include <map>
 #include "dh_session_protocol.h"
 #include "sgx_dh.h"
 #include "sgx_tcrypto.h"
 #include "LocalAttestationCode_t.h"
+#include "SessionCache.h"
+#include "SessionTable.h"
+#include "MessageBatch.h"
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data, size_t decrypted_data_length, char** resp_buffer, size_t* resp_length);
-uint32_t message_exchange_response_generator(char* decrypted_data, char** resp_buffer, size_t* resp_length);
+uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data, size_t decrypted_data_length, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length);
+uint32_t message_exchange_response_generator(char* decrypted_data, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length);
 uint32_t verify_peer_enclave_trust(sgx_dh_session_enclave_identity_t* peer_enclave_identity);
 
 #ifdef __cplusplus
 }
 #endif
 
-#define MAX_SESSION_COUNT  16
+ATTESTATION_STATUS end_session(sgx_enclave_id_t src_enclave_id);
 
-//number of open sessions
-uint32_t g_session_count = 0;
+//The session nonce a message carries in the first bytes of its IV
+static uint32_t message_nonce(const secure_message_t* message)
+{
+    uint32_t nonce;
+    memcpy(&nonce, message->message_aes_gcm_data.reserved, sizeof(nonce));
+    return nonce;
+}
 
-ATTESTATION_STATUS generate_session_id(uint32_t *session_id);
-ATTESTATION_STATUS end_session(sgx_enclave_id_t src_enclave_id);
+//The mode a message was sent in, from the byte of its IV after the nonce
+static uint8_t message_mode(const secure_message_t* message)
+{
+    return message->message_aes_gcm_data.reserved[MESSAGE_MODE_OFFSET];
+}
+
+//The buffer kept with the session for its messages, grown to size bytes if it is smaller; once it has grown to the
+//largest of the session's messages, exchanging them allocates nothing
+static uint8_t* session_message_buffer(dh_session_t *session_info, size_t size)
+{
+    uint8_t* buffer;
+
+    if(session_info->message_buffer_size < size)
+    {
+        if(size > UINT32_MAX)
+        {
+            return NULL;
+        }
+        buffer = (uint8_t*)malloc(size);
+        if(!buffer)
+        {
+            return NULL;
+        }
+        SAFE_FREE(session_info->message_buffer);
+        session_info->message_buffer = buffer;
+        session_info->message_buffer_size = (uint32_t)size;
+    }
+    return session_info->message_buffer;
+}
+
+void release_session_buffers(dh_session_t *session_info)
+{
+    if(session_info)
+    {
+        SAFE_FREE(session_info->message_buffer);
+        session_info->message_buffer_size = 0;
+    }
+}
+
+//Windowed mode, responder: marks request sequence received, unless it was already or is too far behind the newest one to tell
+static bool window_receive(dh_session_t *session_info, uint32_t sequence)
+{
+    uint64_t window = session_info->active.window;
+    uint32_t edge = session_info->active.window_edge;
 
-//Array of open session ids
-session_id_tracker_t *g_session_id_tracker[MAX_SESSION_COUNT];
+    if(window == 0 || sequence > edge)
+    {
+        //A newer request moves the window up to it
+        uint32_t shift = (window == 0) ? SESSION_WINDOW_SIZE : sequence - edge;
+        window = (shift >= SESSION_WINDOW_SIZE) ? 0 : window << shift;
+        session_info->active.window = window | 1;
+        session_info->active.window_edge = sequence;
+        return true;
+    }
+    if(edge - sequence >= SESSION_WINDOW_SIZE || ((window >> (edge - sequence)) & 1))
+    {
+        return false;
+    }
+    session_info->active.window = window | (1ULL << (edge - sequence));
+    return true;
+}
+
+//Copy the session information into the session table entry of session_id
+static ATTESTATION_STATUS store_session(uint32_t session_id, sgx_enclave_id_t peer_enclave_id, const dh_session_t *session_info)
+{
+    dh_session_t *entry = session_table_acquire(session_id, peer_enclave_id);
+    if(!entry)
+    {
+        return INVALID_SESSION;
+    }
+    memcpy(entry, session_info, sizeof(dh_session_t));
+    session_table_release(entry);
+    return SUCCESS;
+}
 
-//Map between the source enclave id and the session information associated with that particular session
-std::map<sgx_enclave_id_t, dh_session_t>g_dest_session_info_map;
+//Establish the session with the initiator under session_id and the session key
+static ATTESTATION_STATUS activate_session(dh_session_t *session_info, sgx_enclave_id_t peer_enclave_id, uint32_t session_id, sgx_key_128bit_t *dh_aek)
+{
+    //save the session ID, status and initialize the session nonce
+    session_info->session_id = session_id;
+    session_info->status = ACTIVE;
+    session_info->active.counter = 0;
+    memcpy(session_info->active.AEK, dh_aek, sizeof(sgx_key_128bit_t));
+    memset(dh_aek,0, sizeof(sgx_key_128bit_t));
+
+    //Activate the session stored for the initiator so that generate_response serves its requests
+    return store_session(session_id, peer_enclave_id, session_info);
+}
 
 //Create a session with the destination enclave
 ATTESTATION_STATUS create_session(sgx_enclave_id_t src_enclave_id,
@@ -87,6 +175,8 @@ ATTESTATION_STATUS create_session(sgx_enclave_id_t src_enclave_id,
 	// for exchange report
 	// ATTESTATION_STATUS status = SUCCESS;
 	sgx_dh_session_enclave_identity_t initiator_identity;
+    session_hello_t hello;
+    session_resume_t resume;
 
     if(!session_info)
     {
@@ -107,34 +197,55 @@ ATTESTATION_STATUS create_session(sgx_enclave_id_t src_enclave_id,
         return status;
     }
 
-    //get a new SessionID
+    //A new handshake replaces any session kept for the initiator, which it no longer holds: a resume the responder
+    //accepted leaves the session active here even when session_cache_resume then fails on the initiator's side
+    session_table_remove_peer(dest_enclave_id);
+
+    //Reserve the session of the initiator under a new SessionID
 	ocall_print_string("[ECALL] Getting a new SessionID\n");
-    if ((status = (sgx_status_t)generate_session_id(&session_id)) != SUCCESS)
+    if ((status = (sgx_status_t)session_table_create(dest_enclave_id, &session_id)) != SUCCESS)
         return status; //no more sessions available
 
-    //Allocate memory for the session id tracker
-    g_session_id_tracker[session_id] = (session_id_tracker_t *)malloc(sizeof(session_id_tracker_t));
-    if(!g_session_id_tracker[session_id])
+    session_info->session_id = session_id;
+    session_info->status = IN_PROGRESS;
+
+    //Get the hello of the initiator, which may ask to resume the session cached for it
+    status = session_hello_ocall(&retstatus, src_enclave_id, dest_enclave_id, &hello);
+    if (status != SGX_SUCCESS || (ATTESTATION_STATUS)retstatus != SUCCESS)
     {
-        return MALLOC_ERROR;
+        session_table_remove(session_id);
+        return status == SGX_SUCCESS ? (ATTESTATION_STATUS)retstatus : ATTESTATION_SE_ERROR;
     }
 
-	memset(g_session_id_tracker[session_id], 0, sizeof(session_id_tracker_t));
-    g_session_id_tracker[session_id]->session_id = session_id;
-    session_info->status = IN_PROGRESS;
+    //Resume the cached session if the hello names one, else ask for the full DH exchange
+    if(session_cache_accept(dest_enclave_id, &hello, session_id, &resume, &dh_aek) == SUCCESS)
+    {
+        ocall_print_string("[ECALL] Resuming the session cached for Enclave1(Initiator)\n");
+    }
+    status = session_resume_ocall(&retstatus, src_enclave_id, dest_enclave_id, &resume);
+    if (status != SGX_SUCCESS || (ATTESTATION_STATUS)retstatus != SUCCESS)
+    {
+        memset(&dh_aek,0, sizeof(sgx_key_128bit_t));
+        session_table_remove(session_id);
+        return status == SGX_SUCCESS ? (ATTESTATION_STATUS)retstatus : ATTESTATION_SE_ERROR;
+    }
+    if(resume.accepted)
+    {
+        return activate_session(session_info, dest_enclave_id, session_id, &dh_aek);
+    }
 
 	//Generate Message1 that will be returned to Source Enclave
 	ocall_print_string("[ECALL] Generating message1 that will be passed to session initiator\n");
     status = sgx_dh_responder_gen_msg1((sgx_dh_msg1_t*)&dh_msg1, &sgx_dh_session);
     if(SGX_SUCCESS != status)
     {
-        SAFE_FREE(g_session_id_tracker[session_id]);
+        session_table_remove(session_id);
         return status;
     }
 
 	memcpy(&session_info->in_progress.dh_session, &sgx_dh_session, sizeof(sgx_dh_session_t));
-    //Store the session information under the correspoding source enlave id key
-	g_dest_session_info_map.insert(std::pair<sgx_enclave_id_t, dh_session_t>(0, *session_info));
+    //Store the session information in the session reserved for the initiator
+	store_session(session_id, dest_enclave_id, session_info);
 
 	// pass session id and msg1 to shared memory
 	// ocall_print_string("Entering session_request_ocall for IPC\n");
@@ -142,10 +253,14 @@ ATTESTATION_STATUS create_session(sgx_enclave_id_t src_enclave_id,
     if (status == SGX_SUCCESS)
     {
         if ((ATTESTATION_STATUS)retstatus != SUCCESS)
+        {
+            session_table_remove(session_id);
             return ((ATTESTATION_STATUS)retstatus);
+        }
     }
     else
     {
+        session_table_remove(session_id);
         return ATTESTATION_SE_ERROR;
     }
 
@@ -165,6 +280,7 @@ ATTESTATION_STATUS create_session(sgx_enclave_id_t src_enclave_id,
 
 	if(SGX_SUCCESS != se_ret)
     {
+        session_table_remove(session_id);
         status = se_ret;
         return status;
     }
@@ -173,6 +289,7 @@ ATTESTATION_STATUS create_session(sgx_enclave_id_t src_enclave_id,
 	ocall_print_string("[ECALL] Verifying Enclave1(Initiator)'s trust\n");
     if(verify_peer_enclave_trust(&initiator_identity) != SUCCESS)
     {
+        session_table_remove(session_id);
         return INVALID_SESSION;
     }
 
@@ -181,14 +298,20 @@ ATTESTATION_STATUS create_session(sgx_enclave_id_t src_enclave_id,
     if (status == SGX_SUCCESS)
     {
         if ((ATTESTATION_STATUS)retstatus != SUCCESS)
+        {
+            session_table_remove(session_id);
             return ((ATTESTATION_STATUS)retstatus);
+        }
     }
     else
     {
+        session_table_remove(session_id);
         return ATTESTATION_SE_ERROR;
     }
 
-    return status;
+    //Keep a resumption secret so that the initiator's next session skips the DH exchange
+    session_cache_store(dest_enclave_id, &initiator_identity, &dh_aek);
+    return activate_session(session_info, dest_enclave_id, session_id, &dh_aek);
 }
 
 //Handle the request from Source Enclave for a session
@@ -205,6 +328,7 @@ ATTESTATION_STATUS session_request(sgx_enclave_id_t src_enclave_id,
     {
         return INVALID_PARAMETER_ERROR;
     }
+    memset(&session_info, 0, sizeof(dh_session_t));
     //Intialize the session as a session responder
     status = sgx_dh_init_session(SGX_DH_SESSION_RESPONDER, &sgx_dh_session);
     if(SGX_SUCCESS != status)
@@ -212,31 +336,26 @@ ATTESTATION_STATUS session_request(sgx_enclave_id_t src_enclave_id,
         return status;
     }
 
-    //get a new SessionID
-    if ((status = (sgx_status_t)generate_session_id(session_id)) != SUCCESS)
-        return status; //no more sessions available
+    //A new handshake replaces any session kept for the source enclave, which the source enclave no longer holds
+    session_table_remove_peer(src_enclave_id);
 
-    //Allocate memory for the session id tracker
-    g_session_id_tracker[*session_id] = (session_id_tracker_t *)malloc(sizeof(session_id_tracker_t));
-    if(!g_session_id_tracker[*session_id])
-    {
-        return MALLOC_ERROR;
-    }
+    //Reserve the session of the source enclave under a new SessionID
+    if ((status = (sgx_status_t)session_table_create(src_enclave_id, session_id)) != SUCCESS)
+        return status; //no more sessions available
 
-    memset(g_session_id_tracker[*session_id], 0, sizeof(session_id_tracker_t));
-    g_session_id_tracker[*session_id]->session_id = *session_id;
+    session_info.session_id = *session_id;
     session_info.status = IN_PROGRESS;
 
     //Generate Message1 that will be returned to Source Enclave
     status = sgx_dh_responder_gen_msg1((sgx_dh_msg1_t*)dh_msg1, &sgx_dh_session);
     if(SGX_SUCCESS != status)
     {
-        SAFE_FREE(g_session_id_tracker[*session_id]);
+        session_table_remove(*session_id);
         return status;
     }
     memcpy(&session_info.in_progress.dh_session, &sgx_dh_session, sizeof(sgx_dh_session_t));
-    //Store the session information under the correspoding source enlave id key
-    g_dest_session_info_map.insert(std::pair<sgx_enclave_id_t, dh_session_t>(src_enclave_id, session_info));
+    //Store the session information in the session reserved for the source enclave
+    status = (sgx_status_t)store_session(*session_id, src_enclave_id, &session_info);
 
     return status;
 }
@@ -249,7 +368,7 @@ ATTESTATION_STATUS exchange_report(sgx_enclave_id_t src_enclave_id,
 {
 
     sgx_key_128bit_t dh_aek;   // Session key
-    dh_session_t *session_info;
+    dh_session_t *session_info = NULL;
     ATTESTATION_STATUS status = SUCCESS;
     sgx_dh_session_t sgx_dh_session;
     sgx_dh_session_enclave_identity_t initiator_identity;
@@ -262,19 +381,15 @@ ATTESTATION_STATUS exchange_report(sgx_enclave_id_t src_enclave_id,
     memset(&dh_aek,0, sizeof(sgx_key_128bit_t));
     do
     {
-        //Retreive the session information for the corresponding source enclave id
-        std::map<sgx_enclave_id_t, dh_session_t>::iterator it = g_dest_session_info_map.find(src_enclave_id);
-        if(it != g_dest_session_info_map.end())
-        {
-            session_info = &it->second;
-        }
-        else
+        //Retreive the session information for the corresponding source enclave id, locked until it is updated
+        session_info = session_table_acquire_peer(src_enclave_id);
+        if(!session_info)
         {
             status = INVALID_SESSION;
             break;
         }
 
-        if(session_info->status != IN_PROGRESS)
+        if(session_info->status != IN_PROGRESS || session_info->session_id != session_id)
         {
             status = INVALID_SESSION;
             break;
@@ -298,18 +413,22 @@ ATTESTATION_STATUS exchange_report(sgx_enclave_id_t src_enclave_id,
         //Verify source enclave's trust
           if(verify_peer_enclave_trust(&initiator_identity) != SUCCESS)
         {
+            session_table_release(session_info);
             return INVALID_SESSION;
         }
 
-        //save the session ID, status and initialize the session nonce
-        session_info->session_id = session_id;
+        //save the status and initialize the session nonce
         session_info->status = ACTIVE;
         session_info->active.counter = 0;
         memcpy(session_info->active.AEK, &dh_aek, sizeof(sgx_key_128bit_t));
         memset(&dh_aek,0, sizeof(sgx_key_128bit_t));
-        g_session_count++;
     }while(0);
 
+    if(session_info)
+    {
+        session_table_release(session_info);
+    }
+
     if(status != SUCCESS)
     {
         end_session(src_enclave_id);
@@ -327,48 +446,221 @@ ATTESTATION_STATUS send_request_receive_response(sgx_enclave_id_t src_enclave_id
                                   size_t max_out_buff_size,
                                   char **out_buff,
                                   size_t* out_buff_len)
+{
+    ATTESTATION_STATUS status;
+
+    if(!out_buff || !out_buff_len)
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
+
+    //Allocate memory for the response payload to be copied
+    *out_buff = (char*)malloc(max_out_buff_size);
+    if(!*out_buff)
+    {
+        return MALLOC_ERROR;
+    }
+
+    memset(*out_buff, 0, max_out_buff_size);
+
+    status = send_request_receive_response_in_place(src_enclave_id, dest_enclave_id, session_info, inp_buff, inp_buff_len,
+                                                    *out_buff, max_out_buff_size, out_buff_len);
+    if(status != SUCCESS)
+    {
+        SAFE_FREE(*out_buff);
+    }
+    return status;
+}
+
+//Send the request message to the destination enclave and decrypt its response into out_buff, through the buffer kept with the session
+ATTESTATION_STATUS send_request_receive_response_in_place(sgx_enclave_id_t src_enclave_id,
+                                  sgx_enclave_id_t dest_enclave_id,
+                                  dh_session_t *session_info,
+                                  const char *inp_buff,
+                                  size_t inp_buff_len,
+                                  char *out_buff,
+                                  size_t out_buff_size,
+                                  size_t* out_buff_len)
 {
     const uint8_t* plaintext;
     uint32_t plaintext_length;
     sgx_status_t status;
     uint32_t retstatus;
-    secure_message_t* req_message;
-    secure_message_t* resp_message;
-    uint8_t *decrypted_data;
+    secure_message_t* message;
+    size_t req_message_size, resp_message_size;
     uint32_t decrypted_data_length;
-    uint32_t plain_text_offset;
-    uint8_t l_tag[TAG_SIZE];
-    size_t max_resp_message_length;
+    uint32_t nonce;
     plaintext = (const uint8_t*)(" ");
     plaintext_length = 0;
 
-    if(!session_info || !inp_buff)
+    if(!session_info || !inp_buff || !out_buff || !out_buff_len || inp_buff_len > UINT32_MAX)
     {
         return INVALID_PARAMETER_ERROR;
     }
+    //The responses to requests of windowed mode come first
+    if(session_info->active.window != 0)
+    {
+        return WINDOW_FULL_ERROR;
+    }
     //Check if the nonce for the session has not exceeded 2^32-2 if so end session and start a new session
-    if(session_info->active.counter == ((uint32_t) - 2))
+    if(__atomic_load_n(&session_info->active.counter, __ATOMIC_RELAXED) >= ((uint32_t) - 2))
     {
+        release_session_buffers(session_info);
         close_session(src_enclave_id, dest_enclave_id);
         create_session(src_enclave_id, dest_enclave_id, session_info);
     }
 
-    //Allocate memory for the AES-GCM request message
-    req_message = (secure_message_t*)malloc(sizeof(secure_message_t)+ inp_buff_len);
-    if(!req_message)
+    //Take the next session nonce for the request; each request gets its own even if callers race for the session
+    nonce = __atomic_fetch_add(&session_info->active.counter, 1, __ATOMIC_RELAXED);
+
+    //The request and then its response take the session's buffer: the ocall copies the request out before the response comes in
+    req_message_size = sizeof(secure_message_t)+ inp_buff_len;
+    resp_message_size = sizeof(secure_message_t)+ out_buff_size;
+    message = (secure_message_t*)session_message_buffer(session_info, (req_message_size > resp_message_size) ? req_message_size : resp_message_size);
+    if(!message)
     {
         return MALLOC_ERROR;
     }
 
-    memset(req_message,0,sizeof(secure_message_t)+ inp_buff_len);
+    memset(message,0,sizeof(secure_message_t));
     const uint32_t data2encrypt_length = (uint32_t)inp_buff_len;
     //Set the payload size to data to encrypt length
-    req_message->message_aes_gcm_data.payload_size = data2encrypt_length;
+    message->message_aes_gcm_data.payload_size = data2encrypt_length;
 
     //Use the session nonce as the payload IV
-    memcpy(req_message->message_aes_gcm_data.reserved,&session_info->active.counter,sizeof(session_info->active.counter));
+    memcpy(message->message_aes_gcm_data.reserved,&nonce,sizeof(nonce));
 
     //Set the session ID of the message to the current session id
+    message->session_id = session_info->session_id;
+
+    //Prepare the request message with the encrypted payload
+    status = sgx_rijndael128GCM_encrypt(&session_info->active.AEK, (const uint8_t*)inp_buff, data2encrypt_length,
+                reinterpret_cast<uint8_t *>(&(message->message_aes_gcm_data.payload)),
+                reinterpret_cast<uint8_t *>(&(message->message_aes_gcm_data.reserved)),
+                sizeof(message->message_aes_gcm_data.reserved), plaintext, plaintext_length,
+                &(message->message_aes_gcm_data.payload_tag));
+
+    if(SGX_SUCCESS != status)
+    {
+        return status;
+    }
+
+    //Ocall to send the request to the Destination Enclave and get the response message back
+    status = send_request_ocall(&retstatus, src_enclave_id, dest_enclave_id, message, req_message_size, out_buff_size,
+                                message, resp_message_size);
+    if (status == SGX_SUCCESS)
+    {
+        if ((ATTESTATION_STATUS)retstatus != SUCCESS)
+            return ((ATTESTATION_STATUS)retstatus);
+    }
+    else
+    {
+        return ATTESTATION_SE_ERROR;
+    }
+
+    //Code to process the response message from the Destination Enclave
+
+    decrypted_data_length = message->message_aes_gcm_data.payload_size;
+    if(decrypted_data_length > out_buff_size)
+    {
+        return OUT_BUFFER_LENGTH_ERROR;
+    }
+
+    //Decrypt the response message payload straight into the caller's buffer
+    status = sgx_rijndael128GCM_decrypt(&session_info->active.AEK, message->message_aes_gcm_data.payload,
+                decrypted_data_length, (uint8_t*)out_buff,
+                reinterpret_cast<uint8_t *>(&(message->message_aes_gcm_data.reserved)),
+                sizeof(message->message_aes_gcm_data.reserved), plaintext, plaintext_length,
+                &message->message_aes_gcm_data.payload_tag);
+
+    if(SGX_SUCCESS != status)
+    {
+        memset(out_buff, 0, decrypted_data_length);
+        return status;
+    }
+
+    // Verify if the nonce obtained in the response is equal to the session nonce + 1 (Prevents replay attacks)
+    if(message_nonce(message) != (nonce + 1 ) || message_mode(message) != MESSAGE_LOCK_STEP)
+    {
+        memset(out_buff, 0, decrypted_data_length);
+        return INVALID_PARAMETER_ERROR;
+    }
+
+    *out_buff_len = decrypted_data_length;
+    return SUCCESS;
+}
+
+//Give back the nonce of a request that never reached the destination enclave, so that the destination enclave's
+//session nonce, one past the last request it served, still matches; not if a later request has taken a nonce since
+static void return_nonce(dh_session_t *session_info, uint32_t nonce)
+{
+    uint32_t next = nonce + 1;
+    __atomic_compare_exchange_n(&session_info->active.counter, &next, nonce, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+//Windowed mode: encrypt the request under the next sequence number and pass it to the destination enclave without waiting for the response
+ATTESTATION_STATUS send_request(sgx_enclave_id_t src_enclave_id,
+                                sgx_enclave_id_t dest_enclave_id,
+                                dh_session_t *session_info,
+                                char *inp_buff,
+                                size_t inp_buff_len,
+                                size_t max_out_buff_size,
+                                uint32_t *sequence)
+{
+    const uint8_t* plaintext;
+    uint32_t plaintext_length;
+    sgx_status_t status;
+    uint32_t retstatus;
+    secure_message_t* req_message;
+    uint32_t nonce;
+    plaintext = (const uint8_t*)(" ");
+    plaintext_length = 0;
+
+    if(!session_info || !inp_buff || !sequence)
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
+
+    //The next request must fit in the window that starts at the oldest request in flight
+    nonce = __atomic_load_n(&session_info->active.counter, __ATOMIC_RELAXED);
+    if(session_info->active.window != 0 && nonce - session_info->active.window_edge >= SESSION_WINDOW_SIZE)
+    {
+        return WINDOW_FULL_ERROR;
+    }
+    //Check if the nonce for the session has not exceeded 2^32-2 if so end session and start a new session, once no request is in flight
+    if(nonce >= ((uint32_t) - 2))
+    {
+        if(session_info->active.window != 0)
+        {
+            return WINDOW_FULL_ERROR;
+        }
+        release_session_buffers(session_info);
+        close_session(src_enclave_id, dest_enclave_id);
+        create_session(src_enclave_id, dest_enclave_id, session_info);
+    }
+
+    //Take the next session nonce as the sequence number of the request
+    nonce = __atomic_fetch_add(&session_info->active.counter, 1, __ATOMIC_RELAXED);
+    if(session_info->active.window == 0)
+    {
+        session_info->active.window_edge = nonce;
+    }
+
+    //The AES-GCM request message takes the session's buffer
+    req_message = (secure_message_t*)session_message_buffer(session_info, sizeof(secure_message_t)+ inp_buff_len);
+    if(!req_message)
+    {
+        return_nonce(session_info, nonce);
+        return MALLOC_ERROR;
+    }
+
+    memset(req_message,0,sizeof(secure_message_t));
+    const uint32_t data2encrypt_length = (uint32_t)inp_buff_len;
+    req_message->message_aes_gcm_data.payload_size = data2encrypt_length;
+
+    //Use the sequence number and the mode as the payload IV
+    memcpy(req_message->message_aes_gcm_data.reserved,&nonce,sizeof(nonce));
+    req_message->message_aes_gcm_data.reserved[MESSAGE_MODE_OFFSET] = MESSAGE_WINDOW_REQUEST;
     req_message->session_id = session_info->session_id;
 
     //Prepare the request message with the encrypted payload
@@ -380,162 +672,194 @@ ATTESTATION_STATUS send_request_receive_response(sgx_enclave_id_t src_enclave_id
 
     if(SGX_SUCCESS != status)
     {
-        SAFE_FREE(req_message);
+        return_nonce(session_info, nonce);
         return status;
     }
 
+    //Ocall to pass the request to the Destination Enclave, the response is fetched by receive_response.
+    //A channel with no room refuses it with WINDOW_FULL_ERROR before it is sent, and its sequence number is given back
+    status = post_request_ocall(&retstatus, src_enclave_id, dest_enclave_id, req_message,
+                                (sizeof(secure_message_t)+ inp_buff_len), max_out_buff_size);
+    if (status == SGX_SUCCESS)
+    {
+        if ((ATTESTATION_STATUS)retstatus == WINDOW_FULL_ERROR)
+            return_nonce(session_info, nonce);
+        if ((ATTESTATION_STATUS)retstatus != SUCCESS)
+            return ((ATTESTATION_STATUS)retstatus);
+    }
+    else
+    {
+        return ATTESTATION_SE_ERROR;
+    }
+
+    //The request is in flight until receive_response gets its response
+    session_info->active.window |= 1ULL << (nonce - session_info->active.window_edge);
+    *sequence = nonce;
+    return SUCCESS;
+}
+
+//Windowed mode: receive the next response from the destination enclave, to any request in flight, along with the sequence number of that request
+ATTESTATION_STATUS receive_response(sgx_enclave_id_t src_enclave_id,
+                                    sgx_enclave_id_t dest_enclave_id,
+                                    dh_session_t *session_info,
+                                    size_t max_out_buff_size,
+                                    char **out_buff,
+                                    size_t* out_buff_len,
+                                    uint32_t *sequence)
+{
+    ATTESTATION_STATUS status;
+
+    if(!out_buff || !out_buff_len)
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
+
     //Allocate memory for the response payload to be copied
     *out_buff = (char*)malloc(max_out_buff_size);
     if(!*out_buff)
     {
-        SAFE_FREE(req_message);
         return MALLOC_ERROR;
     }
 
-    memset(*out_buff, 0, max_out_buff_size);
+    status = receive_response_in_place(src_enclave_id, dest_enclave_id, session_info, *out_buff, max_out_buff_size,
+                                       out_buff_len, sequence);
+    if(status != SUCCESS)
+    {
+        SAFE_FREE(*out_buff);
+    }
+    return status;
+}
+
+//Windowed mode: receive the next response through the buffer kept with the session and decrypt it into out_buff
+ATTESTATION_STATUS receive_response_in_place(sgx_enclave_id_t src_enclave_id,
+                                             sgx_enclave_id_t dest_enclave_id,
+                                             dh_session_t *session_info,
+                                             char *out_buff,
+                                             size_t out_buff_size,
+                                             size_t* out_buff_len,
+                                             uint32_t *sequence)
+{
+    const uint8_t* plaintext;
+    uint32_t plaintext_length;
+    sgx_status_t status;
+    uint32_t retstatus;
+    secure_message_t* resp_message;
+    size_t resp_message_size;
+    uint32_t decrypted_data_length;
+    uint32_t nonce, offset;
+    plaintext = (const uint8_t*)(" ");
+    plaintext_length = 0;
 
-    //Allocate memory for the response message
-    resp_message = (secure_message_t*)malloc(sizeof(secure_message_t)+ max_out_buff_size);
+    if(!session_info || !out_buff || !out_buff_len || !sequence)
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
+    if(session_info->active.window == 0)
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
+
+    //The response message takes the session's buffer
+    resp_message_size = sizeof(secure_message_t)+ out_buff_size;
+    resp_message = (secure_message_t*)session_message_buffer(session_info, resp_message_size);
     if(!resp_message)
     {
-        SAFE_FREE(req_message);
         return MALLOC_ERROR;
     }
 
-    memset(resp_message, 0, sizeof(secure_message_t)+ max_out_buff_size);
+    memset(resp_message, 0, sizeof(secure_message_t));
 
-    //Ocall to send the request to the Destination Enclave and get the response message back
-    status = send_request_ocall(&retstatus, src_enclave_id, dest_enclave_id, req_message,
-                                (sizeof(secure_message_t)+ inp_buff_len), max_out_buff_size,
-                                resp_message, (sizeof(secure_message_t)+ max_out_buff_size));
+    //Ocall to get the next response of the Destination Enclave
+    status = fetch_response_ocall(&retstatus, src_enclave_id, dest_enclave_id, resp_message, resp_message_size);
     if (status == SGX_SUCCESS)
     {
         if ((ATTESTATION_STATUS)retstatus != SUCCESS)
-        {
-            SAFE_FREE(req_message);
-            SAFE_FREE(resp_message);
             return ((ATTESTATION_STATUS)retstatus);
-        }
     }
     else
     {
-        SAFE_FREE(req_message);
-        SAFE_FREE(resp_message);
         return ATTESTATION_SE_ERROR;
     }
 
-    max_resp_message_length = sizeof(secure_message_t)+ max_out_buff_size;
-
-    if(sizeof(resp_message) > max_resp_message_length)
-    {
-        SAFE_FREE(req_message);
-        SAFE_FREE(resp_message);
-        return INVALID_PARAMETER_ERROR;
-    }
-
-    //Code to process the response message from the Destination Enclave
-
     decrypted_data_length = resp_message->message_aes_gcm_data.payload_size;
-    plain_text_offset = decrypted_data_length;
-    decrypted_data = (uint8_t*)malloc(decrypted_data_length);
-    if(!decrypted_data)
+    if(decrypted_data_length > out_buff_size)
     {
-        SAFE_FREE(req_message);
-        SAFE_FREE(resp_message);
-        return MALLOC_ERROR;
+        return OUT_BUFFER_LENGTH_ERROR;
     }
-    memset(&l_tag, 0, 16);
 
-    memset(decrypted_data, 0, decrypted_data_length);
-
-    //Decrypt the response message payload
+    //Decrypt the response message payload straight into the caller's buffer
     status = sgx_rijndael128GCM_decrypt(&session_info->active.AEK, resp_message->message_aes_gcm_data.payload,
-                decrypted_data_length, decrypted_data,
+                decrypted_data_length, (uint8_t*)out_buff,
                 reinterpret_cast<uint8_t *>(&(resp_message->message_aes_gcm_data.reserved)),
-                sizeof(resp_message->message_aes_gcm_data.reserved), &(resp_message->message_aes_gcm_data.payload[plain_text_offset]), plaintext_length,
+                sizeof(resp_message->message_aes_gcm_data.reserved), plaintext, plaintext_length,
                 &resp_message->message_aes_gcm_data.payload_tag);
 
     if(SGX_SUCCESS != status)
     {
-        SAFE_FREE(req_message);
-        SAFE_FREE(decrypted_data);
-        SAFE_FREE(resp_message);
+        memset(out_buff, 0, decrypted_data_length);
         return status;
     }
 
-    // Verify if the nonce obtained in the response is equal to the session nonce + 1 (Prevents replay attacks)
-    if(*(resp_message->message_aes_gcm_data.reserved) != (session_info->active.counter + 1 ))
+    //The response must answer a request in flight, which it takes out of the window (Prevents replay attacks)
+    nonce = message_nonce(resp_message);
+    offset = nonce - session_info->active.window_edge;
+    if(message_mode(resp_message) != MESSAGE_WINDOW_RESPONSE || offset >= SESSION_WINDOW_SIZE ||
+       !((session_info->active.window >> offset) & 1))
     {
-        SAFE_FREE(req_message);
-        SAFE_FREE(resp_message);
-        SAFE_FREE(decrypted_data);
+        memset(out_buff, 0, decrypted_data_length);
         return INVALID_PARAMETER_ERROR;
     }
+    session_info->active.window &= ~(1ULL << offset);
 
-        //Update the value of the session nonce in the source enclave
-    session_info->active.counter = session_info->active.counter + 1;
+    //Slide the window up to the oldest request still in flight
+    while(session_info->active.window != 0 && !(session_info->active.window & 1))
+    {
+        session_info->active.window >>= 1;
+        session_info->active.window_edge++;
+    }
 
-    memcpy(out_buff_len, &decrypted_data_length, sizeof(decrypted_data_length));
-    memcpy(*out_buff, decrypted_data, decrypted_data_length);
+    *out_buff_len = decrypted_data_length;
+    *sequence = nonce;
 
-    SAFE_FREE(decrypted_data);
-    SAFE_FREE(req_message);
-    SAFE_FREE(resp_message);
     return SUCCESS;
-
-
 }
 
-//Process the request from the Source enclave and send the response message back to the Source enclave
-ATTESTATION_STATUS generate_response(sgx_enclave_id_t src_enclave_id,
-                                     secure_message_t* req_message,
-                                     size_t req_message_size,
-                                     size_t max_payload_size,
-                                     secure_message_t* resp_message,
-                                     size_t resp_message_size)
+//Decrypt the request of the locked session, process it and encrypt the response into resp_message.
+//req_header is the enclave's copy of the request header; the payload and resp_message are in untrusted memory.
+static ATTESTATION_STATUS serve_request(dh_session_t *session_info,
+                                        const secure_message_t* req_header,
+                                        const uint8_t* req_payload,
+                                        size_t req_message_size,
+                                        size_t max_payload_size,
+                                        secure_message_t* resp_message,
+                                        size_t resp_message_size)
 {
     const uint8_t* plaintext;
     uint32_t plaintext_length;
+    uint8_t *encrypted_data;
     uint8_t *decrypted_data;
     uint32_t decrypted_data_length;
     uint32_t plain_text_offset;
     ms_in_msg_exchange_t * ms;
     size_t resp_data_length;
-    size_t resp_message_calc_size;
+    size_t resp_data_size;
     char* resp_data;
-    uint8_t l_tag[TAG_SIZE];
+    secure_message_t resp_header;
     size_t header_size, expected_payload_size;
-    dh_session_t *session_info;
-    secure_message_t* temp_resp_message;
     uint32_t ret;
+    uint8_t mode;
     sgx_status_t status;
 
     plaintext = (const uint8_t*)(" ");
     plaintext_length = 0;
 
-    if(!req_message || !resp_message)
-    {
-        return INVALID_PARAMETER_ERROR;
-    }
-
-    //Get the session information from the map corresponding to the source enclave id
-    std::map<sgx_enclave_id_t, dh_session_t>::iterator it = g_dest_session_info_map.find(src_enclave_id);
-    if(it != g_dest_session_info_map.end())
-    {
-        session_info = &it->second;
-    }
-    else
-    {
-        return INVALID_SESSION;
-    }
-
     if(session_info->status != ACTIVE)
     {
         return INVALID_SESSION;
     }
 
     //Set the decrypted data length to the payload size obtained from the message
-    decrypted_data_length = req_message->message_aes_gcm_data.payload_size;
+    decrypted_data_length = req_header->message_aes_gcm_data.payload_size;
 
     header_size = sizeof(secure_message_t);
     expected_payload_size = req_message_size - header_size;
@@ -544,128 +868,171 @@ ATTESTATION_STATUS generate_response(sgx_enclave_id_t src_enclave_id,
     if(expected_payload_size != decrypted_data_length)
         return INVALID_PARAMETER_ERROR;
 
-    memset(&l_tag, 0, 16);
+    //The request must at least say what it is for
+    if(decrypted_data_length < sizeof(ms_in_msg_exchange_t))
+        return INVALID_PARAMETER_ERROR;
+
+    //The response is built for the room the initiator gave it, as much as the response message holds
+    if(resp_message_size < sizeof(secure_message_t))
+        return OUT_BUFFER_LENGTH_ERROR;
+    resp_data_size = resp_message_size - sizeof(secure_message_t);
+    if(resp_data_size > max_payload_size)
+        resp_data_size = max_payload_size;
+
     plain_text_offset = decrypted_data_length;
-    decrypted_data = (uint8_t*)malloc(decrypted_data_length);
-    if(!decrypted_data)
+    //The buffer kept with the session holds the request payload copied in once, the request decrypted and its response built
+    encrypted_data = session_message_buffer(session_info, 2 * (size_t)decrypted_data_length + resp_data_size);
+    if(!encrypted_data)
     {
             return MALLOC_ERROR;
     }
+    decrypted_data = encrypted_data + decrypted_data_length;
+    resp_data = (char*)decrypted_data + decrypted_data_length;
 
-    memset(decrypted_data, 0, decrypted_data_length);
+    //Copy the payload into the enclave before it is authenticated, since the untrusted side may change it meanwhile
+    memcpy(encrypted_data, req_payload, decrypted_data_length);
 
     //Decrypt the request message payload from source enclave
-    status = sgx_rijndael128GCM_decrypt(&session_info->active.AEK, req_message->message_aes_gcm_data.payload,
+    status = sgx_rijndael128GCM_decrypt(&session_info->active.AEK, encrypted_data,
                 decrypted_data_length, decrypted_data,
-                reinterpret_cast<uint8_t *>(&(req_message->message_aes_gcm_data.reserved)),
-                sizeof(req_message->message_aes_gcm_data.reserved), &(req_message->message_aes_gcm_data.payload[plain_text_offset]), plaintext_length,
-                &req_message->message_aes_gcm_data.payload_tag);
+                reinterpret_cast<const uint8_t *>(&(req_header->message_aes_gcm_data.reserved)),
+                sizeof(req_header->message_aes_gcm_data.reserved), &(encrypted_data[plain_text_offset]), plaintext_length,
+                &req_header->message_aes_gcm_data.payload_tag);
 
     if(SGX_SUCCESS != status)
     {
-        SAFE_FREE(decrypted_data);
         return status;
     }
 
     //Casting the decrypted data to the marshaling structure type to obtain type of request (generic message exchange/enclave to enclave call)
     ms = (ms_in_msg_exchange_t *)decrypted_data;
 
+    //The parameters fill the rest of the request, so that they are read where they lie without running past it
+    if(ms->inparam_buff_len != decrypted_data_length - sizeof(ms_in_msg_exchange_t))
+        return INVALID_PARAMETER_ERROR;
+
 
+    mode = message_mode(req_header);
+    if(mode == MESSAGE_WINDOW_REQUEST)
+    {
+        // A request of windowed mode carries its sequence number, which must not have been received before
+        if(!window_receive(session_info, message_nonce(req_header)))
+        {
+            return INVALID_PARAMETER_ERROR;
+        }
+    }
     // Verify if the nonce obtained in the request is equal to the session nonce
-    if((uint32_t)*(req_message->message_aes_gcm_data.reserved) != session_info->active.counter || *(req_message->message_aes_gcm_data.reserved) > ((2^32)-2))
+    else if(mode != MESSAGE_LOCK_STEP || message_nonce(req_header) != session_info->active.counter || message_nonce(req_header) > ((uint32_t) - 2))
     {
-        SAFE_FREE(decrypted_data);
         return INVALID_PARAMETER_ERROR;
     }
 
     if(ms->msg_type == MESSAGE_EXCHANGE)
     {
         //Call the generic secret response generator for message exchange
-        ret = message_exchange_response_generator((char*)decrypted_data, &resp_data, &resp_data_length);
-        if(ret !=0)
-        {
-            SAFE_FREE(decrypted_data);
-            SAFE_FREE(resp_data);
-            return INVALID_SESSION;
-        }
+        ret = message_exchange_response_generator((char*)decrypted_data, resp_data, resp_data_size, &resp_data_length);
     }
     else if(ms->msg_type == ENCLAVE_TO_ENCLAVE_CALL)
     {
         //Call the destination enclave's dispatcher to call the appropriate function in the destination enclave
-        ret = enclave_to_enclave_call_dispatcher((char*)decrypted_data, decrypted_data_length, &resp_data, &resp_data_length);
-        if(ret !=0)
-        {
-            SAFE_FREE(decrypted_data);
-            SAFE_FREE(resp_data);
-            return INVALID_SESSION;
-        }
+        ret = enclave_to_enclave_call_dispatcher((char*)decrypted_data, decrypted_data_length, resp_data, resp_data_size, &resp_data_length);
     }
-    else
+    else if(ms->msg_type == MESSAGE_BATCH)
     {
-        SAFE_FREE(decrypted_data);
-        return INVALID_REQUEST_TYPE_ERROR;
+        //Serve each call of the batch, under the one request message
+        ret = batch_response_generator((char*)decrypted_data, decrypted_data_length, resp_data, resp_data_size, &resp_data_length);
     }
-
-
-    if(resp_data_length > max_payload_size)
+    else
     {
-        SAFE_FREE(resp_data);
-        SAFE_FREE(decrypted_data);
-        return OUT_BUFFER_LENGTH_ERROR;
+        return INVALID_REQUEST_TYPE_ERROR;
     }
 
-    resp_message_calc_size = sizeof(secure_message_t)+ resp_data_length;
-
-    if(resp_message_calc_size > resp_message_size)
+    //A response larger than the room the source enclave gave it is reported as such
+    if(ret == OUT_BUFFER_LENGTH_ERROR || (ret == SUCCESS && resp_data_length > resp_data_size))
     {
-        SAFE_FREE(resp_data);
-        SAFE_FREE(decrypted_data);
         return OUT_BUFFER_LENGTH_ERROR;
     }
-
-    //Code to build the response back to the Source Enclave
-    temp_resp_message = (secure_message_t*)malloc(resp_message_calc_size);
-    if(!temp_resp_message)
+    if(ret != SUCCESS)
     {
-            SAFE_FREE(resp_data);
-            SAFE_FREE(decrypted_data);
-            return MALLOC_ERROR;
+        return INVALID_SESSION;
     }
 
-    memset(temp_resp_message,0,sizeof(secure_message_t)+ resp_data_length);
+    //Code to build the response back to the Source Enclave; the header is kept in the enclave until it is final
+    memset(&resp_header,0,sizeof(secure_message_t));
     const uint32_t data2encrypt_length = (uint32_t)resp_data_length;
-    temp_resp_message->session_id = session_info->session_id;
-    temp_resp_message->message_aes_gcm_data.payload_size = data2encrypt_length;
+    resp_header.session_id = session_info->session_id;
+    resp_header.message_aes_gcm_data.payload_size = data2encrypt_length;
 
-    //Increment the Session Nonce (Replay Protection)
-    session_info->active.counter = session_info->active.counter + 1;
+    if(mode == MESSAGE_WINDOW_REQUEST)
+    {
+        //Answer with the sequence number of the request, and keep the session nonce past it for the lock-step requests that follow
+        memcpy(&resp_header.message_aes_gcm_data.reserved,&req_header->message_aes_gcm_data.reserved,sizeof(uint32_t));
+        resp_header.message_aes_gcm_data.reserved[MESSAGE_MODE_OFFSET] = MESSAGE_WINDOW_RESPONSE;
+        if(message_nonce(req_header) >= session_info->active.counter)
+            session_info->active.counter = message_nonce(req_header) + 1;
+    }
+    else
+    {
+        //Increment the Session Nonce (Replay Protection)
+        session_info->active.counter = session_info->active.counter + 1;
 
-    //Set the response nonce as the session nonce
-    memcpy(&temp_resp_message->message_aes_gcm_data.reserved,&session_info->active.counter,sizeof(session_info->active.counter));
+        //Set the response nonce as the session nonce
+        memcpy(&resp_header.message_aes_gcm_data.reserved,&session_info->active.counter,sizeof(session_info->active.counter));
+    }
 
-    //Prepare the response message with the encrypted payload
+    //Encrypt the response payload straight into the response message
     status = sgx_rijndael128GCM_encrypt(&session_info->active.AEK, (uint8_t*)resp_data, data2encrypt_length,
-                reinterpret_cast<uint8_t *>(&(temp_resp_message->message_aes_gcm_data.payload)),
-                reinterpret_cast<uint8_t *>(&(temp_resp_message->message_aes_gcm_data.reserved)),
-                sizeof(temp_resp_message->message_aes_gcm_data.reserved), plaintext, plaintext_length,
-                &(temp_resp_message->message_aes_gcm_data.payload_tag));
+                reinterpret_cast<uint8_t *>(&(resp_message->message_aes_gcm_data.payload)),
+                reinterpret_cast<uint8_t *>(&(resp_header.message_aes_gcm_data.reserved)),
+                sizeof(resp_header.message_aes_gcm_data.reserved), plaintext, plaintext_length,
+                &(resp_header.message_aes_gcm_data.payload_tag));
 
     if(SGX_SUCCESS != status)
     {
-        SAFE_FREE(resp_data);
-        SAFE_FREE(decrypted_data);
-        SAFE_FREE(temp_resp_message);
         return status;
     }
 
-    memset(resp_message, 0, sizeof(secure_message_t)+ resp_data_length);
-    memcpy(resp_message, temp_resp_message, sizeof(secure_message_t)+ resp_data_length);
+    memcpy(resp_message, &resp_header, sizeof(secure_message_t));
+    return SUCCESS;
+}
+
+//Process the request from the Source enclave and send the response message back to the Source enclave
+ATTESTATION_STATUS generate_response(sgx_enclave_id_t src_enclave_id,
+                                     secure_message_t* req_message,
+                                     size_t req_message_size,
+                                     size_t max_payload_size,
+                                     secure_message_t* resp_message,
+                                     size_t resp_message_size)
+{
+    ATTESTATION_STATUS status;
+    dh_session_t *session_info;
+    secure_message_t req_header;
+
+    if(!req_message || !resp_message || req_message_size < sizeof(secure_message_t))
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
 
-    SAFE_FREE(decrypted_data);
-    SAFE_FREE(resp_data);
-    SAFE_FREE(temp_resp_message);
+    //The messages are passed [user_check] so that the bridge copies neither onto the enclave heap; both must lie outside the enclave
+    if(!sgx_is_outside_enclave(req_message, req_message_size) || !sgx_is_outside_enclave(resp_message, resp_message_size))
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
 
-    return SUCCESS;
+    //Read the request header once, since the untrusted side may change the message while it is served
+    memcpy(&req_header, req_message, sizeof(secure_message_t));
+
+    //Get the session the request names, which must be the source enclave's; it stays locked while the request is served
+    session_info = session_table_acquire(req_header.session_id, src_enclave_id);
+    if(!session_info)
+    {
+        return INVALID_SESSION;
+    }
+
+    status = serve_request(session_info, &req_header, req_message->message_aes_gcm_data.payload, req_message_size, max_payload_size, resp_message, resp_message_size);
+    session_table_release(session_info);
+
+    return status;
 }
 
 //Close a current session
@@ -693,68 +1060,6 @@ ATTESTATION_STATUS close_session(sgx_enclave_id_t src_enclave_id,
 //Respond to the request from the Source Enclave to close the session
 ATTESTATION_STATUS end_session(sgx_enclave_id_t src_enclave_id)
 {
-    ATTESTATION_STATUS status = SUCCESS;
-    int i;
-    dh_session_t session_info;
-    uint32_t session_id;
-
-    //Get the session information from the map corresponding to the source enclave id
-    std::map<sgx_enclave_id_t, dh_session_t>::iterator it = g_dest_session_info_map.find(src_enclave_id);
-    if(it != g_dest_session_info_map.end())
-    {
-        session_info = it->second;
-    }
-    else
-    {
-        return INVALID_SESSION;
-    }
-
-    session_id = session_info.session_id;
-    //Erase the session information for the current session
-    g_dest_session_info_map.erase(src_enclave_id);
-
-    //Update the session id tracker
-    if (g_session_count > 0)
-    {
-        //check if session exists
-        for (i=1; i <= MAX_SESSION_COUNT; i++)
-        {
-            if(g_session_id_tracker[i-1] != NULL && g_session_id_tracker[i-1]->session_id == session_id)
-            {
-                memset(g_session_id_tracker[i-1], 0, sizeof(session_id_tracker_t));
-                SAFE_FREE(g_session_id_tracker[i-1]);
-                g_session_count--;
-                break;
-            }
-        }
-    }
-
-    return status;
-
-}
-
-
-//Returns a new sessionID for the source destination session
-ATTESTATION_STATUS generate_session_id(uint32_t *session_id)
-{
-    ATTESTATION_STATUS status = SUCCESS;
-
-    if(!session_id)
-    {
-        return INVALID_PARAMETER_ERROR;
-    }
-    //if the session structure is untintialized, set that as the next session ID
-    for (int i = 0; i < MAX_SESSION_COUNT; i++)
-    {
-        if (g_session_id_tracker[i] == NULL)
-        {
-            *session_id = i;
-            return status;
-        }
-    }
-
-    status = NO_AVAILABLE_SESSION_ERROR;
-
-    return status;
-
+    //Erase the session information and recycle its slot in the session table
+    return session_table_remove_peer(src_enclave_id);
 }
@@ -0,0 +1,137 @@
+#include "sgx_trts.h"
+#include "MessageBatch.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t enclave_to_enclave_call_dispatcher(char* decrypted_data, size_t decrypted_data_length, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length);
+uint32_t message_exchange_response_generator(char* decrypted_data, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+uint32_t marshal_batch_request(char* const* calls, const size_t* call_lens, uint32_t count, char** marshalled_buff, size_t* marshalled_buff_len)
+{
+    ms_in_msg_exchange_t *ms, *call;
+    size_t param_len, ms_len, offset;
+    uint32_t i;
+
+    if(!calls || !call_lens || count == 0 || !marshalled_buff || !marshalled_buff_len)
+        return INVALID_PARAMETER_ERROR;
+
+    param_len = 0;
+    for(i = 0; i < count; i++)
+    {
+        call = (ms_in_msg_exchange_t *)calls[i];
+        if(!call || call_lens[i] < sizeof(ms_in_msg_exchange_t) ||
+           call_lens[i] != sizeof(ms_in_msg_exchange_t) + call->inparam_buff_len || call->msg_type == MESSAGE_BATCH)
+            return INVALID_PARAMETER_ERROR;
+        param_len += call_lens[i];
+        if(param_len > UINT32_MAX)
+            return INVALID_PARAMETER_ERROR;
+    }
+
+    ms_len = sizeof(ms_in_msg_exchange_t) + param_len;
+    ms = (ms_in_msg_exchange_t *)malloc(ms_len);
+    if(!ms)
+        return MALLOC_ERROR;
+
+    ms->msg_type = MESSAGE_BATCH;
+    ms->target_fn_id = count;
+    ms->inparam_buff_len = (uint32_t)param_len;
+    offset = 0;
+    for(i = 0; i < count; i++)
+    {
+        memcpy(ms->inparam_buff + offset, calls[i], call_lens[i]);
+        offset += call_lens[i];
+    }
+    *marshalled_buff = (char*)ms;
+    *marshalled_buff_len = ms_len;
+    return SUCCESS;
+}
+
+uint32_t unmarshal_batch_response(char* out_buff, size_t out_buff_len, uint32_t count, char** results)
+{
+    ms_out_msg_exchange_t *ms, *result;
+    size_t offset, result_len;
+    uint32_t i;
+
+    if(!out_buff || !results || out_buff_len < sizeof(ms_out_msg_exchange_t))
+        return INVALID_PARAMETER_ERROR;
+    ms = (ms_out_msg_exchange_t *)out_buff;
+    if(ms->retval_len != count || ms->ret_outparam_buff_len != out_buff_len - sizeof(ms_out_msg_exchange_t))
+        return ATTESTATION_ERROR;
+
+    offset = 0;
+    for(i = 0; i < count; i++)
+    {
+        if(ms->ret_outparam_buff_len - offset < sizeof(ms_out_msg_exchange_t))
+            return ATTESTATION_ERROR;
+        result = (ms_out_msg_exchange_t *)(ms->ret_outparam_buff + offset);
+        if(result->ret_outparam_buff_len > ms->ret_outparam_buff_len - offset - sizeof(ms_out_msg_exchange_t) ||
+           result->retval_len > result->ret_outparam_buff_len)
+            return ATTESTATION_ERROR;
+        result_len = sizeof(ms_out_msg_exchange_t) + result->ret_outparam_buff_len;
+        results[i] = (char*)result;
+        offset += result_len;
+    }
+    if(offset != ms->ret_outparam_buff_len)
+        return ATTESTATION_ERROR;
+    return SUCCESS;
+}
+
+uint32_t batch_response_generator(char* decrypted_data, size_t decrypted_data_length, char* resp_buffer, size_t resp_buffer_size, size_t* resp_length)
+{
+    ms_in_msg_exchange_t *ms, *call;
+    ms_out_msg_exchange_t *out;
+    size_t call_len, call_resp_len, offset, out_len;
+    uint32_t i, ret;
+
+    if(!decrypted_data || !resp_buffer || !resp_length || decrypted_data_length < sizeof(ms_in_msg_exchange_t))
+        return INVALID_PARAMETER_ERROR;
+    ms = (ms_in_msg_exchange_t *)decrypted_data;
+    if(ms->inparam_buff_len != decrypted_data_length - sizeof(ms_in_msg_exchange_t))
+        return INVALID_PARAMETER_ERROR;
+    if(resp_buffer_size < sizeof(ms_out_msg_exchange_t) || resp_buffer_size > UINT32_MAX)
+        return OUT_BUFFER_LENGTH_ERROR;
+
+    out = (ms_out_msg_exchange_t *)resp_buffer;
+    out_len = sizeof(ms_out_msg_exchange_t);
+
+    offset = 0;
+    for(i = 0; i < ms->target_fn_id; i++)
+    {
+        //The call must lie within the batch
+        if(ms->inparam_buff_len - offset < sizeof(ms_in_msg_exchange_t))
+            return INVALID_PARAMETER_ERROR;
+        call = (ms_in_msg_exchange_t *)(ms->inparam_buff + offset);
+        if(call->inparam_buff_len > ms->inparam_buff_len - offset - sizeof(ms_in_msg_exchange_t))
+            return INVALID_PARAMETER_ERROR;
+        call_len = sizeof(ms_in_msg_exchange_t) + call->inparam_buff_len;
+
+        //Serve the call as if it came in a message of its own, its result going right after the ones before it
+        if(call->msg_type == MESSAGE_EXCHANGE)
+            ret = message_exchange_response_generator((char*)call, resp_buffer + out_len, resp_buffer_size - out_len, &call_resp_len);
+        else if(call->msg_type == ENCLAVE_TO_ENCLAVE_CALL)
+            ret = enclave_to_enclave_call_dispatcher((char*)call, call_len, resp_buffer + out_len, resp_buffer_size - out_len, &call_resp_len);
+        else
+            ret = INVALID_REQUEST_TYPE_ERROR;
+        if(ret != SUCCESS)
+            return ret;
+
+        out_len += call_resp_len;
+        offset += call_len;
+    }
+    if(offset != ms->inparam_buff_len)
+        return INVALID_PARAMETER_ERROR;
+
+    out->retval_len = ms->target_fn_id;
+    out->ret_outparam_buff_len = (uint32_t)(out_len - sizeof(ms_out_msg_exchange_t));
+    *resp_length = out_len;
+    return SUCCESS;
+}
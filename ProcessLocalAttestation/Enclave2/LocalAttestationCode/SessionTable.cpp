@@ -0,0 +1,291 @@
+#include "sgx_trts.h"
+#include "sgx_spinlock.h"
+#include "SessionTable.h"
+#include "EnclaveMessageExchange.h"
+#include <stddef.h>
+#include <string.h>
+
+#define SESSION_PEER_BUCKETS        (2 * SESSION_TABLE_CAPACITY)
+#define SESSION_PEER_STRIPE_SIZE    (SESSION_PEER_BUCKETS / SESSION_TABLE_STRIPES)
+#define SESSION_PEER_NONE           SESSION_PEER_BUCKETS
+
+#define BUCKET_EMPTY    0x0
+#define BUCKET_USED     0x1
+#define BUCKET_DELETED  0x2     //Removed, but a probe for a later bucket may still pass through it
+
+typedef struct _session_table_slot_t
+{
+    sgx_spinlock_t lock;
+    uint32_t in_use;
+    uint32_t generation; //Bumped each time the slot is recycled
+    sgx_enclave_id_t peer_enclave_id;
+    dh_session_t session;
+} __attribute__((aligned(64))) session_table_slot_t;
+
+typedef struct _session_peer_bucket_t
+{
+    sgx_enclave_id_t peer_enclave_id;
+    uint32_t slot;
+    uint32_t state;
+} session_peer_bucket_t;
+
+typedef struct _session_peer_stripe_t
+{
+    sgx_spinlock_t lock;
+} __attribute__((aligned(64))) session_peer_stripe_t;
+
+static session_table_slot_t g_session_slots[SESSION_TABLE_CAPACITY];
+static session_peer_bucket_t g_session_peer_buckets[SESSION_PEER_BUCKETS];
+static session_peer_stripe_t g_session_peer_stripes[SESSION_TABLE_STRIPES];
+
+//Serializes creating and removing sessions, and guards the free slots and the count
+static sgx_spinlock_t g_session_table_lock = SGX_SPINLOCK_INITIALIZER;
+static uint32_t g_session_free_slots[SESSION_TABLE_CAPACITY];
+static uint32_t g_session_free_count = 0;
+static uint32_t g_session_slots_touched = 0; //Slots at or past this one were never used
+static uint32_t g_session_live = 0;
+
+static uint32_t slot_session_id(uint32_t index)
+{
+    return g_session_slots[index].generation * SESSION_TABLE_CAPACITY + index;
+}
+
+static uint32_t peer_hash(sgx_enclave_id_t peer_enclave_id)
+{
+    return (uint32_t)((peer_enclave_id * 0x9E3779B97F4A7C15ULL) >> 32) & (SESSION_PEER_BUCKETS - 1);
+}
+
+static sgx_spinlock_t* stripe_lock(uint32_t bucket)
+{
+    return &g_session_peer_stripes[bucket / SESSION_PEER_STRIPE_SIZE].lock;
+}
+
+static void set_bucket(uint32_t bucket, uint32_t state, sgx_enclave_id_t peer_enclave_id, uint32_t slot)
+{
+    sgx_spin_lock(stripe_lock(bucket));
+    g_session_peer_buckets[bucket].peer_enclave_id = peer_enclave_id;
+    g_session_peer_buckets[bucket].slot = slot;
+    g_session_peer_buckets[bucket].state = state;
+    sgx_spin_unlock(stripe_lock(bucket));
+}
+
+//Slot of the session with peer_enclave_id, locking each stripe the probe enters; SESSION_TABLE_CAPACITY if none
+static uint32_t lookup_peer(sgx_enclave_id_t peer_enclave_id)
+{
+    uint32_t bucket = peer_hash(peer_enclave_id);
+    sgx_spinlock_t* held = stripe_lock(bucket);
+    uint32_t slot = SESSION_TABLE_CAPACITY;
+
+    sgx_spin_lock(held);
+    for(uint32_t probes = 0; probes < SESSION_PEER_BUCKETS; probes++)
+    {
+        session_peer_bucket_t* entry = &g_session_peer_buckets[bucket];
+        if(entry->state == BUCKET_EMPTY)
+            break;
+        if(entry->state == BUCKET_USED && entry->peer_enclave_id == peer_enclave_id)
+        {
+            slot = entry->slot;
+            break;
+        }
+        bucket = (bucket + 1) & (SESSION_PEER_BUCKETS - 1);
+        if(stripe_lock(bucket) != held)
+        {
+            sgx_spin_unlock(held);
+            held = stripe_lock(bucket);
+            sgx_spin_lock(held);
+        }
+    }
+    sgx_spin_unlock(held);
+    return slot;
+}
+
+//Bucket of peer_enclave_id, and the first one a new entry for it could take; the table lock must be held
+static uint32_t find_peer_bucket(sgx_enclave_id_t peer_enclave_id, uint32_t* free_bucket)
+{
+    uint32_t bucket = peer_hash(peer_enclave_id);
+    if(free_bucket)
+        *free_bucket = SESSION_PEER_NONE;
+
+    //Only the holder of the table lock writes buckets, so they are read here without the stripe locks
+    for(uint32_t probes = 0; probes < SESSION_PEER_BUCKETS; probes++)
+    {
+        session_peer_bucket_t* entry = &g_session_peer_buckets[bucket];
+        if(entry->state != BUCKET_USED && free_bucket && *free_bucket == SESSION_PEER_NONE)
+            *free_bucket = bucket;
+        if(entry->state == BUCKET_EMPTY)
+            break;
+        if(entry->state == BUCKET_USED && entry->peer_enclave_id == peer_enclave_id)
+            return bucket;
+        bucket = (bucket + 1) & (SESSION_PEER_BUCKETS - 1);
+    }
+    return SESSION_PEER_NONE;
+}
+
+//Removes the session in slot index; the table lock and the slot's lock must be held
+static void drop_slot(uint32_t index)
+{
+    session_table_slot_t* slot = &g_session_slots[index];
+    uint32_t bucket = find_peer_bucket(slot->peer_enclave_id, NULL);
+
+    if(bucket != SESSION_PEER_NONE)
+    {
+        //A bucket followed by an empty one ends every probe through it, so it can be emptied, and so can deleted ones before it
+        uint32_t next = (bucket + 1) & (SESSION_PEER_BUCKETS - 1);
+        if(g_session_peer_buckets[next].state == BUCKET_EMPTY)
+        {
+            do
+            {
+                set_bucket(bucket, BUCKET_EMPTY, 0, 0);
+                bucket = (bucket - 1) & (SESSION_PEER_BUCKETS - 1);
+            } while(g_session_peer_buckets[bucket].state == BUCKET_DELETED);
+        }
+        else
+        {
+            set_bucket(bucket, BUCKET_DELETED, 0, 0);
+        }
+    }
+
+    release_session_buffers(&slot->session);
+    memset(&slot->session, 0, sizeof(dh_session_t));
+    slot->peer_enclave_id = 0;
+    slot->in_use = 0;
+    slot->generation++;
+    g_session_free_slots[g_session_free_count++] = index;
+    g_session_live--;
+}
+
+ATTESTATION_STATUS session_table_create(sgx_enclave_id_t peer_enclave_id, uint32_t* session_id)
+{
+    uint32_t free_bucket;
+    uint32_t index;
+    ATTESTATION_STATUS status = SUCCESS;
+
+    if(!session_id)
+    {
+        return INVALID_PARAMETER_ERROR;
+    }
+
+    sgx_spin_lock(&g_session_table_lock);
+    do
+    {
+        if(find_peer_bucket(peer_enclave_id, &free_bucket) != SESSION_PEER_NONE)
+        {
+            status = DUPLICATE_SESSION;
+            break;
+        }
+        if(free_bucket == SESSION_PEER_NONE)
+        {
+            status = NO_AVAILABLE_SESSION_ERROR;
+            break;
+        }
+
+        //Recycled slots first, so that the slots in use stay packed together
+        if(g_session_free_count > 0)
+            index = g_session_free_slots[--g_session_free_count];
+        else if(g_session_slots_touched < SESSION_TABLE_CAPACITY)
+            index = g_session_slots_touched++;
+        else
+        {
+            status = NO_AVAILABLE_SESSION_ERROR;
+            break;
+        }
+
+        session_table_slot_t* slot = &g_session_slots[index];
+        sgx_spin_lock(&slot->lock);
+        slot->peer_enclave_id = peer_enclave_id;
+        memset(&slot->session, 0, sizeof(dh_session_t));
+        slot->session.session_id = slot_session_id(index);
+        slot->session.status = IN_PROGRESS;
+        slot->in_use = 1;
+        sgx_spin_unlock(&slot->lock);
+
+        set_bucket(free_bucket, BUCKET_USED, peer_enclave_id, index);
+        g_session_live++;
+        *session_id = slot_session_id(index);
+    } while(0);
+    sgx_spin_unlock(&g_session_table_lock);
+
+    return status;
+}
+
+dh_session_t* session_table_acquire(uint32_t session_id, sgx_enclave_id_t peer_enclave_id)
+{
+    uint32_t index = session_id & (SESSION_TABLE_CAPACITY - 1);
+    session_table_slot_t* slot = &g_session_slots[index];
+
+    sgx_spin_lock(&slot->lock);
+    if(slot->in_use && slot_session_id(index) == session_id && slot->peer_enclave_id == peer_enclave_id)
+    {
+        return &slot->session;
+    }
+    sgx_spin_unlock(&slot->lock);
+    return NULL;
+}
+
+dh_session_t* session_table_acquire_peer(sgx_enclave_id_t peer_enclave_id)
+{
+    uint32_t index = lookup_peer(peer_enclave_id);
+    if(index == SESSION_TABLE_CAPACITY)
+    {
+        return NULL;
+    }
+
+    //The session may have ended since the index was read
+    session_table_slot_t* slot = &g_session_slots[index];
+    sgx_spin_lock(&slot->lock);
+    if(slot->in_use && slot->peer_enclave_id == peer_enclave_id)
+    {
+        return &slot->session;
+    }
+    sgx_spin_unlock(&slot->lock);
+    return NULL;
+}
+
+void session_table_release(dh_session_t* session)
+{
+    session_table_slot_t* slot = (session_table_slot_t*)((uint8_t*)session - offsetof(session_table_slot_t, session));
+    sgx_spin_unlock(&slot->lock);
+}
+
+ATTESTATION_STATUS session_table_remove(uint32_t session_id)
+{
+    uint32_t index = session_id & (SESSION_TABLE_CAPACITY - 1);
+    session_table_slot_t* slot = &g_session_slots[index];
+    ATTESTATION_STATUS status = INVALID_SESSION;
+
+    sgx_spin_lock(&g_session_table_lock);
+    sgx_spin_lock(&slot->lock);
+    if(slot->in_use && slot_session_id(index) == session_id)
+    {
+        drop_slot(index);
+        status = SUCCESS;
+    }
+    sgx_spin_unlock(&slot->lock);
+    sgx_spin_unlock(&g_session_table_lock);
+
+    return status;
+}
+
+ATTESTATION_STATUS session_table_remove_peer(sgx_enclave_id_t peer_enclave_id)
+{
+    ATTESTATION_STATUS status = INVALID_SESSION;
+
+    sgx_spin_lock(&g_session_table_lock);
+    uint32_t bucket = find_peer_bucket(peer_enclave_id, NULL);
+    if(bucket != SESSION_PEER_NONE)
+    {
+        uint32_t index = g_session_peer_buckets[bucket].slot;
+        sgx_spin_lock(&g_session_slots[index].lock);
+        drop_slot(index);
+        sgx_spin_unlock(&g_session_slots[index].lock);
+        status = SUCCESS;
+    }
+    sgx_spin_unlock(&g_session_table_lock);
+
+    return status;
+}
+
+uint32_t session_table_count(void)
+{
+    return __atomic_load_n(&g_session_live, __ATOMIC_RELAXED);
+}
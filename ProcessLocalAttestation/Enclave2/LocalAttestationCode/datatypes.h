@@ -58,6 +58,16 @@
 
 #define MESSAGE_EXCHANGE 0x0
 #define ENCLAVE_TO_ENCLAVE_CALL 0x1
+#define MESSAGE_BATCH 0x2 //Many calls of the other types in one message, see MessageBatch.h
+
+//Byte of a message's IV, after the nonce, that tells the messages of windowed mode from lock-step ones
+#define MESSAGE_MODE_OFFSET 4
+#define MESSAGE_LOCK_STEP 0x0 //The nonce is the session counter, the response carries it plus one
+#define MESSAGE_WINDOW_REQUEST 0x1 //The nonce is the request's sequence number
+#define MESSAGE_WINDOW_RESPONSE 0x2 //The nonce is the sequence number of the request answered
+
+//Most requests of windowed mode in flight in a session at a time, the bits of dh_session_t's window
+#define SESSION_WINDOW_SIZE 64
 
 #define INVALID_ARGUMENT                   -2   ///< Invalid function argument
 #define LOGIC_ERROR                        -3   ///< Functional logic error
@@ -79,6 +89,25 @@ typedef struct _secure_message_t
     sgx_aes_gcm_data_t message_aes_gcm_data;    
 }secure_message_t;
 
+#define SESSION_TICKET_SIZE 16
+
+//First message of a session, from the initiator: asks to resume a cached session, or for the full DH exchange
+typedef struct _session_hello_t
+{
+    uint32_t resume; //Set if ticket names a session cached by both enclaves
+    uint8_t ticket[SESSION_TICKET_SIZE];
+    uint8_t nonce[NONCE_SIZE];
+} session_hello_t;
+
+//Answer of the responder to session_hello_t
+typedef struct _session_resume_t
+{
+    uint32_t accepted; //Clear if the session continues with the full DH exchange
+    uint32_t session_id;
+    uint8_t nonce[NONCE_SIZE];
+    uint8_t mac[MAC_SIZE]; //Proves that the responder holds the cached secret
+} session_resume_t;
+
 //Format of the input function parameter structure
 typedef struct _ms_in_msg_exchange_t {
     uint32_t msg_type; //Type of Call E2E or general message exchange
@@ -94,12 +123,6 @@ typedef struct _ms_out_msg_exchange_t {
     char ret_outparam_buff[]; //Serialized return value and output parameters
 } ms_out_msg_exchange_t;
 
-//Session Tracker to generate session ids
-typedef struct _session_id_tracker_t
-{
-    uint32_t          session_id;
-}session_id_tracker_t;
-
 #pragma pack(pop)
 
 #endif
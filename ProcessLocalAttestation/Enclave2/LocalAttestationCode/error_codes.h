@@ -50,4 +50,5 @@ typedef uint32_t ATTESTATION_STATUS;
 #define ENCLAVE_TRUST_ERROR              0xED
 #define ENCRYPT_DECRYPT_ERROR            0xEE
 #define DUPLICATE_SESSION                0xEF
+#define WINDOW_FULL_ERROR                0xF0
 #endif
@@ -1,8 +1,17 @@
 #include <stdio.h>
 #include <iostream>
+#include <string>
+#include <vector>
 #include "Enclave_u.h"
 #include "sgx_urts.h"
 #include "sgx_utils/sgx_utils.h"
+#include "Sealed.h"
+#include "sealing_codec.h"
+#include "sealed_record.h"
+#include "sealing/record_index.h"
+#include "sealing/kv_store.h"
+#include "sealing/dedup_store.h"
+#include "memprof_app.h"
 
 /* Global EID shared by multiple threads */
 sgx_enclave_id_t global_eid = 0;
@@ -17,6 +26,7 @@ int main(int argc, char const *argv[]) {
         std::cout << "Fail to initialize enclave." << std::endl;
         return 1;
     }
+    MEMPROF_BEGIN(global_eid);
     int ptr;
     sgx_status_t status = generate_random_number(global_eid, &ptr);
     std::cout << status << std::endl;
@@ -26,13 +36,12 @@ int main(int argc, char const *argv[]) {
     printf("Random number: %d\n", ptr);
 
     // Seal the random number
-    size_t sealed_size = sizeof(sgx_sealed_data_t) + sizeof(ptr);
-    uint8_t* sealed_data = (uint8_t*)malloc(sealed_size);
+    Sealed<int> sealed_data;
 
     sgx_status_t ecall_status;
     status = seal(global_eid, &ecall_status,
-            (uint8_t*)&ptr, sizeof(ptr),
-            (sgx_sealed_data_t*)sealed_data, sealed_size);
+            (uint8_t*)&ptr, Sealed<int>::plaintext_size,
+            sealed_data.data(), Sealed<int>::size);
 
     if (!is_ecall_successful(status, "Sealing failed :(", ecall_status)) {
         return 1;
@@ -40,8 +49,8 @@ int main(int argc, char const *argv[]) {
 
     int unsealed;
     status = unseal(global_eid, &ecall_status,
-            (sgx_sealed_data_t*)sealed_data, sealed_size,
-            (uint8_t*)&unsealed, sizeof(unsealed));
+            sealed_data.data(), Sealed<int>::size,
+            (uint8_t*)&unsealed, Sealed<int>::plaintext_size);
 
     if (!is_ecall_successful(status, "Unsealing failed :(", ecall_status)) {
         return 1;
@@ -49,5 +58,120 @@ int main(int argc, char const *argv[]) {
 
     std::cout << "Seal round trip success! Receive back " << unsealed << std::endl;
 
+    // Compress and seal a repetitive log
+    std::string log;
+    for (int i = 0; i < 100; i++) {
+        log += "{\"level\":\"info\",\"msg\":\"request served\",\"id\":" + std::to_string(i) + "}\n";
+    }
+    std::vector<uint8_t> compressed_blob(SEALING_COMPRESSED_MAX_SIZE(log.size()));
+    uint32_t compressed_len = 0;
+    status = seal_compressed(global_eid, &ecall_status,
+            (uint8_t*)log.data(), log.size(),
+            (sgx_sealed_data_t*)compressed_blob.data(), compressed_blob.size(), &compressed_len);
+
+    if (!is_ecall_successful(status, "Compressed sealing failed :(", ecall_status)) {
+        return 1;
+    }
+
+    // The codec header tells the App how large the plaintext is
+    sealing_codec_header_t header;
+    if (!sealing_codec_read_header((sgx_sealed_data_t*)compressed_blob.data(), compressed_len, &header)) {
+        std::cout << "Missing codec header :(" << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> unsealed_log(header.plaintext_len);
+    uint32_t unsealed_log_len = 0;
+    status = unseal_compressed(global_eid, &ecall_status,
+            (sgx_sealed_data_t*)compressed_blob.data(), compressed_len,
+            unsealed_log.data(), (uint32_t)unsealed_log.size(), &unsealed_log_len);
+
+    if (!is_ecall_successful(status, "Compressed unsealing failed :(", ecall_status) ||
+            std::string(unsealed_log.begin(), unsealed_log.end()) != log) {
+        return 1;
+    }
+
+    std::cout << "Compressed seal round trip success! " << log.size() << " bytes sealed into "
+        << compressed_len << " bytes (plain seal: " << sizeof(sgx_sealed_data_t) + log.size() << ")" << std::endl;
+
+    // Seal a few records under public keys and index them without ECALLs
+    std::vector<std::vector<uint8_t> > records;
+    RecordIndex index;
+    for (uint64_t i = 0; i < 10; i++) {
+        std::string secret = "secret #" + std::to_string(i);
+        sealed_record_key_t key;
+        memset(&key, 0, sizeof(key));
+        key.record_id = 1000 + i;
+        key.timestamp = 1700000000 + 60 * i;
+        key.type = i % 2;
+
+        records.push_back(std::vector<uint8_t>(SEALED_RECORD_SIZE(secret.size())));
+        status = seal_record(global_eid, &ecall_status, &key, (uint8_t*)secret.data(), secret.size(),
+                (sgx_sealed_data_t*)records.back().data(), records.back().size());
+        if (!is_ecall_successful(status, "Record sealing failed :(", ecall_status)) {
+            return 1;
+        }
+        index.add((sgx_sealed_data_t*)records.back().data(), records.back().size(), i);
+    }
+
+    std::vector<RecordRef> odd = index.range(1700000000 + 60 * 2, 1700000000 + 60 * 8, 1);
+    std::cout << "Records of type 1 in range: " << odd.size() << std::endl;
+
+    const RecordRef* ref = index.find(1007);
+    if (ref == NULL) {
+        std::cout << "Record 1007 not indexed :(" << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t>& record = records[ref->location];
+    std::vector<uint8_t> secret(record.size() - SEALED_RECORD_SIZE(0));
+    uint32_t secret_len = 0;
+    status = unseal_record(global_eid, &ecall_status, (sgx_sealed_data_t*)record.data(), ref->sealed_len,
+            (sealed_record_key_t*)&ref->key, secret.data(), (uint32_t)secret.size(), &secret_len);
+    if (!is_ecall_successful(status, "Record unsealing failed :(", ecall_status)) {
+        return 1;
+    }
+
+    std::cout << "Record " << ref->key.record_id << " unsealed: "
+        << std::string(secret.begin(), secret.begin() + secret_len) << std::endl;
+
+    // Keep a few entries in the sealed key-value store, persisted in kv_data/
+    SealedKV kv(global_eid, "kv_data");
+    if (kv.open() != SGX_SUCCESS) {
+        return 1;
+    }
+    kv.put("user:alice", "alice's secret");
+    kv.put("user:bob", "bob's secret");
+    kv.remove("user:bob");
+
+    std::string value;
+    bool found = false;
+    if (kv.get("user:alice", &value, &found) != SGX_SUCCESS || !found || kv.close() != SGX_SUCCESS) {
+        std::cout << "Sealed store lookup failed :(" << std::endl;
+        return 1;
+    }
+    std::cout << "Sealed store: user:alice = " << value << std::endl;
+
+    // Provision the same configuration bundle to a few tenants: it is sealed only once
+    DedupStore blobs(global_eid, "dedup_data");
+    if (blobs.open() != SGX_SUCCESS) {
+        return 1;
+    }
+    std::string bundle;
+    for (unsigned i = 0; bundle.size() < 256 * 1024; i++) {
+        bundle += "setting_" + std::to_string(i * 2654435761u) + " = " + std::to_string(i) + "\n";
+    }
+    for (int tenant = 0; tenant < 4; tenant++) {
+        std::string config = "tenant = " + std::to_string(tenant) + "\n" + bundle;
+        if (blobs.put("tenant-" + std::to_string(tenant), config.data(), config.size()) != SGX_SUCCESS) {
+            std::cout << "Dedup store write failed :(" << std::endl;
+            return 1;
+        }
+    }
+    dedup_stats_t dedup;
+    if (blobs.stats(&dedup) != SGX_SUCCESS || blobs.close() != SGX_SUCCESS) {
+        return 1;
+    }
+    std::cout << "Dedup store: " << dedup.logical_bytes << " bytes in " << dedup.blobs << " blobs stored in "
+        << dedup.stored_bytes << " bytes, ratio " << dedup_ratio(&dedup) << std::endl;
+
     return 0;
 }
@@ -0,0 +1,385 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Enclave_u.h"
+#include "sgx_utils/sgx_utils.h"
+#include "dedup_store.h"
+
+#define KEY_FILE "store.key"
+#define MANIFEST_DIR "manifests"
+#define CHUNK_DIR "chunks"
+#define TMP_SUFFIX ".tmp"
+
+/* First guess for the size of a blob in get() */
+#define GET_BUFFER_SIZE (64 * 1024)
+
+static std::string to_hex(const uint8_t* data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (size_t i = 0; i < len; i++) {
+        hex += digits[data[i] >> 4];
+        hex += digits[data[i] & 0xF];
+    }
+    return hex;
+}
+
+/* Returns false unless hex is an even number of lowercase hex digits */
+static bool from_hex(const std::string& hex, std::vector<uint8_t>* data) {
+    if (hex.size() % 2 != 0) return false;
+    data->clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int value = 0;
+        for (size_t j = i; j < i + 2; j++) {
+            char c = hex[j];
+            if (c >= '0' && c <= '9') value = value * 16 + (c - '0');
+            else if (c >= 'a' && c <= 'f') value = value * 16 + (c - 'a' + 10);
+            else return false;
+        }
+        data->push_back((uint8_t)value);
+    }
+    return true;
+}
+
+static bool write_all(int fd, const uint8_t* buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, buf + done, len - done, offset + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, uint8_t* buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, offset + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+static bool fsync_dir(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+DedupStore::DedupStore(sgx_enclave_id_t eid, const std::string& dir)
+    : eid_(eid), dir_(dir), opened_(false), writing_fd_(-1) {}
+
+DedupStore::~DedupStore() {
+    close();
+}
+
+sgx_status_t DedupStore::open() {
+    const std::string dirs[] = { dir_, dir_ + "/" MANIFEST_DIR, dir_ + "/" CHUNK_DIR };
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        if (mkdir(dirs[i].c_str(), 0700) != 0 && errno != EEXIST) {
+            printf("Cannot create \"%s\": %s\n", dirs[i].c_str(), strerror(errno));
+            return SGX_ERROR_UNEXPECTED;
+        }
+    }
+
+    list_files();
+    sgx_status_t ecall_status;
+    sgx_status_t status = dedup_open(eid_, &ecall_status, this);
+    manifest_names_.clear();
+    chunk_ids_.clear();
+    if (!is_ecall_successful(status, "Opening the dedup store failed :(", ecall_status)) {
+        return status != SGX_SUCCESS ? status : ecall_status;
+    }
+    opened_ = true;
+    return SGX_SUCCESS;
+}
+
+sgx_status_t DedupStore::close() {
+    if (!opened_) return SGX_SUCCESS;
+    opened_ = false;
+    if (writing_fd_ >= 0) {
+        ::close(writing_fd_);
+        writing_fd_ = -1;
+    }
+
+    sgx_status_t ecall_status;
+    sgx_status_t status = dedup_close(eid_, &ecall_status);
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+sgx_status_t DedupStore::put(const std::string& name, const void* data, size_t len) {
+    sgx_status_t ecall_status;
+    sgx_status_t status = dedup_put(eid_, &ecall_status, (uint8_t*)name.data(), name.size(),
+            (uint8_t*)data, len);
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+sgx_status_t DedupStore::get(const std::string& name, std::vector<uint8_t>* data, bool* found) {
+    data->resize(GET_BUFFER_SIZE);
+    for (;;) {
+        uint64_t blob_len = 0;
+        sgx_status_t ecall_status;
+        sgx_status_t status = dedup_get(eid_, &ecall_status, (uint8_t*)name.data(), name.size(),
+                data->data(), data->size(), &blob_len);
+        if (status != SGX_SUCCESS || ecall_status != SGX_SUCCESS) {
+            return status != SGX_SUCCESS ? status : ecall_status;
+        }
+
+        *found = blob_len != DEDUP_NOT_FOUND;
+        if (!*found) {
+            data->clear();
+            return SGX_SUCCESS;
+        }
+        bool fits = blob_len <= data->size();
+        data->resize(blob_len);
+        if (fits) return SGX_SUCCESS;
+    }
+}
+
+sgx_status_t DedupStore::remove(const std::string& name) {
+    sgx_status_t ecall_status;
+    sgx_status_t status = dedup_remove(eid_, &ecall_status, (uint8_t*)name.data(), name.size());
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+sgx_status_t DedupStore::stats(dedup_stats_t* stats) {
+    sgx_status_t ecall_status;
+    sgx_status_t status = dedup_get_stats(eid_, &ecall_status, stats);
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+std::string DedupStore::manifest_path(const std::string& name) const {
+    return dir_ + "/" MANIFEST_DIR "/" + to_hex((const uint8_t*)name.data(), name.size());
+}
+
+/* Chunks are spread over 256 directories by the first byte of their ID */
+std::string DedupStore::chunk_path(const dedup_chunk_id_t& id) const {
+    std::string hex = to_hex(id.id, DEDUP_CHUNK_ID_SIZE);
+    return dir_ + "/" CHUNK_DIR "/" + hex.substr(0, 2) + "/" + hex;
+}
+
+/* Takes the listing dedup_open walks, and drops the manifests left half written */
+void DedupStore::list_files() {
+    manifest_names_.clear();
+    chunk_ids_.clear();
+
+    std::string manifests = dir_ + "/" MANIFEST_DIR;
+    DIR* d = opendir(manifests.c_str());
+    if (d != NULL) {
+        struct dirent* entry;
+        while ((entry = readdir(d)) != NULL) {
+            std::string file = entry->d_name;
+            std::vector<uint8_t> name;
+            if (file.size() > strlen(TMP_SUFFIX) &&
+                    file.compare(file.size() - strlen(TMP_SUFFIX), strlen(TMP_SUFFIX), TMP_SUFFIX) == 0) {
+                unlink((manifests + "/" + file).c_str());
+            } else if (from_hex(file, &name) && !name.empty()) {
+                manifest_names_.push_back(std::string(name.begin(), name.end()));
+            }
+        }
+        closedir(d);
+    }
+
+    std::string chunks = dir_ + "/" CHUNK_DIR;
+    d = opendir(chunks.c_str());
+    if (d == NULL) return;
+    struct dirent* bucket;
+    while ((bucket = readdir(d)) != NULL) {
+        if (bucket->d_name[0] == '.') continue;
+        DIR* b = opendir((chunks + "/" + bucket->d_name).c_str());
+        if (b == NULL) continue;
+        struct dirent* entry;
+        while ((entry = readdir(b)) != NULL) {
+            std::vector<uint8_t> id;
+            if (from_hex(entry->d_name, &id) && id.size() == DEDUP_CHUNK_ID_SIZE) {
+                dedup_chunk_id_t chunk_id;
+                memcpy(chunk_id.id, id.data(), DEDUP_CHUNK_ID_SIZE);
+                chunk_ids_.push_back(chunk_id);
+            }
+        }
+        closedir(b);
+    }
+    closedir(d);
+}
+
+int DedupStore::read_key(uint8_t* buf, uint32_t cap, uint32_t* len) {
+    *len = 0;
+    int fd = ::open((dir_ + "/" KEY_FILE).c_str(), O_RDONLY);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && (uint64_t)st.st_size <= cap && st.st_size > 0 &&
+        read_all(fd, buf, (size_t)st.st_size, 0);
+    ::close(fd);
+    if (ok) *len = (uint32_t)st.st_size;
+    return ok ? 0 : -1;
+}
+
+int DedupStore::write_key(const uint8_t* buf, uint32_t len) {
+    std::string path = dir_ + "/" KEY_FILE;
+    std::string tmp = path + TMP_SUFFIX;
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return -1;
+
+    bool ok = write_all(fd, buf, len, 0) && fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    ok = ok && rename(tmp.c_str(), path.c_str()) == 0 && fsync_dir(dir_);
+    if (!ok) unlink(tmp.c_str());
+    return ok ? 0 : -1;
+}
+
+int DedupStore::manifest_at(uint32_t index, uint8_t* name, uint32_t cap, uint32_t* name_len) {
+    *name_len = 0;
+    if (index >= manifest_names_.size()) return 0;
+    const std::string& found = manifest_names_[index];
+    if (found.size() > cap) return -1;
+    memcpy(name, found.data(), found.size());
+    *name_len = (uint32_t)found.size();
+    return 0;
+}
+
+int DedupStore::manifest_size(const std::string& name, uint64_t* size) {
+    struct stat st;
+    if (stat(manifest_path(name).c_str(), &st) != 0) {
+        *size = 0;
+        return errno == ENOENT ? 0 : -1;
+    }
+    *size = (uint64_t)st.st_size;
+    return 0;
+}
+
+int DedupStore::read_manifest(const std::string& name, uint64_t offset, uint8_t* buf, size_t len) {
+    int fd = ::open(manifest_path(name).c_str(), O_RDONLY);
+    if (fd < 0) return -1;
+    bool ok = read_all(fd, buf, len, (off_t)offset);
+    ::close(fd);
+    return ok ? 0 : -1;
+}
+
+int DedupStore::write_manifest(const std::string& name, uint64_t offset, const uint8_t* buf, size_t len) {
+    /* Offset 0 starts the manifest over, dropping a write that was never finished */
+    if (offset == 0 || writing_ != name) {
+        if (writing_fd_ >= 0) ::close(writing_fd_);
+        writing_ = name;
+        writing_fd_ = offset == 0 ?
+            ::open((manifest_path(name) + TMP_SUFFIX).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600) : -1;
+    }
+    if (writing_fd_ < 0) return -1;
+    return write_all(writing_fd_, buf, len, (off_t)offset) ? 0 : -1;
+}
+
+/* Makes the chunks and the manifest durable, then puts the manifest in place */
+int DedupStore::finish_manifest(const std::string& name) {
+    if (writing_ != name || writing_fd_ < 0) return -1;
+    int fd = writing_fd_;
+    writing_fd_ = -1;
+    writing_.clear();
+
+    std::string path = manifest_path(name);
+    bool ok = syncfs(fd) == 0 && fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    ok = ok && rename((path + TMP_SUFFIX).c_str(), path.c_str()) == 0;
+    ok = ok && fsync_dir(dir_ + "/" MANIFEST_DIR);
+    return ok ? 0 : -1;
+}
+
+int DedupStore::remove_manifest(const std::string& name) {
+    return unlink(manifest_path(name).c_str()) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+int DedupStore::chunk_at(uint32_t index, dedup_chunk_id_t* id, uint32_t* found) {
+    *found = index < chunk_ids_.size() ? 1 : 0;
+    if (*found) *id = chunk_ids_[index];
+    return 0;
+}
+
+int DedupStore::write_chunk(const dedup_chunk_id_t& id, const uint8_t* buf, size_t len) {
+    std::string path = chunk_path(id);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 && errno == ENOENT) {
+        /* First chunk in its directory */
+        std::string bucket = path.substr(0, path.rfind('/'));
+        if (mkdir(bucket.c_str(), 0700) != 0 && errno != EEXIST) return -1;
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    }
+    if (fd < 0) return -1;
+    bool ok = write_all(fd, buf, len, 0);
+    ok = ::close(fd) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+int DedupStore::read_chunk(const dedup_chunk_id_t& id, uint8_t* buf, uint32_t cap, uint32_t* len) {
+    int fd = ::open(chunk_path(id).c_str(), O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && (uint64_t)st.st_size <= cap && read_all(fd, buf, (size_t)st.st_size, 0);
+    ::close(fd);
+    *len = ok ? (uint32_t)st.st_size : 0;
+    return ok ? 0 : -1;
+}
+
+int DedupStore::remove_chunk(const dedup_chunk_id_t& id) {
+    return unlink(chunk_path(id).c_str()) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+static std::string name_of(const uint8_t* name, size_t name_len) {
+    return std::string((const char*)name, name_len);
+}
+
+/* OCall implementations */
+int ocall_dedup_read_key(void* store, uint8_t* buf, uint32_t cap, uint32_t* len) {
+    return ((DedupStore*)store)->read_key(buf, cap, len);
+}
+
+int ocall_dedup_write_key(void* store, uint8_t* buf, uint32_t len) {
+    return ((DedupStore*)store)->write_key(buf, len);
+}
+
+int ocall_dedup_manifest_at(void* store, uint32_t index, uint8_t* name, uint32_t cap, uint32_t* name_len) {
+    return ((DedupStore*)store)->manifest_at(index, name, cap, name_len);
+}
+
+int ocall_dedup_manifest_size(void* store, uint8_t* name, size_t name_len, uint64_t* size) {
+    return ((DedupStore*)store)->manifest_size(name_of(name, name_len), size);
+}
+
+int ocall_dedup_read_manifest(void* store, uint8_t* name, size_t name_len, uint64_t offset, uint8_t* buf, size_t len) {
+    return ((DedupStore*)store)->read_manifest(name_of(name, name_len), offset, buf, len);
+}
+
+int ocall_dedup_write_manifest(void* store, uint8_t* name, size_t name_len, uint64_t offset, uint8_t* buf, size_t len) {
+    return ((DedupStore*)store)->write_manifest(name_of(name, name_len), offset, buf, len);
+}
+
+int ocall_dedup_finish_manifest(void* store, uint8_t* name, size_t name_len) {
+    return ((DedupStore*)store)->finish_manifest(name_of(name, name_len));
+}
+
+int ocall_dedup_remove_manifest(void* store, uint8_t* name, size_t name_len) {
+    return ((DedupStore*)store)->remove_manifest(name_of(name, name_len));
+}
+
+int ocall_dedup_chunk_at(void* store, uint32_t index, dedup_chunk_id_t* id, uint32_t* found) {
+    return ((DedupStore*)store)->chunk_at(index, id, found);
+}
+
+int ocall_dedup_write_chunk(void* store, dedup_chunk_id_t* id, uint8_t* buf, size_t len) {
+    return ((DedupStore*)store)->write_chunk(*id, buf, len);
+}
+
+int ocall_dedup_read_chunk(void* store, dedup_chunk_id_t* id, uint8_t* buf, uint32_t cap, uint32_t* len) {
+    return ((DedupStore*)store)->read_chunk(*id, buf, cap, len);
+}
+
+int ocall_dedup_remove_chunk(void* store, dedup_chunk_id_t* id) {
+    return ((DedupStore*)store)->remove_chunk(*id);
+}
@@ -0,0 +1,74 @@
+#ifndef DEDUP_STORE_H_
+#define DEDUP_STORE_H_
+
+#include <string>
+#include <vector>
+#include "sgx_urts.h"
+#include "sealed_dedup.h"
+
+/**
+ * @brief      App side of the deduplicating sealed block store.
+ *
+ * @details    Wraps the dedup_* ECALLs and keeps the store's files in dir:
+ *
+ *               store.key                 the sealed store key
+ *               manifests/<hex of name>   one sealed manifest per blob
+ *               chunks/<xx>/<chunk ID>    one sealed chunk per distinct chunk
+ *
+ *             Chunk files are written without fsync; finishing a manifest
+ *             syncs the file system first, so a manifest never reaches the
+ *             disk before its chunks.
+ *
+ *             One store per enclave. The enclave runs one operation at a time.
+ */
+class DedupStore {
+public:
+    DedupStore(sgx_enclave_id_t eid, const std::string& dir);
+    ~DedupStore();
+
+    sgx_status_t open();
+    sgx_status_t close();
+
+    /* Stores data under name, replacing any blob of that name */
+    sgx_status_t put(const std::string& name, const void* data, size_t len);
+    /* *found is false if there is no blob by that name */
+    sgx_status_t get(const std::string& name, std::vector<uint8_t>* data, bool* found);
+    sgx_status_t remove(const std::string& name);
+    sgx_status_t stats(dedup_stats_t* stats);
+
+    /* Store file access for the ocall_dedup_* OCALLs: 0 on success, -1 on failure */
+    int read_key(uint8_t* buf, uint32_t cap, uint32_t* len);
+    int write_key(const uint8_t* buf, uint32_t len);
+    int manifest_at(uint32_t index, uint8_t* name, uint32_t cap, uint32_t* name_len);
+    int manifest_size(const std::string& name, uint64_t* size);
+    int read_manifest(const std::string& name, uint64_t offset, uint8_t* buf, size_t len);
+    int write_manifest(const std::string& name, uint64_t offset, const uint8_t* buf, size_t len);
+    int finish_manifest(const std::string& name);
+    int remove_manifest(const std::string& name);
+    int chunk_at(uint32_t index, dedup_chunk_id_t* id, uint32_t* found);
+    int write_chunk(const dedup_chunk_id_t& id, const uint8_t* buf, size_t len);
+    int read_chunk(const dedup_chunk_id_t& id, uint8_t* buf, uint32_t cap, uint32_t* len);
+    int remove_chunk(const dedup_chunk_id_t& id);
+
+private:
+    DedupStore(const DedupStore&);
+    DedupStore& operator=(const DedupStore&);
+
+    std::string manifest_path(const std::string& name) const;
+    std::string chunk_path(const dedup_chunk_id_t& id) const;
+    void list_files();
+
+    sgx_enclave_id_t eid_;
+    std::string dir_;
+    bool opened_;
+
+    /* What was on disk when open() started, walked by dedup_open */
+    std::vector<std::string> manifest_names_;
+    std::vector<dedup_chunk_id_t> chunk_ids_;
+
+    /* The manifest being written, as a .tmp file */
+    std::string writing_;
+    int writing_fd_;
+};
+
+#endif // DEDUP_STORE_H_
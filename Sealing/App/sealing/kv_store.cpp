@@ -0,0 +1,327 @@
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Enclave_u.h"
+#include "sgx_utils/sgx_utils.h"
+#include "kv_store.h"
+
+#define SEGMENT_SUFFIX ".seg"
+#define SEGMENT_TMP_SUFFIX ".seg.tmp"
+
+/* How often the merge thread checks the number of segments */
+#define MERGE_POLL_MS 50
+
+/* First guess for the size of a value in get() */
+#define GET_BUFFER_SIZE 256
+
+static bool has_suffix(const std::string& name, const char* suffix) {
+    size_t len = strlen(suffix);
+    return name.size() > len && name.compare(name.size() - len, len, suffix) == 0;
+}
+
+SealedKV::SealedKV(sgx_enclave_id_t eid, const std::string& dir)
+    : eid_(eid), dir_(dir), stopping_(false) {}
+
+SealedKV::~SealedKV() {
+    close();
+}
+
+sgx_status_t SealedKV::open(unsigned merge_threshold) {
+    if (mkdir(dir_.c_str(), 0700) != 0 && errno != EEXIST) {
+        printf("Cannot create \"%s\": %s\n", dir_.c_str(), strerror(errno));
+        return SGX_ERROR_UNEXPECTED;
+    }
+
+    /* Segments that were being written when the App stopped are incomplete */
+    DIR* d = opendir(dir_.c_str());
+    if (d != NULL) {
+        struct dirent* entry;
+        while ((entry = readdir(d)) != NULL) {
+            if (has_suffix(entry->d_name, SEGMENT_TMP_SUFFIX)) {
+                unlink((dir_ + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(d);
+    }
+
+    sgx_status_t ecall_status;
+    sgx_status_t status = kv_open(eid_, &ecall_status, this);
+    if (!is_ecall_successful(status, "Opening the sealed store failed :(", ecall_status)) {
+        return status != SGX_SUCCESS ? status : ecall_status;
+    }
+
+    stopping_ = false;
+    merger_ = std::thread(&SealedKV::merge_loop, this, merge_threshold);
+    return SGX_SUCCESS;
+}
+
+sgx_status_t SealedKV::close() {
+    if (!merger_.joinable()) return SGX_SUCCESS;
+    {
+        std::lock_guard<std::mutex> lock(merge_lock_);
+        stopping_ = true;
+    }
+    merge_wakeup_.notify_all();
+    merger_.join();
+
+    sgx_status_t ecall_status;
+    sgx_status_t status = kv_close(eid_, &ecall_status);
+
+    std::lock_guard<std::mutex> lock(files_lock_);
+    for (std::map<uint64_t, int>::iterator it = readers_.begin(); it != readers_.end(); ++it) {
+        ::close(it->second);
+    }
+    readers_.clear();
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+sgx_status_t SealedKV::put(const std::string& key, const std::string& value) {
+    sgx_status_t ecall_status;
+    sgx_status_t status = kv_put(eid_, &ecall_status, (uint8_t*)key.data(), key.size(),
+            (uint8_t*)value.data(), value.size());
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+sgx_status_t SealedKV::remove(const std::string& key) {
+    sgx_status_t ecall_status;
+    sgx_status_t status = kv_delete(eid_, &ecall_status, (uint8_t*)key.data(), key.size());
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+sgx_status_t SealedKV::get(const std::string& key, std::string* value, bool* found) {
+    value->resize(GET_BUFFER_SIZE);
+    for (;;) {
+        uint32_t value_len = 0;
+        sgx_status_t ecall_status;
+        sgx_status_t status = kv_get(eid_, &ecall_status, (uint8_t*)key.data(), key.size(),
+                (uint8_t*)&(*value)[0], value->size(), &value_len);
+        if (status != SGX_SUCCESS || ecall_status != SGX_SUCCESS) {
+            return status != SGX_SUCCESS ? status : ecall_status;
+        }
+
+        *found = value_len != KV_NOT_FOUND;
+        if (!*found) {
+            value->clear();
+            return SGX_SUCCESS;
+        }
+        bool fits = value_len <= value->size();
+        value->resize(value_len);
+        if (fits) return SGX_SUCCESS;
+    }
+}
+
+sgx_status_t SealedKV::scan(const std::string& start, const std::string& end,
+        std::vector<std::pair<std::string, std::string> >* entries) {
+    std::vector<uint8_t> out(KV_SCAN_ENTRY_HEADER + KV_MAX_KEY_SIZE + KV_MAX_VALUE_SIZE);
+    std::vector<uint8_t> next(KV_MAX_KEY_SIZE + 1);
+    std::string from = start;
+
+    entries->clear();
+    for (;;) {
+        uint32_t out_len = 0;
+        uint32_t next_len = 0;
+        sgx_status_t ecall_status;
+        sgx_status_t status = kv_scan(eid_, &ecall_status, (uint8_t*)from.data(), from.size(),
+                (uint8_t*)end.data(), end.size(), out.data(), out.size(), &out_len,
+                next.data(), next.size(), &next_len);
+        if (status != SGX_SUCCESS || ecall_status != SGX_SUCCESS) {
+            return status != SGX_SUCCESS ? status : ecall_status;
+        }
+
+        for (size_t pos = 0; pos + KV_SCAN_ENTRY_HEADER <= out_len;) {
+            uint32_t key_len, value_len;
+            memcpy(&key_len, &out[pos], sizeof(uint32_t));
+            memcpy(&value_len, &out[pos + sizeof(uint32_t)], sizeof(uint32_t));
+            const char* key = (const char*)&out[pos + KV_SCAN_ENTRY_HEADER];
+            entries->push_back(std::make_pair(std::string(key, key_len), std::string(key + key_len, value_len)));
+            pos += KV_SCAN_ENTRY_HEADER + key_len + value_len;
+        }
+
+        if (next_len == 0) return SGX_SUCCESS;
+        from.assign((const char*)next.data(), next_len);
+    }
+}
+
+sgx_status_t SealedKV::flush() {
+    sgx_status_t ecall_status;
+    sgx_status_t status = kv_flush(eid_, &ecall_status);
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+sgx_status_t SealedKV::stats(kv_stats_t* stats) {
+    sgx_status_t ecall_status;
+    sgx_status_t status = kv_get_stats(eid_, &ecall_status, stats);
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+void SealedKV::merge_loop(unsigned merge_threshold) {
+    std::unique_lock<std::mutex> lock(merge_lock_);
+    while (!stopping_) {
+        merge_wakeup_.wait_for(lock, std::chrono::milliseconds(MERGE_POLL_MS));
+        if (stopping_) break;
+        lock.unlock();
+
+        kv_stats_t current;
+        if (stats(&current) == SGX_SUCCESS && current.segments >= merge_threshold) {
+            sgx_status_t ecall_status;
+            sgx_status_t status = kv_merge(eid_, &ecall_status);
+            is_ecall_successful(status, "Merging sealed segments failed :(", ecall_status);
+        }
+        lock.lock();
+    }
+}
+
+std::string SealedKV::segment_path(uint64_t id) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64, id);
+    return dir_ + "/" + name + SEGMENT_SUFFIX;
+}
+
+int SealedKV::list_segments(uint64_t* ids, uint32_t cap, uint32_t* count) {
+    DIR* d = opendir(dir_.c_str());
+    if (d == NULL) return -1;
+
+    *count = 0;
+    int ret = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        std::string name = entry->d_name;
+        if (!has_suffix(name, SEGMENT_SUFFIX)) continue;
+        if (*count == cap) {
+            ret = -1;
+            break;
+        }
+        ids[(*count)++] = strtoull(name.c_str(), NULL, 16);
+    }
+    closedir(d);
+    return ret;
+}
+
+int SealedKV::segment_size(uint64_t id, uint64_t* size) {
+    struct stat st;
+    if (stat(segment_path(id).c_str(), &st) != 0) return -1;
+    *size = (uint64_t)st.st_size;
+    return 0;
+}
+
+/* A read-only descriptor for a finished segment, opened once */
+int SealedKV::reader(uint64_t id) {
+    std::lock_guard<std::mutex> lock(files_lock_);
+    std::map<uint64_t, int>::iterator it = readers_.find(id);
+    if (it != readers_.end()) return it->second;
+
+    int fd = ::open(segment_path(id).c_str(), O_RDONLY);
+    if (fd >= 0) readers_[id] = fd;
+    return fd;
+}
+
+int SealedKV::read(uint64_t id, uint64_t offset, uint8_t* buf, size_t len) {
+    int fd = reader(id);
+    if (fd < 0) return -1;
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+int SealedKV::append(uint64_t id, const uint8_t* buf, size_t len) {
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(files_lock_);
+        std::map<uint64_t, int>::iterator it = writers_.find(id);
+        if (it == writers_.end()) {
+            std::string tmp = segment_path(id) + ".tmp";
+            fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0) return -1;
+            writers_[id] = fd;
+        } else {
+            fd = it->second;
+        }
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/* Makes a written segment durable and visible under its final name */
+int SealedKV::finish_segment(uint64_t id) {
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(files_lock_);
+        std::map<uint64_t, int>::iterator it = writers_.find(id);
+        if (it == writers_.end()) return -1;
+        fd = it->second;
+        writers_.erase(it);
+    }
+
+    std::string path = segment_path(id);
+    bool ok = fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    ok = ok && rename((path + ".tmp").c_str(), path.c_str()) == 0;
+
+    int dir_fd = ::open(dir_.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+        ok = fsync(dir_fd) == 0 && ok;
+        ::close(dir_fd);
+    }
+    return ok ? 0 : -1;
+}
+
+int SealedKV::remove_segment(uint64_t id) {
+    std::string path = segment_path(id);
+    std::lock_guard<std::mutex> lock(files_lock_);
+    std::map<uint64_t, int>::iterator it = writers_.find(id);
+    if (it != writers_.end()) {
+        ::close(it->second);
+        writers_.erase(it);
+        unlink((path + ".tmp").c_str());
+    }
+    it = readers_.find(id);
+    if (it != readers_.end()) {
+        ::close(it->second);
+        readers_.erase(it);
+    }
+    return unlink(path.c_str()) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+/* OCall implementations */
+int ocall_kv_list_segments(void* store, uint64_t* ids, uint32_t cap, uint32_t* count) {
+    return ((SealedKV*)store)->list_segments(ids, cap, count);
+}
+
+int ocall_kv_segment_size(void* store, uint64_t id, uint64_t* size) {
+    return ((SealedKV*)store)->segment_size(id, size);
+}
+
+int ocall_kv_read(void* store, uint64_t id, uint64_t offset, uint8_t* buf, size_t len) {
+    return ((SealedKV*)store)->read(id, offset, buf, len);
+}
+
+int ocall_kv_append(void* store, uint64_t id, uint8_t* buf, size_t len) {
+    return ((SealedKV*)store)->append(id, buf, len);
+}
+
+int ocall_kv_finish_segment(void* store, uint64_t id) {
+    return ((SealedKV*)store)->finish_segment(id);
+}
+
+int ocall_kv_remove_segment(void* store, uint64_t id) {
+    return ((SealedKV*)store)->remove_segment(id);
+}
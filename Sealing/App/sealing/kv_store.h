@@ -0,0 +1,77 @@
+#ifndef KV_STORE_H_
+#define KV_STORE_H_
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "sgx_urts.h"
+#include "sealed_kv.h"
+
+/**
+ * @brief      App side of the sealed key-value store.
+ *
+ * @details    Wraps the kv_* ECALLs and keeps the segment files the enclave
+ *             writes, one file per segment in dir. Everything in the files is
+ *             sealed; the App only sees segment IDs, offsets and sizes.
+ *
+ *             open() starts a background thread that calls kv_merge whenever
+ *             merge_threshold segments have piled up. It runs in its own
+ *             TCS, so the enclave needs one TCS more than the threads using
+ *             the store.
+ *
+ *             One store per enclave. All methods are thread-safe.
+ */
+class SealedKV {
+public:
+    SealedKV(sgx_enclave_id_t eid, const std::string& dir);
+    ~SealedKV();
+
+    sgx_status_t open(unsigned merge_threshold = 4);
+    /* Stops merging, flushes the memtable and closes the store */
+    sgx_status_t close();
+
+    sgx_status_t put(const std::string& key, const std::string& value);
+    sgx_status_t remove(const std::string& key);
+    /* *found is false if the key is absent or deleted */
+    sgx_status_t get(const std::string& key, std::string* value, bool* found);
+    /* Every live entry with start <= key < end, in key order; an empty end means no upper bound */
+    sgx_status_t scan(const std::string& start, const std::string& end,
+            std::vector<std::pair<std::string, std::string> >* entries);
+
+    sgx_status_t flush();
+    sgx_status_t stats(kv_stats_t* stats);
+
+    /* Segment file access for the ocall_kv_* OCALLs: 0 on success, -1 on failure */
+    int list_segments(uint64_t* ids, uint32_t cap, uint32_t* count);
+    int segment_size(uint64_t id, uint64_t* size);
+    int read(uint64_t id, uint64_t offset, uint8_t* buf, size_t len);
+    int append(uint64_t id, const uint8_t* buf, size_t len);
+    int finish_segment(uint64_t id);
+    int remove_segment(uint64_t id);
+
+private:
+    SealedKV(const SealedKV&);
+    SealedKV& operator=(const SealedKV&);
+
+    std::string segment_path(uint64_t id) const;
+    int reader(uint64_t id);
+    void merge_loop(unsigned merge_threshold);
+
+    sgx_enclave_id_t eid_;
+    std::string dir_;
+
+    std::mutex files_lock_;
+    std::map<uint64_t, int> writers_;   /* segments being written, as .tmp files */
+    std::map<uint64_t, int> readers_;
+
+    std::mutex merge_lock_;
+    std::condition_variable merge_wakeup_;
+    bool stopping_;
+    std::thread merger_;
+};
+
+#endif // KV_STORE_H_
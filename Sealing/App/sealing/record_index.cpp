@@ -0,0 +1,41 @@
+#include "record_index.h"
+
+const uint32_t RecordIndex::ANY_TYPE;
+
+bool RecordIndex::add(const sgx_sealed_data_t* sealed_data, size_t sealed_size, uint64_t location) {
+    RecordRef ref;
+    if (!sealed_record_read_key(sealed_data, sealed_size, &ref.key)) return false;
+    ref.location = location;
+    /* sgx_calc_sealed_data_size is trusted-only; read_key checked payload_size */
+    ref.sealed_len = (uint32_t)sizeof(sgx_sealed_data_t) + sealed_data->aes_data.payload_size;
+
+    remove(ref.key.record_id);
+    std::map<uint64_t, RecordRef>::iterator it = by_id_.insert(std::make_pair(ref.key.record_id, ref)).first;
+    by_time_[std::make_pair(ref.key.timestamp, ref.key.record_id)] = &it->second;
+    return true;
+}
+
+bool RecordIndex::remove(uint64_t record_id) {
+    std::map<uint64_t, RecordRef>::iterator it = by_id_.find(record_id);
+    if (it == by_id_.end()) return false;
+    by_time_.erase(std::make_pair(it->second.key.timestamp, record_id));
+    by_id_.erase(it);
+    return true;
+}
+
+const RecordRef* RecordIndex::find(uint64_t record_id) const {
+    std::map<uint64_t, RecordRef>::const_iterator it = by_id_.find(record_id);
+    return it == by_id_.end() ? NULL : &it->second;
+}
+
+std::vector<RecordRef> RecordIndex::range(uint64_t from, uint64_t to, uint32_t type) const {
+    std::vector<RecordRef> found;
+    std::map<std::pair<uint64_t, uint64_t>, const RecordRef*>::const_iterator it =
+        by_time_.lower_bound(std::make_pair(from, (uint64_t)0));
+    for (; it != by_time_.end() && it->first.first < to; ++it) {
+        if (type == ANY_TYPE || it->second->key.type == type) {
+            found.push_back(*it->second);
+        }
+    }
+    return found;
+}
@@ -0,0 +1,66 @@
+#ifndef RECORD_INDEX_H_
+#define RECORD_INDEX_H_
+
+#include <map>
+#include <vector>
+#include "sgx_tseal.h"
+#include "sealed_record.h"
+
+/* Where a sealed record lives, as far as the App is concerned */
+struct RecordRef {
+    sealed_record_key_t key;
+    uint64_t location;  /* chosen by the caller: file offset, slot, ... */
+    uint32_t sealed_len;
+};
+
+/**
+ * @brief      Index of seal_record blobs built from their public keys.
+ *
+ * @details    Keys are read from the additional MAC text of each blob with
+ *             sealed_record_read_key, so building the index and answering
+ *             lookups and range scans needs no ECALL. The index is untrusted:
+ *             unseal_record checks that the blob it is given really is the
+ *             record expected.
+ *
+ *             Adding a record ID that is already indexed replaces the older
+ *             entry. Not thread-safe.
+ */
+class RecordIndex {
+public:
+    /**
+     * @brief      Indexes one sealed blob.
+     *
+     * @param      sealed_data  The sealed blob
+     * @param[in]  sealed_size  Size of the buffer holding the blob
+     * @param[in]  location     Where the caller keeps the blob
+     *
+     * @return     false if the blob carries no record key.
+     */
+    bool add(const sgx_sealed_data_t* sealed_data, size_t sealed_size, uint64_t location);
+
+    bool remove(uint64_t record_id);
+
+    /* Returns NULL if record_id is not indexed */
+    const RecordRef* find(uint64_t record_id) const;
+
+    /**
+     * @brief      Finds the records with from <= timestamp < to, in timestamp
+     *             order.
+     *
+     * @param[in]  from  The first timestamp included
+     * @param[in]  to    The first timestamp excluded
+     * @param[in]  type  Only records of this type, if not ANY_TYPE
+     */
+    std::vector<RecordRef> range(uint64_t from, uint64_t to, uint32_t type = ANY_TYPE) const;
+
+    size_t size() const { return by_id_.size(); }
+
+    static const uint32_t ANY_TYPE = 0xFFFFFFFF;
+
+private:
+    std::map<uint64_t, RecordRef> by_id_;
+    /* (timestamp, record ID) of every entry in by_id_ */
+    std::map<std::pair<uint64_t, uint64_t>, const RecordRef*> by_time_;
+};
+
+#endif // RECORD_INDEX_H_
@@ -0,0 +1,172 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "Enclave_u.h"
+#include "sgx_utils/sgx_utils.h"
+#include "seal_queue.h"
+
+/* Empty polls of the completion ring before the completion thread backs off */
+#define COMPLETION_SPIN 1024
+#define COMPLETION_SLEEP_US 50
+
+/* Upper bound on a parked worker's sleep, in case a wakeup is missed */
+#define WORKER_WAIT_MS 10
+
+/* Parked workers of every queue sleep here; submit_seal wakes them */
+static std::mutex g_wait_lock;
+static std::condition_variable g_work_available;
+
+// OCall implementations
+void ocall_seal_worker_wait(void* queue) {
+    SealQueue::wait_for_work((seal_queue_shared_t*)queue);
+}
+
+void SealQueue::wait_for_work(seal_queue_shared_t* shared) {
+    std::unique_lock<std::mutex> guard(g_wait_lock);
+    __atomic_add_fetch(&shared->idle_workers, 1, __ATOMIC_SEQ_CST);
+    g_work_available.wait_for(guard, std::chrono::milliseconds(WORKER_WAIT_MS), [shared] {
+        return __atomic_load_n(&shared->stop, __ATOMIC_ACQUIRE) || !shared->requests.empty();
+    });
+    __atomic_sub_fetch(&shared->idle_workers, 1, __ATOMIC_SEQ_CST);
+}
+
+SealQueue::SealQueue(sgx_enclave_id_t eid, unsigned workers)
+    : eid(eid), worker_count(workers), shared(NULL), workers_done(false), started(false), submitting(0) {
+}
+
+SealQueue::~SealQueue() {
+    stop();
+    free(shared);
+}
+
+int SealQueue::start() {
+    if (started) return 0;
+
+    void* memory = NULL;
+    if (posix_memalign(&memory, 64, sizeof(seal_queue_shared_t)) != 0) return -1;
+    shared = (seal_queue_shared_t*)memory;
+    shared->requests.init();
+    shared->completions.init();
+    shared->stop = 0;
+    shared->idle_workers = 0;
+
+    for (unsigned i = 0; i < worker_count; i++) {
+        workers.push_back(std::thread(&SealQueue::run_worker, this));
+    }
+    completer = std::thread(&SealQueue::run_completions, this);
+    started = true;
+    return 0;
+}
+
+void SealQueue::run_worker() {
+    sgx_status_t ecall_status;
+    sgx_status_t status = seal_worker_run(eid, &ecall_status, shared);
+    is_ecall_successful(status, "Seal worker failed :(", ecall_status);
+}
+
+std::future<SealResult> SealQueue::submit_seal(std::vector<uint8_t> plaintext) {
+    PendingSeal* pending = new PendingSeal;
+    pending->plaintext.swap(plaintext);
+    pending->sealed.resize(sizeof(sgx_sealed_data_t) + pending->plaintext.size());
+    std::future<SealResult> result = pending->promise.get_future();
+
+    /* Announced before started is read, so that stop() either sees this
+     * submit and waits for it, or this submit sees the queue stopped.
+     */
+    submitting.fetch_add(1);
+    if (!started.load() || workers_done.load() || __atomic_load_n(&shared->stop, __ATOMIC_ACQUIRE)) {
+        submitting.fetch_sub(1);
+        seal_completion_t completion = { (uint64_t)(uintptr_t)pending, SGX_ERROR_INVALID_STATE, 0 };
+        complete(completion);
+        return result;
+    }
+
+    seal_job_t job;
+    job.id = (uint64_t)(uintptr_t)pending;
+    job.plaintext = pending->plaintext.data();
+    job.plaintext_len = (uint32_t)pending->plaintext.size();
+    job.sealed = pending->sealed.data();
+    job.sealed_size = (uint32_t)pending->sealed.size();
+
+    while (!shared->requests.push(job)) {
+        /* The workers leave on stop and would never make room */
+        if (__atomic_load_n(&shared->stop, __ATOMIC_ACQUIRE)) {
+            submitting.fetch_sub(1);
+            seal_completion_t completion = { job.id, SGX_ERROR_INVALID_STATE, 0 };
+            complete(completion);
+            return result;
+        }
+        std::this_thread::yield();
+    }
+
+    /* Pairs with the increment in wait_for_work: either the worker sees the
+     * job before it sleeps, or we see it parked and wake it up.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shared->idle_workers, __ATOMIC_RELAXED) > 0) {
+        std::lock_guard<std::mutex> guard(g_wait_lock);
+        g_work_available.notify_all();
+    }
+    submitting.fetch_sub(1);
+    return result;
+}
+
+void SealQueue::complete(const seal_completion_t& completion) {
+    PendingSeal* pending = (PendingSeal*)(uintptr_t)completion.id;
+    SealResult result;
+    result.status = completion.status;
+    if (completion.status == SGX_SUCCESS) {
+        pending->sealed.resize(completion.sealed_len);
+        result.sealed.swap(pending->sealed);
+    }
+    pending->promise.set_value(std::move(result));
+    delete pending;
+}
+
+void SealQueue::run_completions() {
+    unsigned idle = 0;
+    for (;;) {
+        seal_completion_t completion;
+        if (shared->completions.pop(&completion)) {
+            complete(completion);
+            idle = 0;
+            continue;
+        }
+        if (workers_done.load() && shared->completions.empty()) break;
+
+        if (++idle < COMPLETION_SPIN) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(COMPLETION_SLEEP_US));
+        }
+    }
+}
+
+void SealQueue::stop() {
+    if (!started.exchange(false)) return;
+
+    __atomic_store_n(&shared->stop, 1, __ATOMIC_RELEASE);
+    {
+        std::lock_guard<std::mutex> guard(g_wait_lock);
+        g_work_available.notify_all();
+    }
+    /* New submits now fail; wait for those already pushing */
+    while (submitting.load() > 0) {
+        std::this_thread::yield();
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    workers.clear();
+    workers_done.store(true);
+    completer.join();
+
+    /* Left over if every worker failed to enter the enclave, or pushed by a
+     * submit after the workers had drained the ring and left
+     */
+    seal_job_t job;
+    while (shared->requests.pop(&job)) {
+        seal_completion_t completion = { job.id, SGX_ERROR_INVALID_STATE, 0 };
+        complete(completion);
+    }
+}
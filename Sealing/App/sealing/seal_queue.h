@@ -0,0 +1,83 @@
+#ifndef SEAL_QUEUE_H_
+#define SEAL_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "sgx_urts.h"
+#include "sgx_tseal.h"
+#include "seal_ring.h"
+
+struct SealResult {
+    sgx_status_t status;
+    std::vector<uint8_t> sealed;
+};
+
+/**
+ * @brief      Asynchronous sealing served by resident enclave worker threads.
+ *
+ * @details    start() enters the enclave once per worker thread through the
+ *             seal_worker_run ECALL; the workers then stay inside and take
+ *             jobs from a lock-free ring in untrusted memory, posting results
+ *             to a second ring that a completion thread turns into fulfilled
+ *             futures. In steady state no enclave transition happens per
+ *             job; an idle worker leaves the enclave once and sleeps in
+ *             ocall_seal_worker_wait until the next submit_seal.
+ *
+ *             Each worker occupies a TCS for the lifetime of the queue, so
+ *             workers must stay below TCSNum in Enclave.config.xml.
+ */
+class SealQueue {
+public:
+    SealQueue(sgx_enclave_id_t eid, unsigned workers);
+    ~SealQueue();
+
+    /* Starts the enclave workers. Returns 0 on success, -1 otherwise. */
+    int start();
+
+    /**
+     * @brief      Queues plaintext for sealing.
+     *
+     * @details    Blocks only while the request ring is full.
+     *
+     * @param[in]  plaintext  The data to be sealed, moved into the queue
+     *
+     * @return     A future holding the sealed blob, or the error status.
+     */
+    std::future<SealResult> submit_seal(std::vector<uint8_t> plaintext);
+
+    /* Drains the submitted jobs and stops the workers */
+    void stop();
+
+    /* Called by ocall_seal_worker_wait on behalf of an idle worker */
+    static void wait_for_work(seal_queue_shared_t* shared);
+
+private:
+    SealQueue(const SealQueue&);
+    SealQueue& operator=(const SealQueue&);
+
+    struct PendingSeal {
+        std::vector<uint8_t> plaintext;
+        std::vector<uint8_t> sealed;
+        std::promise<SealResult> promise;
+    };
+
+    void run_worker();
+    void run_completions();
+    void complete(const seal_completion_t& completion);
+
+    const sgx_enclave_id_t eid;
+    const unsigned worker_count;
+    seal_queue_shared_t* shared;
+    std::vector<std::thread> workers;
+    std::thread completer;
+    std::atomic<bool> workers_done;
+    std::atomic<bool> started;
+    /* submit_seal calls past the started check; stop() drains once none is left */
+    std::atomic<unsigned> submitting;
+};
+
+#endif // SEAL_QUEUE_H_
@@ -0,0 +1,173 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "sgx_urts.h"
+#include "sgx_utils.h"
+#include "enclave_pool.h"
+
+/* Delay before retrying a failed background recreation */
+#define RECREATE_RETRY_MS 100
+
+typedef std::chrono::steady_clock pool_clock;
+
+static double elapsed_us_since(pool_clock::time_point begin) {
+    return std::chrono::duration<double, std::micro>(pool_clock::now() - begin).count();
+}
+
+EnclavePool::EnclavePool(const std::string& launch_token_path, const std::string& enclave_name,
+        size_t size, warmup_function warmup)
+    : token_path(launch_token_path), enclave_name(enclave_name), target_size(size), warmup(warmup),
+      token_updated(0), owned(0), lost(0), recreated(0), created(0),
+      total_create_us(0), first_ecall_us(-1), stopping(false) {
+    memset(token, 0x0, sizeof(sgx_launch_token_t));
+}
+
+EnclavePool::~EnclavePool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    instance_lost.notify_all();
+    idle_available.notify_all();
+    if (recreator.joinable()) recreator.join();
+
+    /* Instances still checked out are owned by their callers */
+    for (size_t i = 0; i < idle.size(); i++) {
+        sgx_destroy_enclave(idle[i]);
+    }
+}
+
+/* Create one instance with the cached launch token and run the warmup ECALL */
+sgx_status_t EnclavePool::create_instance(sgx_enclave_id_t* eid, double* elapsed_us) {
+    pool_clock::time_point begin = pool_clock::now();
+    sgx_status_t ret;
+    {
+        std::lock_guard<std::mutex> guard(create_lock);
+        int updated = 0;
+        /* Debug Support: set 2nd parameter to 1 */
+        ret = sgx_create_enclave(enclave_name.c_str(), SGX_DEBUG_FLAG, &token, &updated, eid, NULL);
+        if (updated) token_updated = 1;
+    }
+    if (ret != SGX_SUCCESS) return ret;
+
+    if (warmup != NULL && (ret = warmup(*eid)) != SGX_SUCCESS) {
+        sgx_destroy_enclave(*eid);
+        return ret;
+    }
+    *elapsed_us = elapsed_us_since(begin);
+    return SGX_SUCCESS;
+}
+
+int EnclavePool::start() {
+    pool_clock::time_point begin = pool_clock::now();
+    FILE* fp = read_launch_token(token_path.c_str(), &token);
+
+    for (size_t i = 0; i < target_size; i++) {
+        sgx_enclave_id_t eid = 0;
+        double create_us = 0;
+        sgx_status_t ret = create_instance(&eid, &create_us);
+        if (ret != SGX_SUCCESS) {
+            print_error_message(ret);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        /* Without a warmup no ECALL was made, so there is no time to report */
+        if (warmup != NULL && first_ecall_us < 0) first_ecall_us = elapsed_us_since(begin);
+        idle.push_back(eid);
+        owned++;
+        created++;
+        total_create_us += create_us;
+        idle_available.notify_one();
+    }
+
+    write_launch_token(token_path.c_str(), &token, token_updated, fp);
+
+    std::lock_guard<std::mutex> guard(lock);
+    /* Instances that failed at startup are retried in the background too */
+    lost += target_size - created;
+    recreator = std::thread(&EnclavePool::recreate_lost_instances, this);
+    if (lost > 0) instance_lost.notify_one();
+    return owned > 0 ? 0 : -1;
+}
+
+bool EnclavePool::checkout(sgx_enclave_id_t* eid, long timeout_ms) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (timeout_ms < 0) {
+        idle_available.wait(guard, [this] { return stopping || !idle.empty(); });
+    } else if (!idle_available.wait_for(guard, std::chrono::milliseconds(timeout_ms),
+                [this] { return stopping || !idle.empty(); })) {
+        return false;
+    }
+    if (stopping) return false;
+
+    *eid = idle.back();
+    idle.pop_back();
+    return true;
+}
+
+void EnclavePool::checkin(sgx_enclave_id_t eid, sgx_status_t last_status) {
+    if (last_status == SGX_ERROR_ENCLAVE_LOST) {
+        /* The instance is unusable after a power transition: it has to be
+         * destroyed and loaded again, which the recreator does off this path.
+         */
+        sgx_destroy_enclave(eid);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            owned--;
+            lost++;
+        }
+        instance_lost.notify_one();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        idle.push_back(eid);
+    }
+    idle_available.notify_one();
+}
+
+void EnclavePool::recreate_lost_instances() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        instance_lost.wait(guard, [this] { return stopping || lost > 0; });
+        if (stopping) return;
+
+        guard.unlock();
+        sgx_enclave_id_t eid = 0;
+        double create_us = 0;
+        sgx_status_t ret = create_instance(&eid, &create_us);
+        guard.lock();
+
+        if (ret != SGX_SUCCESS) {
+            print_error_message(ret);
+            instance_lost.wait_for(guard, std::chrono::milliseconds(RECREATE_RETRY_MS),
+                    [this] { return stopping; });
+            continue;
+        }
+        if (stopping) {
+            sgx_destroy_enclave(eid);
+            return;
+        }
+
+        lost--;
+        owned++;
+        recreated++;
+        created++;
+        total_create_us += create_us;
+        idle.push_back(eid);
+        idle_available.notify_one();
+    }
+}
+
+EnclavePool::Stats EnclavePool::stats() {
+    std::lock_guard<std::mutex> guard(lock);
+    Stats s;
+    s.size = owned;
+    s.idle = idle.size();
+    s.recreated = recreated;
+    s.time_to_first_ecall_us = first_ecall_us;
+    s.mean_create_us = created > 0 ? total_create_us / created : 0;
+    return s;
+}
@@ -0,0 +1,101 @@
+#ifndef ENCLAVE_POOL_H_
+#define ENCLAVE_POOL_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sgx_urts.h"
+
+/**
+ * @brief      A fixed-size pool of pre-created instances of one enclave.
+ *
+ * @details    start() pays the enclave load cost (launch token I/O and
+ *             sgx_create_enclave) for every instance up front, so request
+ *             handlers only checkout() an idle instance and checkin() it when
+ *             done. An instance checked in with SGX_ERROR_ENCLAVE_LOST (e.g.
+ *             after a power transition) is destroyed and recreated by a
+ *             background thread, off the request path.
+ *
+ *             The launch token file is read once in start() and written back
+ *             once if it was updated; recreations reuse the in-memory token.
+ */
+class EnclavePool {
+public:
+    /* Optional ECALL run once on each new instance before it is handed out */
+    typedef sgx_status_t (*warmup_function)(sgx_enclave_id_t eid);
+
+    struct Stats {
+        size_t size;                    /* instances currently owned by the pool */
+        size_t idle;                    /* instances ready to be checked out */
+        size_t recreated;               /* instances recreated after SGX_ERROR_ENCLAVE_LOST */
+        double time_to_first_ecall_us;  /* start() until the first instance finished its warmup ECALL, -1 without a warmup */
+        double mean_create_us;          /* mean sgx_create_enclave + warmup time per instance */
+    };
+
+    EnclavePool(const std::string& launch_token_path, const std::string& enclave_name,
+            size_t size, warmup_function warmup = NULL);
+    ~EnclavePool();
+
+    /**
+     * @brief      Creates all instances and starts the recreation thread.
+     *
+     * @return     0 if at least one instance was created, -1 otherwise.
+     */
+    int start();
+
+    /**
+     * @brief      Takes an idle instance out of the pool.
+     *
+     * @param      eid         Receives the enclave id
+     * @param[in]  timeout_ms  How long to wait for an idle instance, negative
+     *                         to wait forever
+     *
+     * @return     true if an instance was checked out, false on timeout or if
+     *             the pool is shutting down.
+     */
+    bool checkout(sgx_enclave_id_t* eid, long timeout_ms = -1);
+
+    /**
+     * @brief      Returns an instance to the pool.
+     *
+     * @param[in]  eid          The enclave id obtained from checkout()
+     * @param[in]  last_status  Status of the last ECALL made on the instance.
+     *                          SGX_ERROR_ENCLAVE_LOST schedules a recreation.
+     */
+    void checkin(sgx_enclave_id_t eid, sgx_status_t last_status = SGX_SUCCESS);
+
+    Stats stats();
+
+private:
+    EnclavePool(const EnclavePool&);
+    EnclavePool& operator=(const EnclavePool&);
+
+    sgx_status_t create_instance(sgx_enclave_id_t* eid, double* elapsed_us);
+    void recreate_lost_instances();
+
+    const std::string token_path;
+    const std::string enclave_name;
+    const size_t target_size;
+    const warmup_function warmup;
+
+    std::mutex create_lock;             /* serializes sgx_create_enclave and token updates */
+    sgx_launch_token_t token;
+    int token_updated;
+
+    std::mutex lock;
+    std::condition_variable idle_available;
+    std::condition_variable instance_lost;
+    std::vector<sgx_enclave_id_t> idle;
+    size_t owned;
+    size_t lost;
+    size_t recreated;
+    size_t created;
+    double total_create_us;
+    double first_ecall_us;
+    bool stopping;
+    std::thread recreator;
+};
+
+#endif // ENCLAVE_POOL_H_
@@ -1,10 +1,15 @@
 #ifndef SGX_UTILS_H_
 #define SGX_UTILS_H_
 
+#include <cstdio>
 #include <string>
 
 void print_error_message(sgx_status_t ret);
 
+FILE* read_launch_token(const char* token_path, sgx_launch_token_t* token);
+
+void write_launch_token(const char* token_path, const sgx_launch_token_t* token, int updated, FILE* fp);
+
 int initialize_enclave(sgx_enclave_id_t* eid, const std::string& launch_token_path, const std::string& enclave_name);
 
 bool is_ecall_successful(sgx_status_t sgx_status, const std::string& err_msg, sgx_status_t ecall_return_value = SGX_SUCCESS);
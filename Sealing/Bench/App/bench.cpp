@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "sgx_urts.h"
+#include "BenchEnclave_u.h"
+#include "sgx_utils/sgx_utils.h"
+#include "sgx_utils/enclave_pool.h"
+#include "sealing_codec.h"
+#include "sealing/seal_queue.h"
+
+#ifndef BENCH_SGX_MODE
+# define BENCH_SGX_MODE "SIM"
+#endif
+
+/* HeapMaxSize in Bench/Enclave/BenchEnclave.config.xml, minus headroom for
+ * the trusted runtime. Every running ECALL holds a plaintext and a sealed
+ * copy of the payload on the enclave heap at the same time, plus the
+ * compression buffer for seal_compressed.
+ */
+#define ENCLAVE_HEAP_BUDGET (304UL << 20)
+
+/* Each (payload, threads) point runs about this many bytes per thread */
+#define BYTES_PER_POINT (16UL << 20)
+
+/* Longest wait for the pool to recreate an instance checked in as lost */
+#define RECREATE_TIMEOUT_MS 60000
+
+/* bench_seal/bench_unseal batch up to this many payload bytes per ECALL */
+#define CRYPTO_BATCH_BYTES (1UL << 20)
+#define CRYPTO_BATCH_MAX 64
+
+sgx_enclave_id_t global_eid = 0;
+
+enum bench_op {
+    OP_ECALL,           /* empty ECALL */
+    OP_EDL_COPY,        /* [in]/[out] copy of a seal-sized payload, no work */
+    OP_SEAL,            /* the seal ECALL end to end */
+    OP_UNSEAL,          /* the unseal ECALL end to end */
+    OP_SEAL_CRYPTO,     /* sgx_seal_data alone */
+    OP_UNSEAL_CRYPTO,   /* sgx_unseal_data alone */
+    OP_SEAL_COMPRESSED, /* the seal_compressed ECALL end to end */
+    OP_UNSEAL_COMPRESSED,
+    OP_SEAL_ASYNC,      /* SealQueue::submit_seal until the future is ready */
+    OP_SEAL_POOLED      /* the seal ECALL on an instance checked out of an EnclavePool */
+};
+
+static const char* op_names[] = {
+    "ecall", "edl_copy", "seal", "unseal", "seal_crypto", "unseal_crypto",
+    "seal_compressed", "unseal_compressed", "seal_async", "seal_pooled"
+};
+
+/* Enclave worker threads serving OP_SEAL_ASYNC */
+#define SEAL_QUEUE_WORKERS 2
+static SealQueue* seal_queue = NULL;
+
+/* Instances serving OP_SEAL_POOLED, NULL if the pool is disabled */
+static EnclavePool* enclave_pool = NULL;
+
+struct bench_config {
+    size_t min_size;
+    size_t max_size;
+    unsigned max_threads;
+    unsigned max_iterations;
+    size_t pool_size;
+    std::string output_prefix;
+};
+
+struct bench_result {
+    bench_op op;
+    size_t payload;
+    unsigned threads;
+    size_t ops;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double max_ns;
+    double ops_per_sec;
+    double mb_per_sec;
+    size_t sealed_bytes;    /* blob size written by the seal ops, 0 otherwise */
+};
+
+struct thread_state {
+    std::vector<uint8_t> plaintext;
+    std::vector<uint8_t> sealed;
+    std::vector<uint8_t> compressed;
+    uint32_t compressed_len;
+    std::vector<double> samples_ns;
+    sgx_status_t error;
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ns_between(bench_clock::time_point begin, bench_clock::time_point end) {
+    return std::chrono::duration<double, std::nano>(end - begin).count();
+}
+
+static sgx_status_t call_op(bench_op op, thread_state* state, size_t len, uint32_t batch) {
+    sgx_status_t ecall_status = SGX_SUCCESS;
+    sgx_status_t status = SGX_SUCCESS;
+    uint8_t* plaintext = state->plaintext.data();
+    uint8_t* sealed = state->sealed.data();
+    size_t sealed_size = state->sealed.size();
+
+    switch (op) {
+    case OP_ECALL:
+        status = bench_empty(global_eid);
+        break;
+    case OP_EDL_COPY:
+        status = bench_copy(global_eid, plaintext, sealed, len, sealed_size);
+        break;
+    case OP_SEAL:
+        status = seal(global_eid, &ecall_status, plaintext, len,
+                (sgx_sealed_data_t*)sealed, sealed_size);
+        break;
+    case OP_UNSEAL:
+        status = unseal(global_eid, &ecall_status, (sgx_sealed_data_t*)sealed, sealed_size,
+                plaintext, (uint32_t)len);
+        break;
+    case OP_SEAL_CRYPTO:
+        status = bench_seal(global_eid, &ecall_status, len, batch);
+        break;
+    case OP_UNSEAL_CRYPTO:
+        status = bench_unseal(global_eid, &ecall_status, len, batch);
+        break;
+    case OP_SEAL_COMPRESSED:
+        status = seal_compressed(global_eid, &ecall_status, plaintext, len,
+                (sgx_sealed_data_t*)state->compressed.data(), state->compressed.size(),
+                &state->compressed_len);
+        break;
+    case OP_UNSEAL_COMPRESSED: {
+        uint32_t plaintext_len = 0;
+        status = unseal_compressed(global_eid, &ecall_status,
+                (sgx_sealed_data_t*)state->compressed.data(), state->compressed_len,
+                plaintext, (uint32_t)len, &plaintext_len);
+        break;
+    }
+    case OP_SEAL_POOLED: {
+        /* More threads than instances wait in checkout, so the samples include the queueing */
+        sgx_enclave_id_t eid;
+        if (!enclave_pool->checkout(&eid)) {
+            return SGX_ERROR_UNEXPECTED;
+        }
+        status = seal(eid, &ecall_status, plaintext, len, (sgx_sealed_data_t*)sealed, sealed_size);
+        enclave_pool->checkin(eid, status);
+        break;
+    }
+    }
+    return status != SGX_SUCCESS ? status : ecall_status;
+}
+
+/* Keeps every job in flight at once: the samples are submit-to-completion latencies */
+static void run_async_thread(thread_state* state, unsigned iterations) {
+    std::vector<std::future<SealResult> > futures;
+    std::vector<bench_clock::time_point> submitted;
+    for (unsigned i = 0; i < iterations; i++) {
+        submitted.push_back(bench_clock::now());
+        futures.push_back(seal_queue->submit_seal(state->plaintext));
+    }
+    for (unsigned i = 0; i < iterations; i++) {
+        SealResult result = futures[i].get();
+        if (result.status != SGX_SUCCESS) {
+            state->error = result.status;
+            return;
+        }
+        state->samples_ns.push_back(ns_between(submitted[i], bench_clock::now()));
+    }
+}
+
+static void run_thread(bench_op op, thread_state* state, size_t len, unsigned iterations, uint32_t batch,
+        const std::atomic<bool>* start) {
+    state->samples_ns.reserve(iterations);
+    while (!start->load()) {
+        std::this_thread::yield();
+    }
+    if (op == OP_SEAL_ASYNC) {
+        run_async_thread(state, iterations);
+        return;
+    }
+    for (unsigned i = 0; i < iterations; i++) {
+        bench_clock::time_point begin = bench_clock::now();
+        sgx_status_t status = call_op(op, state, len, batch);
+        bench_clock::time_point end = bench_clock::now();
+        if (status != SGX_SUCCESS) {
+            state->error = status;
+            return;
+        }
+        state->samples_ns.push_back(ns_between(begin, end));
+    }
+}
+
+/* Run op on every thread and return the wall time in ns, or a negative value on error */
+static double run_threads(bench_op op, std::vector<thread_state>& states, size_t len,
+        unsigned iterations, uint32_t batch) {
+    std::vector<std::thread> threads;
+    std::atomic<bool> start(false);
+    for (size_t t = 0; t < states.size(); t++) {
+        states[t].samples_ns.clear();
+        states[t].error = SGX_SUCCESS;
+        threads.push_back(std::thread(run_thread, op, &states[t], len, iterations, batch, &start));
+    }
+
+    /* Thread creation is kept out of the wall time */
+    bench_clock::time_point begin = bench_clock::now();
+    start.store(true);
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    double wall_ns = ns_between(begin, bench_clock::now());
+
+    for (size_t t = 0; t < states.size(); t++) {
+        if (states[t].error != SGX_SUCCESS) {
+            printf("%s failed for %zu bytes:\n", op_names[op], len);
+            print_error_message(states[t].error);
+            return -1;
+        }
+    }
+    return wall_ns;
+}
+
+static double mean_of(const std::vector<thread_state>& states) {
+    double sum = 0;
+    size_t count = 0;
+    for (size_t t = 0; t < states.size(); t++) {
+        for (size_t i = 0; i < states[t].samples_ns.size(); i++) {
+            sum += states[t].samples_ns[i];
+        }
+        count += states[t].samples_ns.size();
+    }
+    return count > 0 ? sum / count : 0;
+}
+
+/**
+ * @brief      Folds the per-call samples of all threads into one result.
+ *
+ * @param[in]  baseline_ns  Mean cost of the overhead that is not being
+ *                          measured, subtracted from every sample
+ * @param[in]  batch        Operations done per sample
+ */
+static bench_result summarize(bench_op op, const std::vector<thread_state>& states, size_t len,
+        double wall_ns, double baseline_ns, uint32_t batch) {
+    std::vector<double> samples;
+    for (size_t t = 0; t < states.size(); t++) {
+        for (size_t i = 0; i < states[t].samples_ns.size(); i++) {
+            samples.push_back(std::max(0.0, states[t].samples_ns[i] - baseline_ns) / batch);
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+
+    bench_result r;
+    r.op = op;
+    r.payload = len;
+    r.threads = (unsigned)states.size();
+    r.ops = samples.size() * batch;
+    r.mean_ns = 0;
+    for (size_t i = 0; i < samples.size(); i++) r.mean_ns += samples[i];
+    r.mean_ns /= samples.size();
+    r.p50_ns = samples[samples.size() / 2];
+    r.p99_ns = samples[std::min(samples.size() - 1, (size_t)(samples.size() * 0.99))];
+    r.max_ns = samples.back();
+
+    /* The threads run the baseline work in parallel, so it only costs its
+     * per-thread share of the wall time.
+     */
+    double busy_ns = wall_ns - baseline_ns * (samples.size() / states.size());
+    if (busy_ns <= 0) busy_ns = wall_ns;
+    r.ops_per_sec = r.ops / (busy_ns / 1e9);
+    r.mb_per_sec = r.ops_per_sec * len / (1024.0 * 1024.0);
+
+    switch (op) {
+    case OP_SEAL:
+    case OP_SEAL_CRYPTO:
+    case OP_SEAL_ASYNC:
+    case OP_SEAL_POOLED:
+        r.sealed_bytes = sizeof(sgx_sealed_data_t) + len;
+        break;
+    case OP_SEAL_COMPRESSED:
+        r.sealed_bytes = states[0].compressed_len;
+        break;
+    default:
+        r.sealed_bytes = 0;
+    }
+    return r;
+}
+
+/* JSON log lines: compressible like the payloads sealed in production */
+static void fill_payload(std::vector<uint8_t>* payload, size_t len) {
+    std::string text;
+    unsigned seed = 1;
+    while (text.size() < len) {
+        char line[128];
+        seed = seed * 1103515245 + 12345;
+        snprintf(line, sizeof(line), "{\"ts\":%u,\"level\":\"info\",\"msg\":\"request served\",\"latency_ms\":%u}\n",
+                seed, (seed >> 16) % 500);
+        text += line;
+    }
+    payload->assign(text.begin(), text.begin() + len);
+}
+
+/* Benchmark every operation for one (payload, threads) point */
+static bool bench_point(size_t len, unsigned thread_count, unsigned iterations,
+        std::vector<bench_result>* results) {
+    size_t sealed_size = sizeof(sgx_sealed_data_t) + len;
+    uint32_t batch = (uint32_t)std::max(1UL, std::min((unsigned long)CRYPTO_BATCH_MAX, CRYPTO_BATCH_BYTES / len));
+
+    std::vector<thread_state> states(thread_count);
+    for (size_t t = 0; t < states.size(); t++) {
+        fill_payload(&states[t].plaintext, len);
+        states[t].sealed.assign(sealed_size, 0);
+        states[t].compressed.assign(SEALING_COMPRESSED_MAX_SIZE(len), 0);
+        states[t].compressed_len = 0;
+        /* unseal needs a valid blob to start from */
+        if (call_op(OP_SEAL, &states[t], len, 0) != SGX_SUCCESS ||
+                call_op(OP_SEAL_COMPRESSED, &states[t], len, 0) != SGX_SUCCESS) {
+            return false;
+        }
+    }
+
+    /* Transition cost */
+    double wall_ns = run_threads(OP_ECALL, states, len, iterations, 0);
+    if (wall_ns < 0) return false;
+    double ecall_ns = mean_of(states);
+    results->push_back(summarize(OP_ECALL, states, 0, wall_ns, 0, 1));
+
+    /* EDL copy cost: the same buffers as seal, minus the transition */
+    if ((wall_ns = run_threads(OP_EDL_COPY, states, len, iterations, 0)) < 0) return false;
+    results->push_back(summarize(OP_EDL_COPY, states, len, wall_ns, ecall_ns, 1));
+
+    /* End to end */
+    if ((wall_ns = run_threads(OP_SEAL, states, len, iterations, 0)) < 0) return false;
+    results->push_back(summarize(OP_SEAL, states, len, wall_ns, 0, 1));
+    if ((wall_ns = run_threads(OP_UNSEAL, states, len, iterations, 0)) < 0) return false;
+    results->push_back(summarize(OP_UNSEAL, states, len, wall_ns, 0, 1));
+
+    /* Resident enclave workers: no transition per job once they are busy */
+    if ((wall_ns = run_threads(OP_SEAL_ASYNC, states, len, iterations, 0)) < 0) return false;
+    results->push_back(summarize(OP_SEAL_ASYNC, states, len, wall_ns, 0, 1));
+
+    /* Pre-created instances: seal plus the checkout/checkin round trip */
+    if (enclave_pool != NULL) {
+        if ((wall_ns = run_threads(OP_SEAL_POOLED, states, len, iterations, 0)) < 0) return false;
+        results->push_back(summarize(OP_SEAL_POOLED, states, len, wall_ns, 0, 1));
+    }
+
+    /* In-enclave compression: compare with seal/unseal for the MB/s cost, sealed_bytes for the ratio */
+    if ((wall_ns = run_threads(OP_SEAL_COMPRESSED, states, len, iterations, 0)) < 0) return false;
+    results->push_back(summarize(OP_SEAL_COMPRESSED, states, len, wall_ns, 0, 1));
+    if ((wall_ns = run_threads(OP_UNSEAL_COMPRESSED, states, len, iterations, 0)) < 0) return false;
+    results->push_back(summarize(OP_UNSEAL_COMPRESSED, states, len, wall_ns, 0, 1));
+
+    /* Crypto cost: t(batch) - t(0) removes the transition and the setup */
+    const bench_op crypto_ops[] = { OP_SEAL_CRYPTO, OP_UNSEAL_CRYPTO };
+    for (size_t i = 0; i < sizeof(crypto_ops) / sizeof(crypto_ops[0]); i++) {
+        if (run_threads(crypto_ops[i], states, len, iterations, 0) < 0) return false;
+        double setup_ns = mean_of(states);
+        if ((wall_ns = run_threads(crypto_ops[i], states, len, iterations, batch)) < 0) return false;
+        results->push_back(summarize(crypto_ops[i], states, len, wall_ns, setup_ns, batch));
+    }
+    return true;
+}
+
+static void write_csv(const std::string& path, const std::vector<bench_result>& results) {
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "mode,op,payload_bytes,threads,ops,mean_ns,p50_ns,p99_ns,max_ns,ops_per_sec,mb_per_sec,sealed_bytes\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result& r = results[i];
+        fprintf(fp, "%s,%s,%zu,%u,%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f,%zu\n",
+                BENCH_SGX_MODE, op_names[r.op], r.payload, r.threads, r.ops,
+                r.mean_ns, r.p50_ns, r.p99_ns, r.max_ns, r.ops_per_sec, r.mb_per_sec, r.sealed_bytes);
+    }
+    fclose(fp);
+}
+
+static void write_json(const std::string& path, const std::vector<bench_result>& results) {
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "{\n  \"mode\": \"%s\",\n  \"results\": [\n", BENCH_SGX_MODE);
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result& r = results[i];
+        fprintf(fp, "    {\"op\": \"%s\", \"payload_bytes\": %zu, \"threads\": %u, \"ops\": %zu, "
+                "\"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"max_ns\": %.1f, "
+                "\"ops_per_sec\": %.1f, \"mb_per_sec\": %.2f, \"sealed_bytes\": %zu}%s\n",
+                op_names[r.op], r.payload, r.threads, r.ops,
+                r.mean_ns, r.p50_ns, r.p99_ns, r.max_ns, r.ops_per_sec, r.mb_per_sec, r.sealed_bytes,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+/**
+ * @brief      Checks an instance back in as lost and waits for the pool to
+ *             recreate it, as after a power transition.
+ *
+ * @return     The time until the new instance is ready in us, or a negative
+ *             value if it did not come.
+ */
+static double measure_recreation(EnclavePool* pool) {
+    sgx_enclave_id_t eid;
+    size_t recreated = pool->stats().recreated;
+    if (!pool->checkout(&eid, RECREATE_TIMEOUT_MS)) {
+        return -1;
+    }
+
+    bench_clock::time_point begin = bench_clock::now();
+    pool->checkin(eid, SGX_ERROR_ENCLAVE_LOST);
+    while (pool->stats().recreated == recreated) {
+        if (ns_between(begin, bench_clock::now()) > RECREATE_TIMEOUT_MS * 1e6) {
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return ns_between(begin, bench_clock::now()) / 1e3;
+}
+
+static void usage(const char* name) {
+    printf("Usage: %s [-s min_bytes] [-S max_bytes] [-t max_threads] [-i max_iterations] [-p pool_size] [-o output_prefix]\n", name);
+    printf("  Payloads go from min_bytes to max_bytes in steps of 4x (default 16 B .. 16 MB),\n");
+    printf("  threads from 1 to max_threads in steps of 2x (default 4).\n");
+    printf("  max_bytes x max_threads must fit the %lu MB enclave heap budget.\n", ENCLAVE_HEAP_BUDGET >> 20);
+    printf("  seal_pooled runs on pool_size pre-created enclave instances (default 2, 0 to skip it).\n");
+    printf("  Results are written to <output_prefix>.csv and <output_prefix>.json (default bench_sealing).\n");
+}
+
+int main(int argc, char* argv[]) {
+    bench_config config;
+    config.min_size = 16;
+    config.max_size = 16UL << 20;
+    config.max_threads = 4;
+    config.max_iterations = 1000;
+    config.pool_size = 2;
+    config.output_prefix = "bench_sealing";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:S:t:i:p:o:h")) != -1) {
+        switch (opt) {
+        case 's': config.min_size = strtoul(optarg, NULL, 0); break;
+        case 'S': config.max_size = strtoul(optarg, NULL, 0); break;
+        case 't': config.max_threads = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'i': config.max_iterations = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'p': config.pool_size = strtoul(optarg, NULL, 0); break;
+        case 'o': config.output_prefix = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (config.min_size == 0 || config.max_threads == 0 || config.max_iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    /* Refuse the whole sweep up front rather than skip its largest points */
+    if ((config.max_threads + SEAL_QUEUE_WORKERS) * SEALING_COMPRESSED_MAX_SIZE(3 * config.max_size) > ENCLAVE_HEAP_BUDGET) {
+        printf("%zu bytes x %u threads exceeds the enclave heap budget.\n", config.max_size, config.max_threads);
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (initialize_enclave(&global_eid, "bench_enclave.token", "bench_enclave.signed.so") < 0) {
+        printf("Fail to initialize enclave.\n");
+        return 1;
+    }
+
+    SealQueue queue(global_eid, SEAL_QUEUE_WORKERS);
+    if (queue.start() < 0) {
+        printf("Fail to start the seal queue.\n");
+        sgx_destroy_enclave(global_eid);
+        return 1;
+    }
+    seal_queue = &queue;
+
+    /* Every instance runs bench_empty once before it is handed out */
+    EnclavePool pool("bench_enclave.token", "bench_enclave.signed.so", config.pool_size, bench_empty);
+    if (config.pool_size > 0) {
+        if (pool.start() < 0) {
+            printf("Fail to start the enclave pool.\n");
+            queue.stop();
+            sgx_destroy_enclave(global_eid);
+            return 1;
+        }
+        EnclavePool::Stats pool_stats = pool.stats();
+        double recreate_us = measure_recreation(&pool);
+        printf("Enclave pool: %zu instances, first ready after %.0f us, %.0f us to create each, %.0f us to recreate a lost one\n",
+                pool_stats.size, pool_stats.time_to_first_ecall_us, pool_stats.mean_create_us, recreate_us);
+        enclave_pool = &pool;
+    }
+
+    std::vector<bench_result> results;
+    printf("%-18s %10s %7s %12s %12s %12s %12s %12s\n",
+            "op", "payload", "threads", "mean_ns", "p99_ns", "ops/s", "MB/s", "sealed");
+    for (size_t len = config.min_size; len <= config.max_size; len *= 4) {
+        unsigned iterations = (unsigned)std::max(2UL, std::min((unsigned long)config.max_iterations, BYTES_PER_POINT / len));
+        for (unsigned threads = 1; threads <= config.max_threads; threads *= 2) {
+            size_t first = results.size();
+            if (!bench_point(len, threads, iterations, &results)) {
+                queue.stop();
+                sgx_destroy_enclave(global_eid);
+                return 1;
+            }
+            for (size_t i = first; i < results.size(); i++) {
+                const bench_result& r = results[i];
+                printf("%-18s %10zu %7u %12.1f %12.1f %12.1f %12.2f %12zu\n", op_names[r.op], r.payload,
+                        r.threads, r.mean_ns, r.p99_ns, r.ops_per_sec, r.mb_per_sec, r.sealed_bytes);
+            }
+        }
+    }
+
+    write_csv(config.output_prefix + ".csv", results);
+    write_json(config.output_prefix + ".json", results);
+    printf("Results written to %s.csv and %s.json\n", config.output_prefix.c_str(), config.output_prefix.c_str());
+
+    queue.stop();
+    sgx_destroy_enclave(global_eid);
+    return 0;
+}
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include "sgx_urts.h"
+#include "BenchEnclave_u.h"
+#include "sgx_utils/sgx_utils.h"
+#include "sealing/kv_store.h"
+
+#ifndef BENCH_SGX_MODE
+# define BENCH_SGX_MODE "SIM"
+#endif
+
+/* Entries returned by each scan */
+#define SCAN_LENGTH 100
+
+/* The merge thread compacts the store once this many segments exist */
+#define MERGE_THRESHOLD 4
+
+sgx_enclave_id_t global_eid = 0;
+
+enum kv_op {
+    KV_OP_PUT,          /* load of every key, in random order */
+    KV_OP_GET_HIT,      /* kv_get of a key that is present */
+    KV_OP_GET_MISS,     /* kv_get of a key that never was, mostly answered by the bloom filters */
+    KV_OP_SCAN          /* kv_scan of SCAN_LENGTH consecutive keys */
+};
+
+static const char* op_names[] = { "put", "get_hit", "get_miss", "scan" };
+
+struct kv_bench_config {
+    uint64_t keys;
+    size_t value_size;
+    unsigned max_threads;
+    unsigned lookups;
+    std::string dir;
+    std::string output_prefix;
+    bool keep;
+};
+
+struct kv_bench_result {
+    kv_op op;
+    unsigned threads;
+    size_t ops;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double max_ns;
+    double ops_per_sec;
+    kv_stats_t stats;   /* store state right after the run */
+};
+
+struct kv_thread_state {
+    std::vector<uint64_t> ids;
+    std::vector<double> samples_ns;
+    sgx_status_t error;
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ns_between(bench_clock::time_point begin, bench_clock::time_point end) {
+    return std::chrono::duration<double, std::nano>(end - begin).count();
+}
+
+/* Fixed width, so the byte order of the keys is the numeric order of the IDs */
+static std::string key_of(uint64_t id) {
+    char key[24];
+    snprintf(key, sizeof(key), "user%016llu", (unsigned long long)id);
+    return key;
+}
+
+static std::string value_of(uint64_t id, size_t value_size) {
+    std::string value(value_size, 'v');
+    snprintf(&value[0], value_size, "%llu:", (unsigned long long)id);
+    value[value_size - 1] = '\n';
+    return value;
+}
+
+static sgx_status_t call_op(SealedKV* kv, kv_op op, uint64_t id, size_t value_size) {
+    std::string value;
+    bool found = false;
+    sgx_status_t status = SGX_SUCCESS;
+
+    switch (op) {
+    case KV_OP_PUT:
+        status = kv->put(key_of(id), value_of(id, value_size));
+        break;
+    case KV_OP_GET_HIT:
+    case KV_OP_GET_MISS:
+        status = kv->get(key_of(id), &value, &found);
+        if (status == SGX_SUCCESS && found != (op == KV_OP_GET_HIT)) {
+            printf("Key %s is unexpectedly %s.\n", key_of(id).c_str(), found ? "present" : "missing");
+            status = SGX_ERROR_UNEXPECTED;
+        }
+        break;
+    case KV_OP_SCAN: {
+        std::vector<std::pair<std::string, std::string> > entries;
+        status = kv->scan(key_of(id), key_of(id + 2 * SCAN_LENGTH), &entries);
+        break;
+    }
+    }
+    return status;
+}
+
+static void run_thread(SealedKV* kv, kv_op op, kv_thread_state* state, size_t value_size,
+        const std::atomic<bool>* start) {
+    state->samples_ns.reserve(state->ids.size());
+    while (!start->load()) {
+        std::this_thread::yield();
+    }
+    for (size_t i = 0; i < state->ids.size(); i++) {
+        bench_clock::time_point begin = bench_clock::now();
+        sgx_status_t status = call_op(kv, op, state->ids[i], value_size);
+        bench_clock::time_point end = bench_clock::now();
+        if (status != SGX_SUCCESS) {
+            state->error = status;
+            return;
+        }
+        state->samples_ns.push_back(ns_between(begin, end));
+    }
+}
+
+/* Run op over the IDs of every thread and return the wall time in ns, or a negative value on error */
+static double run_threads(SealedKV* kv, kv_op op, std::vector<kv_thread_state>& states, size_t value_size) {
+    std::vector<std::thread> threads;
+    std::atomic<bool> start(false);
+    for (size_t t = 0; t < states.size(); t++) {
+        states[t].samples_ns.clear();
+        states[t].error = SGX_SUCCESS;
+        threads.push_back(std::thread(run_thread, kv, op, &states[t], value_size, &start));
+    }
+
+    bench_clock::time_point begin = bench_clock::now();
+    start.store(true);
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    double wall_ns = ns_between(begin, bench_clock::now());
+
+    for (size_t t = 0; t < states.size(); t++) {
+        if (states[t].error != SGX_SUCCESS) {
+            printf("%s failed:\n", op_names[op]);
+            print_error_message(states[t].error);
+            return -1;
+        }
+    }
+    return wall_ns;
+}
+
+static kv_bench_result summarize(kv_op op, const std::vector<kv_thread_state>& states, double wall_ns) {
+    std::vector<double> samples;
+    for (size_t t = 0; t < states.size(); t++) {
+        samples.insert(samples.end(), states[t].samples_ns.begin(), states[t].samples_ns.end());
+    }
+    std::sort(samples.begin(), samples.end());
+
+    kv_bench_result r;
+    r.op = op;
+    r.threads = (unsigned)states.size();
+    r.ops = samples.size();
+    r.mean_ns = 0;
+    for (size_t i = 0; i < samples.size(); i++) r.mean_ns += samples[i];
+    r.mean_ns /= samples.size();
+    r.p50_ns = samples[samples.size() / 2];
+    r.p99_ns = samples[std::min(samples.size() - 1, (size_t)(samples.size() * 0.99))];
+    r.max_ns = samples.back();
+    r.ops_per_sec = r.ops / (wall_ns / 1e9);
+    memset(&r.stats, 0, sizeof(r.stats));
+    return r;
+}
+
+/* Deal ids round-robin over thread_count threads */
+static std::vector<kv_thread_state> split_ids(const std::vector<uint64_t>& ids, unsigned thread_count) {
+    std::vector<kv_thread_state> states(thread_count);
+    for (size_t i = 0; i < ids.size(); i++) {
+        states[i % thread_count].ids.push_back(ids[i]);
+    }
+    return states;
+}
+
+/* Let the merge thread catch up, so the lookups see the compacted store */
+static sgx_status_t wait_for_merges(SealedKV* kv, kv_stats_t* stats) {
+    sgx_status_t status;
+    while ((status = kv->stats(stats)) == SGX_SUCCESS && stats->segments >= MERGE_THRESHOLD) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return status;
+}
+
+static bool run_bench(SealedKV* kv, const kv_bench_config& config, std::vector<kv_bench_result>* results) {
+    std::mt19937_64 rng(1);
+
+    /* Present keys have even IDs, so odd IDs are misses that fall inside the key range */
+    std::vector<uint64_t> ids(config.keys);
+    for (uint64_t i = 0; i < config.keys; i++) ids[i] = 2 * i;
+    std::shuffle(ids.begin(), ids.end(), rng);
+
+    printf("Loading %llu keys with %zu byte values...\n", (unsigned long long)config.keys, config.value_size);
+    std::vector<kv_thread_state> states = split_ids(ids, 1);
+    double wall_ns = run_threads(kv, KV_OP_PUT, states, config.value_size);
+    if (wall_ns < 0) return false;
+    kv_bench_result load = summarize(KV_OP_PUT, states, wall_ns);
+
+    bench_clock::time_point begin = bench_clock::now();
+    if (kv->flush() != SGX_SUCCESS || wait_for_merges(kv, &load.stats) != SGX_SUCCESS) {
+        printf("Flushing the store failed.\n");
+        return false;
+    }
+    printf("Flush and merges after the load: %.1f ms, %u segment(s), %u merge(s)\n",
+            ns_between(begin, bench_clock::now()) / 1e6, load.stats.segments, load.stats.merges);
+    results->push_back(load);
+
+    const kv_op lookup_ops[] = { KV_OP_GET_HIT, KV_OP_GET_MISS, KV_OP_SCAN };
+    for (size_t o = 0; o < sizeof(lookup_ops) / sizeof(lookup_ops[0]); o++) {
+        kv_op op = lookup_ops[o];
+        std::uniform_int_distribution<uint64_t> pick(0, config.keys > SCAN_LENGTH ? config.keys - SCAN_LENGTH - 1 : 0);
+        std::vector<uint64_t> lookups(op == KV_OP_SCAN ? std::max(1U, config.lookups / SCAN_LENGTH) : config.lookups);
+        for (size_t i = 0; i < lookups.size(); i++) {
+            lookups[i] = 2 * pick(rng) + (op == KV_OP_GET_MISS ? 1 : 0);
+        }
+
+        for (unsigned threads = 1; threads <= config.max_threads; threads *= 2) {
+            kv_stats_t before;
+            if (kv->stats(&before) != SGX_SUCCESS) return false;
+            states = split_ids(lookups, threads);
+            if ((wall_ns = run_threads(kv, op, states, config.value_size)) < 0) return false;
+            kv_bench_result r = summarize(op, states, wall_ns);
+            if (kv->stats(&r.stats) != SGX_SUCCESS) return false;
+            /* Counters of this run only */
+            r.stats.blocks_read -= before.blocks_read;
+            r.stats.bloom_negatives -= before.bloom_negatives;
+            results->push_back(r);
+        }
+    }
+    return true;
+}
+
+static void write_csv(const std::string& path, const std::vector<kv_bench_result>& results) {
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "mode,op,threads,ops,mean_ns,p50_ns,p99_ns,max_ns,ops_per_sec,"
+            "segments,merges,segment_keys,segment_bytes,bloom_bytes,index_bytes,blocks_read,bloom_negatives\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const kv_bench_result& r = results[i];
+        fprintf(fp, "%s,%s,%u,%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%u,%u,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                BENCH_SGX_MODE, op_names[r.op], r.threads, r.ops,
+                r.mean_ns, r.p50_ns, r.p99_ns, r.max_ns, r.ops_per_sec,
+                r.stats.segments, r.stats.merges,
+                (unsigned long long)r.stats.segment_keys, (unsigned long long)r.stats.segment_bytes,
+                (unsigned long long)r.stats.bloom_bytes, (unsigned long long)r.stats.index_bytes,
+                (unsigned long long)r.stats.blocks_read, (unsigned long long)r.stats.bloom_negatives);
+    }
+    fclose(fp);
+}
+
+static void write_json(const std::string& path, const kv_bench_config& config,
+        const std::vector<kv_bench_result>& results) {
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        printf("Warning: Failed to open \"%s\" for writing.\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "{\n  \"mode\": \"%s\",\n  \"keys\": %llu,\n  \"value_bytes\": %zu,\n  \"results\": [\n",
+            BENCH_SGX_MODE, (unsigned long long)config.keys, config.value_size);
+    for (size_t i = 0; i < results.size(); i++) {
+        const kv_bench_result& r = results[i];
+        fprintf(fp, "    {\"op\": \"%s\", \"threads\": %u, \"ops\": %zu, "
+                "\"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"max_ns\": %.1f, \"ops_per_sec\": %.1f, "
+                "\"segments\": %u, \"merges\": %u, \"segment_keys\": %llu, \"segment_bytes\": %llu, "
+                "\"bloom_bytes\": %llu, \"index_bytes\": %llu, \"blocks_read\": %llu, \"bloom_negatives\": %llu}%s\n",
+                op_names[r.op], r.threads, r.ops,
+                r.mean_ns, r.p50_ns, r.p99_ns, r.max_ns, r.ops_per_sec,
+                r.stats.segments, r.stats.merges,
+                (unsigned long long)r.stats.segment_keys, (unsigned long long)r.stats.segment_bytes,
+                (unsigned long long)r.stats.bloom_bytes, (unsigned long long)r.stats.index_bytes,
+                (unsigned long long)r.stats.blocks_read, (unsigned long long)r.stats.bloom_negatives,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+/* Removes the segment files the benchmark wrote, and dir itself */
+static void remove_store(const std::string& dir) {
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL) return;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strstr(entry->d_name, ".seg") != NULL) {
+            unlink((dir + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(d);
+    rmdir(dir.c_str());
+}
+
+static void usage(const char* name) {
+    printf("Usage: %s [-n keys] [-v value_bytes] [-t max_threads] [-l lookups] [-d dir] [-k] [-o output_prefix]\n", name);
+    printf("  Loads keys entries (default 2000000 x 100 B) into a fresh store in dir (default kv_bench_data),\n");
+    printf("  then runs lookups gets and lookups/%d scans from 1 to max_threads in steps of 2x (default 100000, 4).\n", SCAN_LENGTH);
+    printf("  The store is removed at the end unless -k is given.\n");
+    printf("  Results are written to <output_prefix>.csv and <output_prefix>.json (default bench_kv).\n");
+}
+
+int main(int argc, char* argv[]) {
+    kv_bench_config config;
+    config.keys = 2000000;
+    config.value_size = 100;
+    config.max_threads = 4;
+    config.lookups = 100000;
+    config.dir = "kv_bench_data";
+    config.output_prefix = "bench_kv";
+    config.keep = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:v:t:l:d:ko:h")) != -1) {
+        switch (opt) {
+        case 'n': config.keys = strtoull(optarg, NULL, 0); break;
+        case 'v': config.value_size = strtoul(optarg, NULL, 0); break;
+        case 't': config.max_threads = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'l': config.lookups = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'd': config.dir = optarg; break;
+        case 'k': config.keep = true; break;
+        case 'o': config.output_prefix = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (config.keys <= SCAN_LENGTH || config.value_size < 32 || config.value_size > KV_MAX_VALUE_SIZE ||
+            config.max_threads == 0 || config.lookups == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* A leftover store would be loaded by kv_open and skew every number */
+    DIR* existing = opendir(config.dir.c_str());
+    if (existing != NULL) {
+        closedir(existing);
+        printf("\"%s\" already exists, remove it or pick another directory with -d.\n", config.dir.c_str());
+        return 1;
+    }
+
+    if (initialize_enclave(&global_eid, "bench_enclave.token", "bench_enclave.signed.so") < 0) {
+        printf("Fail to initialize enclave.\n");
+        return 1;
+    }
+
+    SealedKV kv(global_eid, config.dir);
+    if (kv.open(MERGE_THRESHOLD) != SGX_SUCCESS) {
+        sgx_destroy_enclave(global_eid);
+        return 1;
+    }
+
+    std::vector<kv_bench_result> results;
+    bool ok = run_bench(&kv, config, &results);
+    kv.close();
+    if (!config.keep) remove_store(config.dir);
+    sgx_destroy_enclave(global_eid);
+    if (!ok) return 1;
+
+    printf("%-10s %7s %10s %12s %12s %12s %8s %12s %12s\n",
+            "op", "threads", "ops", "mean_ns", "p99_ns", "ops/s", "segments", "blocks_read", "bloom_neg");
+    for (size_t i = 0; i < results.size(); i++) {
+        const kv_bench_result& r = results[i];
+        printf("%-10s %7u %10zu %12.1f %12.1f %12.1f %8u %12llu %12llu\n", op_names[r.op], r.threads, r.ops,
+                r.mean_ns, r.p99_ns, r.ops_per_sec, r.stats.segments,
+                (unsigned long long)r.stats.blocks_read, (unsigned long long)r.stats.bloom_negatives);
+    }
+    const kv_stats_t& loaded = results[0].stats;
+    printf("Store: %llu keys in %llu segment bytes, %llu bloom bytes and %llu index bytes in the enclave\n",
+            (unsigned long long)loaded.segment_keys, (unsigned long long)loaded.segment_bytes,
+            (unsigned long long)loaded.bloom_bytes, (unsigned long long)loaded.index_bytes);
+
+    write_csv(config.output_prefix + ".csv", results);
+    write_json(config.output_prefix + ".json", config, results);
+    printf("Results written to %s.csv and %s.json\n", config.output_prefix.c_str(), config.output_prefix.c_str());
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "string.h"
+#include "Compress.h"
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+/* The last bytes of the input are always emitted as literals */
+#define LZ_LAST_LITERALS 5
+/* Skip ahead faster through data that does not compress */
+#define LZ_SKIP_SHIFT 6
+
+#define LZ_ERROR 0xFFFFFFFFu
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the extension bytes of a length whose nibble was 15 */
+static bool write_length(uint8_t** op, const uint8_t* oend, uint32_t len) {
+    for (len -= 15; ; len -= 255) {
+        if (*op >= oend) return false;
+        if (len < 255) {
+            *(*op)++ = (uint8_t)len;
+            return true;
+        }
+        *(*op)++ = 255;
+    }
+}
+
+static bool read_length(const uint8_t** ip, const uint8_t* iend, uint32_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) return false;
+        b = *(*ip)++;
+        if (*len > LZ_ERROR - 255) return false;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+/* Emits literals [anchor, anchor + lit_len) followed by a match, if match_len > 0 */
+static bool write_sequence(uint8_t** op, const uint8_t* oend, const uint8_t* anchor,
+        uint32_t lit_len, uint32_t offset, uint32_t match_len) {
+    if (*op >= oend) return false;
+    uint8_t* token = (*op)++;
+    uint32_t match_code = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+    *token = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+
+    if (lit_len >= 15 && !write_length(op, oend, lit_len)) return false;
+    if ((uint32_t)(oend - *op) < lit_len) return false;
+    memcpy(*op, anchor, lit_len);
+    *op += lit_len;
+
+    if (match_len == 0) return true;
+    if (oend - *op < 2) return false;
+    *(*op)++ = (uint8_t)(offset & 0xFF);
+    *(*op)++ = (uint8_t)(offset >> 8);
+    return match_code < 15 || write_length(op, oend, match_code);
+}
+
+uint32_t lz_compress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_cap) {
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint8_t* op = dst;
+    const uint8_t* oend = dst + dst_cap;
+    uint32_t anchor = 0;
+    uint32_t ip = 0;
+
+    if (src_len > LZ_MIN_MATCH + LZ_LAST_LITERALS) {
+        uint32_t match_limit = src_len - LZ_LAST_LITERALS;
+        while (ip + LZ_MIN_MATCH <= match_limit) {
+            uint32_t h = hash32(read32(src + ip));
+            uint32_t candidate = table[h];
+            table[h] = ip;
+
+            if (candidate >= ip || ip - candidate > LZ_MAX_OFFSET ||
+                    read32(src + candidate) != read32(src + ip)) {
+                ip += 1 + ((ip - anchor) >> LZ_SKIP_SHIFT);
+                continue;
+            }
+
+            uint32_t match_len = LZ_MIN_MATCH;
+            while (ip + match_len < match_limit && src[candidate + match_len] == src[ip + match_len]) {
+                match_len++;
+            }
+            if (!write_sequence(&op, oend, src + anchor, ip - anchor, ip - candidate, match_len)) {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    if (!write_sequence(&op, oend, src + anchor, src_len - anchor, 0, 0)) return 0;
+    return (uint32_t)(op - dst);
+}
+
+uint32_t lz_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_cap) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    const uint8_t* oend = dst + dst_cap;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        uint32_t lit_len = token >> 4;
+        if (lit_len == 15 && !read_length(&ip, iend, &lit_len)) return LZ_ERROR;
+        if ((uint32_t)(iend - ip) < lit_len || (uint32_t)(oend - op) < lit_len) return LZ_ERROR;
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        /* The literal-only sequence ends the block */
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return LZ_ERROR;
+        uint32_t offset = ip[0] | ((uint32_t)ip[1] << 8);
+        ip += 2;
+        uint32_t match_len = token & 0x0F;
+        if (match_len == 15 && !read_length(&ip, iend, &match_len)) return LZ_ERROR;
+        match_len += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (uint32_t)(op - dst) || (uint32_t)(oend - op) < match_len) {
+            return LZ_ERROR;
+        }
+        /* Byte by byte: the match may overlap the bytes it produces */
+        const uint8_t* match = op - offset;
+        for (uint32_t i = 0; i < match_len; i++) {
+            op[i] = match[i];
+        }
+        op += match_len;
+    }
+    return (uint32_t)(op - dst);
+}
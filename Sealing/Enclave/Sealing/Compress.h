@@ -0,0 +1,50 @@
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+#include <stdint.h>
+
+/*
+ * A small LZ77 block compressor for use inside the enclave. It only needs
+ * memcpy/memset from the trusted libc and keeps its 16 KB hash table on the
+ * stack, so it adds no heap use beyond the output buffer.
+ *
+ * Block format: a sequence of
+ *   token            high nibble literal count, low nibble match length - 4
+ *   [length bytes]   if a nibble is 15, further bytes are added until one < 255
+ *   literals
+ *   offset           2 bytes little endian, distance back into the output
+ *   [length bytes]   match length extension
+ * The last sequence carries literals only and ends the block.
+ */
+
+/**
+ * @brief      Compresses src into dst.
+ *
+ * @param      src      The input
+ * @param[in]  src_len  The input length
+ * @param      dst      The output buffer
+ * @param[in]  dst_cap  The output buffer size, SEALING_LZ_BOUND(src_len) is
+ *                      always enough
+ *
+ * @return     The compressed length, or 0 if dst is too small.
+ */
+uint32_t lz_compress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_cap);
+
+/**
+ * @brief      Decompresses an lz_compress block.
+ *
+ * @details    Every length and offset is checked against both buffers, so a
+ *             malformed block fails instead of reading or writing out of
+ *             bounds.
+ *
+ * @param      src      The compressed block
+ * @param[in]  src_len  The block length
+ * @param      dst      The output buffer
+ * @param[in]  dst_cap  The output buffer size
+ *
+ * @return     The decompressed length, or UINT32_MAX if the block is
+ *             malformed or does not fit in dst.
+ */
+uint32_t lz_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_cap);
+
+#endif // COMPRESS_H_
@@ -0,0 +1,684 @@
+#include "sgx_trts.h"
+#include "sgx_tseal.h"
+#include "sgx_tcrypto.h"
+#include "sgx_thread.h"
+#include "stdlib.h"
+#include "string.h"
+#include <map>
+#include <vector>
+#include "Enclave_t.h"
+#include "sealed_dedup.h"
+
+/*
+ * A content-addressed store that seals every distinct chunk of data once.
+ *
+ * dedup_put cuts a blob at content-defined boundaries (normalized gear hash
+ * chunking, DEDUP_MIN_CHUNK..DEDUP_MAX_CHUNK), so an edit only changes the
+ * chunks around it and shared regions give identical chunks wherever they
+ * sit in a blob. Each chunk is named by its AES-CMAC under a key that never
+ * leaves the enclave; a chunk already in the store is not sealed or written
+ * again. The blob itself becomes a sealed manifest listing its chunks.
+ *
+ * Files, all kept by the App:
+ *   - the store key, sealed: the chunk ID key and the gear table derive from it
+ *   - one sealed chunk per ID, its ID and length as additional MAC text
+ *   - one sealed manifest per blob, its name as additional MAC text
+ *
+ * The chunk table (ID, reference count, length) lives in the enclave. It is
+ * rebuilt from the manifests by dedup_open, which also removes the chunks no
+ * manifest references, e.g. after a crash in the middle of a dedup_put.
+ *
+ * Deduplication is visible from outside: the App learns which chunks are
+ * shared between blobs and their lengths, though not their content. The
+ * files are also not protected against rollback.
+ *
+ * All ECALLs take one store-wide lock.
+ */
+
+#define DEDUP_KEY_MAGIC      0x4B444553     /* "SEDK" */
+#define DEDUP_CHUNK_MAGIC    0x43444553     /* "SEDC" */
+#define DEDUP_MANIFEST_MAGIC 0x4D444553     /* "SEDM" */
+
+/* Normalized chunking: cuts are unlikely before DEDUP_AVG_CHUNK and likely after */
+#define DEDUP_MASK_SMALL (((1ULL << 15) - 1) << 49)
+#define DEDUP_MASK_LARGE (((1ULL << 11) - 1) << 53)
+
+/* Manifests go through OCALLs in pieces of this size */
+#define DEDUP_IO_BYTES (64 * 1024)
+
+typedef struct dedup_chunk_aad {
+    uint32_t magic;
+    uint32_t len;
+    dedup_chunk_id_t id;
+} dedup_chunk_aad_t;
+
+/* Start of a manifest, followed by chunks entries */
+typedef struct dedup_manifest_header {
+    uint64_t blob_len;
+    uint32_t chunks;
+    uint32_t reserved;
+} dedup_manifest_header_t;
+
+typedef struct dedup_manifest_entry {
+    dedup_chunk_id_t id;
+    uint32_t len;
+} dedup_manifest_entry_t;
+
+struct chunk_id_less {
+    bool operator()(const dedup_chunk_id_t& a, const dedup_chunk_id_t& b) const {
+        return memcmp(a.id, b.id, DEDUP_CHUNK_ID_SIZE) < 0;
+    }
+};
+
+struct dedup_chunk {
+    uint32_t refs;
+    uint32_t len;
+};
+
+typedef std::map<dedup_chunk_id_t, dedup_chunk, chunk_id_less> dedup_chunk_table;
+
+/* A decoded manifest */
+struct dedup_manifest {
+    uint64_t blob_len;
+    uint64_t sealed_len;
+    std::vector<dedup_manifest_entry_t> entries;
+};
+
+static sgx_thread_mutex_t dedup_lock = SGX_THREAD_MUTEX_INITIALIZER;
+/* Everything below is guarded by dedup_lock */
+static void* dedup_store = NULL;
+static sgx_cmac_128bit_key_t dedup_id_key;
+static uint64_t dedup_gear[256];
+static dedup_chunk_table dedup_chunks;
+static uint64_t dedup_chunk_bytes = 0;
+static uint64_t dedup_chunk_refs = 0;
+static uint64_t dedup_blobs = 0;
+static uint64_t dedup_logical_bytes = 0;
+static uint64_t dedup_manifest_bytes = 0;
+static uint64_t dedup_put_bytes = 0;
+static uint64_t dedup_written_bytes = 0;
+
+class dedup_locked {
+public:
+    dedup_locked() { sgx_thread_mutex_lock(&dedup_lock); }
+    ~dedup_locked() { sgx_thread_mutex_unlock(&dedup_lock); }
+};
+
+/* ret is read through a pointer so that it is only looked at after the OCALL returned */
+static sgx_status_t ocall_result(sgx_status_t status, const int* ret) {
+    if (status != SGX_SUCCESS) return status;
+    return *ret == 0 ? SGX_SUCCESS : SGX_ERROR_UNEXPECTED;
+}
+
+static uint32_t sealed_chunk_size(uint32_t len) {
+    return sgx_calc_sealed_data_size(sizeof(dedup_chunk_aad_t), len);
+}
+
+static sgx_status_t cmac(const sgx_cmac_128bit_key_t* key, const void* data, uint32_t len, uint8_t* mac) {
+    return sgx_rijndael128_cmac_msg(key, (const uint8_t*)data, len, (sgx_cmac_128bit_tag_t*)mac);
+}
+
+/* Derives the chunk ID key and the gear table from the store key */
+static sgx_status_t derive_keys(const sgx_cmac_128bit_key_t* store_key) {
+    static const char id_label[] = "dedup chunk id";
+    static const char gear_label[] = "dedup gear";
+
+    sgx_status_t status = cmac(store_key, id_label, sizeof(id_label), dedup_id_key);
+    if (status != SGX_SUCCESS) return status;
+
+    /* A secret gear table keeps the App from predicting where chunks are cut */
+    sgx_cmac_128bit_key_t gear_key;
+    status = cmac(store_key, gear_label, sizeof(gear_label), gear_key);
+    for (uint32_t i = 0; i < 256 && status == SGX_SUCCESS; i++) {
+        uint8_t mac[SGX_CMAC_MAC_SIZE];
+        status = cmac(&gear_key, &i, sizeof(i), mac);
+        memcpy(&dedup_gear[i], mac, sizeof(dedup_gear[i]));
+    }
+    memset(gear_key, 0, sizeof(gear_key));
+    return status;
+}
+
+/**
+ * @brief      Unseals the store key, or creates and stores it the first time.
+ *
+ * @param      store  The App's handle
+ *
+ * @return     SGX_SUCCESS if the keys are ready, error code otherwise.
+ */
+static sgx_status_t load_key(void* store) {
+    uint32_t aad = DEDUP_KEY_MAGIC;
+    sgx_cmac_128bit_key_t store_key;
+    uint32_t sealed_len = sgx_calc_sealed_data_size(sizeof(aad), sizeof(store_key));
+    std::vector<uint8_t> sealed(sealed_len);
+
+    int ret;
+    uint32_t len = 0;
+    sgx_status_t status = ocall_result(ocall_dedup_read_key(&ret, store, &sealed[0], sealed_len, &len), &ret);
+    if (status != SGX_SUCCESS) return status;
+
+    if (len == 0) {
+        status = sgx_read_rand(store_key, sizeof(store_key));
+        if (status == SGX_SUCCESS) {
+            status = sgx_seal_data(sizeof(aad), (const uint8_t*)&aad, sizeof(store_key), store_key,
+                    sealed_len, (sgx_sealed_data_t*)&sealed[0]);
+        }
+        if (status == SGX_SUCCESS) {
+            status = ocall_result(ocall_dedup_write_key(&ret, store, &sealed[0], sealed_len), &ret);
+        }
+    } else {
+        const sgx_sealed_data_t* sealed_key = (const sgx_sealed_data_t*)&sealed[0];
+        uint32_t aad_len = sizeof(aad);
+        uint32_t key_len = sizeof(store_key);
+        if (len != sealed_len || sgx_get_add_mac_txt_len(sealed_key) != aad_len ||
+                sgx_get_encrypt_txt_len(sealed_key) != key_len) {
+            return SGX_ERROR_MAC_MISMATCH;
+        }
+        status = sgx_unseal_data(sealed_key, (uint8_t*)&aad, &aad_len, store_key, &key_len);
+        if (status == SGX_SUCCESS && aad != DEDUP_KEY_MAGIC) status = SGX_ERROR_MAC_MISMATCH;
+    }
+
+    if (status == SGX_SUCCESS) status = derive_keys(&store_key);
+    memset(store_key, 0, sizeof(store_key));
+    return status;
+}
+
+/* Length of the next chunk of the len bytes at data */
+static uint32_t chunk_boundary(const uint8_t* data, size_t len) {
+    if (len <= DEDUP_MIN_CHUNK) return (uint32_t)len;
+    if (len > DEDUP_MAX_CHUNK) len = DEDUP_MAX_CHUNK;
+    size_t normal = len < DEDUP_AVG_CHUNK ? len : DEDUP_AVG_CHUNK;
+
+    uint64_t fingerprint = 0;
+    size_t i = DEDUP_MIN_CHUNK;
+    for (; i < normal; i++) {
+        fingerprint = (fingerprint << 1) + dedup_gear[data[i]];
+        if ((fingerprint & DEDUP_MASK_SMALL) == 0) return (uint32_t)(i + 1);
+    }
+    for (; i < len; i++) {
+        fingerprint = (fingerprint << 1) + dedup_gear[data[i]];
+        if ((fingerprint & DEDUP_MASK_LARGE) == 0) return (uint32_t)(i + 1);
+    }
+    return (uint32_t)len;
+}
+
+/* Seals a new chunk and hands it to the App */
+static sgx_status_t write_chunk(const dedup_chunk_id_t& id, const uint8_t* data, uint32_t len,
+        std::vector<uint8_t>* sealed) {
+    dedup_chunk_aad_t aad;
+    aad.magic = DEDUP_CHUNK_MAGIC;
+    aad.len = len;
+    aad.id = id;
+
+    uint32_t sealed_len = sealed_chunk_size(len);
+    sgx_status_t status = sgx_seal_data(sizeof(aad), (const uint8_t*)&aad, len, data, sealed_len,
+            (sgx_sealed_data_t*)&(*sealed)[0]);
+    if (status != SGX_SUCCESS) return status;
+
+    int ret;
+    status = ocall_result(ocall_dedup_write_chunk(&ret, dedup_store, (dedup_chunk_id_t*)&id, &(*sealed)[0], sealed_len), &ret);
+    if (status == SGX_SUCCESS) dedup_written_bytes += sealed_len;
+    return status;
+}
+
+/**
+ * @brief      Reads and unseals one chunk.
+ *
+ * @param[in]  entry   The chunk, as listed in a manifest
+ * @param      sealed  Scratch buffer of sealed_chunk_size(DEDUP_MAX_CHUNK) bytes
+ * @param      data    Receives entry.len bytes
+ *
+ * @return     SGX_SUCCESS if the chunk is genuine and the one asked for,
+ *             error code otherwise.
+ */
+static sgx_status_t read_chunk(const dedup_manifest_entry_t& entry, std::vector<uint8_t>* sealed, uint8_t* data) {
+    int ret;
+    uint32_t len = 0;
+    sgx_status_t status = ocall_result(ocall_dedup_read_chunk(&ret, dedup_store, (dedup_chunk_id_t*)&entry.id,
+                &(*sealed)[0], (uint32_t)sealed->size(), &len), &ret);
+    if (status != SGX_SUCCESS) return status;
+
+    const sgx_sealed_data_t* sealed_chunk = (const sgx_sealed_data_t*)&(*sealed)[0];
+    dedup_chunk_aad_t aad;
+    uint32_t aad_len = sizeof(aad);
+    uint32_t text_len = entry.len;
+    if (len != sealed_chunk_size(entry.len) || sgx_get_add_mac_txt_len(sealed_chunk) != aad_len ||
+            sgx_get_encrypt_txt_len(sealed_chunk) != text_len) {
+        return SGX_ERROR_MAC_MISMATCH;
+    }
+    status = sgx_unseal_data(sealed_chunk, (uint8_t*)&aad, &aad_len, data, &text_len);
+    if (status == SGX_SUCCESS && (aad.magic != DEDUP_CHUNK_MAGIC || aad.len != entry.len ||
+                memcmp(aad.id.id, entry.id.id, DEDUP_CHUNK_ID_SIZE) != 0)) {
+        status = SGX_ERROR_MAC_MISMATCH;
+    }
+    return status;
+}
+
+/* Removes the chunks in ids that ended up with no reference */
+static void drop_unreferenced(const std::vector<dedup_chunk_id_t>& ids) {
+    for (size_t i = 0; i < ids.size(); i++) {
+        dedup_chunk_table::iterator it = dedup_chunks.find(ids[i]);
+        if (it == dedup_chunks.end() || it->second.refs > 0) continue;
+        dedup_chunk_bytes -= it->second.len;
+        dedup_chunks.erase(it);
+
+        int ret;
+        ocall_dedup_remove_chunk(&ret, dedup_store, (dedup_chunk_id_t*)&ids[i]);
+    }
+}
+
+/* Drops the references of a manifest that is gone, and the chunks left unused */
+static void release_chunks(const std::vector<dedup_manifest_entry_t>& entries) {
+    std::vector<dedup_chunk_id_t> released;
+    for (size_t i = 0; i < entries.size(); i++) {
+        dedup_chunk_table::iterator it = dedup_chunks.find(entries[i].id);
+        if (it == dedup_chunks.end()) continue;
+        dedup_chunk_refs--;
+        if (--it->second.refs == 0) released.push_back(entries[i].id);
+    }
+    drop_unreferenced(released);
+}
+
+/**
+ * @brief      Chunks a blob and writes out the chunks the store lacks.
+ *
+ * @details    The blob is copied into the enclave a window at a time, and
+ *             every chunk is hashed and sealed from that copy, so the App
+ *             changing the buffer meanwhile cannot make an ID and its chunk
+ *             disagree.
+ *
+ * @param[in]  data      The blob, outside the enclave
+ * @param[in]  data_len  The size of the blob
+ * @param      entries   Receives the chunk list of the manifest
+ * @param      added     Receives the IDs put in the chunk table, still
+ *                       without a reference
+ *
+ * @return     SGX_SUCCESS if all chunks are stored, error code otherwise.
+ */
+static sgx_status_t store_chunks(const uint8_t* data, uint64_t data_len,
+        std::vector<dedup_manifest_entry_t>* entries, std::vector<dedup_chunk_id_t>* added) {
+    std::vector<uint8_t> window(2 * DEDUP_MAX_CHUNK);
+    std::vector<uint8_t> sealed(sealed_chunk_size(DEDUP_MAX_CHUNK));
+    size_t begin = 0;
+    size_t end = 0;
+    uint64_t copied = 0;
+
+    for (;;) {
+        /* Keep at least a full chunk in the window, moving less than that each time */
+        if (end - begin < DEDUP_MAX_CHUNK && copied < data_len) {
+            memmove(&window[0], &window[begin], end - begin);
+            end -= begin;
+            begin = 0;
+            size_t n = window.size() - end;
+            if (n > data_len - copied) n = (size_t)(data_len - copied);
+            memcpy(&window[end], data + copied, n);
+            end += n;
+            copied += n;
+        }
+        if (begin == end) break;
+
+        dedup_manifest_entry_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.len = chunk_boundary(&window[begin], end - begin);
+        sgx_status_t status = cmac(&dedup_id_key, &window[begin], entry.len, entry.id.id);
+        if (status != SGX_SUCCESS) return status;
+
+        if (dedup_chunks.find(entry.id) == dedup_chunks.end()) {
+            status = write_chunk(entry.id, &window[begin], entry.len, &sealed);
+            if (status != SGX_SUCCESS) return status;
+            dedup_chunk chunk;
+            chunk.refs = 0;
+            chunk.len = entry.len;
+            dedup_chunks[entry.id] = chunk;
+            dedup_chunk_bytes += entry.len;
+            added->push_back(entry.id);
+        }
+        entries->push_back(entry);
+        begin += entry.len;
+    }
+    return SGX_SUCCESS;
+}
+
+static std::vector<uint8_t> manifest_aad(const uint8_t* name, size_t name_len) {
+    std::vector<uint8_t> aad(sizeof(uint32_t) + name_len);
+    uint32_t magic = DEDUP_MANIFEST_MAGIC;
+    memcpy(&aad[0], &magic, sizeof(magic));
+    memcpy(&aad[sizeof(magic)], name, name_len);
+    return aad;
+}
+
+/* Largest sealed manifest dedup_put can produce */
+static uint64_t max_manifest_size() {
+    uint64_t entries = DEDUP_MAX_BLOB_SIZE / DEDUP_MIN_CHUNK + 1;
+    return sgx_calc_sealed_data_size(sizeof(uint32_t) + DEDUP_MAX_NAME_SIZE,
+            (uint32_t)(sizeof(dedup_manifest_header_t) + entries * sizeof(dedup_manifest_entry_t)));
+}
+
+/**
+ * @brief      Reads and unseals the manifest of a blob.
+ *
+ * @param[in]  name      The blob name
+ * @param[in]  name_len  The size of the name
+ * @param      found     Set to false if there is no such blob
+ * @param      manifest  Receives the manifest
+ *
+ * @return     SGX_SUCCESS if the manifest is absent or genuine, error code
+ *             otherwise.
+ */
+static sgx_status_t read_manifest(const uint8_t* name, size_t name_len, bool* found, dedup_manifest* manifest) {
+    int ret;
+    uint64_t size = 0;
+    *found = false;
+    sgx_status_t status = ocall_result(ocall_dedup_manifest_size(&ret, dedup_store, (uint8_t*)name, name_len, &size), &ret);
+    if (status != SGX_SUCCESS || size == 0) return status;
+    if (size < sizeof(sgx_sealed_data_t) || size > max_manifest_size()) return SGX_ERROR_MAC_MISMATCH;
+
+    std::vector<uint8_t> sealed((size_t)size);
+    for (uint64_t offset = 0; offset < size && status == SGX_SUCCESS; offset += DEDUP_IO_BYTES) {
+        size_t len = size - offset < DEDUP_IO_BYTES ? (size_t)(size - offset) : DEDUP_IO_BYTES;
+        status = ocall_result(ocall_dedup_read_manifest(&ret, dedup_store, (uint8_t*)name, name_len, offset,
+                    &sealed[(size_t)offset], len), &ret);
+    }
+    if (status != SGX_SUCCESS) return status;
+
+    /* The sizes come from the file: make sure they stay inside what was read */
+    const sgx_sealed_data_t* sealed_manifest = (const sgx_sealed_data_t*)&sealed[0];
+    uint32_t aad_len = sgx_get_add_mac_txt_len(sealed_manifest);
+    uint32_t text_len = sgx_get_encrypt_txt_len(sealed_manifest);
+    uint32_t needed = sgx_calc_sealed_data_size(aad_len, text_len);
+    if (aad_len != sizeof(uint32_t) + name_len || text_len < sizeof(dedup_manifest_header_t) ||
+            needed == UINT32_MAX || needed > size) {
+        return SGX_ERROR_MAC_MISMATCH;
+    }
+
+    std::vector<uint8_t> aad(aad_len);
+    std::vector<uint8_t> plaintext(text_len);
+    status = sgx_unseal_data(sealed_manifest, &aad[0], &aad_len, &plaintext[0], &text_len);
+    if (status != SGX_SUCCESS) return status;
+    if (aad != manifest_aad(name, name_len)) return SGX_ERROR_MAC_MISMATCH;
+
+    dedup_manifest_header_t header;
+    memcpy(&header, &plaintext[0], sizeof(header));
+    if (header.chunks != (text_len - sizeof(header)) / sizeof(dedup_manifest_entry_t) ||
+            (text_len - sizeof(header)) % sizeof(dedup_manifest_entry_t) != 0) {
+        return SGX_ERROR_MAC_MISMATCH;
+    }
+
+    manifest->blob_len = header.blob_len;
+    manifest->sealed_len = size;
+    manifest->entries.resize(header.chunks);
+    if (header.chunks > 0) {
+        memcpy(&manifest->entries[0], &plaintext[sizeof(header)], header.chunks * sizeof(dedup_manifest_entry_t));
+    }
+    *found = true;
+    return SGX_SUCCESS;
+}
+
+/* Seals a manifest and writes it in place of the previous one. Returns its sealed size in *sealed_len. */
+static sgx_status_t write_manifest(const uint8_t* name, size_t name_len, uint64_t blob_len,
+        const std::vector<dedup_manifest_entry_t>& entries, uint64_t* sealed_len) {
+    dedup_manifest_header_t header;
+    header.blob_len = blob_len;
+    header.chunks = (uint32_t)entries.size();
+    header.reserved = 0;
+
+    std::vector<uint8_t> plaintext(sizeof(header) + entries.size() * sizeof(dedup_manifest_entry_t));
+    memcpy(&plaintext[0], &header, sizeof(header));
+    if (!entries.empty()) {
+        memcpy(&plaintext[sizeof(header)], &entries[0], entries.size() * sizeof(dedup_manifest_entry_t));
+    }
+
+    std::vector<uint8_t> aad = manifest_aad(name, name_len);
+    uint32_t size = sgx_calc_sealed_data_size((uint32_t)aad.size(), (uint32_t)plaintext.size());
+    if (size == UINT32_MAX) return SGX_ERROR_INVALID_PARAMETER;
+    std::vector<uint8_t> sealed(size);
+    sgx_status_t status = sgx_seal_data((uint32_t)aad.size(), &aad[0], (uint32_t)plaintext.size(), &plaintext[0],
+            size, (sgx_sealed_data_t*)&sealed[0]);
+
+    int ret;
+    for (uint32_t offset = 0; offset < size && status == SGX_SUCCESS; offset += DEDUP_IO_BYTES) {
+        size_t len = size - offset < DEDUP_IO_BYTES ? size - offset : DEDUP_IO_BYTES;
+        status = ocall_result(ocall_dedup_write_manifest(&ret, dedup_store, (uint8_t*)name, name_len, offset,
+                    &sealed[offset], len), &ret);
+    }
+    if (status == SGX_SUCCESS) {
+        status = ocall_result(ocall_dedup_finish_manifest(&ret, dedup_store, (uint8_t*)name, name_len), &ret);
+    }
+    if (status == SGX_SUCCESS) {
+        dedup_written_bytes += size;
+        *sealed_len = size;
+    }
+    return status;
+}
+
+static void reset_store() {
+    dedup_store = NULL;
+    dedup_chunks.clear();
+    dedup_chunk_bytes = 0;
+    dedup_chunk_refs = 0;
+    dedup_blobs = 0;
+    dedup_logical_bytes = 0;
+    dedup_manifest_bytes = 0;
+    dedup_put_bytes = 0;
+    dedup_written_bytes = 0;
+    memset(dedup_id_key, 0, sizeof(dedup_id_key));
+    memset(dedup_gear, 0, sizeof(dedup_gear));
+}
+
+/* Rebuilds the chunk table from every manifest, then removes the chunks none references */
+static sgx_status_t load_store() {
+    int ret;
+    sgx_status_t status = SGX_SUCCESS;
+    uint8_t name[DEDUP_MAX_NAME_SIZE];
+
+    for (uint32_t index = 0; status == SGX_SUCCESS; index++) {
+        uint32_t name_len = 0;
+        status = ocall_result(ocall_dedup_manifest_at(&ret, dedup_store, index, name, sizeof(name), &name_len), &ret);
+        if (status != SGX_SUCCESS || name_len == 0) break;
+        if (name_len > sizeof(name)) return SGX_ERROR_UNEXPECTED;
+
+        bool found;
+        dedup_manifest manifest;
+        /* A manifest that fails to unseal fails the open: skipping it would remove its chunks */
+        status = read_manifest(name, name_len, &found, &manifest);
+        if (status != SGX_SUCCESS) break;
+        if (!found) continue;
+
+        for (size_t i = 0; i < manifest.entries.size(); i++) {
+            const dedup_manifest_entry_t& entry = manifest.entries[i];
+            dedup_chunk_table::iterator it = dedup_chunks.find(entry.id);
+            if (it == dedup_chunks.end()) {
+                dedup_chunk chunk;
+                chunk.refs = 0;
+                chunk.len = entry.len;
+                it = dedup_chunks.insert(std::make_pair(entry.id, chunk)).first;
+                dedup_chunk_bytes += entry.len;
+            }
+            it->second.refs++;
+            dedup_chunk_refs++;
+        }
+        dedup_blobs++;
+        dedup_logical_bytes += manifest.blob_len;
+        dedup_manifest_bytes += manifest.sealed_len;
+    }
+
+    for (uint32_t index = 0; status == SGX_SUCCESS; index++) {
+        dedup_chunk_id_t id;
+        uint32_t found = 0;
+        status = ocall_result(ocall_dedup_chunk_at(&ret, dedup_store, index, &id, &found), &ret);
+        if (status != SGX_SUCCESS || !found) break;
+        if (dedup_chunks.find(id) == dedup_chunks.end()) {
+            status = ocall_result(ocall_dedup_remove_chunk(&ret, dedup_store, &id), &ret);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief      Opens the store kept in the App's files.
+ *
+ * @details    Reads every manifest to count the references to each chunk.
+ *             Only one store can be open in an enclave at a time.
+ *
+ * @param      store  The App's handle, passed back to every OCALL
+ *
+ * @return     SGX_SUCCESS if opened, error code otherwise.
+ */
+sgx_status_t dedup_open(void* store) {
+    dedup_locked lock;
+    if (dedup_store != NULL || store == NULL) return SGX_ERROR_INVALID_STATE;
+
+    reset_store();
+    sgx_status_t status = load_key(store);
+    if (status == SGX_SUCCESS) {
+        dedup_store = store;
+        status = load_store();
+    }
+    if (status != SGX_SUCCESS) reset_store();
+    return status;
+}
+
+sgx_status_t dedup_close(void) {
+    dedup_locked lock;
+    if (dedup_store == NULL) return SGX_ERROR_INVALID_STATE;
+    reset_store();
+    return SGX_SUCCESS;
+}
+
+static bool valid_name(const uint8_t* name, size_t name_len) {
+    return name != NULL && name_len > 0 && name_len <= DEDUP_MAX_NAME_SIZE;
+}
+
+/**
+ * @brief      Stores a blob under name, replacing any blob of that name.
+ *
+ * @param[in]  name      The blob name
+ * @param[in]  name_len  The size of the name
+ * @param[in]  data      The blob, outside the enclave
+ * @param[in]  data_len  The size of the blob, at most DEDUP_MAX_BLOB_SIZE
+ *
+ * @return     SGX_SUCCESS if stored, error code otherwise; the previous
+ *             blob is left as it was on failure.
+ */
+sgx_status_t dedup_put(uint8_t* name, size_t name_len, uint8_t* data, uint64_t data_len) {
+    if (!valid_name(name, name_len) || data_len > DEDUP_MAX_BLOB_SIZE ||
+            (data_len > 0 && (data == NULL || !sgx_is_outside_enclave(data, (size_t)data_len)))) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+    dedup_locked lock;
+    if (dedup_store == NULL) return SGX_ERROR_INVALID_STATE;
+
+    bool replaced;
+    dedup_manifest previous;
+    sgx_status_t status = read_manifest(name, name_len, &replaced, &previous);
+    if (status != SGX_SUCCESS) return status;
+
+    std::vector<dedup_manifest_entry_t> entries;
+    std::vector<dedup_chunk_id_t> added;
+    uint64_t manifest_len = 0;
+    status = store_chunks(data, data_len, &entries, &added);
+    if (status == SGX_SUCCESS) {
+        status = write_manifest(name, name_len, data_len, entries, &manifest_len);
+    }
+    if (status != SGX_SUCCESS) {
+        drop_unreferenced(added);
+        return status;
+    }
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        dedup_chunks[entries[i].id].refs++;
+    }
+    dedup_chunk_refs += entries.size();
+    if (replaced) {
+        release_chunks(previous.entries);
+        dedup_blobs--;
+        dedup_logical_bytes -= previous.blob_len;
+        dedup_manifest_bytes -= previous.sealed_len;
+    }
+    dedup_blobs++;
+    dedup_logical_bytes += data_len;
+    dedup_manifest_bytes += manifest_len;
+    dedup_put_bytes += data_len;
+    return SGX_SUCCESS;
+}
+
+/**
+ * @brief      Reads a blob back.
+ *
+ * @param[in]  name      The blob name
+ * @param[in]  name_len  The size of the name
+ * @param      out       Receives the blob, outside the enclave
+ * @param[in]  out_cap   The size of out
+ * @param      blob_len  Set to the size of the blob, or DEDUP_NOT_FOUND. If
+ *                       it exceeds out_cap, out is left untouched.
+ *
+ * @return     SGX_SUCCESS if the blob is absent, too large for out or read,
+ *             error code otherwise.
+ */
+sgx_status_t dedup_get(uint8_t* name, size_t name_len, uint8_t* out, uint64_t out_cap, uint64_t* blob_len) {
+    if (!valid_name(name, name_len) || blob_len == NULL ||
+            (out_cap > 0 && (out == NULL || !sgx_is_outside_enclave(out, (size_t)out_cap)))) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+    dedup_locked lock;
+    if (dedup_store == NULL) return SGX_ERROR_INVALID_STATE;
+
+    bool found;
+    dedup_manifest manifest;
+    sgx_status_t status = read_manifest(name, name_len, &found, &manifest);
+    if (status != SGX_SUCCESS) return status;
+    *blob_len = found ? manifest.blob_len : DEDUP_NOT_FOUND;
+    if (!found || manifest.blob_len > out_cap) return SGX_SUCCESS;
+
+    std::vector<uint8_t> sealed(sealed_chunk_size(DEDUP_MAX_CHUNK));
+    std::vector<uint8_t> chunk(DEDUP_MAX_CHUNK);
+    uint64_t offset = 0;
+    for (size_t i = 0; i < manifest.entries.size(); i++) {
+        const dedup_manifest_entry_t& entry = manifest.entries[i];
+        if (entry.len > DEDUP_MAX_CHUNK || entry.len > manifest.blob_len - offset) return SGX_ERROR_MAC_MISMATCH;
+        status = read_chunk(entry, &sealed, &chunk[0]);
+        if (status != SGX_SUCCESS) return status;
+        memcpy(out + offset, &chunk[0], entry.len);
+        offset += entry.len;
+    }
+    return offset == manifest.blob_len ? SGX_SUCCESS : SGX_ERROR_MAC_MISMATCH;
+}
+
+/* Removing a blob that does not exist succeeds */
+sgx_status_t dedup_remove(uint8_t* name, size_t name_len) {
+    if (!valid_name(name, name_len)) return SGX_ERROR_INVALID_PARAMETER;
+    dedup_locked lock;
+    if (dedup_store == NULL) return SGX_ERROR_INVALID_STATE;
+
+    bool found;
+    dedup_manifest manifest;
+    sgx_status_t status = read_manifest(name, name_len, &found, &manifest);
+    if (status != SGX_SUCCESS || !found) return status;
+
+    int ret;
+    status = ocall_result(ocall_dedup_remove_manifest(&ret, dedup_store, name, name_len), &ret);
+    if (status != SGX_SUCCESS) return status;
+
+    release_chunks(manifest.entries);
+    dedup_blobs--;
+    dedup_logical_bytes -= manifest.blob_len;
+    dedup_manifest_bytes -= manifest.sealed_len;
+    return SGX_SUCCESS;
+}
+
+sgx_status_t dedup_get_stats(dedup_stats_t* stats) {
+    if (stats == NULL) return SGX_ERROR_INVALID_PARAMETER;
+    memset(stats, 0, sizeof(dedup_stats_t));
+
+    dedup_locked lock;
+    if (dedup_store == NULL) return SGX_ERROR_INVALID_STATE;
+    stats->blobs = dedup_blobs;
+    stats->logical_bytes = dedup_logical_bytes;
+    stats->chunks = dedup_chunks.size();
+    stats->chunk_refs = dedup_chunk_refs;
+    stats->chunk_bytes = dedup_chunk_bytes;
+    stats->stored_bytes = dedup_manifest_bytes +
+        dedup_chunks.size() * (uint64_t)sealed_chunk_size(0) + dedup_chunk_bytes;
+    stats->put_bytes = dedup_put_bytes;
+    stats->written_bytes = dedup_written_bytes;
+    return SGX_SUCCESS;
+}
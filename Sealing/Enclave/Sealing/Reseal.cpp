@@ -0,0 +1,111 @@
+#include "sgx_trts.h"
+#include "sgx_tseal.h"
+#include "stdlib.h"
+#include "string.h"
+#include "Enclave_t.h"
+#include "reseal_batch.h"
+
+/**
+ * @brief      Unseals one blob and seals it again in place under key_policy.
+ *
+ * @details    The additional MAC text (codec header, record key, ...) is
+ *             carried over unchanged, and so are the attribute and misc masks
+ *             of the original key request. The new blob is bound to this
+ *             enclave's identity and ISV SVN, and has the same size as the old
+ *             one.
+ *
+ * @param      blob        The blob, inside the enclave
+ * @param      blob_len    The size of the buffer holding the blob, replaced
+ *                         by the size of the new blob
+ * @param[in]  key_policy  SGX_KEYPOLICY_MRENCLAVE or SGX_KEYPOLICY_MRSIGNER
+ * @param      scratch     A buffer reused across blobs
+ * @param      scratch_cap The size of scratch
+ *
+ * @return     SGX_SUCCESS if resealed, error code otherwise.
+ */
+static sgx_status_t reseal_blob(uint8_t* blob, uint32_t* blob_len, uint16_t key_policy,
+        uint8_t** scratch, uint32_t* scratch_cap) {
+    if (*blob_len < sizeof(sgx_sealed_data_t)) return SGX_ERROR_INVALID_PARAMETER;
+    sgx_sealed_data_t* sealed_data = (sgx_sealed_data_t*)blob;
+
+    /* The sizes come from the blob being migrated: make sure they stay inside it */
+    uint32_t aad_len = sgx_get_add_mac_txt_len(sealed_data);
+    uint32_t text_len = sgx_get_encrypt_txt_len(sealed_data);
+    uint32_t needed = sgx_calc_sealed_data_size(aad_len, text_len);
+    if (needed == UINT32_MAX || needed > *blob_len) return SGX_ERROR_INVALID_PARAMETER;
+
+    uint32_t scratch_len = aad_len + text_len;
+    if (*scratch == NULL || scratch_len > *scratch_cap) {
+        uint8_t* grown = (uint8_t*)realloc(*scratch, scratch_len > 0 ? scratch_len : 1);
+        if (grown == NULL) return SGX_ERROR_OUT_OF_MEMORY;
+        *scratch = grown;
+        *scratch_cap = scratch_len;
+    }
+    uint8_t* aad = *scratch;
+    uint8_t* text = *scratch + aad_len;
+
+    sgx_status_t status = sgx_unseal_data(sealed_data, aad_len > 0 ? aad : NULL,
+            aad_len > 0 ? &aad_len : NULL, text, &text_len);
+    if (status == SGX_SUCCESS) {
+        sgx_attributes_t attribute_mask = sealed_data->key_request.attribute_mask;
+        sgx_misc_select_t misc_mask = sealed_data->key_request.misc_mask;
+        status = sgx_seal_data_ex(key_policy, attribute_mask, misc_mask,
+                aad_len, aad_len > 0 ? aad : NULL, text_len, text, needed, sealed_data);
+        if (status == SGX_SUCCESS) *blob_len = needed;
+    }
+
+    memset(*scratch, 0, scratch_len);
+    return status;
+}
+
+/**
+ * @brief      Migrates a batch of sealed blobs to this enclave.
+ *
+ * @details    Used when a new enclave version ships: each blob is unsealed
+ *             with the key it was sealed with, which works as long as the
+ *             key policy of the old blob allows this enclave to derive it
+ *             (MRSIGNER, same signer, ISV SVN not lower), and sealed again
+ *             under key_policy. Batching many blobs into one ECALL keeps the
+ *             transition and marshalling cost off the per-blob path.
+ *
+ *             blobs holds count blobs one after the other, blob i taking
+ *             RESEAL_BATCH_STRIDE(blob_lens[i]) bytes. Blobs are resealed in place; blob_lens and
+ *             statuses report each blob's new size and result, so one bad
+ *             blob does not fail the batch.
+ *
+ * @param      blobs       The blobs
+ * @param[in]  blobs_size  The size of blobs
+ * @param      blob_lens   The size of each blob
+ * @param      statuses    The result for each blob
+ * @param[in]  count       The number of blobs
+ * @param[in]  key_policy  SGX_KEYPOLICY_MRENCLAVE or SGX_KEYPOLICY_MRSIGNER
+ *
+ * @return     SGX_SUCCESS if the batch was processed, error code otherwise.
+ */
+sgx_status_t reseal_batch(uint8_t* blobs, size_t blobs_size, uint32_t* blob_lens,
+        sgx_status_t* statuses, uint32_t count, uint16_t key_policy) {
+    if (key_policy != SGX_KEYPOLICY_MRENCLAVE && key_policy != SGX_KEYPOLICY_MRSIGNER) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+    if (count > 0 && (blobs == NULL || blob_lens == NULL || statuses == NULL)) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+
+    size_t offset = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (RESEAL_BATCH_STRIDE((size_t)blob_lens[i]) > blobs_size - offset) return SGX_ERROR_INVALID_PARAMETER;
+        offset += RESEAL_BATCH_STRIDE((size_t)blob_lens[i]);
+    }
+
+    uint8_t* scratch = NULL;
+    uint32_t scratch_cap = 0;
+    offset = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t stride = RESEAL_BATCH_STRIDE((size_t)blob_lens[i]);
+        statuses[i] = reseal_blob(blobs + offset, &blob_lens[i], key_policy, &scratch, &scratch_cap);
+        offset += stride;
+    }
+
+    free(scratch);
+    return SGX_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#include "sgx_trts.h"
+#include "sgx_tseal.h"
+#include "stdlib.h"
+#include "string.h"
+#include "Enclave_t.h"
+#include "seal_ring.h"
+
+/* Empty polls before a worker parks itself in ocall_seal_worker_wait */
+#define SEAL_WORKER_SPIN 4096
+
+/* Per-worker buffers, grown on demand and reused across jobs */
+typedef struct seal_worker_buffers {
+    uint8_t* plaintext;
+    uint32_t plaintext_cap;
+    sgx_sealed_data_t* sealed;
+    uint32_t sealed_cap;
+} seal_worker_buffers_t;
+
+static bool reserve(void** buf, uint32_t* cap, uint32_t size) {
+    if (size <= *cap) return true;
+    void* grown = realloc(*buf, size);
+    if (grown == NULL) return false;
+    *buf = grown;
+    *cap = size;
+    return true;
+}
+
+/**
+ * @brief      Seals one job popped from the untrusted request ring.
+ *
+ * @details    The job is a copy in enclave memory, but every pointer and size
+ *             in it comes from the App: both buffers must be entirely outside
+ *             the enclave. The plaintext is copied in before sealing so it
+ *             cannot change under sgx_seal_data, and sgx_seal_data requires
+ *             the blob to be written inside the enclave anyway.
+ *
+ * @param      job         The job
+ * @param      buffers     The worker's buffers
+ * @param      sealed_len  The size of the blob written to job->sealed
+ *
+ * @return     SGX_SUCCESS if seal successful, error code otherwise.
+ */
+static sgx_status_t seal_job(const seal_job_t* job, seal_worker_buffers_t* buffers, uint32_t* sealed_len) {
+    uint32_t needed = sgx_calc_sealed_data_size(0, job->plaintext_len);
+    if (needed == UINT32_MAX || needed > job->sealed_size ||
+            !sgx_is_outside_enclave(job->plaintext, job->plaintext_len) ||
+            !sgx_is_outside_enclave(job->sealed, job->sealed_size)) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+
+    if (!reserve((void**)&buffers->plaintext, &buffers->plaintext_cap, job->plaintext_len) ||
+            !reserve((void**)&buffers->sealed, &buffers->sealed_cap, needed)) {
+        return SGX_ERROR_OUT_OF_MEMORY;
+    }
+
+    memcpy(buffers->plaintext, job->plaintext, job->plaintext_len);
+    sgx_status_t status = sgx_seal_data(0, NULL, job->plaintext_len, buffers->plaintext,
+            needed, buffers->sealed);
+    memset(buffers->plaintext, 0, job->plaintext_len);
+    if (status != SGX_SUCCESS) return status;
+
+    memcpy(job->sealed, buffers->sealed, needed);
+    *sealed_len = needed;
+    return SGX_SUCCESS;
+}
+
+/**
+ * @brief      Serves seal jobs from the shared queue until the App stops it.
+ *
+ * @details    Meant to be called once per worker thread and to stay inside
+ *             the enclave: jobs are taken from and completed into rings in
+ *             untrusted memory, so a busy worker makes no enclave transition
+ *             per job. A worker that finds no work for SEAL_WORKER_SPIN polls
+ *             leaves the enclave once through ocall_seal_worker_wait, which
+ *             blocks until the App submits more work.
+ *
+ * @param      queue  The seal_queue_shared_t set up by the App
+ *
+ * @return     SGX_SUCCESS once stopped, SGX_ERROR_INVALID_PARAMETER if the
+ *             queue is not in untrusted memory.
+ */
+sgx_status_t seal_worker_run(void* queue) {
+    if (queue == NULL || !sgx_is_outside_enclave(queue, sizeof(seal_queue_shared_t))) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+    seal_queue_shared_t* shared = (seal_queue_shared_t*)queue;
+
+    seal_worker_buffers_t buffers;
+    memset(&buffers, 0, sizeof(buffers));
+
+    sgx_status_t status = SGX_SUCCESS;
+    uint32_t idle = 0;
+    for (;;) {
+        seal_job_t job;
+        if (!shared->requests.pop(&job)) {
+            /* Drain everything that was submitted before stopping */
+            if (__atomic_load_n(&shared->stop, __ATOMIC_ACQUIRE)) break;
+            if (++idle < SEAL_WORKER_SPIN) {
+                __builtin_ia32_pause();
+                continue;
+            }
+            idle = 0;
+            if ((status = ocall_seal_worker_wait(queue)) != SGX_SUCCESS) break;
+            continue;
+        }
+        idle = 0;
+
+        seal_completion_t completion;
+        completion.id = job.id;
+        completion.sealed_len = 0;
+        completion.status = seal_job(&job, &buffers, &completion.sealed_len);
+        while (!shared->completions.push(completion)) {
+            __builtin_ia32_pause();
+        }
+    }
+
+    free(buffers.plaintext);
+    free(buffers.sealed);
+    return status;
+}
@@ -0,0 +1,1061 @@
+#include "sgx_trts.h"
+#include "sgx_tseal.h"
+#include "sgx_thread.h"
+#include "stdlib.h"
+#include "string.h"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "Enclave_t.h"
+#include "sealed_kv.h"
+
+/*
+ * A log-structured key-value store whose files only ever hold sealed data.
+ *
+ * put/delete go to an in-enclave memtable. When it reaches
+ * KV_MEMTABLE_BYTES it is written out as a segment: its entries in key order,
+ * cut into sealed blocks of about KV_BLOCK_BYTES, followed by a sealed index
+ * block and a clear-text trailer locating it:
+ *
+ *   block 0 | block 1 | ... | index block | kv_trailer_t
+ *
+ * Every sealed block carries a kv_block_aad_t as additional MAC text, so a
+ * block moved to another segment or position fails to unseal. The index
+ * block holds the segment's sequence number, bloom filter and the first key
+ * of every block; it is loaded into the enclave when the segment is created
+ * or the store is opened, so kv_get reads at most one block per segment
+ * whose bloom filter matches.
+ *
+ * Segments are immutable. kv_merge combines all of them into one, keeping
+ * the newest version of each key and dropping deletions, while puts, gets and
+ * new flushes go on. Segments are reference counted so that readers can keep
+ * using a merged-away segment; its file is removed with the last reference.
+ *
+ * Like any sealed data the files are not protected against rollback: the App
+ * can bring back an older copy of the whole store, but not forge or mix
+ * entries.
+ */
+
+#define KV_SEGMENT_MAGIC 0x564B4553     /* "SEKV" */
+/* Block number of the index block in its additional MAC text */
+#define KV_INDEX_BLOCK 0xFFFFFFFF
+
+#define KV_BLOOM_BITS_PER_KEY 10
+#define KV_BLOOM_HASHES 7
+
+/* Entries taken from each memtable or segment by one kv_scan call */
+#define KV_SCAN_BATCH 256
+
+/* Most segment files kv_open accepts */
+#define KV_MAX_SEGMENTS 4096
+
+/* Memtable bookkeeping per entry, on top of the key and value bytes */
+#define KV_ENTRY_OVERHEAD 64
+
+/* An entry in a block: flags, key length, value length, key, value */
+#define KV_ENTRY_DELETED 1
+#define KV_ENTRY_HEADER (1 + 2 * sizeof(uint32_t))
+
+typedef struct kv_block_aad {
+    uint32_t magic;
+    uint32_t block;
+    uint64_t segment;
+} kv_block_aad_t;
+
+typedef struct kv_trailer {
+    uint64_t index_offset;
+    uint32_t index_len;
+    uint32_t magic;
+} kv_trailer_t;
+
+/* Start of the index block, followed by the bloom filter and the block list */
+typedef struct kv_index_header {
+    uint64_t sequence;
+    uint64_t keys;
+    uint32_t blocks;
+    uint32_t bloom_bytes;
+} kv_index_header_t;
+
+/* One block list entry, followed by key_len bytes of the block's first key */
+typedef struct kv_index_entry {
+    uint64_t offset;
+    uint32_t sealed_len;
+    uint32_t key_len;
+} kv_index_entry_t;
+
+static int compare_keys(const uint8_t* a, size_t a_len, const uint8_t* b, size_t b_len) {
+    int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (c != 0) return c;
+    return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+/* Byte order, as used in segments; std::string may compare chars as signed */
+struct key_less {
+    bool operator()(const std::string& a, const std::string& b) const {
+        return compare_keys((const uint8_t*)a.data(), a.size(), (const uint8_t*)b.data(), b.size()) < 0;
+    }
+};
+
+struct kv_value {
+    std::string data;
+    bool deleted;
+};
+
+typedef std::map<std::string, kv_value, key_less> kv_memtable;
+
+struct kv_block_ref {
+    std::string first_key;
+    uint64_t offset;
+    uint32_t sealed_len;
+};
+
+struct kv_segment {
+    void* store;            /* the App's handle, for removing the file */
+    uint64_t id;
+    uint64_t sequence;      /* newer data has a higher sequence */
+    uint64_t keys;
+    uint64_t file_size;
+    std::vector<uint8_t> bloom;
+    std::vector<kv_block_ref> blocks;
+    uint32_t refs;
+    bool obsolete;          /* merged away: remove the file with the last reference */
+};
+
+/* A decoded entry; key and value point into a block or the memtable */
+struct kv_entry {
+    const uint8_t* key;
+    uint32_t key_len;
+    const uint8_t* value;
+    uint32_t value_len;
+    bool deleted;
+};
+
+static sgx_thread_mutex_t kv_lock = SGX_THREAD_MUTEX_INITIALIZER;
+/* Everything below is guarded by kv_lock */
+static void* kv_store = NULL;
+static kv_memtable kv_mem;
+static uint64_t kv_mem_bytes = 0;
+static std::vector<kv_segment*> kv_segments;    /* oldest first */
+static uint64_t kv_next_id = 1;
+static uint64_t kv_next_sequence = 1;
+static bool kv_merging = false;
+static uint32_t kv_merges = 0;
+/* Updated without the lock */
+static uint64_t kv_blocks_read = 0;
+static uint64_t kv_bloom_negatives = 0;
+
+class kv_locked {
+public:
+    kv_locked() { sgx_thread_mutex_lock(&kv_lock); }
+    ~kv_locked() { sgx_thread_mutex_unlock(&kv_lock); }
+};
+
+static uint64_t kv_hash(const uint8_t* key, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ key[i]) * 1099511628211ULL;
+    }
+    /* FNV-1a mixes the low bits poorly, finish like splitmix64 */
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+static void bloom_add(std::vector<uint8_t>* bloom, uint64_t hash) {
+    uint64_t bits = bloom->size() * 8;
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0; i < KV_BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + (uint64_t)i * h2) % bits;
+        (*bloom)[bit / 8] |= (uint8_t)(1 << (bit % 8));
+    }
+}
+
+static bool bloom_may_contain(const std::vector<uint8_t>& bloom, uint64_t hash) {
+    uint64_t bits = bloom.size() * 8;
+    if (bits == 0) return false;
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0; i < KV_BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + (uint64_t)i * h2) % bits;
+        if ((bloom[bit / 8] & (1 << (bit % 8))) == 0) return false;
+    }
+    return true;
+}
+
+static void segment_acquire(kv_segment* segment) {
+    __atomic_add_fetch(&segment->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void segment_release(kv_segment* segment) {
+    if (__atomic_sub_fetch(&segment->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    if (segment->obsolete) {
+        int ret;
+        ocall_kv_remove_segment(&ret, segment->store, segment->id);
+    }
+    delete segment;
+}
+
+/* Takes a reference on every current segment, oldest first. Call with kv_lock held. */
+static std::vector<kv_segment*> snapshot_segments() {
+    for (size_t i = 0; i < kv_segments.size(); i++) {
+        segment_acquire(kv_segments[i]);
+    }
+    return kv_segments;
+}
+
+static void release_segments(const std::vector<kv_segment*>& segments) {
+    for (size_t i = 0; i < segments.size(); i++) {
+        segment_release(segments[i]);
+    }
+}
+
+/* ret is read through a pointer so that it is only looked at after the OCALL returned */
+static sgx_status_t ocall_result(sgx_status_t status, const int* ret) {
+    if (status != SGX_SUCCESS) return status;
+    return *ret == 0 ? SGX_SUCCESS : SGX_ERROR_UNEXPECTED;
+}
+
+/**
+ * @brief      Reads and unseals one block of a segment.
+ *
+ * @param      store       The App's store handle
+ * @param[in]  segment_id  The segment
+ * @param[in]  block       The block number, or KV_INDEX_BLOCK
+ * @param[in]  offset      Where the sealed block starts in the file
+ * @param[in]  sealed_len  The size of the sealed block
+ * @param      plaintext   Receives the block
+ *
+ * @return     SGX_SUCCESS if the block is genuine and where it belongs,
+ *             error code otherwise.
+ */
+static sgx_status_t read_block(void* store, uint64_t segment_id, uint32_t block, uint64_t offset,
+        uint32_t sealed_len, std::vector<uint8_t>* plaintext) {
+    if (sealed_len < sizeof(sgx_sealed_data_t)) return SGX_ERROR_INVALID_PARAMETER;
+
+    sgx_sealed_data_t* sealed = (sgx_sealed_data_t*)malloc(sealed_len);
+    if (sealed == NULL) return SGX_ERROR_OUT_OF_MEMORY;
+
+    int ret;
+    sgx_status_t status = ocall_result(ocall_kv_read(&ret, store, segment_id, offset, (uint8_t*)sealed, sealed_len), &ret);
+    if (status == SGX_SUCCESS) {
+        /* The sizes come from the file: make sure they stay inside the block read */
+        uint32_t aad_len = sgx_get_add_mac_txt_len(sealed);
+        uint32_t text_len = sgx_get_encrypt_txt_len(sealed);
+        uint32_t needed = sgx_calc_sealed_data_size(aad_len, text_len);
+        if (aad_len != sizeof(kv_block_aad_t) || needed == UINT32_MAX || needed > sealed_len) {
+            status = SGX_ERROR_MAC_MISMATCH;
+        }
+        if (status == SGX_SUCCESS) {
+            kv_block_aad_t aad;
+            plaintext->resize(text_len > 0 ? text_len : 1);
+            status = sgx_unseal_data(sealed, (uint8_t*)&aad, &aad_len, &(*plaintext)[0], &text_len);
+            plaintext->resize(text_len);
+            if (status == SGX_SUCCESS && (aad.magic != KV_SEGMENT_MAGIC || aad.segment != segment_id ||
+                        aad.block != block)) {
+                status = SGX_ERROR_MAC_MISMATCH;
+            }
+        }
+    }
+    free(sealed);
+    if (status == SGX_SUCCESS && block != KV_INDEX_BLOCK) {
+        __atomic_add_fetch(&kv_blocks_read, 1, __ATOMIC_RELAXED);
+    }
+    return status;
+}
+
+/* Decodes the entry at *pos of a block and moves *pos past it */
+static bool next_entry(const std::vector<uint8_t>& block, size_t* pos, kv_entry* entry) {
+    if (block.size() - *pos < KV_ENTRY_HEADER) return false;
+    const uint8_t* p = &block[*pos];
+    memcpy(&entry->key_len, p + 1, sizeof(uint32_t));
+    memcpy(&entry->value_len, p + 1 + sizeof(uint32_t), sizeof(uint32_t));
+    size_t left = block.size() - *pos - KV_ENTRY_HEADER;
+    if (entry->key_len > left || entry->value_len > left - entry->key_len) return false;
+
+    entry->deleted = (p[0] & KV_ENTRY_DELETED) != 0;
+    entry->key = p + KV_ENTRY_HEADER;
+    entry->value = entry->key + entry->key_len;
+    *pos += KV_ENTRY_HEADER + entry->key_len + entry->value_len;
+    return true;
+}
+
+/* Index of the block that would hold key, or -1 if key sorts before the segment */
+static long find_block(const kv_segment* segment, const uint8_t* key, size_t key_len) {
+    long lo = 0;
+    long hi = (long)segment->blocks.size() - 1;
+    long found = -1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        const std::string& first = segment->blocks[mid].first_key;
+        if (compare_keys((const uint8_t*)first.data(), first.size(), key, key_len) <= 0) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+/* Walks the entries of a segment in key order, one block in memory at a time */
+class kv_cursor {
+public:
+    kv_cursor(void* store, const kv_segment* segment)
+        : store_(store), segment_(segment), block_(0), pos_(0), valid_(false), status_(SGX_SUCCESS) {}
+
+    /* Positions the cursor on the first entry >= key */
+    void seek(const uint8_t* key, size_t key_len) {
+        long block = find_block(segment_, key, key_len);
+        if (!load(block < 0 ? 0 : (uint32_t)block)) return;
+        while (valid_ && compare_keys(entry_.key, entry_.key_len, key, key_len) < 0) {
+            next();
+        }
+    }
+
+    void seek_first() {
+        load(0);
+    }
+
+    void next() {
+        if (next_entry(data_, &pos_, &entry_)) return;
+        load(block_ + 1);
+    }
+
+    bool valid() const { return valid_; }
+    sgx_status_t status() const { return status_; }
+    const kv_entry& entry() const { return entry_; }
+
+private:
+    bool load(uint32_t block) {
+        valid_ = false;
+        for (; block < segment_->blocks.size(); block++) {
+            const kv_block_ref& ref = segment_->blocks[block];
+            status_ = read_block(store_, segment_->id, block, ref.offset, ref.sealed_len, &data_);
+            if (status_ != SGX_SUCCESS) return false;
+            block_ = block;
+            pos_ = 0;
+            if (next_entry(data_, &pos_, &entry_)) {
+                valid_ = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void* store_;
+    const kv_segment* segment_;
+    uint32_t block_;
+    std::vector<uint8_t> data_;
+    size_t pos_;
+    kv_entry entry_;
+    bool valid_;
+    sgx_status_t status_;
+};
+
+/* Writes a new segment file from entries added in key order */
+class kv_segment_writer {
+public:
+    kv_segment_writer(void* store, uint64_t id)
+        : store_(store), segment_(new kv_segment()), offset_(0) {
+        segment_->store = store;
+        segment_->id = id;
+        segment_->sequence = 0;
+        segment_->keys = 0;
+        segment_->file_size = 0;
+        segment_->refs = 1;
+        segment_->obsolete = false;
+    }
+
+    ~kv_segment_writer() {
+        delete segment_;
+    }
+
+    sgx_status_t add(const kv_entry& entry) {
+        size_t size = KV_ENTRY_HEADER + entry.key_len + entry.value_len;
+        if (!block_.empty() && block_.size() + size > KV_BLOCK_BYTES) {
+            sgx_status_t status = write_block();
+            if (status != SGX_SUCCESS) return status;
+        }
+        if (block_.empty()) {
+            block_first_key_.assign((const char*)entry.key, entry.key_len);
+        }
+
+        uint8_t header[KV_ENTRY_HEADER];
+        header[0] = entry.deleted ? KV_ENTRY_DELETED : 0;
+        memcpy(header + 1, &entry.key_len, sizeof(uint32_t));
+        memcpy(header + 1 + sizeof(uint32_t), &entry.value_len, sizeof(uint32_t));
+        block_.insert(block_.end(), header, header + KV_ENTRY_HEADER);
+        block_.insert(block_.end(), entry.key, entry.key + entry.key_len);
+        block_.insert(block_.end(), entry.value, entry.value + entry.value_len);
+        hashes_.push_back(kv_hash(entry.key, entry.key_len));
+        segment_->keys++;
+        return SGX_SUCCESS;
+    }
+
+    uint64_t keys() const { return segment_->keys; }
+
+    /**
+     * @brief      Writes the last block, the index block and the trailer.
+     *
+     * @param[in]  sequence  The sequence number of the segment
+     * @param      segment   Receives the segment, owned by the caller
+     *
+     * @return     SGX_SUCCESS if the segment file is complete, error code
+     *             otherwise.
+     */
+    sgx_status_t finish(uint64_t sequence, kv_segment** segment) {
+        sgx_status_t status = SGX_SUCCESS;
+        if (!block_.empty()) status = write_block();
+        if (status != SGX_SUCCESS) return status;
+
+        segment_->sequence = sequence;
+        size_t bloom_bytes = (size_t)((segment_->keys * KV_BLOOM_BITS_PER_KEY + 7) / 8);
+        segment_->bloom.assign(bloom_bytes > 0 ? bloom_bytes : 1, 0);
+        for (size_t i = 0; i < hashes_.size(); i++) {
+            bloom_add(&segment_->bloom, hashes_[i]);
+        }
+        std::vector<uint64_t>().swap(hashes_);
+
+        kv_index_header_t header;
+        header.sequence = sequence;
+        header.keys = segment_->keys;
+        header.blocks = (uint32_t)segment_->blocks.size();
+        header.bloom_bytes = (uint32_t)segment_->bloom.size();
+        block_.assign((const uint8_t*)&header, (const uint8_t*)(&header + 1));
+        block_.insert(block_.end(), segment_->bloom.begin(), segment_->bloom.end());
+        for (size_t i = 0; i < segment_->blocks.size(); i++) {
+            const kv_block_ref& ref = segment_->blocks[i];
+            kv_index_entry_t entry;
+            entry.offset = ref.offset;
+            entry.sealed_len = ref.sealed_len;
+            entry.key_len = (uint32_t)ref.first_key.size();
+            block_.insert(block_.end(), (const uint8_t*)&entry, (const uint8_t*)(&entry + 1));
+            block_.insert(block_.end(), ref.first_key.begin(), ref.first_key.end());
+        }
+
+        kv_trailer_t trailer;
+        trailer.index_offset = offset_;
+        trailer.magic = KV_SEGMENT_MAGIC;
+        if ((status = seal_and_append(KV_INDEX_BLOCK, &trailer.index_len)) != SGX_SUCCESS) return status;
+
+        int ret;
+        status = ocall_result(ocall_kv_append(&ret, store_, segment_->id, (uint8_t*)&trailer, sizeof(trailer)), &ret);
+        if (status != SGX_SUCCESS) return status;
+        status = ocall_result(ocall_kv_finish_segment(&ret, store_, segment_->id), &ret);
+        if (status != SGX_SUCCESS) return status;
+
+        segment_->file_size = offset_ + sizeof(trailer);
+        *segment = segment_;
+        segment_ = NULL;
+        return SGX_SUCCESS;
+    }
+
+    /* Removes whatever was written of an unfinished segment */
+    void abandon() {
+        if (segment_ == NULL) return;
+        int ret;
+        ocall_kv_remove_segment(&ret, store_, segment_->id);
+    }
+
+private:
+    sgx_status_t write_block() {
+        kv_block_ref ref;
+        ref.first_key = block_first_key_;
+        ref.offset = offset_;
+        sgx_status_t status = seal_and_append((uint32_t)segment_->blocks.size(), &ref.sealed_len);
+        if (status == SGX_SUCCESS) segment_->blocks.push_back(ref);
+        return status;
+    }
+
+    /* Seals block_ as block number block and appends it to the file */
+    sgx_status_t seal_and_append(uint32_t block, uint32_t* sealed_len) {
+        kv_block_aad_t aad;
+        aad.magic = KV_SEGMENT_MAGIC;
+        aad.block = block;
+        aad.segment = segment_->id;
+
+        uint32_t needed = sgx_calc_sealed_data_size(sizeof(aad), (uint32_t)block_.size());
+        if (needed == UINT32_MAX) return SGX_ERROR_INVALID_PARAMETER;
+        sealed_.resize(needed);
+        sgx_status_t status = sgx_seal_data(sizeof(aad), (const uint8_t*)&aad, (uint32_t)block_.size(),
+                block_.empty() ? NULL : &block_[0], needed, (sgx_sealed_data_t*)&sealed_[0]);
+        if (!block_.empty()) memset(&block_[0], 0, block_.size());
+        block_.clear();
+        if (status != SGX_SUCCESS) return status;
+
+        int ret;
+        status = ocall_result(ocall_kv_append(&ret, store_, segment_->id, &sealed_[0], needed), &ret);
+        if (status != SGX_SUCCESS) return status;
+        offset_ += needed;
+        *sealed_len = needed;
+        return SGX_SUCCESS;
+    }
+
+    void* store_;
+    kv_segment* segment_;
+    uint64_t offset_;
+    std::vector<uint8_t> block_;
+    std::string block_first_key_;
+    std::vector<uint8_t> sealed_;
+    std::vector<uint64_t> hashes_;
+};
+
+/* Writes the memtable out as the newest segment. Call with kv_lock held. */
+static sgx_status_t flush_memtable() {
+    if (kv_mem.empty()) return SGX_SUCCESS;
+
+    kv_segment_writer writer(kv_store, kv_next_id++);
+    sgx_status_t status = SGX_SUCCESS;
+    for (kv_memtable::const_iterator it = kv_mem.begin(); it != kv_mem.end() && status == SGX_SUCCESS; ++it) {
+        kv_entry entry;
+        entry.key = (const uint8_t*)it->first.data();
+        entry.key_len = (uint32_t)it->first.size();
+        entry.value = (const uint8_t*)it->second.data.data();
+        entry.value_len = (uint32_t)it->second.data.size();
+        entry.deleted = it->second.deleted;
+        status = writer.add(entry);
+    }
+
+    kv_segment* segment = NULL;
+    if (status == SGX_SUCCESS) status = writer.finish(kv_next_sequence, &segment);
+    if (status != SGX_SUCCESS) {
+        /* The memtable is kept, a later flush tries again */
+        writer.abandon();
+        return status;
+    }
+
+    kv_next_sequence++;
+    kv_segments.push_back(segment);
+    kv_mem.clear();
+    kv_mem_bytes = 0;
+    return SGX_SUCCESS;
+}
+
+/* Records a put or delete in the memtable. Call with kv_lock held. */
+static sgx_status_t memtable_set(const uint8_t* key, size_t key_len, const uint8_t* value, size_t value_len,
+        bool deleted) {
+    std::string k((const char*)key, key_len);
+    kv_memtable::iterator it = kv_mem.find(k);
+    if (it == kv_mem.end()) {
+        it = kv_mem.insert(std::make_pair(k, kv_value())).first;
+        kv_mem_bytes += key_len + KV_ENTRY_OVERHEAD;
+    } else {
+        kv_mem_bytes -= it->second.data.size();
+    }
+    it->second.data.assign((const char*)value, value_len);
+    it->second.deleted = deleted;
+    kv_mem_bytes += value_len;
+
+    /* If the flush fails the entry stays in the memtable and the next write tries again */
+    return kv_mem_bytes >= KV_MEMTABLE_BYTES ? flush_memtable() : SGX_SUCCESS;
+}
+
+/* Loads the index block of a segment file into a new kv_segment */
+static sgx_status_t load_segment(uint64_t id, kv_segment** loaded) {
+    int ret;
+    uint64_t file_size = 0;
+    sgx_status_t status = ocall_result(ocall_kv_segment_size(&ret, kv_store, id, &file_size), &ret);
+    if (status != SGX_SUCCESS) return status;
+
+    /* The trailer is not sealed: it only has to point at a genuine index block */
+    kv_trailer_t trailer;
+    if (file_size < sizeof(trailer)) return SGX_ERROR_MAC_MISMATCH;
+    status = ocall_result(ocall_kv_read(&ret, kv_store, id, file_size - sizeof(trailer),
+                (uint8_t*)&trailer, sizeof(trailer)), &ret);
+    if (status != SGX_SUCCESS) return status;
+    if (trailer.magic != KV_SEGMENT_MAGIC || trailer.index_offset > file_size - sizeof(trailer) ||
+            trailer.index_len > file_size - sizeof(trailer) - trailer.index_offset) {
+        return SGX_ERROR_MAC_MISMATCH;
+    }
+
+    std::vector<uint8_t> index;
+    status = read_block(kv_store, id, KV_INDEX_BLOCK, trailer.index_offset, trailer.index_len, &index);
+    if (status != SGX_SUCCESS) return status;
+
+    /* The index block is genuine, the checks below only guard against bugs */
+    kv_index_header_t header;
+    if (index.size() < sizeof(header)) return SGX_ERROR_UNEXPECTED;
+    memcpy(&header, &index[0], sizeof(header));
+    size_t pos = sizeof(header);
+    if (header.bloom_bytes > index.size() - pos) return SGX_ERROR_UNEXPECTED;
+
+    kv_segment* segment = new kv_segment();
+    segment->store = kv_store;
+    segment->id = id;
+    segment->sequence = header.sequence;
+    segment->keys = header.keys;
+    segment->file_size = file_size;
+    segment->refs = 1;
+    segment->obsolete = false;
+    segment->bloom.assign(index.begin() + pos, index.begin() + pos + header.bloom_bytes);
+    pos += header.bloom_bytes;
+
+    for (uint32_t i = 0; i < header.blocks; i++) {
+        kv_index_entry_t entry;
+        if (index.size() - pos < sizeof(entry)) break;
+        memcpy(&entry, &index[pos], sizeof(entry));
+        pos += sizeof(entry);
+        if (entry.key_len > index.size() - pos) break;
+
+        kv_block_ref ref;
+        ref.first_key.assign((const char*)&index[pos], entry.key_len);
+        ref.offset = entry.offset;
+        ref.sealed_len = entry.sealed_len;
+        pos += entry.key_len;
+        segment->blocks.push_back(ref);
+    }
+    if (segment->blocks.size() != header.blocks) {
+        delete segment;
+        return SGX_ERROR_UNEXPECTED;
+    }
+
+    *loaded = segment;
+    return SGX_SUCCESS;
+}
+
+struct segment_older {
+    bool operator()(const kv_segment* a, const kv_segment* b) const {
+        return a->sequence != b->sequence ? a->sequence < b->sequence : a->id < b->id;
+    }
+};
+
+/**
+ * @brief      Opens the store kept in the App's segment files.
+ *
+ * @details    Loads the index block of every segment, which verifies it,
+ *             and keeps their bloom filters and block lists in the enclave.
+ *             Only one store can be open in an enclave at a time.
+ *
+ * @param      store  The App's handle, passed back to every OCALL
+ *
+ * @return     SGX_SUCCESS if opened, error code otherwise.
+ */
+sgx_status_t kv_open(void* store) {
+    kv_locked lock;
+    if (kv_store != NULL || store == NULL) return SGX_ERROR_INVALID_STATE;
+
+    std::vector<uint64_t> ids(KV_MAX_SEGMENTS);
+    uint32_t count = 0;
+    int ret;
+    sgx_status_t status = ocall_result(ocall_kv_list_segments(&ret, store, &ids[0], KV_MAX_SEGMENTS, &count), &ret);
+    if (status != SGX_SUCCESS) return status;
+    if (count > KV_MAX_SEGMENTS) return SGX_ERROR_INVALID_PARAMETER;
+
+    kv_store = store;
+    for (uint32_t i = 0; i < count && status == SGX_SUCCESS; i++) {
+        kv_segment* segment = NULL;
+        status = load_segment(ids[i], &segment);
+        if (status == SGX_SUCCESS) kv_segments.push_back(segment);
+    }
+    if (status != SGX_SUCCESS) {
+        release_segments(kv_segments);
+        kv_segments.clear();
+        kv_store = NULL;
+        return status;
+    }
+
+    std::sort(kv_segments.begin(), kv_segments.end(), segment_older());
+    kv_next_id = 1;
+    kv_next_sequence = 1;
+    for (size_t i = 0; i < kv_segments.size(); i++) {
+        if (kv_segments[i]->id >= kv_next_id) kv_next_id = kv_segments[i]->id + 1;
+        if (kv_segments[i]->sequence >= kv_next_sequence) kv_next_sequence = kv_segments[i]->sequence + 1;
+    }
+    kv_merges = 0;
+    return SGX_SUCCESS;
+}
+
+/**
+ * @brief      Flushes the memtable and closes the store.
+ *
+ * @details    The App must not call kv_merge concurrently.
+ *
+ * @return     SGX_SUCCESS if closed, error code otherwise.
+ */
+sgx_status_t kv_close(void) {
+    kv_locked lock;
+    if (kv_store == NULL || kv_merging) return SGX_ERROR_INVALID_STATE;
+
+    sgx_status_t status = flush_memtable();
+    if (status != SGX_SUCCESS) return status;
+
+    release_segments(kv_segments);
+    kv_segments.clear();
+    kv_store = NULL;
+    return SGX_SUCCESS;
+}
+
+static bool valid_key(const uint8_t* key, size_t key_len) {
+    return key != NULL && key_len > 0 && key_len <= KV_MAX_KEY_SIZE;
+}
+
+sgx_status_t kv_put(uint8_t* key, size_t key_len, uint8_t* value, size_t value_len) {
+    if (!valid_key(key, key_len) || value_len > KV_MAX_VALUE_SIZE || (value == NULL && value_len > 0)) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+    kv_locked lock;
+    if (kv_store == NULL) return SGX_ERROR_INVALID_STATE;
+    return memtable_set(key, key_len, value, value_len, false);
+}
+
+sgx_status_t kv_delete(uint8_t* key, size_t key_len) {
+    if (!valid_key(key, key_len)) return SGX_ERROR_INVALID_PARAMETER;
+    kv_locked lock;
+    if (kv_store == NULL) return SGX_ERROR_INVALID_STATE;
+    return memtable_set(key, key_len, NULL, 0, true);
+}
+
+/* Looks key up in one segment. Returns SGX_SUCCESS with *found set. */
+static sgx_status_t segment_get(void* store, const kv_segment* segment, const uint8_t* key, size_t key_len,
+        uint64_t hash, std::vector<uint8_t>* block, kv_entry* entry, bool* found) {
+    *found = false;
+    if (!bloom_may_contain(segment->bloom, hash)) {
+        __atomic_add_fetch(&kv_bloom_negatives, 1, __ATOMIC_RELAXED);
+        return SGX_SUCCESS;
+    }
+    long i = find_block(segment, key, key_len);
+    if (i < 0) return SGX_SUCCESS;
+
+    const kv_block_ref& ref = segment->blocks[i];
+    sgx_status_t status = read_block(store, segment->id, (uint32_t)i, ref.offset, ref.sealed_len, block);
+    if (status != SGX_SUCCESS) return status;
+
+    size_t pos = 0;
+    while (next_entry(*block, &pos, entry)) {
+        int c = compare_keys(entry->key, entry->key_len, key, key_len);
+        if (c == 0) {
+            *found = true;
+            break;
+        }
+        if (c > 0) break;
+    }
+    return SGX_SUCCESS;
+}
+
+/**
+ * @brief      Reads the value of a key.
+ *
+ * @details    Looks in the memtable, then in the segments from newest to
+ *             oldest, reading one block from each segment whose bloom filter
+ *             matches. Segment blocks are read without holding the store
+ *             lock.
+ *
+ * @param      key        The key
+ * @param[in]  key_len    The key length
+ * @param      value      A buffer to store the value
+ * @param[in]  value_cap  The size of the buffer
+ * @param      value_len  The length of the value, KV_NOT_FOUND if there is
+ *                        none. If it is larger than value_cap nothing is
+ *                        copied: call again with a buffer that large.
+ *
+ * @return     SGX_SUCCESS if the lookup completed, error code otherwise.
+ */
+sgx_status_t kv_get(uint8_t* key, size_t key_len, uint8_t* value, size_t value_cap, uint32_t* value_len) {
+    if (!valid_key(key, key_len) || value_len == NULL || (value == NULL && value_cap > 0)) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+    *value_len = KV_NOT_FOUND;
+
+    void* store;
+    std::vector<kv_segment*> segments;
+    {
+        kv_locked lock;
+        if (kv_store == NULL) return SGX_ERROR_INVALID_STATE;
+        kv_memtable::const_iterator it = kv_mem.find(std::string((const char*)key, key_len));
+        if (it != kv_mem.end()) {
+            if (!it->second.deleted) {
+                *value_len = (uint32_t)it->second.data.size();
+                if (*value_len <= value_cap) memcpy(value, it->second.data.data(), *value_len);
+            }
+            return SGX_SUCCESS;
+        }
+        store = kv_store;
+        segments = snapshot_segments();
+    }
+
+    uint64_t hash = kv_hash(key, key_len);
+    std::vector<uint8_t> block;
+    sgx_status_t status = SGX_SUCCESS;
+    for (size_t i = segments.size(); i-- > 0;) {
+        kv_entry entry;
+        bool found;
+        status = segment_get(store, segments[i], key, key_len, hash, &block, &entry, &found);
+        if (status != SGX_SUCCESS) break;
+        if (!found) continue;
+
+        if (!entry.deleted) {
+            *value_len = entry.value_len;
+            if (entry.value_len <= value_cap) memcpy(value, entry.value, entry.value_len);
+        }
+        break;
+    }
+
+    release_segments(segments);
+    return status;
+}
+
+/* An entry copied out of a block or the memtable by kv_scan */
+struct kv_scan_entry {
+    std::string value;
+    bool deleted;
+};
+
+typedef std::map<std::string, kv_scan_entry, key_less> kv_scan_map;
+
+static bool before_end(const std::string& key, const uint8_t* end, size_t end_len) {
+    return end_len == 0 || compare_keys((const uint8_t*)key.data(), key.size(), end, end_len) < 0;
+}
+
+/**
+ * @brief      Returns the live entries with start <= key < end, in key order.
+ *
+ * @details    One call takes at most KV_SCAN_BATCH entries from the memtable
+ *             and from each segment, merges them with newer versions
+ *             winning, and returns the part of the key range that all those
+ *             sources fully cover. Scanning continues from *next; next_len
+ *             is 0 once the range is done.
+ *
+ * @param      start      The first key of the range
+ * @param[in]  start_len  Its length, 0 to start at the first key
+ * @param      end        The first key after the range
+ * @param[in]  end_len    Its length, 0 for no upper bound
+ * @param      out        Receives the entries, see KV_SCAN_ENTRY_HEADER
+ * @param[in]  out_cap    The size of out, at least KV_SCAN_ENTRY_HEADER +
+ *                        KV_MAX_KEY_SIZE + KV_MAX_VALUE_SIZE
+ * @param      out_len    The bytes written to out
+ * @param      next       Receives the start key of the next call
+ * @param[in]  next_cap   The size of next, at least KV_MAX_KEY_SIZE + 1
+ * @param      next_len   The length of next, 0 if the scan is complete
+ *
+ * @return     SGX_SUCCESS if the scan step completed, error code otherwise.
+ */
+sgx_status_t kv_scan(uint8_t* start, size_t start_len, uint8_t* end, size_t end_len,
+        uint8_t* out, size_t out_cap, uint32_t* out_len, uint8_t* next, size_t next_cap, uint32_t* next_len) {
+    if (start_len > KV_MAX_KEY_SIZE + 1 || end_len > KV_MAX_KEY_SIZE + 1 || out == NULL || next == NULL ||
+            out_cap < KV_SCAN_ENTRY_HEADER + KV_MAX_KEY_SIZE + KV_MAX_VALUE_SIZE || out_cap > UINT32_MAX ||
+            next_cap < KV_MAX_KEY_SIZE + 1 || out_len == NULL || next_len == NULL) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+    *out_len = 0;
+    *next_len = 0;
+
+    /* The key up to which every source that was cut short is covered */
+    bool bounded = false;
+    std::string bound;
+    /* Sources from oldest to newest, so that newer versions overwrite older ones */
+    std::vector<kv_scan_map> sources;
+
+    void* store;
+    std::vector<kv_segment*> segments;
+    kv_scan_map memtable;
+    {
+        kv_locked lock;
+        if (kv_store == NULL) return SGX_ERROR_INVALID_STATE;
+        kv_memtable::const_iterator it = kv_mem.lower_bound(std::string((const char*)start, start_len));
+        for (uint32_t n = 0; it != kv_mem.end() && before_end(it->first, end, end_len); ++it) {
+            if (n++ == KV_SCAN_BATCH) {
+                bounded = true;
+                bound = memtable.rbegin()->first;
+                break;
+            }
+            kv_scan_entry& entry = memtable[it->first];
+            entry.value = it->second.data;
+            entry.deleted = it->second.deleted;
+        }
+        store = kv_store;
+        segments = snapshot_segments();
+    }
+
+    sgx_status_t status = SGX_SUCCESS;
+    for (size_t i = 0; i < segments.size() && status == SGX_SUCCESS; i++) {
+        sources.push_back(kv_scan_map());
+        kv_scan_map& source = sources.back();
+
+        kv_cursor cursor(store, segments[i]);
+        if (start_len > 0) {
+            cursor.seek(start, start_len);
+        } else {
+            cursor.seek_first();
+        }
+        for (uint32_t n = 0; cursor.valid(); cursor.next()) {
+            std::string key((const char*)cursor.entry().key, cursor.entry().key_len);
+            if (!before_end(key, end, end_len)) break;
+            if (n++ == KV_SCAN_BATCH) {
+                const std::string& last = source.rbegin()->first;
+                if (!bounded || key_less()(last, bound)) bound = last;
+                bounded = true;
+                break;
+            }
+            kv_scan_entry& entry = source[key];
+            entry.value.assign((const char*)cursor.entry().value, cursor.entry().value_len);
+            entry.deleted = cursor.entry().deleted;
+        }
+        status = cursor.status();
+    }
+    release_segments(segments);
+    if (status != SGX_SUCCESS) return status;
+    sources.push_back(memtable);
+
+    kv_scan_map merged;
+    for (size_t i = 0; i < sources.size(); i++) {
+        for (kv_scan_map::const_iterator it = sources[i].begin(); it != sources[i].end(); ++it) {
+            if (bounded && key_less()(bound, it->first)) break;
+            merged[it->first] = it->second;
+        }
+    }
+
+    size_t written = 0;
+    for (kv_scan_map::const_iterator it = merged.begin(); it != merged.end(); ++it) {
+        if (it->second.deleted) continue;
+        uint32_t key_len = (uint32_t)it->first.size();
+        uint32_t value_len = (uint32_t)it->second.value.size();
+        if (out_cap - written < KV_SCAN_ENTRY_HEADER + key_len + value_len) {
+            /* Out of room: resume at this key */
+            memcpy(next, it->first.data(), key_len);
+            *next_len = key_len;
+            *out_len = (uint32_t)written;
+            return SGX_SUCCESS;
+        }
+        memcpy(out + written, &key_len, sizeof(uint32_t));
+        memcpy(out + written + sizeof(uint32_t), &value_len, sizeof(uint32_t));
+        memcpy(out + written + KV_SCAN_ENTRY_HEADER, it->first.data(), key_len);
+        memcpy(out + written + KV_SCAN_ENTRY_HEADER + key_len, it->second.value.data(), value_len);
+        written += KV_SCAN_ENTRY_HEADER + key_len + value_len;
+    }
+    *out_len = (uint32_t)written;
+
+    if (bounded) {
+        /* The smallest key after bound */
+        memcpy(next, bound.data(), bound.size());
+        next[bound.size()] = 0;
+        *next_len = (uint32_t)bound.size() + 1;
+    }
+    return SGX_SUCCESS;
+}
+
+/* Writes the memtable out as a segment now */
+sgx_status_t kv_flush(void) {
+    kv_locked lock;
+    if (kv_store == NULL) return SGX_ERROR_INVALID_STATE;
+    return flush_memtable();
+}
+
+/**
+ * @brief      Merges all current segments into one.
+ *
+ * @details    Meant to be called from a background thread. The store lock is
+ *             only held to pick the segments and to swap in the result: puts,
+ *             gets, scans and flushes go on during the merge. The merged
+ *             segment keeps the newest version of every key and drops
+ *             deletions, since it replaces the oldest data in the store. It
+ *             takes the sequence number of the newest segment merged, so
+ *             segments flushed meanwhile stay newer. A merge already running,
+ *             or fewer than two segments, make this a no-op.
+ *
+ * @return     SGX_SUCCESS if merged or nothing to do, error code otherwise.
+ */
+sgx_status_t kv_merge(void) {
+    void* store;
+    std::vector<kv_segment*> inputs;
+    uint64_t id;
+    {
+        kv_locked lock;
+        if (kv_store == NULL) return SGX_ERROR_INVALID_STATE;
+        if (kv_merging || kv_segments.size() < 2) return SGX_SUCCESS;
+        kv_merging = true;
+        store = kv_store;
+        inputs = snapshot_segments();
+        id = kv_next_id++;
+    }
+
+    std::vector<kv_cursor*> cursors;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        cursors.push_back(new kv_cursor(store, inputs[i]));
+        cursors.back()->seek_first();
+    }
+
+    kv_segment_writer writer(store, id);
+    sgx_status_t status = SGX_SUCCESS;
+    for (;;) {
+        /* The smallest key; on ties the newest input, which comes last */
+        long newest = -1;
+        for (size_t i = 0; i < cursors.size(); i++) {
+            if (cursors[i]->status() != SGX_SUCCESS) status = cursors[i]->status();
+            if (!cursors[i]->valid()) continue;
+            if (newest < 0 || compare_keys(cursors[i]->entry().key, cursors[i]->entry().key_len,
+                        cursors[newest]->entry().key, cursors[newest]->entry().key_len) <= 0) {
+                newest = (long)i;
+            }
+        }
+        if (status != SGX_SUCCESS || newest < 0) break;
+
+        kv_entry entry = cursors[newest]->entry();
+        if (!entry.deleted) status = writer.add(entry);
+        if (status != SGX_SUCCESS) break;
+
+        /* Step past this key in every input; the newest goes last, entry points into its block */
+        for (size_t i = 0; i < cursors.size(); i++) {
+            if ((long)i == newest) continue;
+            while (cursors[i]->valid() && compare_keys(cursors[i]->entry().key, cursors[i]->entry().key_len,
+                        entry.key, entry.key_len) == 0) {
+                cursors[i]->next();
+            }
+        }
+        cursors[newest]->next();
+    }
+    for (size_t i = 0; i < cursors.size(); i++) {
+        delete cursors[i];
+    }
+
+    kv_segment* merged = NULL;
+    if (status == SGX_SUCCESS && writer.keys() > 0) {
+        status = writer.finish(inputs.back()->sequence, &merged);
+    }
+    if (status != SGX_SUCCESS) writer.abandon();
+
+    {
+        kv_locked lock;
+        if (status == SGX_SUCCESS) {
+            /* The inputs are still the oldest segments, anything flushed since came after them */
+            kv_segments.erase(kv_segments.begin(), kv_segments.begin() + inputs.size());
+            if (merged != NULL) kv_segments.insert(kv_segments.begin(), merged);
+            for (size_t i = 0; i < inputs.size(); i++) {
+                inputs[i]->obsolete = true;
+                segment_release(inputs[i]);
+            }
+            kv_merges++;
+        }
+        kv_merging = false;
+    }
+
+    release_segments(inputs);
+    return status;
+}
+
+sgx_status_t kv_get_stats(kv_stats_t* stats) {
+    if (stats == NULL) return SGX_ERROR_INVALID_PARAMETER;
+    memset(stats, 0, sizeof(kv_stats_t));
+
+    kv_locked lock;
+    if (kv_store == NULL) return SGX_ERROR_INVALID_STATE;
+    stats->memtable_keys = kv_mem.size();
+    stats->memtable_bytes = kv_mem_bytes;
+    stats->segments = (uint32_t)kv_segments.size();
+    stats->merges = kv_merges;
+    for (size_t i = 0; i < kv_segments.size(); i++) {
+        const kv_segment* segment = kv_segments[i];
+        stats->segment_keys += segment->keys;
+        stats->segment_bytes += segment->file_size;
+        stats->bloom_bytes += segment->bloom.size();
+        for (size_t j = 0; j < segment->blocks.size(); j++) {
+            stats->index_bytes += sizeof(kv_block_ref) + segment->blocks[j].first_key.size();
+        }
+    }
+    stats->blocks_read = __atomic_load_n(&kv_blocks_read, __ATOMIC_RELAXED);
+    stats->bloom_negatives = __atomic_load_n(&kv_bloom_negatives, __ATOMIC_RELAXED);
+    return SGX_SUCCESS;
+}
@@ -1,7 +1,11 @@
 #include "sgx_trts.h"
 #include "sgx_tseal.h"
+#include "stdlib.h"
 #include "string.h"
 #include "Enclave_t.h"
+#include "sealing_codec.h"
+#include "sealed_record.h"
+#include "Compress.h"
 
 /**
  * @brief      Seals the plaintext given into the sgx_sealed_data_t structure
@@ -46,3 +50,197 @@ sgx_status_t unseal(sgx_sealed_data_t* sealed_data, size_t sealed_size, uint8_t*
     sgx_status_t status = sgx_unseal_data(sealed_data, NULL, NULL, (uint8_t*)plaintext, &plaintext_len);
     return status;
 }
+
+/**
+ * @brief      Compresses the plaintext given and seals the result into the
+ *             sgx_sealed_data_t structure given.
+ *
+ * @details    The plaintext is compressed inside the enclave, since it cannot
+ *             be compressed once sealed. If compression does not make it
+ *             smaller, it is sealed as is. A sealing_codec_header_t recording
+ *             the codec and the original length is sealed as the additional
+ *             MAC text. sealed_size must be at least
+ *             SEALING_COMPRESSED_MAX_SIZE(plaintext_len); the size actually
+ *             used is returned in sealed_len.
+ *
+ * @param      plaintext      The data to be sealed
+ * @param[in]  plaintext_len  The plaintext length
+ * @param      sealed_data    The pointer to the sealed data structure
+ * @param[in]  sealed_size    The size of the sealed data structure supplied
+ * @param      sealed_len     The size of the sealed blob written
+ *
+ * @return     SGX_SUCCESS if seal successful, error code otherwise.
+ */
+sgx_status_t seal_compressed(uint8_t* plaintext, size_t plaintext_len,
+        sgx_sealed_data_t* sealed_data, size_t sealed_size, uint32_t* sealed_len) {
+    if (plaintext_len > UINT32_MAX - SEALING_LZ_BOUND(0) || sealed_len == NULL) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+
+    sealing_codec_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SEALING_CODEC_MAGIC;
+    header.codec = SEALING_CODEC_NONE;
+    header.plaintext_len = (uint32_t)plaintext_len;
+
+    const uint8_t* payload = plaintext;
+    uint32_t payload_len = (uint32_t)plaintext_len;
+
+    /* Fall back to storing the plaintext if there is no memory to compress */
+    uint32_t bound = (uint32_t)SEALING_LZ_BOUND(plaintext_len);
+    uint8_t* compressed = (uint8_t*)malloc(bound);
+    if (compressed != NULL) {
+        uint32_t compressed_len = lz_compress(plaintext, (uint32_t)plaintext_len, compressed, bound);
+        if (compressed_len > 0 && compressed_len < plaintext_len) {
+            header.codec = SEALING_CODEC_LZ;
+            payload = compressed;
+            payload_len = compressed_len;
+        }
+    }
+
+    sgx_status_t status;
+    uint32_t needed = sgx_calc_sealed_data_size(sizeof(header), payload_len);
+    if (needed == UINT32_MAX || needed > sealed_size) {
+        status = SGX_ERROR_INVALID_PARAMETER;
+    } else {
+        status = sgx_seal_data(sizeof(header), (const uint8_t*)&header,
+                payload_len, payload, needed, sealed_data);
+        *sealed_len = needed;
+    }
+
+    free(compressed);
+    return status;
+}
+
+/**
+ * @brief      Unseals a blob produced by seal_compressed and decompresses it.
+ *
+ * @details    The codec header is only trusted after sgx_unseal_data has
+ *             verified it. plaintext_max_len can be taken from the header
+ *             with sealing_codec_read_header on the App side.
+ *
+ * @param      sealed_data        The sealed data
+ * @param[in]  sealed_size        The size of the sealed data
+ * @param      plaintext          A pointer to buffer to store the plaintext
+ * @param[in]  plaintext_max_len  The size of buffer prepared to store the
+ *                                plaintext
+ * @param      plaintext_len      The length of the plaintext written
+ *
+ * @return     SGX_SUCCESS if unseal successful, error code otherwise.
+ */
+sgx_status_t unseal_compressed(sgx_sealed_data_t* sealed_data, size_t sealed_size,
+        uint8_t* plaintext, uint32_t plaintext_max_len, uint32_t* plaintext_len) {
+    if (sealed_size < sizeof(sgx_sealed_data_t) || plaintext_len == NULL) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+
+    /* The sizes come from the untrusted blob: make sure they stay inside it */
+    uint32_t header_len = sgx_get_add_mac_txt_len(sealed_data);
+    uint32_t payload_len = sgx_get_encrypt_txt_len(sealed_data);
+    uint32_t needed = sgx_calc_sealed_data_size(header_len, payload_len);
+    if (header_len != sizeof(sealing_codec_header_t) || needed == UINT32_MAX || needed > sealed_size) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+
+    uint8_t* payload = (uint8_t*)malloc(payload_len > 0 ? payload_len : 1);
+    if (payload == NULL) return SGX_ERROR_OUT_OF_MEMORY;
+
+    sealing_codec_header_t header;
+    sgx_status_t status = sgx_unseal_data(sealed_data, (uint8_t*)&header, &header_len,
+            payload, &payload_len);
+    if (status == SGX_SUCCESS) {
+        if (header.magic != SEALING_CODEC_MAGIC || header.plaintext_len > plaintext_max_len) {
+            status = SGX_ERROR_INVALID_PARAMETER;
+        } else if (header.codec == SEALING_CODEC_NONE && payload_len == header.plaintext_len) {
+            memcpy(plaintext, payload, payload_len);
+        } else if (header.codec != SEALING_CODEC_LZ ||
+                lz_decompress(payload, payload_len, plaintext, header.plaintext_len) != header.plaintext_len) {
+            status = SGX_ERROR_UNEXPECTED;
+        }
+    }
+    if (status == SGX_SUCCESS) *plaintext_len = header.plaintext_len;
+
+    memset(payload, 0, payload_len);
+    free(payload);
+    return status;
+}
+
+/**
+ * @brief      Seals the plaintext given with its public record key as the
+ *             additional MAC text.
+ *
+ * @details    The key (record ID, timestamp, type) stays readable in the blob
+ *             so the App can index it with sealed_record_read_key, but it is
+ *             covered by the MAC. The magic is set here, callers only fill in
+ *             the other fields. sealed_size must be at least
+ *             SEALED_RECORD_SIZE(plaintext_len).
+ *
+ * @param      key            The public record key
+ * @param      plaintext      The data to be sealed
+ * @param[in]  plaintext_len  The plaintext length
+ * @param      sealed_data    The pointer to the sealed data structure
+ * @param[in]  sealed_size    The size of the sealed data structure supplied
+ *
+ * @return     SGX_SUCCESS if seal successful, error code otherwise.
+ */
+sgx_status_t seal_record(sealed_record_key_t* key, uint8_t* plaintext, size_t plaintext_len,
+        sgx_sealed_data_t* sealed_data, size_t sealed_size) {
+    if (key == NULL || plaintext_len > UINT32_MAX) return SGX_ERROR_INVALID_PARAMETER;
+
+    sealed_record_key_t aad = *key;
+    aad.magic = SEALED_RECORD_MAGIC;
+
+    uint32_t needed = sgx_calc_sealed_data_size(sizeof(aad), (uint32_t)plaintext_len);
+    if (needed == UINT32_MAX || needed > sealed_size) return SGX_ERROR_INVALID_PARAMETER;
+
+    return sgx_seal_data(sizeof(aad), (const uint8_t*)&aad, (uint32_t)plaintext_len, plaintext,
+            needed, sealed_data);
+}
+
+/**
+ * @brief      Unseals a blob produced by seal_record, checking that it is the
+ *             record the caller asked for.
+ *
+ * @details    The App picks blobs through an untrusted index, so the key
+ *             found in a genuine blob is compared with expected_key after
+ *             sgx_unseal_data: a valid blob of another record is rejected like
+ *             a tampered one.
+ *
+ * @param      sealed_data        The sealed data
+ * @param[in]  sealed_size        The size of the sealed data
+ * @param      expected_key       The key of the record wanted
+ * @param      plaintext          A pointer to buffer to store the plaintext
+ * @param[in]  plaintext_max_len  The size of buffer prepared to store the
+ *                                plaintext
+ * @param      plaintext_len      The length of the plaintext written
+ *
+ * @return     SGX_SUCCESS if unseal successful, SGX_ERROR_MAC_MISMATCH if the
+ *             blob holds another record, error code otherwise.
+ */
+sgx_status_t unseal_record(sgx_sealed_data_t* sealed_data, size_t sealed_size, sealed_record_key_t* expected_key,
+        uint8_t* plaintext, uint32_t plaintext_max_len, uint32_t* plaintext_len) {
+    if (sealed_size < sizeof(sgx_sealed_data_t) || expected_key == NULL || plaintext_len == NULL) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+
+    /* The sizes come from the untrusted blob: make sure they stay inside it */
+    uint32_t key_len = sgx_get_add_mac_txt_len(sealed_data);
+    uint32_t payload_len = sgx_get_encrypt_txt_len(sealed_data);
+    uint32_t needed = sgx_calc_sealed_data_size(key_len, payload_len);
+    if (key_len != sizeof(sealed_record_key_t) || needed == UINT32_MAX || needed > sealed_size ||
+            payload_len > plaintext_max_len) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+
+    sealed_record_key_t key;
+    sgx_status_t status = sgx_unseal_data(sealed_data, (uint8_t*)&key, &key_len, plaintext, &payload_len);
+    if (status != SGX_SUCCESS) return status;
+
+    if (key.magic != SEALED_RECORD_MAGIC || key.type != expected_key->type ||
+            key.record_id != expected_key->record_id || key.timestamp != expected_key->timestamp) {
+        memset(plaintext, 0, payload_len);
+        return SGX_ERROR_MAC_MISMATCH;
+    }
+    *plaintext_len = payload_len;
+    return SGX_SUCCESS;
+}
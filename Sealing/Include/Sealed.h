@@ -0,0 +1,107 @@
+#ifndef SEALED_H_
+#define SEALED_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "sgx_tseal.h"
+
+/**
+ * @brief      Fixed-size sealed container for a plain-old-data type T.
+ *
+ * @details    The sealed blob for a T is always sizeof(sgx_sealed_data_t) +
+ *             sizeof(T) bytes (no additional MAC text, AES-GCM preserves the
+ *             plaintext length), so the whole blob is held inline and a
+ *             Sealed<T> can live on the stack or inside another struct with
+ *             no heap allocation.
+ *
+ *             The header is shared by the App and the Enclave. On the App
+ *             side only data()/size are used, to hand the buffer to the
+ *             seal/unseal ECALLs. seal()/unseal() call the trusted sealing
+ *             library and are only instantiated when used, so they are safe
+ *             to leave in the App build as long as the App never calls them.
+ *
+ *             The Enclave is built with -std=c++03, so the sizes are exposed
+ *             as static const integral members rather than constexpr; both
+ *             are usable in constant expressions.
+ *
+ * @tparam     T     A trivially copyable type. Pointers are rejected since
+ *                   sealing the pointer value is never what the caller wants.
+ */
+template <typename T>
+class Sealed {
+public:
+    static const size_t plaintext_size = sizeof(T);
+    static const size_t size = sizeof(sgx_sealed_data_t) + sizeof(T);
+
+    Sealed() {
+        memset(m_storage.bytes, 0, size);
+    }
+
+    sgx_sealed_data_t* data() {
+        return reinterpret_cast<sgx_sealed_data_t*>(m_storage.bytes);
+    }
+
+    const sgx_sealed_data_t* data() const {
+        return reinterpret_cast<const sgx_sealed_data_t*>(m_storage.bytes);
+    }
+
+    uint8_t* bytes() {
+        return m_storage.bytes;
+    }
+
+    const uint8_t* bytes() const {
+        return m_storage.bytes;
+    }
+
+    /**
+     * @brief      Seals value into this container. Enclave side only.
+     *
+     * @param[in]  value  The value to be sealed
+     *
+     * @return     SGX_SUCCESS on success, the sgx_seal_data error otherwise.
+     */
+    sgx_status_t seal(const T& value) {
+        return sgx_seal_data(0, NULL,
+                (uint32_t)plaintext_size, reinterpret_cast<const uint8_t*>(&value),
+                (uint32_t)size, data());
+    }
+
+    /**
+     * @brief      Unseals this container into value. Enclave side only.
+     *
+     * @details    The decrypted length is checked against sizeof(T), so a blob
+     *             sealed from a different type is rejected instead of being
+     *             partially copied.
+     *
+     * @param      value  Where to store the unsealed value
+     *
+     * @return     SGX_SUCCESS on success, SGX_ERROR_INVALID_PARAMETER if the
+     *             blob does not hold a T, the sgx_unseal_data error otherwise.
+     */
+    sgx_status_t unseal(T* value) const {
+        if (value == NULL || sgx_get_encrypt_txt_len(data()) != plaintext_size) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+        uint32_t value_len = (uint32_t)plaintext_size;
+        return sgx_unseal_data(data(), NULL, NULL,
+                reinterpret_cast<uint8_t*>(value), &value_len);
+    }
+
+private:
+    /* Seal the pointee, not the pointer */
+    template <typename U> struct reject_pointer { typedef U type; };
+    template <typename U> struct reject_pointer<U*>;
+    typedef typename reject_pointer<T>::type checked_type;
+
+    /* uint64_t member keeps the inline blob aligned like sgx_sealed_data_t */
+    union {
+        uint64_t align;
+        uint8_t bytes[size];
+    } m_storage;
+};
+
+template <typename T> const size_t Sealed<T>::plaintext_size;
+template <typename T> const size_t Sealed<T>::size;
+
+#endif // SEALED_H_
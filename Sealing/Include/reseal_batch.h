@@ -0,0 +1,12 @@
+#ifndef RESEAL_BATCH_H_
+#define RESEAL_BATCH_H_
+
+/* Blobs in a reseal_batch buffer start at multiples of this, so the enclave
+ * reads every sgx_sealed_data_t at its natural alignment */
+#define RESEAL_BATCH_ALIGN 8
+
+/* Bytes taken in the batch buffer by a blob of len bytes */
+#define RESEAL_BATCH_STRIDE(len) \
+    (((len) + RESEAL_BATCH_ALIGN - 1) & ~((size_t)RESEAL_BATCH_ALIGN - 1))
+
+#endif // RESEAL_BATCH_H_
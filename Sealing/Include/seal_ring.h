@@ -0,0 +1,129 @@
+#ifndef SEAL_RING_H_
+#define SEAL_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "sgx_error.h"
+
+/**
+ * @brief      Bounded lock-free multi-producer/multi-consumer ring.
+ *
+ * @details    Each slot carries a sequence number that tells producers and
+ *             consumers whose turn it is, so push/pop only need one CAS on
+ *             the head or tail index. The ring lives in untrusted memory and
+ *             is shared by the App and the Enclave, which is why it is plain
+ *             data using the GCC __atomic builtins: the Enclave is built with
+ *             -std=c++03 and has no <atomic>.
+ *
+ *             The Enclave must treat every value it pops as untrusted; the
+ *             ring only guarantees that indices stay inside the slot array.
+ *
+ * @tparam     T         A plain-old-data value type
+ * @tparam     Capacity  Number of slots, a power of two
+ */
+template <typename T, uint32_t Capacity>
+struct SealRing {
+    struct Slot {
+        uint64_t sequence;
+        T value;
+    };
+
+    /* Producers and consumers each get their own cache line */
+    uint64_t head __attribute__((aligned(64)));
+    uint64_t tail __attribute__((aligned(64)));
+    Slot slots[Capacity] __attribute__((aligned(64)));
+
+    void init() {
+        typedef char capacity_is_power_of_two[(Capacity & (Capacity - 1)) == 0 ? 1 : -1];
+        (void)sizeof(capacity_is_power_of_two);
+
+        for (uint64_t i = 0; i < Capacity; i++) {
+            __atomic_store_n(&slots[i].sequence, i, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&head, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&tail, 0, __ATOMIC_RELEASE);
+    }
+
+    /* Returns false if the ring is full */
+    bool push(const T& value) {
+        uint64_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        for (;;) {
+            Slot* slot = &slots[pos & (Capacity - 1)];
+            uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+            int64_t diff = (int64_t)(seq - pos);
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true,
+                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    memcpy(&slot->value, &value, sizeof(T));
+                    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    /* Returns false if the ring is empty */
+    bool pop(T* value) {
+        uint64_t pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        for (;;) {
+            Slot* slot = &slots[pos & (Capacity - 1)];
+            uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+            int64_t diff = (int64_t)(seq - (pos + 1));
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&tail, &pos, pos + 1, true,
+                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    memcpy(value, &slot->value, sizeof(T));
+                    __atomic_store_n(&slot->sequence, pos + Capacity, __ATOMIC_RELEASE);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    bool empty() {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) == __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    }
+};
+
+#define SEAL_QUEUE_CAPACITY 1024
+
+/* A seal request: the Enclave reads plaintext and writes the blob to sealed */
+typedef struct seal_job {
+    uint64_t id;
+    const uint8_t* plaintext;
+    uint32_t plaintext_len;
+    uint8_t* sealed;
+    uint32_t sealed_size;
+} seal_job_t;
+
+typedef struct seal_completion {
+    uint64_t id;
+    sgx_status_t status;
+    uint32_t sealed_len;
+} seal_completion_t;
+
+/**
+ * @brief      The memory shared by SealQueue and the Enclave worker threads.
+ *
+ * @details    Allocated by the App and handed to seal_worker_run as a
+ *             [user_check] pointer. stop is set by the App to drain and end
+ *             the workers; idle_workers counts workers parked in
+ *             ocall_seal_worker_wait.
+ */
+typedef struct seal_queue_shared {
+    SealRing<seal_job_t, SEAL_QUEUE_CAPACITY> requests;
+    SealRing<seal_completion_t, SEAL_QUEUE_CAPACITY> completions;
+    uint32_t stop __attribute__((aligned(64)));
+    uint32_t idle_workers;
+} seal_queue_shared_t;
+
+#endif // SEAL_RING_H_
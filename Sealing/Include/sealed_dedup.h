@@ -0,0 +1,45 @@
+#ifndef SEALED_DEDUP_H_
+#define SEALED_DEDUP_H_
+
+#include <stdint.h>
+
+/* Content-defined chunk sizes of the deduplicating store, see Enclave/Sealing/DedupStore.cpp */
+#define DEDUP_MIN_CHUNK     (2 * 1024)
+#define DEDUP_AVG_CHUNK     (8 * 1024)
+#define DEDUP_MAX_CHUNK     (64 * 1024)
+
+/* The App names manifest files after the hex of the blob name */
+#define DEDUP_MAX_NAME_SIZE 120
+#define DEDUP_MAX_BLOB_SIZE (256ULL * 1024 * 1024)
+
+/* dedup_get sets *blob_len to this when there is no blob by that name */
+#define DEDUP_NOT_FOUND     0xFFFFFFFFFFFFFFFFULL
+
+/*
+ * Chunks are named by a keyed hash (AES-CMAC) of their plaintext. The key
+ * never leaves the enclave, so the App sees which chunks are equal but
+ * cannot test a guess of their content against an ID.
+ */
+#define DEDUP_CHUNK_ID_SIZE 16
+
+typedef struct dedup_chunk_id {
+    uint8_t id[DEDUP_CHUNK_ID_SIZE];
+} dedup_chunk_id_t;
+
+typedef struct dedup_stats {
+    uint64_t blobs;
+    uint64_t logical_bytes;     /* plaintext size of all blobs */
+    uint64_t chunks;            /* unique chunks stored */
+    uint64_t chunk_refs;        /* chunks referenced by all manifests, duplicates included */
+    uint64_t chunk_bytes;       /* plaintext size of the unique chunks */
+    uint64_t stored_bytes;      /* sealed chunks plus sealed manifests, i.e. the disk footprint */
+    uint64_t put_bytes;         /* plaintext handed to dedup_put since dedup_open */
+    uint64_t written_bytes;     /* sealed bytes written since dedup_open */
+} dedup_stats_t;
+
+/* Plaintext bytes kept per byte stored, including the sealing overhead */
+static inline double dedup_ratio(const dedup_stats_t* stats) {
+    return stats->stored_bytes > 0 ? (double)stats->logical_bytes / stats->stored_bytes : 1.0;
+}
+
+#endif // SEALED_DEDUP_H_
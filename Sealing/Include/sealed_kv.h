@@ -0,0 +1,39 @@
+#ifndef SEALED_KV_H_
+#define SEALED_KV_H_
+
+#include <stdint.h>
+
+/* Limits of the sealed key-value store, see Enclave/Sealing/SealedKV.cpp */
+#define KV_MAX_KEY_SIZE     1024
+#define KV_MAX_VALUE_SIZE   (64 * 1024)
+
+/* Writes are buffered in the enclave until the memtable holds this many bytes */
+#define KV_MEMTABLE_BYTES   (4 * 1024 * 1024)
+
+/* Target plaintext size of one sealed block in a segment file */
+#define KV_BLOCK_BYTES      (16 * 1024)
+
+/* kv_get sets *value_len to this when the key is absent or deleted */
+#define KV_NOT_FOUND        0xFFFFFFFF
+
+/*
+ * kv_scan output: entries one after the other, each
+ *   uint32_t key_len, uint32_t value_len, key, value
+ * with native byte order, and no alignment between entries.
+ */
+#define KV_SCAN_ENTRY_HEADER (2 * sizeof(uint32_t))
+
+typedef struct kv_stats {
+    uint64_t memtable_keys;
+    uint64_t memtable_bytes;
+    uint32_t segments;
+    uint32_t merges;
+    uint64_t segment_keys;          /* entries in segments, shadowed ones included */
+    uint64_t segment_bytes;         /* size of the segment files */
+    uint64_t bloom_bytes;           /* enclave memory held by bloom filters */
+    uint64_t index_bytes;           /* enclave memory held by sparse indexes */
+    uint64_t blocks_read;           /* blocks unsealed by kv_get and kv_scan */
+    uint64_t bloom_negatives;       /* segments skipped by kv_get thanks to the bloom filter */
+} kv_stats_t;
+
+#endif // SEALED_KV_H_
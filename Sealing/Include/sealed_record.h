@@ -0,0 +1,60 @@
+#ifndef SEALED_RECORD_H_
+#define SEALED_RECORD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "sgx_tseal.h"
+
+#define SEALED_RECORD_MAGIC 0x43455253  /* "SREC" */
+
+/**
+ * @brief      Public key of a sealed record, stored as the additional MAC
+ *             text of a seal_record blob.
+ *
+ * @details    The key is authenticated but not encrypted: the App can read it
+ *             from a blob to index, look up and range-scan records without an
+ *             ECALL, and any change to it makes sgx_unseal_data fail. Nothing
+ *             put in here is secret.
+ */
+typedef struct sealed_record_key {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t record_id;
+    uint64_t timestamp;
+} sealed_record_key_t;
+
+/* Sealed buffer size that is exactly enough for seal_record of n bytes */
+#define SEALED_RECORD_SIZE(n) \
+    (sizeof(sgx_sealed_data_t) + sizeof(sealed_record_key_t) + (n))
+
+/**
+ * @brief      Reads the record key of a sealed blob from untrusted code.
+ *
+ * @details    Same layout as sealing_codec_read_header: the additional MAC
+ *             text follows the encrypted text in aes_data.payload. The key is
+ *             only checked for shape here; its integrity is verified by
+ *             sgx_unseal_data in the Enclave.
+ *
+ * @param      sealed_data  The sealed blob
+ * @param[in]  sealed_size  Size of the buffer holding the blob
+ * @param      key          Receives the key
+ *
+ * @return     1 if the blob carries a record key, 0 otherwise.
+ */
+static inline int sealed_record_read_key(const sgx_sealed_data_t* sealed_data,
+        size_t sealed_size, sealed_record_key_t* key) {
+    if (sealed_size < sizeof(sgx_sealed_data_t)) return 0;
+
+    uint32_t payload_size = sealed_data->aes_data.payload_size;
+    uint32_t offset = sealed_data->plain_text_offset;
+    if (offset > payload_size || payload_size - offset != sizeof(sealed_record_key_t) ||
+            sealed_size - sizeof(sgx_sealed_data_t) < payload_size) {
+        return 0;
+    }
+
+    memcpy(key, sealed_data->aes_data.payload + offset, sizeof(sealed_record_key_t));
+    return key->magic == SEALED_RECORD_MAGIC;
+}
+
+#endif // SEALED_RECORD_H_
@@ -0,0 +1,67 @@
+#ifndef SEALING_CODEC_H_
+#define SEALING_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "sgx_tseal.h"
+
+/* Codec used for the encrypted payload of a seal_compressed blob */
+#define SEALING_CODEC_NONE  0   /* payload is the plaintext itself */
+#define SEALING_CODEC_LZ    1   /* payload is the LZ block (see Enclave/Sealing/Compress.h) */
+
+#define SEALING_CODEC_MAGIC 0x5A4C4553  /* "SELZ" */
+
+/**
+ * @brief      Header stored as the additional MAC text of a seal_compressed
+ *             blob.
+ *
+ * @details    The header is authenticated but not encrypted, so the App can
+ *             read plaintext_len from a blob to size the unseal buffer
+ *             without an ECALL, and the Enclave can trust it after
+ *             sgx_unseal_data succeeds.
+ */
+typedef struct sealing_codec_header {
+    uint32_t magic;
+    uint8_t codec;
+    uint8_t reserved[3];
+    uint32_t plaintext_len;
+} sealing_codec_header_t;
+
+/* Worst case LZ output for n input bytes: one length byte per 255 literals plus a token */
+#define SEALING_LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+/* Sealed buffer size that is always enough for seal_compressed of n bytes */
+#define SEALING_COMPRESSED_MAX_SIZE(n) \
+    (sizeof(sgx_sealed_data_t) + sizeof(sealing_codec_header_t) + SEALING_LZ_BOUND(n))
+
+/**
+ * @brief      Reads the codec header of a sealed blob from untrusted code.
+ *
+ * @details    The additional MAC text follows the encrypted text in
+ *             aes_data.payload. The header is only checked for shape here;
+ *             its integrity is verified by sgx_unseal_data in the Enclave.
+ *
+ * @param      sealed_data  The sealed blob
+ * @param[in]  sealed_size  Size of the buffer holding the blob
+ * @param      header       Receives the header
+ *
+ * @return     1 if the blob carries a codec header, 0 otherwise.
+ */
+static inline int sealing_codec_read_header(const sgx_sealed_data_t* sealed_data,
+        size_t sealed_size, sealing_codec_header_t* header) {
+    if (sealed_size < sizeof(sgx_sealed_data_t)) return 0;
+
+    uint32_t payload_size = sealed_data->aes_data.payload_size;
+    uint32_t offset = sealed_data->plain_text_offset;
+    if (offset > payload_size || payload_size - offset != sizeof(sealing_codec_header_t) ||
+            sealed_size - sizeof(sgx_sealed_data_t) < payload_size) {
+        return 0;
+    }
+
+    /* The header follows variable-length ciphertext, so it may be unaligned */
+    memcpy(header, sealed_data->aes_data.payload + offset, sizeof(sealing_codec_header_t));
+    return header->magic == SEALING_CODEC_MAGIC;
+}
+
+#endif // SEALING_CODEC_H_
@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sgx_urts.h"
+#include "sgx_tseal.h"
+#include "Enclave_u.h"
+#include "sgx_utils/sgx_utils.h"
+#include "reseal_batch.h"
+
+/* Blob bytes handed to one reseal_batch ECALL. The enclave holds a copy of
+ * the batch plus one unsealed blob per running ECALL, see HeapMaxSize in
+ * Enclave/Enclave.config.xml. A blob larger than this goes alone.
+ */
+#define MIGRATE_BATCH_BYTES (2UL << 20)
+
+/* Written next to the output file, then renamed over it */
+#define MIGRATE_TMP_SUFFIX ".reseal-tmp"
+
+#define MIGRATE_CHECKPOINT_NAME ".reseal-checkpoint"
+
+sgx_enclave_id_t global_eid = 0;
+
+struct migrate_config {
+    std::string input_dir;
+    std::string output_dir;
+    std::string checkpoint_path;
+    unsigned threads;
+    unsigned batch_blobs;
+    uint16_t key_policy;
+};
+
+/* Appends a blob at the next RESEAL_BATCH_ALIGN boundary */
+static void add_to_batch(std::vector<uint8_t>* batch, const std::vector<uint8_t>& blob) {
+    batch->insert(batch->end(), blob.begin(), blob.end());
+    batch->resize(RESEAL_BATCH_STRIDE(batch->size()));
+}
+
+/* Shared by the worker threads */
+struct migrate_state {
+    const migrate_config* config;
+    std::vector<std::string> files;     /* relative to input_dir, still to migrate */
+    std::atomic<size_t> next;
+    std::atomic<size_t> migrated;
+    std::atomic<size_t> failed;
+    std::atomic<bool> aborted;
+    std::mutex checkpoint_lock;
+    FILE* checkpoint;
+};
+
+/* OCall implementations */
+void ocall_print(const char* str) {
+    printf("%s\n", str);
+}
+
+/* The seal queue is not used here, no worker ever parks */
+void ocall_seal_worker_wait(void* queue) {
+    (void)queue;
+}
+
+/* Collects the regular files below dir, as paths relative to root */
+static bool list_files(const std::string& root, const std::string& dir, std::vector<std::string>* files) {
+    std::string path = dir.empty() ? root : root + "/" + dir;
+    DIR* d = opendir(path.c_str());
+    if (d == NULL) {
+        printf("Cannot open directory \"%s\": %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool ok = true;
+    struct dirent* entry;
+    while (ok && (entry = readdir(d)) != NULL) {
+        std::string name = entry->d_name;
+        if (name == "." || name == ".." || name == MIGRATE_CHECKPOINT_NAME) continue;
+        std::string relative = dir.empty() ? name : dir + "/" + name;
+
+        struct stat st;
+        if (stat((root + "/" + relative).c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            ok = list_files(root, relative, files);
+        } else if (S_ISREG(st.st_mode)) {
+            files->push_back(relative);
+        }
+    }
+    closedir(d);
+    return ok;
+}
+
+static bool read_file(const std::string& path, std::vector<uint8_t>* data) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) return false;
+
+    bool ok = fseek(fp, 0, SEEK_END) == 0;
+    long size = ok ? ftell(fp) : -1;
+    ok = size >= 0 && (unsigned long)size <= UINT32_MAX && fseek(fp, 0, SEEK_SET) == 0;
+    if (ok) {
+        data->resize((size_t)size);
+        ok = size == 0 || fread(data->data(), 1, (size_t)size, fp) == (size_t)size;
+    }
+    fclose(fp);
+    return ok;
+}
+
+/* Creates every missing directory leading to path */
+static bool make_parent_dirs(const std::string& path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        if (mkdir(path.substr(0, slash).c_str(), 0700) != 0 && errno != EEXIST) return false;
+    }
+    return true;
+}
+
+/* Writes data to path so that path holds either the old or the new content, never a mix */
+static bool write_file_atomic(const std::string& path, const uint8_t* data, size_t len) {
+    if (!make_parent_dirs(path)) return false;
+
+    std::string tmp = path + MIGRATE_TMP_SUFFIX;
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return false;
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(fd, data + written, len - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        written += (size_t)n;
+    }
+    bool ok = written == len && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (ok && rename(tmp.c_str(), path.c_str()) == 0) return true;
+    unlink(tmp.c_str());
+    return false;
+}
+
+/* The files named in the checkpoint have been migrated by an earlier run */
+static std::set<std::string> read_checkpoint(const std::string& path) {
+    std::set<std::string> done;
+    FILE* fp = fopen(path.c_str(), "r");
+    if (fp == NULL) return done;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strlen(line);
+        /* A line cut short by a crash has no newline: that file is redone */
+        if (len == 0 || line[len - 1] != '\n') continue;
+        line[len - 1] = '\0';
+        done.insert(line);
+    }
+    fclose(fp);
+    return done;
+}
+
+static void write_checkpoint(migrate_state* state, const std::vector<std::string>& files) {
+    if (files.empty()) return;
+    std::lock_guard<std::mutex> lock(state->checkpoint_lock);
+    for (size_t i = 0; i < files.size(); i++) {
+        fprintf(state->checkpoint, "%s\n", files[i].c_str());
+    }
+    fflush(state->checkpoint);
+    fsync(fileno(state->checkpoint));
+}
+
+/**
+ * @brief      Migrates batches of files until none are left.
+ *
+ * @details    A batch is filled with up to batch_blobs files, or
+ *             MIGRATE_BATCH_BYTES, and resealed by one reseal_batch ECALL.
+ *             Each resealed blob is written atomically to the output
+ *             directory before its name goes to the checkpoint, so a file
+ *             in the checkpoint always has its output on disk.
+ */
+static void migrate_worker(migrate_state* state) {
+    const migrate_config& config = *state->config;
+    std::vector<uint8_t> batch;
+    std::vector<uint8_t> blob;
+    std::string carried;    /* read, but did not fit in the previous batch */
+
+    while (!state->aborted.load()) {
+        std::vector<std::string> names;
+        std::vector<uint32_t> lens;
+        batch.clear();
+        if (!carried.empty()) {
+            names.push_back(carried);
+            lens.push_back((uint32_t)blob.size());
+            add_to_batch(&batch, blob);
+            carried.clear();
+        }
+
+        while (names.size() < config.batch_blobs) {
+            size_t i = state->next.fetch_add(1);
+            if (i >= state->files.size()) break;
+
+            const std::string& name = state->files[i];
+            if (!read_file(config.input_dir + "/" + name, &blob)) {
+                printf("Cannot read \"%s\"\n", name.c_str());
+                state->failed++;
+                continue;
+            }
+            if (!names.empty() && batch.size() + blob.size() > MIGRATE_BATCH_BYTES) {
+                carried = name;
+                break;
+            }
+            names.push_back(name);
+            lens.push_back((uint32_t)blob.size());
+            add_to_batch(&batch, blob);
+        }
+        if (names.empty()) return;
+
+        /* reseal_batch replaces lens with the resealed sizes, blobs keep their place */
+        std::vector<uint32_t> strides(lens.size());
+        for (size_t i = 0; i < lens.size(); i++) {
+            strides[i] = (uint32_t)RESEAL_BATCH_STRIDE(lens[i]);
+        }
+        std::vector<sgx_status_t> statuses(names.size(), SGX_ERROR_UNEXPECTED);
+        sgx_status_t ecall_status;
+        sgx_status_t status = reseal_batch(global_eid, &ecall_status, batch.data(), batch.size(),
+                lens.data(), statuses.data(), (uint32_t)names.size(), config.key_policy);
+        if (!is_ecall_successful(status, "Batch resealing failed :(", ecall_status)) {
+            state->failed += names.size();
+            state->aborted = true;
+            return;
+        }
+
+        std::vector<std::string> done;
+        size_t offset = 0;
+        for (size_t i = 0; i < names.size(); i++) {
+            const uint8_t* resealed = batch.data() + offset;
+            offset += strides[i];
+            if (statuses[i] != SGX_SUCCESS) {
+                printf("Cannot reseal \"%s\": ", names[i].c_str());
+                print_error_message(statuses[i]);
+                state->failed++;
+            } else if (!write_file_atomic(config.output_dir + "/" + names[i], resealed, lens[i])) {
+                printf("Cannot write \"%s\": %s\n", names[i].c_str(), strerror(errno));
+                state->failed++;
+            } else {
+                done.push_back(names[i]);
+                state->migrated++;
+            }
+        }
+        write_checkpoint(state, done);
+    }
+}
+
+static void usage(const char* name) {
+    printf("Usage: %s -i input_dir -o output_dir [-t threads] [-b batch_blobs] [-p mrenclave|mrsigner] [-c checkpoint]\n", name);
+    printf("  Reseals every blob below input_dir with this enclave into the same path below output_dir.\n");
+    printf("  Migrated files are recorded in the checkpoint (default output_dir/%s);\n", MIGRATE_CHECKPOINT_NAME);
+    printf("  running again with the same checkpoint resumes where the last run stopped.\n");
+    printf("  Defaults: 4 threads (keep below TCSNum), 64 blobs per batch, mrsigner.\n");
+}
+
+int main(int argc, char* argv[]) {
+    migrate_config config;
+    config.threads = 4;
+    config.batch_blobs = 64;
+    config.key_policy = SGX_KEYPOLICY_MRSIGNER;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:o:t:b:p:c:h")) != -1) {
+        switch (opt) {
+        case 'i': config.input_dir = optarg; break;
+        case 'o': config.output_dir = optarg; break;
+        case 't': config.threads = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'b': config.batch_blobs = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'p':
+            if (strcmp(optarg, "mrenclave") == 0) {
+                config.key_policy = SGX_KEYPOLICY_MRENCLAVE;
+            } else if (strcmp(optarg, "mrsigner") == 0) {
+                config.key_policy = SGX_KEYPOLICY_MRSIGNER;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c': config.checkpoint_path = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (config.input_dir.empty() || config.output_dir.empty() || config.threads == 0 || config.batch_blobs == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (config.checkpoint_path.empty()) {
+        config.checkpoint_path = config.output_dir + "/" + MIGRATE_CHECKPOINT_NAME;
+    }
+
+    migrate_state state;
+    state.config = &config;
+    state.next = 0;
+    state.migrated = 0;
+    state.failed = 0;
+    state.aborted = false;
+
+    std::vector<std::string> all;
+    if (!list_files(config.input_dir, "", &all)) return 1;
+    std::sort(all.begin(), all.end());
+    std::set<std::string> done = read_checkpoint(config.checkpoint_path);
+    for (size_t i = 0; i < all.size(); i++) {
+        if (done.count(all[i]) == 0) state.files.push_back(all[i]);
+    }
+    printf("%zu blobs found, %zu already migrated\n", all.size(), all.size() - state.files.size());
+    if (state.files.empty()) return 0;
+
+    if (!make_parent_dirs(config.checkpoint_path) ||
+            (state.checkpoint = fopen(config.checkpoint_path.c_str(), "a")) == NULL) {
+        printf("Cannot open checkpoint \"%s\"\n", config.checkpoint_path.c_str());
+        return 1;
+    }
+
+    if (initialize_enclave(&global_eid, "enclave.token", "enclave.signed.so") < 0) {
+        printf("Fail to initialize enclave.\n");
+        fclose(state.checkpoint);
+        return 1;
+    }
+
+    typedef std::chrono::steady_clock migrate_clock;
+    migrate_clock::time_point start = migrate_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < config.threads; i++) {
+        workers.push_back(std::thread(migrate_worker, &state));
+    }
+
+    /* Progress once a second until every file has been handed out */
+    size_t last = 0;
+    migrate_clock::time_point last_time = start;
+    while (state.next.load() < state.files.size() && !state.aborted.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        migrate_clock::time_point now = migrate_clock::now();
+        double seconds = std::chrono::duration<double>(now - last_time).count();
+        if (seconds < 1) continue;
+        size_t migrated = state.migrated.load();
+        printf("%zu/%zu migrated, %zu failed, %.1f blobs/s\n", migrated, state.files.size(),
+                state.failed.load(), (migrated - last) / seconds);
+        last = migrated;
+        last_time = now;
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+
+    double seconds = std::chrono::duration<double>(migrate_clock::now() - start).count();
+    printf("Migrated %zu blobs in %.2f s (%.1f blobs/s), %zu failed\n", state.migrated.load(), seconds,
+            seconds > 0 ? state.migrated.load() / seconds : 0.0, state.failed.load());
+
+    fclose(state.checkpoint);
+    sgx_destroy_enclave(global_eid);
+    return state.failed.load() == 0 ? 0 : 1;
+}